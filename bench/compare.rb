@@ -0,0 +1,42 @@
+# frozen_string_literal: true
+
+# Compare two JSON outputs of bench/run.rb, e.g. of the base and head commits.
+#
+#   $ bundle exec rake 'bench:compare[bench/results/base.json,bench/results/head.json]'
+#
+# The ratios are head / base, so a ratio below 1 of sec/iter means that the head is faster.
+
+require 'json'
+
+module Numo
+  module Optimize
+    module Bench
+      module_function
+
+      def load_results(path)
+        JSON.parse(File.read(path), symbolize_names: true)[:results].to_h do |r|
+          [[r[:method], r[:problem], r[:n]], r]
+        end
+      end
+
+      def compare(base_path, head_path)
+        base = load_results(base_path)
+        head = load_results(head_path)
+        puts 'method            problem                     n  sec/iter ratio  allocs ratio  fev base/head'
+        head.each do |key, h|
+          b = base[key]
+          next if b.nil?
+
+          puts format('%<method>-17s %<problem>-20s %<n>8d %<time>14.3f %<allocs>13.3f %<fev_base>8d/%<fev_head>d',
+                      method: key[0], problem: key[1], n: key[2], time: h[:time_per_iter] / b[:time_per_iter],
+                      allocs: h[:allocations].fdiv([b[:allocations], 1].max), fev_base: b[:n_fev], fev_head: h[:n_fev])
+        end
+      end
+    end
+  end
+end
+
+if $PROGRAM_NAME == __FILE__
+  abort "usage: ruby #{$PROGRAM_NAME} BASE.json HEAD.json" unless ARGV.size == 2
+  Numo::Optimize::Bench.compare(*ARGV)
+end
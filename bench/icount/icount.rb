@@ -0,0 +1,173 @@
+# frozen_string_literal: true
+
+# Count the instructions and cache misses of the fixed solves in bench/icount/solves.rb under cachegrind,
+# and compare them per solver phase with bench/icount/baseline.json.
+# The exit status is 1 if a phase regresses more than the threshold.
+#
+#   $ bundle exec rake bench:icount
+#   $ ICOUNT_UPDATE=1 bundle exec rake bench:icount
+#
+# The environment variables below change the check:
+#   ICOUNT_UPDATE          write the counts to the baseline instead of comparing them
+#   ICOUNT_BASELINE        path of the baseline (default: bench/icount/baseline.json)
+#   ICOUNT_THRESHOLD       allowed increase of the instructions (default: 0.02)
+#   ICOUNT_MISS_THRESHOLD  allowed increase of the cache misses (default: 0.10)
+#   ICOUNT_CASES           comma-separated cases to run (default: all)
+#
+# The counts depend on the compiler and its flags, so the baseline is recorded on the image of the CI job:
+# run the icount workflow by hand with update enabled, and commit the baseline.json it uploads.
+# A case or a phase without its baseline fails the check. The workflow compares the pushes and the pull requests
+# only once baseline.json holds recorded cases, and compares on every manual run.
+
+require 'fileutils'
+require 'json'
+require 'open3'
+require 'rbconfig'
+require_relative 'solves'
+
+module Numo
+  module Optimize
+    module Bench
+      # Deterministic performance check based on the simulated counts of cachegrind.
+      module Icount
+        BASELINE = ENV.fetch('ICOUNT_BASELINE', File.join(__dir__, 'baseline.json'))
+        OUTPUT_DIR = File.expand_path('../../tmp/icount', __dir__)
+
+        # The cache is fixed so that the miss counts do not depend on the host.
+        CACHEGRIND = %w[valgrind --tool=cachegrind --cache-sim=yes
+                        --I1=32768,8,64 --D1=32768,8,64 --LL=8388608,16,64].freeze
+
+        # The functions of the extension grouped by the phase of the solvers.
+        # The 64-bit integer copies are counted with the 32-bit ones.
+        PHASES = {
+          'cauchy' => %w[cauchy_ hpsolb_],
+          'subspace' => %w[freev_ formk_ cmprlb_ subsm_ bmv_],
+          'line_search' => %w[lnsrlb_ dcsrch_ dcstep_ lnsrch_start lnsrch_next lnsrch_backtrack lnsrch_hager_zhang
+                             lnsrch_batch_start lnsrch_batch_pick],
+          'update' => %w[matupd_ formt_],
+          'blas' => %w[ddot_ daxpy_ dcopy_ dscal_],
+          'linpack' => %w[dpofa_ dtrsl_],
+          'mainlb' => %w[setulb_ mainlb_ active_ projgr_ errclb_],
+          'scg' => %w[scg_run many_scg_solve],
+          'fdiff' => %w[fdiff_steps fdiff_gradient],
+          'driver' => %w[lbfgsb_fmin_loop scg_fmin_loop scg_eval],
+          'objective' => %w[fixture_rosenbrock_fg fixture_sphere_fg]
+        }.freeze
+
+        PHASE_OF = PHASES.flat_map { |phase, fns| fns.map { |fn| [fn, phase] } }.to_h.freeze
+
+        # Counts below these values are too small for their relative change to be meaningful.
+        MIN_INSTRUCTIONS = 100_000
+        MIN_MISSES = 1_000
+
+        module_function
+
+        def phase_of(fn)
+          PHASE_OF.fetch(fn.sub(/_i64_\z/, '_'), 'other')
+        end
+
+        # Sum the costs of the functions of the extension by phase.
+        def parse(path)
+          events = []
+          file = fn = nil
+          phases = Hash.new { |h, k| h[k] = { 'Ir' => 0, 'D1miss' => 0, 'LLmiss' => 0 } }
+          File.foreach(path) do |line|
+            case line
+            when /\Aevents: (.*)/ then events = Regexp.last_match(1).split
+            when /\Afl=(.*)/ then file = Regexp.last_match(1)
+            when /\Afn=(.*)/ then fn = Regexp.last_match(1)
+            when /\A\d/
+              next unless file&.include?('numo/optimize/')
+
+              counts = events.zip(line.split.drop(1).map(&:to_i)).to_h { |ev, c| [ev, c || 0] }
+              add_counts(phases['total'], counts)
+              add_counts(phases[phase_of(fn)], counts)
+            end
+          end
+          phases.sort.to_h
+        end
+
+        def add_counts(acc, counts)
+          acc['Ir'] += counts.fetch('Ir', 0)
+          acc['D1miss'] += counts.fetch('D1mr', 0) + counts.fetch('D1mw', 0)
+          acc['LLmiss'] += counts.fetch('ILmr', 0) + counts.fetch('DLmr', 0) + counts.fetch('DLmw', 0)
+        end
+
+        def count(name)
+          out = File.join(OUTPUT_DIR, "#{name}.cachegrind")
+          cmd = [*CACHEGRIND, "--cachegrind-out-file=#{out}", RbConfig.ruby, File.join(__dir__, 'solves.rb'), name]
+          stdout, stderr, status = Open3.capture3(*cmd)
+          abort "#{cmd.join(' ')} failed:\n#{stderr}" unless status.success?
+          puts stdout
+          parse(out)
+        end
+
+        # Return the failures of the phases whose counts have increased more than the thresholds.
+        def compare(name, base, head, threshold, miss_threshold)
+          failures = []
+          puts format('%-26<name>s %-12<phase>s %14<base>s %14<head>s %8<ratio>s %8<d1>s %8<ll>s',
+                      name:, phase: 'phase', base: 'base Ir', head: 'head Ir', ratio: 'Ir', d1: 'D1miss', ll: 'LLmiss')
+          head.each do |phase, h|
+            b = base[phase]
+            if b.nil?
+              failures << "#{name}/#{phase} (no baseline)"
+              puts format('%-26<name>s %-12<phase>s %14<base>s %14<head>d  NO BASELINE', name: '', phase:, base: '-',
+                          head: h['Ir'])
+              next
+            end
+
+            ir = change(b['Ir'], h['Ir'], MIN_INSTRUCTIONS)
+            d1 = change(b['D1miss'], h['D1miss'], MIN_MISSES)
+            ll = change(b['LLmiss'], h['LLmiss'], MIN_MISSES)
+            failed = (ir || 0) > threshold || (d1 || 0) > miss_threshold || (ll || 0) > miss_threshold
+            failures << "#{name}/#{phase}" if failed
+            puts format('%-26<name>s %-12<phase>s %14<base>d %14<head>d %8<ir>s %8<d1>s %8<ll>s%<mark>s',
+                        name: '', phase:, base: b['Ir'], head: h['Ir'], ir: percent(ir), d1: percent(d1),
+                        ll: percent(ll), mark: failed ? '  REGRESSION' : '')
+          end
+          failures
+        end
+
+        def change(base, head, min)
+          return nil if base < min && head < min
+
+          (head - base).fdiv([base, 1].max)
+        end
+
+        def percent(val)
+          val.nil? ? '-' : format('%+.1f%%', 100 * val)
+        end
+
+        def main
+          names = ENV.fetch('ICOUNT_CASES', CASES.keys.join(',')).split(',').map(&:strip)
+          threshold = Float(ENV.fetch('ICOUNT_THRESHOLD', '0.02'))
+          miss_threshold = Float(ENV.fetch('ICOUNT_MISS_THRESHOLD', '0.10'))
+          baseline = File.exist?(BASELINE) ? JSON.parse(File.read(BASELINE)) : { 'cases' => {} }
+          FileUtils.mkdir_p(OUTPUT_DIR)
+
+          counts = names.to_h { |name| [name, count(name)] }
+          File.write(File.join(OUTPUT_DIR, 'counts.json'), JSON.pretty_generate('cases' => counts))
+
+          if ENV['ICOUNT_UPDATE']
+            baseline['cases'].merge!(counts)
+            File.write(BASELINE, "#{JSON.pretty_generate(baseline)}\n")
+            puts "Updated #{BASELINE}"
+            return
+          end
+
+          failures = counts.flat_map do |name, head|
+            base = baseline['cases'][name]
+            if base.nil?
+              puts "#{name}: no baseline; record it on the CI image with ICOUNT_UPDATE=1"
+              next ["#{name} (no baseline)"]
+            end
+            compare(name, base, head, threshold, miss_threshold)
+          end
+          abort "Regressions over the thresholds or missing baselines: #{failures.join(', ')}" unless failures.empty?
+        end
+      end
+    end
+  end
+end
+
+Numo::Optimize::Bench::Icount.main if $PROGRAM_NAME == __FILE__
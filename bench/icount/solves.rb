@@ -0,0 +1,88 @@
+# frozen_string_literal: true
+
+# The fixed solves counted by bench/icount/icount.rb under cachegrind.
+# MANY_CASES run with the native objectives on a single thread of minimize_many, so that no Ruby code runs
+# during the solves. MINIMIZE_CASES call Numo::Optimize.minimize with Ruby procs as users do; only the
+# functions of the extension are counted, so the cost of the procs does not enter the counts.
+#
+#   $ ruby bench/icount/solves.rb lbfgsb_rosenbrock
+
+$LOAD_PATH.unshift File.expand_path('../../lib', __dir__)
+require 'numo/optimize'
+
+module Numo
+  module Optimize
+    module Bench
+      module Icount
+        # The points are computed from the indices instead of the random numbers.
+        def self.x_init(n)
+          Numo::DFloat.cast(Array.new(n) { |i| ((i % 7) * 0.3) - 0.8 })
+        end
+
+        def self.rosenbrock_bounds(n)
+          bounds = Numo::DFloat.zeros(n, 2)
+          bounds[true, 0] = -0.5
+          bounds[true, 1] = 0.8
+          bounds
+        end
+
+        # The extended Rosenbrock function and its gradient written with Numo as the users of minimize do.
+        ROSENBROCK = proc do |x|
+          a = x[1..] - (x[0...-1]**2)
+          ((100 * (a**2)) + ((1 - x[0...-1])**2)).sum
+        end
+
+        ROSENBROCK_GRAD = proc do |x|
+          a = x[1..] - (x[0...-1]**2)
+          g = Numo::DFloat.zeros(x.size)
+          g[0...-1] = (-400 * x[0...-1] * a) - (2 * (1 - x[0...-1]))
+          g[1..] += 200 * a
+          g
+        end
+
+        MANY_CASES = {
+          'lbfgsb_rosenbrock' => lambda {
+            { fnc: NativeObjective.fixture(:rosenbrock), x_init: x_init(100), maxiter: 1000 }
+          },
+          'lbfgsb_rosenbrock_bounded' => lambda {
+            { fnc: NativeObjective.fixture(:rosenbrock), x_init: x_init(100).clip(-0.5, 0.8),
+              bounds: rosenbrock_bounds(100), maxiter: 1000 }
+          },
+          'lbfgsb_rosenbrock_large' => lambda {
+            { fnc: NativeObjective.fixture(:rosenbrock), x_init: x_init(100_000), maxiter: 30 }
+          },
+          'scg_rosenbrock' => lambda {
+            { fnc: NativeObjective.fixture(:rosenbrock), x_init: x_init(100), method: 'SCG', maxiter: 1000 }
+          }
+        }.freeze
+
+        MINIMIZE_CASES = {
+          'minimize_lbfgsb_rosenbrock' => lambda {
+            { fnc: ROSENBROCK, jcb: ROSENBROCK_GRAD, x_init: x_init(100), maxiter: 1000 }
+          },
+          'minimize_lbfgsb_rosenbrock_bounded' => lambda {
+            { fnc: ROSENBROCK, jcb: ROSENBROCK_GRAD, x_init: x_init(100).clip(-0.5, 0.8),
+              bounds: rosenbrock_bounds(100), maxiter: 1000 }
+          },
+          'minimize_scg_rosenbrock' => lambda {
+            { fnc: ROSENBROCK, jcb: ROSENBROCK_GRAD, x_init: x_init(100), method: 'SCG', maxiter: 1000 }
+          }
+        }.freeze
+
+        CASES = MANY_CASES.merge(MINIMIZE_CASES).freeze
+
+        def self.solve(name)
+          problem = CASES.fetch(name) { abort "unknown case: #{name} (#{CASES.keys.join(', ')})" }.call
+          result = if MANY_CASES.key?(name)
+                     Numo::Optimize.minimize_many([problem], threads: 1).first
+                   else
+                     Numo::Optimize.minimize(**problem)
+                   end
+          puts "#{name}: n_iter=#{result[:n_iter]} n_fev=#{result[:n_fev]} fnc=#{result[:fnc]} task=#{result[:task]}"
+        end
+      end
+    end
+  end
+end
+
+Numo::Optimize::Bench::Icount.solve(ARGV.fetch(0)) if $PROGRAM_NAME == __FILE__
@@ -0,0 +1,443 @@
+/**
+ * Microbenchmarks of the native core of numo-optimize without the Ruby extension.
+ *
+ * setulb_ is driven on native test functions, and the kernels ddot_, daxpy_, dpofa_, bmv_, cauchy_,
+ * and subsm_ are timed separately. bmv_, cauchy_, and subsm_ are called on a snapshot of the solver
+ * state taken after a few iterations on the bounded Rosenbrock chain of driver1, so that the memory
+ * and the free variables are those of a real solve. The stacks contain no Ruby frames, which makes
+ * the executable suitable for perf record and VTune.
+ *
+ *   $ make -C bench/native run
+ *   $ bench/native/build/bench_core -n 1000,100000 -m 10 subsm_ cauchy_
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blas.h"
+#include "lbfgsb.h"
+#include "linpack.h"
+
+#define MIN_SECONDS 0.05
+#define MAX_SIZES 16
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef void (*bench_fn)(void* arg);
+
+/* Returns the seconds per call of fn, doubling the calls until they take MIN_SECONDS. */
+static double bench_time(bench_fn fn, void* arg) {
+  for (long reps = 1;; reps *= 2) {
+    const double start = now();
+    for (long i = 0; i < reps; i++) fn(arg);
+    const double elapsed = now() - start;
+    if (elapsed >= MIN_SECONDS) return elapsed / (double)reps;
+  }
+}
+
+/* Returns the seconds per call of fn excluding reset, which restores the inputs overwritten by fn. */
+static double bench_time_reset(bench_fn fn, bench_fn reset, void* arg) {
+  const double t = bench_time(fn, arg) - bench_time(reset, arg);
+  return t > 0.0 ? t : 0.0;
+}
+
+static void* xcalloc(size_t n, size_t size) {
+  void* ptr = calloc(n, size);
+  if (ptr == NULL) {
+    fprintf(stderr, "bench_core: out of memory\n");
+    exit(1);
+  }
+  return ptr;
+}
+
+static int selected(int argc, char** argv, const char* name) {
+  if (argc == 0) return 1;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], name) == 0) return 1;
+  }
+  return 0;
+}
+
+static void report(const char* kernel, const char* problem, F77_int n, F77_int m, double seconds, const char* note) {
+  printf("%-8s %-20s %8ld %4ld %14.1f  %s\n", kernel, problem, (long)n, (long)m, seconds * 1e9, note);
+  fflush(stdout);
+}
+
+/* ---- test functions ---- */
+
+typedef struct {
+  const char* name;
+  void (*init)(F77_int n, double* x, double* l, double* u, F77_int* nbd);
+  double (*fg)(F77_int n, const double* x, double* g);
+} problem;
+
+/* The bounded Rosenbrock chain of driver1 of L-BFGS-B. */
+static void driver1_init(F77_int n, double* x, double* l, double* u, F77_int* nbd) {
+  for (F77_int i = 0; i < n; i++) {
+    x[i] = 3.0;
+    l[i] = i % 2 == 0 ? 1.0 : -100.0;
+    u[i] = 100.0;
+    nbd[i] = 2;
+  }
+}
+
+static double driver1_fg(F77_int n, const double* x, double* g) {
+  double f = 0.25 * (x[0] - 1.0) * (x[0] - 1.0);
+  double t1 = x[1] - x[0] * x[0];
+  g[0] = 2.0 * (x[0] - 1.0) - 16.0 * x[0] * t1;
+  for (F77_int i = 1; i < n - 1; i++) {
+    const double t2 = t1;
+    t1 = x[i + 1] - x[i] * x[i];
+    f += t2 * t2;
+    g[i] = 8.0 * t2 - 16.0 * x[i] * t1;
+  }
+  f += t1 * t1;
+  g[n - 1] = 8.0 * t1;
+  return 4.0 * f;
+}
+
+/* The unbounded extended Rosenbrock function of pairs (x[2i], x[2i + 1]). */
+static void rosenbrock_init(F77_int n, double* x, double* l, double* u, F77_int* nbd) {
+  for (F77_int i = 0; i < n; i++) {
+    x[i] = i % 2 == 0 ? -1.2 : 1.0;
+    l[i] = 0.0;
+    u[i] = 0.0;
+    nbd[i] = 0;
+  }
+}
+
+static double rosenbrock_fg(F77_int n, const double* x, double* g) {
+  double f = 0.0;
+  for (F77_int i = 0; i + 1 < n; i += 2) {
+    const double r = x[i + 1] - x[i] * x[i];
+    const double s = 1.0 - x[i];
+    f += 100.0 * r * r + s * s;
+    g[i] = -400.0 * x[i] * r - 2.0 * s;
+    g[i + 1] = 200.0 * r;
+  }
+  return f;
+}
+
+static const problem problems[] = {
+  { "driver1", driver1_init, driver1_fg },
+  { "extended_rosenbrock", rosenbrock_init, rosenbrock_fg },
+};
+
+/* ---- solver state ---- */
+
+typedef struct {
+  const problem* prob;
+  F77_int n, m, iprint;
+  double f, factr, pgtol;
+  double *x, *l, *u, *g, *wa;
+  F77_int *nbd, *iwa;
+  char task[60], csave[60];
+  F77_int lsave[4], isave[44];
+  double dsave[29];
+  int64_t n_iter, n_fev;
+  double time_fg;
+} solver;
+
+static void solver_init(solver* s, const problem* prob, F77_int n, F77_int m) {
+  memset(s, 0, sizeof(*s));
+  s->prob = prob;
+  s->n = n;
+  s->m = m;
+  s->iprint = -1;
+  s->factr = 1e7;
+  s->pgtol = 1e-5;
+  s->x = xcalloc(n, sizeof(double));
+  s->l = xcalloc(n, sizeof(double));
+  s->u = xcalloc(n, sizeof(double));
+  s->g = xcalloc(n, sizeof(double));
+  s->nbd = xcalloc(n, sizeof(F77_int));
+  s->iwa = xcalloc(3 * (size_t)n, sizeof(F77_int));
+  s->wa = xcalloc((2 * (size_t)m + 5) * n + 12 * (size_t)m * m + 12 * (size_t)m, sizeof(double));
+  prob->init(n, s->x, s->l, s->u, s->nbd);
+  strcpy(s->task, "START");
+}
+
+static void solver_free(solver* s) {
+  free(s->x);
+  free(s->l);
+  free(s->u);
+  free(s->g);
+  free(s->nbd);
+  free(s->iwa);
+  free(s->wa);
+}
+
+/* Runs the solver up to max_iter iterations, and returns the seconds spent in setulb_. */
+static double solver_run(solver* s, int64_t max_iter) {
+  double time_total = 0.0;
+  while (s->n_iter < max_iter) {
+    const double start = now();
+    setulb_(&s->n, &s->m, s->x, s->l, s->u, s->nbd, &s->f, s->g, &s->factr, &s->pgtol, s->wa, s->iwa, s->task, &s->iprint,
+            s->csave, s->lsave, s->isave, s->dsave);
+    time_total += now() - start;
+    if (strncmp(s->task, "FG", 2) == 0) {
+      const double t = now();
+      s->f = s->prob->fg(s->n, s->x, s->g);
+      s->time_fg += now() - t;
+      s->n_fev++;
+    } else if (strncmp(s->task, "NEW_X", 5) == 0) {
+      s->n_iter++;
+    } else {
+      break;
+    }
+  }
+  return time_total;
+}
+
+/* Views of the workspace laid out by setulb_, and the variables saved by mainlb_. */
+typedef struct {
+  solver* s;
+  double *ws, *wy, *sy, *wt, *wn, *z, *r, *t, *d, *xp, *wa;
+  F77_int *index, *iwhere, *indx2;
+  F77_int col, head, nfree, cnstnd, nseg, iword, info;
+  double theta, epsmch, sbgnrm;
+  double *z_saved, *r_saved, *v, *p;
+} snapshot;
+
+static void snapshot_init(snapshot* sn, solver* s) {
+  const size_t n = s->n;
+  const size_t m = s->m;
+  memset(sn, 0, sizeof(*sn));
+  sn->s = s;
+  sn->ws = s->wa;
+  sn->wy = sn->ws + m * n;
+  sn->sy = sn->wy + m * n;
+  sn->wt = sn->sy + 2 * m * m;
+  sn->wn = sn->wt + m * m;
+  sn->z = sn->wn + 8 * m * m;
+  sn->r = sn->z + n;
+  sn->d = sn->r + n;
+  sn->t = sn->d + n;
+  sn->xp = sn->t + n;
+  sn->wa = sn->xp + n;
+  sn->index = s->iwa;
+  sn->iwhere = s->iwa + n;
+  sn->indx2 = s->iwa + 2 * n;
+  /* isave[20 + k] and dsave[k - 1] hold the k-th saved variables of mainlb_, and lsave[1] holds cnstnd. */
+  /* sbgnrm is the input of cauchy_ computed by projgr_ at the current x. */
+  sn->head = s->isave[26];
+  sn->col = s->isave[27];
+  sn->nfree = s->isave[37];
+  sn->cnstnd = s->lsave[1];
+  sn->theta = s->dsave[0];
+  sn->epsmch = s->dsave[4];
+  sn->sbgnrm = s->dsave[12];
+  sn->z_saved = xcalloc(n, sizeof(double));
+  sn->r_saved = xcalloc(n, sizeof(double));
+  sn->v = xcalloc(2 * m, sizeof(double));
+  sn->p = xcalloc(2 * m, sizeof(double));
+  for (size_t i = 0; i < 2 * m; i++) sn->v[i] = 1.0 / (double)(i + 1);
+}
+
+static void snapshot_free(snapshot* sn) {
+  free(sn->z_saved);
+  free(sn->r_saved);
+  free(sn->v);
+  free(sn->p);
+}
+
+static void run_bmv(void* arg) {
+  snapshot* sn = (snapshot*)arg;
+  bmv_(&sn->s->m, sn->sy, sn->wt, &sn->col, sn->v, sn->p, &sn->info);
+}
+
+static void run_cauchy(void* arg) {
+  snapshot* sn = (snapshot*)arg;
+  solver* s = sn->s;
+  const size_t m = s->m;
+  cauchy_(&s->n, s->x, s->l, s->u, s->nbd, s->g, sn->indx2, sn->iwhere, sn->t, sn->d, sn->z, &s->m, sn->wy, sn->ws, sn->sy,
+          sn->wt, &sn->theta, &sn->col, &sn->head, sn->wa, sn->wa + 2 * m, sn->wa + 4 * m, sn->wa + 6 * m, &sn->nseg,
+          &s->iprint, &sn->sbgnrm, &sn->info, &sn->epsmch);
+}
+
+static void reset_subsm(void* arg) {
+  snapshot* sn = (snapshot*)arg;
+  memcpy(sn->z, sn->z_saved, sn->s->n * sizeof(double));
+  memcpy(sn->r, sn->r_saved, sn->s->n * sizeof(double));
+}
+
+static void run_subsm(void* arg) {
+  snapshot* sn = (snapshot*)arg;
+  solver* s = sn->s;
+  reset_subsm(arg);
+  subsm_(&s->n, &s->m, &sn->nfree, sn->index, s->l, s->u, s->nbd, sn->z, sn->r, sn->xp, sn->ws, sn->wy, &sn->theta, s->x, s->g,
+         &sn->col, &sn->head, &sn->iword, sn->wa, sn->wn, &s->iprint, &sn->info);
+}
+
+/* ---- BLAS and LINPACK ---- */
+
+typedef struct {
+  F77_int n, inc;
+  double alpha;
+  double *x, *y, *a, *a_saved;
+  volatile double sink;
+} vectors;
+
+static void run_ddot(void* arg) {
+  vectors* v = (vectors*)arg;
+  v->sink = ddot_(&v->n, v->x, &v->inc, v->y, &v->inc);
+}
+
+static void run_daxpy(void* arg) {
+  vectors* v = (vectors*)arg;
+  daxpy_(&v->n, &v->alpha, v->x, &v->inc, v->y, &v->inc);
+}
+
+static void reset_dpofa(void* arg) {
+  vectors* v = (vectors*)arg;
+  memcpy(v->a, v->a_saved, (size_t)v->n * v->n * sizeof(double));
+}
+
+static void run_dpofa(void* arg) {
+  vectors* v = (vectors*)arg;
+  F77_int info;
+  reset_dpofa(arg);
+  dpofa_(v->a, &v->n, &v->n, &info);
+}
+
+static void bench_vectors(int argc, char** argv, F77_int n) {
+  vectors v = { n, 1, 1e-12, NULL, NULL, NULL, NULL, 0.0 };
+  v.x = xcalloc(n, sizeof(double));
+  v.y = xcalloc(n, sizeof(double));
+  for (F77_int i = 0; i < n; i++) {
+    v.x[i] = 1.0 / (double)(i + 1);
+    v.y[i] = 1.0;
+  }
+  if (selected(argc, argv, "ddot_")) report("ddot_", "-", n, 0, bench_time(run_ddot, &v), "");
+  if (selected(argc, argv, "daxpy_")) report("daxpy_", "-", n, 0, bench_time(run_daxpy, &v), "");
+  free(v.x);
+  free(v.y);
+}
+
+/* Factorizes the k x k matrix I + 1/(i + j + 1), which is positive definite. */
+static void bench_dpofa(int argc, char** argv, F77_int k) {
+  if (!selected(argc, argv, "dpofa_")) return;
+  vectors v = { k, 1, 0.0, NULL, NULL, NULL, NULL, 0.0 };
+  v.a = xcalloc((size_t)k * k, sizeof(double));
+  v.a_saved = xcalloc((size_t)k * k, sizeof(double));
+  for (F77_int j = 0; j < k; j++) {
+    for (F77_int i = 0; i < k; i++) {
+      v.a_saved[i + (size_t)j * k] = (i == j ? 1.0 : 0.0) + 1.0 / (double)(i + j + 1);
+    }
+  }
+  report("dpofa_", "-", k, 0, bench_time_reset(run_dpofa, reset_dpofa, &v), "k x k");
+  free(v.a);
+  free(v.a_saved);
+}
+
+/* ---- L-BFGS-B ---- */
+
+static void bench_setulb(int argc, char** argv, const problem* prob, F77_int n, F77_int m, int64_t max_iter) {
+  if (!selected(argc, argv, "setulb_")) return;
+  solver s;
+  char note[96];
+  solver_init(&s, prob, n, m);
+  const double time_solver = solver_run(&s, max_iter);
+  snprintf(note, sizeof(note), "per iteration, %ld iterations, %ld evaluations, fg %.1f ns/eval", (long)s.n_iter, (long)s.n_fev,
+           s.n_fev > 0 ? s.time_fg / (double)s.n_fev * 1e9 : 0.0);
+  report("setulb_", prob->name, n, m, s.n_iter > 0 ? time_solver / (double)s.n_iter : 0.0, note);
+  solver_free(&s);
+}
+
+static void bench_kernels(int argc, char** argv, F77_int n, F77_int m) {
+  if (!selected(argc, argv, "bmv_") && !selected(argc, argv, "cauchy_") && !selected(argc, argv, "subsm_")) return;
+  solver s;
+  snapshot sn;
+  char note[64];
+  solver_init(&s, &problems[0], n, m);
+  /* Fill the memory of m pairs before taking the snapshot. */
+  solver_run(&s, m + 2);
+  snapshot_init(&sn, &s);
+  snprintf(note, sizeof(note), "col %ld, nfree %ld", (long)sn.col, (long)sn.nfree);
+  if (sn.col == 0) {
+    fprintf(stderr, "bench_core: the solve of n = %ld ended before the memory was filled\n", (long)n);
+  } else {
+    if (selected(argc, argv, "bmv_")) report("bmv_", s.prob->name, n, m, bench_time(run_bmv, &sn), note);
+    /* cauchy_ also leaves W'(xcp - x) in wa and xcp in z, from which cmprlb_ computes the input of subsm_. */
+    run_cauchy(&sn);
+    if (selected(argc, argv, "cauchy_")) report("cauchy_", s.prob->name, n, m, bench_time(run_cauchy, &sn), note);
+    if (selected(argc, argv, "subsm_")) {
+      cmprlb_(&s.n, &s.m, s.x, s.g, sn.ws, sn.wy, sn.sy, sn.wt, sn.z, sn.r, sn.wa, sn.index, &sn.theta, &sn.col, &sn.head,
+              &sn.nfree, &sn.cnstnd, &sn.info);
+      memcpy(sn.z_saved, sn.z, (size_t)n * sizeof(double));
+      memcpy(sn.r_saved, sn.r, (size_t)n * sizeof(double));
+      report("subsm_", s.prob->name, n, m, bench_time_reset(run_subsm, reset_subsm, &sn), note);
+    }
+  }
+  snapshot_free(&sn);
+  solver_free(&s);
+}
+
+static int parse_sizes(const char* arg, F77_int* sizes) {
+  int count = 0;
+  char* end;
+  while (count < MAX_SIZES && *arg != '\0') {
+    const long val = strtol(arg, &end, 10);
+    if (end == arg || val < 2) return -1;
+    sizes[count++] = (F77_int)val;
+    arg = *end == ',' ? end + 1 : end;
+  }
+  return count;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: bench_core [-n SIZES] [-m M] [-i MAX_ITER] [KERNEL ...]\n"
+                  "  -n SIZES     comma-separated numbers of variables (default: 10,1000,100000,1000000)\n"
+                  "  -m M         number of the correction pairs (default: 10)\n"
+                  "  -i MAX_ITER  maximum number of iterations of setulb_ (default: 100)\n"
+                  "  KERNEL       setulb_, ddot_, daxpy_, dpofa_, bmv_, cauchy_, or subsm_ (default: all)\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  F77_int sizes[MAX_SIZES] = { 10, 1000, 100000, 1000000 };
+  int n_sizes = 4;
+  F77_int m = 10;
+  int64_t max_iter = 100;
+  int i = 1;
+
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 >= argc) usage();
+    if (strcmp(argv[i], "-n") == 0) {
+      n_sizes = parse_sizes(argv[++i], sizes);
+      if (n_sizes <= 0) usage();
+    } else if (strcmp(argv[i], "-m") == 0) {
+      m = (F77_int)atol(argv[++i]);
+      if (m < 1) usage();
+    } else if (strcmp(argv[i], "-i") == 0) {
+      max_iter = atol(argv[++i]);
+      if (max_iter < 1) usage();
+    } else {
+      usage();
+    }
+  }
+  argc -= i;
+  argv += i;
+
+  printf("%-8s %-20s %8s %4s %14s  %s\n", "kernel", "problem", "n", "m", "ns/call", "note");
+  for (int k = 0; k < n_sizes; k++) {
+    bench_vectors(argc, argv, sizes[k]);
+  }
+  /* The Cholesky factorizations of L-BFGS-B are of the m x m matrix in formt_ and the 2m x 2m matrix in formk_. */
+  bench_dpofa(argc, argv, m);
+  bench_dpofa(argc, argv, 2 * m);
+  for (int k = 0; k < n_sizes; k++) {
+    bench_kernels(argc, argv, sizes[k], m);
+    for (size_t p = 0; p < sizeof(problems) / sizeof(problems[0]); p++) {
+      bench_setulb(argc, argv, &problems[p], sizes[k], m, max_iter);
+    }
+  }
+  return 0;
+}
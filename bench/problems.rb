@@ -0,0 +1,147 @@
+# frozen_string_literal: true
+
+module Numo
+  module Optimize
+    module Bench
+      # Objective functions of the benchmarks.
+      # Each problem has f returning the function value and fg returning [f, g] as the objective with `jcb: true`,
+      # and they are vectorized so that the solver rather than the Ruby loop dominates at large n.
+      module Problems
+        # The bounded Rosenbrock chain of driver1 of L-BFGS-B, which is the first test of test_optimize.rb.
+        class Driver1
+          attr_reader :size, :x_init, :bounds
+
+          def initialize(size)
+            @size = size
+            @x_init = Numo::DFloat.zeros(size) + 3
+            @bounds = Numo::DFloat.zeros(size, 2) + 100
+            @bounds[true, 0] = Numo::DFloat.cast(Array.new(size) { |i| i.even? ? 1.0 : -100.0 })
+          end
+
+          def f(x)
+            t = x[1...@size] - (x[0...(@size - 1)]**2)
+            4.0 * ((0.25 * ((x[0] - 1)**2)) + t.dot(t))
+          end
+
+          def fg(x)
+            head = x[0...(@size - 1)]
+            t = x[1...@size] - (head**2)
+            g = Numo::DFloat.zeros(@size)
+            g[0] = 2.0 * (x[0] - 1.0)
+            g[1...@size] += 8.0 * t
+            g[0...(@size - 1)] -= 16.0 * head * t
+            [4.0 * ((0.25 * ((x[0] - 1)**2)) + t.dot(t)), g]
+          end
+        end
+
+        # The extended Rosenbrock function of pairs (x[2i], x[2i + 1]), starting at (-1.2, 1).
+        class ExtendedRosenbrock
+          attr_reader :size, :x_init
+
+          def initialize(size)
+            raise ArgumentError, 'size of extended Rosenbrock must be even' if size.odd?
+
+            @size = size
+            @x_init = Numo::DFloat.zeros(size / 2, 2)
+            @x_init[true, 0] = -1.2
+            @x_init[true, 1] = 1.0
+            @x_init = @x_init.reshape(size)
+          end
+
+          def bounds = nil
+
+          def f(x)
+            a, b = pairs(x)
+            r = b - (a**2)
+            s = 1.0 - a
+            (100.0 * r.dot(r)) + s.dot(s)
+          end
+
+          def fg(x)
+            a, b = pairs(x)
+            r = b - (a**2)
+            s = 1.0 - a
+            g = Numo::DFloat.zeros(@size / 2, 2)
+            g[true, 0] = (-400.0 * a * r) - (2.0 * s)
+            g[true, 1] = 200.0 * r
+            [(100.0 * r.dot(r)) + s.dot(s), g.reshape(@size)]
+          end
+
+          private
+
+          def pairs(x)
+            xs = x.reshape(@size / 2, 2)
+            [xs[true, 0], xs[true, 1]]
+          end
+        end
+
+        # The convex quadratic 0.5 x' D x - sum(x) with the diagonal D spread over [1, 100].
+        class Quadratic
+          attr_reader :size, :x_init
+
+          def initialize(size)
+            @size = size
+            @x_init = Numo::DFloat.zeros(size)
+            @diag = size == 1 ? Numo::DFloat[1] : 1.0 + (99.0 * Numo::DFloat.new(size).seq / (size - 1))
+          end
+
+          def bounds = nil
+
+          def f(x)
+            (0.5 * (@diag * x).dot(x)) - x.sum
+          end
+
+          def fg(x)
+            dx = @diag * x
+            [(0.5 * dx.dot(x)) - x.sum, dx - 1.0]
+          end
+        end
+
+        # The L2-regularized logistic loss on the random data of n features.
+        # The samples are fewer at large n to keep the data under about 80 MB.
+        class Logistic
+          attr_reader :size, :x_init
+
+          def initialize(size, reg: 1e-2)
+            @size = size
+            @reg = reg
+            n_samples = (10_000_000 / size).clamp(10, 1000)
+            rng = Random.new(1)
+            Numo::NArray.srand(1)
+            @data = Numo::DFloat.new(n_samples, size).rand_norm / Math.sqrt(size)
+            @labels = Numo::DFloat.cast(Array.new(n_samples) { rng.rand < 0.5 ? -1.0 : 1.0 })
+            @x_init = Numo::DFloat.zeros(size)
+          end
+
+          def bounds = nil
+
+          def f(x)
+            z = -@labels * @data.dot(x)
+            softplus(z).mean + (0.5 * @reg * x.dot(x))
+          end
+
+          def fg(x)
+            z = -@labels * @data.dot(x)
+            sigma = 1.0 / (1.0 + Numo::NMath.exp(-z))
+            g = @data.transpose.dot(-@labels * sigma) / @labels.size
+            [softplus(z).mean + (0.5 * @reg * x.dot(x)), g + (@reg * x)]
+          end
+
+          private
+
+          # log(1 + exp(z)) computed without overflow.
+          def softplus(z)
+            ((z.abs + z) / 2) + Numo::NMath.log(1.0 + Numo::NMath.exp(-z.abs))
+          end
+        end
+
+        ALL = {
+          driver1: Driver1,
+          extended_rosenbrock: ExtendedRosenbrock,
+          quadratic: Quadratic,
+          logistic: Logistic
+        }.freeze
+      end
+    end
+  end
+end
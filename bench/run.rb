@@ -0,0 +1,135 @@
+# frozen_string_literal: true
+
+# Run the benchmarks of the solvers and save the results as JSON.
+#
+#   $ bundle exec rake bench
+#   $ BENCH_SIZES=10,1000 BENCH_METHODS=L-BFGS-B BENCH_OUTPUT=head.json bundle exec rake bench
+#
+# The environment variables below select the benchmarks:
+#   BENCH_SIZES     comma-separated numbers of variables (default: 10,1000,100000,1000000)
+#   BENCH_METHODS   comma-separated methods (default: L-BFGS-B,L-BFGS-B-bounded,SCG,Nelder-Mead)
+#   BENCH_PROBLEMS  comma-separated problems (default: driver1,extended_rosenbrock,quadratic,logistic)
+#   BENCH_MAXITER   maximum number of iterations of each solve (default: 200)
+#   BENCH_REPEAT    number of runs of each benchmark, of which the median is reported (default: 3)
+#   BENCH_OUTPUT    path of the JSON output (default: bench/results/<commit>.json)
+
+$LOAD_PATH.unshift File.expand_path('../lib', __dir__)
+require 'numo/optimize'
+require 'fileutils'
+require 'json'
+require_relative 'problems'
+
+module Numo
+  module Optimize
+    module Bench
+      # Nelder-Mead keeps n + 1 points of n variables in Ruby, so it runs only up to this size.
+      NELDER_MEAD_MAX_SIZE = 1000
+
+      HEADER = 'method            problem                     n  iter    fev   sec/iter    fev/sec    ruby    allocs'
+
+      module_function
+
+      def env_list(name, default)
+        ENV.fetch(name, default).split(',').map(&:strip).reject(&:empty?)
+      end
+
+      def clock
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      def runnable?(method, problem, size)
+        return false if method == 'Nelder-Mead' && size > NELDER_MEAD_MAX_SIZE
+        return false if problem == :extended_rosenbrock && size.odd?
+        # driver1 is bounded, and the others are unbounded.
+        return problem == :driver1 if method == 'L-BFGS-B-bounded'
+        return problem != :driver1 if method == 'L-BFGS-B'
+
+        true
+      end
+
+      # Solve the problem once, and measure the time, the share of the Ruby objective, and the allocations.
+      def run_once(method, problem, maxiter)
+        callback_time = 0.0
+        if method == 'Nelder-Mead'
+          fnc = proc do |x|
+            t = clock
+            f = problem.f(x)
+            callback_time += clock - t
+            f
+          end
+          jcb = nil
+        else
+          fnc = proc do |x|
+            t = clock
+            fg = problem.fg(x)
+            callback_time += clock - t
+            fg
+          end
+          jcb = true
+        end
+        name = method == 'L-BFGS-B-bounded' ? 'L-BFGS-B' : method
+        bounds = method == 'L-BFGS-B-bounded' ? problem.bounds : nil
+
+        GC.start
+        gc_count = GC.count
+        allocated = GC.stat(:total_allocated_objects)
+        t_start = clock
+        res = Numo::Optimize.minimize(fnc:, jcb:, x_init: problem.x_init, method: name, bounds:, maxiter:)
+        time = clock - t_start
+        { time:, callback_time:, n_iter: res[:n_iter], n_fev: res[:n_fev], fnc: res[:fnc],
+          allocations: GC.stat(:total_allocated_objects) - allocated, gc_runs: GC.count - gc_count }
+      end
+
+      def run(method, problem_name, size, maxiter, repeat)
+        problem = Problems::ALL.fetch(problem_name).new(size)
+        runs = Array.new(repeat) { run_once(method, problem, maxiter) }
+        r = runs.sort_by { |run| run[:time] }[runs.size / 2]
+        n_iter = [r[:n_iter], 1].max
+        { method:, problem: problem_name, n: size, n_iter: r[:n_iter], n_fev: r[:n_fev], fnc: r[:fnc],
+          time: r[:time], time_per_iter: r[:time] / n_iter, fev_per_sec: r[:n_fev] / r[:time],
+          callback_share: r[:callback_time] / r[:time], allocations: r[:allocations],
+          allocations_per_iter: r[:allocations].fdiv(n_iter), gc_runs: r[:gc_runs] }
+      end
+
+      def commit
+        `git rev-parse --short HEAD 2>/dev/null`.strip.then { |sha| sha.empty? ? 'unknown' : sha }
+      end
+
+      def report(result)
+        format('%<method>-17s %<problem>-20s %<n>8d %<n_iter>5d %<n_fev>6d ' \
+               '%<time_per_iter>10.3e %<fev_per_sec>10.3e %<share>6.1f%% %<allocations>9d',
+               **result, share: 100 * result[:callback_share])
+      end
+
+      def main
+        sizes = env_list('BENCH_SIZES', '10,1000,100000,1000000').map { |s| Integer(s) }
+        methods = env_list('BENCH_METHODS', 'L-BFGS-B,L-BFGS-B-bounded,SCG,Nelder-Mead')
+        problems = env_list('BENCH_PROBLEMS', Problems::ALL.keys.join(',')).map(&:to_sym)
+        maxiter = Integer(ENV.fetch('BENCH_MAXITER', '200'))
+        repeat = Integer(ENV.fetch('BENCH_REPEAT', '3'))
+        sha = commit
+        output = ENV.fetch('BENCH_OUTPUT', File.join(__dir__, 'results', "#{sha}.json"))
+
+        puts HEADER
+        results = []
+        sizes.each do |size|
+          methods.product(problems).each do |method, problem|
+            next unless runnable?(method, problem, size)
+
+            results << run(method, problem, size, maxiter, repeat)
+            puts report(results.last)
+          end
+        end
+
+        FileUtils.mkdir_p(File.dirname(output))
+        File.write(output, JSON.pretty_generate(
+                             commit: sha, ruby: RUBY_DESCRIPTION, version: Numo::Optimize::VERSION,
+                             maxiter:, repeat:, results:
+                           ))
+        puts "Saved #{output}"
+      end
+    end
+  end
+end
+
+Numo::Optimize::Bench.main if $PROGRAM_NAME == __FILE__
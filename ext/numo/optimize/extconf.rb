@@ -22,7 +22,22 @@ if RUBY_PLATFORM.match?(/mswin|cygwin|mingw/)
   abort 'libnarray.a not found.' unless have_library('narray', 'nary_new')
 end
 
-$defs << '-DUSE_INT64' if with_config('use-int64', false)
+$defs << '-DFORCE_INT64' if with_config('use-int64', false)
+
+# The worker pool of minimize_many runs the tasks serially without pthread.
+have_library('pthread', 'pthread_create') if have_header('pthread.h')
+
+# SharedMemory of ForkedObjective maps anonymous shared memory.
+have_header('sys/mman.h')
+
+# The static tracepoints of the solvers expand to nothing unless the extension is built with --enable-sdt.
+if enable_config('sdt', false)
+  abort 'sys/sdt.h not found.' unless have_header('sys/sdt.h')
+  $defs << '-DNUMO_OPTIMIZE_SDT'
+end
+
+# NativeObjective.fixture, the native objectives of the tests and the benchmarks, is defined only with --enable-fixtures.
+$defs << '-DNUMO_OPTIMIZE_FIXTURES' if enable_config('fixtures', false)
 
 $srcs = Dir.glob("#{$srcdir}/**/*.c").map { |path| File.basename(path) }
 
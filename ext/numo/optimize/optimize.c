@@ -2,414 +2,3394 @@
 
 VALUE rb_mOptimize;
 VALUE rb_mLbfgsb;
+VALUE rb_cLbfgsbWorkspace;
+VALUE rb_cLbfgsbState;
 VALUE rb_mScg;
+VALUE rb_mNelderMead;
+VALUE rb_cNativeObjective;
+VALUE rb_cSharedMemory;
+VALUE rb_cEvalCache;
 
-#define SIGMA_INIT 1e-4
-#define BETA_MIN 1e-15
-#define BETA_MAX 1e+15
+static void blas_daxpy(int64_t n, double a, double* x, double* y) {
+  if (n > INT32_MAX) {
+    int64_t inc = 1;
+    daxpy_i64_(&n, &a, x, &inc, y, &inc);
+    return;
+  }
+  F77_int n32 = (F77_int)n;
+  F77_int inc = 1;
+  daxpy_(&n32, &a, x, &inc, y, &inc);
+}
+
+/* Casts the gradient returned from the user function to a contiguous Numo::DFloat with n elements. */
+static VALUE jcb_to_dfloat(VALUE j_val, int64_t n) {
+  if (CLASS_OF(j_val) != numo_cDFloat) {
+    j_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, j_val);
+  }
+  if (!RTEST(nary_check_contiguous(j_val))) {
+    j_val = nary_dup(j_val);
+  }
+  narray_t* j_nary = NULL;
+  GetNArray(j_val, j_nary);
+  if ((int64_t)NA_SIZE(j_nary) != n) {
+    rb_raise(rb_eArgError, "The size of jcb must be equal to that of x.");
+  }
+  return j_val;
+}
+
+/* Returns the array reshaped to the shape of ref if their shapes differ. */
+static VALUE reshape_like(VALUE val, VALUE ref) {
+  narray_t* val_nary = NULL;
+  narray_t* ref_nary = NULL;
+  GetNArray(val, val_nary);
+  GetNArray(ref, ref_nary);
+  if (NA_NDIM(val_nary) == NA_NDIM(ref_nary) &&
+      memcmp(NA_SHAPE(val_nary), NA_SHAPE(ref_nary), NA_NDIM(ref_nary) * sizeof(size_t)) == 0) {
+    return val;
+  }
+  VALUE shape = rb_ary_new_capa(NA_NDIM(ref_nary));
+  for (int i = 0; i < NA_NDIM(ref_nary); i++) {
+    rb_ary_push(shape, SIZET2NUM(NA_SHAPE(ref_nary)[i]));
+  }
+  return rb_funcallv(val, rb_intern("reshape"), (int)RARRAY_LEN(shape), RARRAY_CONST_PTR(shape));
+}
+
+/* Returns the seconds of the monotonic clock, which is not affected by the changes of the system time. */
+static double monotonic_seconds(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#else
+  return (double)time(NULL);
+#endif
+}
+
+/* Returns the deadline on the monotonic clock for the timeout in seconds given as nil or Numeric. */
+static double solve_deadline(VALUE timeout_val) {
+  if (NIL_P(timeout_val)) {
+    return HUGE_VAL;
+  }
+  const double timeout = NUM2DBL(timeout_val);
+  if (!(timeout >= 0.0)) {
+    rb_raise(rb_eArgError, "timeout must be a non-negative number.");
+  }
+  return monotonic_seconds() + timeout;
+}
+
+/* Returns the limit of the number of evaluations given as nil or Integer. */
+static int64_t solve_max_fev(VALUE max_fev_val) {
+  if (NIL_P(max_fev_val)) {
+    return INT64_MAX;
+  }
+  const int64_t max_fev = NUM2LL(max_fev_val);
+  if (max_fev <= 0) {
+    rb_raise(rb_eArgError, "max_fev must be a positive integer.");
+  }
+  return max_fev;
+}
+
+/* Returns the number of iterations between the calls of the callback given as nil or Integer. */
+static int64_t solve_callback_every(VALUE every_val) {
+  if (NIL_P(every_val)) {
+    return 1;
+  }
+  const int64_t every = NUM2LL(every_val);
+  if (every <= 0) {
+    rb_raise(rb_eArgError, "every must be a positive integer.");
+  }
+  return every;
+}
+
+/**
+ * Calls the callback with the current point, function value, infinity norm of the projected gradient, and
+ * number of iterations. x is the array updated by the solver, so nothing is copied for the call.
+ * Returns true if the callback asks the solver to stop by returning :stop.
+ */
+static bool solve_callback(VALUE callback, VALUE x_val, double f, double pg_norm, int64_t n_iter) {
+  VALUE ret = rb_funcall(callback, rb_intern("call"), 4, x_val, DBL2NUM(f), DBL2NUM(pg_norm), LL2NUM(n_iter));
+  return ret == ID2SYM(rb_intern("stop"));
+}
+
+/* Counters of the Ruby heap at the start of a solve, from which the allocations and GC runs of the solve are taken. */
+typedef struct {
+  size_t allocated;
+  size_t gc_count;
+} solve_alloc_mark;
+
+static void solve_alloc_mark_start(solve_alloc_mark* mark) {
+  mark->allocated = rb_gc_stat(ID2SYM(rb_intern("total_allocated_objects")));
+  mark->gc_count = rb_gc_count();
+}
+
+/**
+ * Stores allocations (Ruby objects allocated since the mark), gc_runs (GC runs since the mark), and native_bytes
+ * (bytes of the native memory allocated by the solve outside Ruby objects) in the stats hash.
+ * The counters are read before storing anything, so the entries themselves are not counted.
+ */
+static void solve_alloc_stats(VALUE stats_val, const solve_alloc_mark* mark, size_t native_bytes) {
+  const size_t allocated = rb_gc_stat(ID2SYM(rb_intern("total_allocated_objects"))) - mark->allocated;
+  const size_t gc_runs = rb_gc_count() - mark->gc_count;
+  rb_hash_aset(stats_val, ID2SYM(rb_intern("allocations")), SIZET2NUM(allocated));
+  rb_hash_aset(stats_val, ID2SYM(rb_intern("gc_runs")), SIZET2NUM(gc_runs));
+  rb_hash_aset(stats_val, ID2SYM(rb_intern("native_bytes")), SIZET2NUM(native_bytes));
+}
+
+/* Native objective function given as C function pointers. */
+typedef struct {
+  numo_optimize_fg_t fg;
+  numo_optimize_batch_f_t batch_f;
+  void* data;
+} native_objective;
+
+static const rb_data_type_t native_objective_type = {
+  "Numo::Optimize::NativeObjective",
+  {
+    NULL,
+    RUBY_TYPED_DEFAULT_FREE,
+    NULL,
+  },
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE native_objective_alloc(VALUE klass) {
+  native_objective* obj = ALLOC(native_objective);
+  memset(obj, 0, sizeof(*obj));
+  return TypedData_Wrap_Struct(klass, &native_objective_type, obj);
+}
+
+/* Returns the wrapped native objective function if the given object is Numo::Optimize::NativeObjective, or NULL otherwise. */
+static native_objective* get_native_objective(VALUE obj_val) {
+  if (!rb_typeddata_is_kind_of(obj_val, &native_objective_type)) {
+    return NULL;
+  }
+  return (native_objective*)RTYPEDDATA_DATA(obj_val);
+}
+
+/* Returns the address given as nil, Integer, or an object responding to to_i such as Fiddle::Pointer. */
+static void* native_objective_address(VALUE addr_val) {
+  if (NIL_P(addr_val)) {
+    return NULL;
+  }
+  if (!RB_INTEGER_TYPE_P(addr_val)) {
+    addr_val = rb_funcall(addr_val, rb_intern("to_i"), 0);
+  }
+  return (void*)(uintptr_t)NUM2ULL(addr_val);
+}
+
+static VALUE native_objective_initialize(int argc, VALUE* argv, VALUE self) {
+  VALUE fg_val = Qnil;
+  VALUE batch_f_val = Qnil;
+  VALUE data_val = Qnil;
+  native_objective* obj = NULL;
+
+  rb_scan_args(argc, argv, "21", &fg_val, &batch_f_val, &data_val);
+  TypedData_Get_Struct(self, native_objective, &native_objective_type, obj);
+  obj->fg = (numo_optimize_fg_t)native_objective_address(fg_val);
+  obj->batch_f = (numo_optimize_batch_f_t)native_objective_address(batch_f_val);
+  obj->data = native_objective_address(data_val);
+  if (obj->fg == NULL && obj->batch_f == NULL) {
+    rb_raise(rb_eArgError, "At least one of fg and batch_f must be given.");
+  }
+  /* Keep the given objects such as Fiddle::Handle alive while the functions are used. */
+  rb_iv_set(self, "@refs", rb_ary_new3(3, fg_val, batch_f_val, data_val));
+  return self;
+}
+
+static VALUE native_objective_has_fg(VALUE self) {
+  return get_native_objective(self)->fg != NULL ? Qtrue : Qfalse;
+}
+
+static VALUE native_objective_has_batch_f(VALUE self) {
+  return get_native_objective(self)->batch_f != NULL ? Qtrue : Qfalse;
+}
+
+/* Evaluates f at k points laid out as structure of arrays with batch_f, or with fg point by point; tmp has n elements. */
+static void native_objective_eval_batch(const native_objective* obj, int64_t n, int64_t k, const double* x, double* f,
+                                        double* tmp) {
+  if (obj->batch_f != NULL) {
+    obj->batch_f(n, k, x, f, obj->data);
+    return;
+  }
+  for (int64_t p = 0; p < k; p++) {
+    for (int64_t i = 0; i < n; i++) {
+      tmp[i] = x[i * k + p];
+    }
+    f[p] = obj->fg(n, tmp, NULL, obj->data);
+  }
+}
+
+#ifdef NUMO_OPTIMIZE_FIXTURES
+/* The extended Rosenbrock function. */
+static double fixture_rosenbrock_fg(int64_t n, const double* x, double* g, void* data) {
+  double f = 0.0;
+  if (g != NULL) memset(g, 0, n * sizeof(double));
+  for (int64_t i = 0; i + 1 < n; i++) {
+    const double a = x[i + 1] - x[i] * x[i];
+    const double b = 1.0 - x[i];
+    f += 100.0 * a * a + b * b;
+    if (g != NULL) {
+      g[i] += -400.0 * x[i] * a - 2.0 * b;
+      g[i + 1] += 200.0 * a;
+    }
+  }
+  return f;
+}
+
+static void fixture_rosenbrock_batch_f(int64_t n, int64_t k, const double* x, double* f, void* data) {
+  memset(f, 0, k * sizeof(double));
+  for (int64_t i = 0; i + 1 < n; i++) {
+    const double* xi = x + i * k;
+    const double* xj = x + (i + 1) * k;
+    for (int64_t p = 0; p < k; p++) {
+      const double a = xj[p] - xi[p] * xi[p];
+      const double b = 1.0 - xi[p];
+      f[p] += 100.0 * a * a + b * b;
+    }
+  }
+}
+
+/* The sum of squares. */
+static double fixture_sphere_fg(int64_t n, const double* x, double* g, void* data) {
+  double f = 0.0;
+  for (int64_t i = 0; i < n; i++) {
+    f += x[i] * x[i];
+    if (g != NULL) g[i] = 2.0 * x[i];
+  }
+  return f;
+}
+
+static void fixture_sphere_batch_f(int64_t n, int64_t k, const double* x, double* f, void* data) {
+  memset(f, 0, k * sizeof(double));
+  for (int64_t i = 0; i < n; i++) {
+    const double* xi = x + i * k;
+    for (int64_t p = 0; p < k; p++) {
+      f[p] += xi[p] * xi[p];
+    }
+  }
+}
+
+static VALUE native_objective_fixture(VALUE klass, VALUE name_val) {
+  const char* name = rb_id2name(rb_sym2id(rb_to_symbol(name_val)));
+  VALUE obj_val = native_objective_alloc(klass);
+  native_objective* obj = get_native_objective(obj_val);
+  if (strcmp(name, "rosenbrock") == 0) {
+    obj->fg = fixture_rosenbrock_fg;
+    obj->batch_f = fixture_rosenbrock_batch_f;
+  } else if (strcmp(name, "sphere") == 0) {
+    obj->fg = fixture_sphere_fg;
+    obj->batch_f = fixture_sphere_batch_f;
+  } else {
+    rb_raise(rb_eArgError, "Unknown fixture objective: %s", name);
+  }
+  return obj_val;
+}
+#endif /* NUMO_OPTIMIZE_FIXTURES */
+
+/* Array of doubles in an anonymous shared mapping, which is shared with the processes forked after its creation. */
+typedef struct {
+  double* ptr;
+  int64_t size;
+} shared_memory;
+
+static void shared_memory_free(void* ptr) {
+  shared_memory* shm = (shared_memory*)ptr;
+#ifdef HAVE_SYS_MMAN_H
+  if (shm->ptr != NULL) {
+    munmap(shm->ptr, (size_t)shm->size * sizeof(double));
+  }
+#endif
+  xfree(shm);
+}
+
+static size_t shared_memory_size(const void* ptr) {
+  const shared_memory* shm = (const shared_memory*)ptr;
+  return sizeof(*shm) + (size_t)shm->size * sizeof(double);
+}
+
+static const rb_data_type_t shared_memory_type = {
+  "Numo::Optimize::SharedMemory",
+  {
+    NULL,
+    shared_memory_free,
+    shared_memory_size,
+  },
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE shared_memory_alloc(VALUE klass) {
+  shared_memory* shm = ALLOC(shared_memory);
+  memset(shm, 0, sizeof(*shm));
+  return TypedData_Wrap_Struct(klass, &shared_memory_type, shm);
+}
+
+static shared_memory* get_shared_memory(VALUE self) {
+  shared_memory* shm = NULL;
+  TypedData_Get_Struct(self, shared_memory, &shared_memory_type, shm);
+  if (shm->ptr == NULL) {
+    rb_raise(rb_eRuntimeError, "SharedMemory is not initialized.");
+  }
+  return shm;
+}
+
+static VALUE shared_memory_initialize(VALUE self, VALUE size_val) {
+  shared_memory* shm = NULL;
+  const int64_t size = NUM2LL(size_val);
+
+  TypedData_Get_Struct(self, shared_memory, &shared_memory_type, shm);
+  if (shm->ptr != NULL) {
+    rb_raise(rb_eRuntimeError, "SharedMemory is already initialized.");
+  }
+  if (size <= 0) {
+    rb_raise(rb_eArgError, "size must be a positive integer.");
+  }
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  void* ptr = mmap(NULL, (size_t)size * sizeof(double), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    rb_sys_fail("mmap");
+  }
+  shm->ptr = (double*)ptr;
+  shm->size = size;
+#else
+  rb_raise(rb_eNotImpError, "SharedMemory is not available on this platform.");
+#endif
+  return self;
+}
+
+static VALUE shared_memory_get_size(VALUE self) {
+  return LL2NUM(get_shared_memory(self)->size);
+}
+
+/* Checks that the range [offset, offset + length) is in the shared memory. */
+static void shared_memory_check_range(const shared_memory* shm, int64_t offset, int64_t length) {
+  if (offset < 0 || length < 0 || offset > shm->size - length) {
+    rb_raise(rb_eIndexError, "The range [%" PRId64 ", %" PRId64 ") is out of the shared memory of size %" PRId64 ".", offset,
+             offset + length, shm->size);
+  }
+}
+
+static VALUE shared_memory_write(VALUE self, VALUE offset_val, VALUE arr_val) {
+  shared_memory* shm = get_shared_memory(self);
+  const int64_t offset = NUM2LL(offset_val);
+  narray_t* arr_nary = NULL;
+
+  if (CLASS_OF(arr_val) != numo_cDFloat) {
+    arr_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, arr_val);
+  }
+  if (!RTEST(nary_check_contiguous(arr_val))) {
+    arr_val = nary_dup(arr_val);
+  }
+  GetNArray(arr_val, arr_nary);
+  const int64_t length = (int64_t)NA_SIZE(arr_nary);
+  shared_memory_check_range(shm, offset, length);
+  memcpy(shm->ptr + offset, na_get_pointer_for_read(arr_val), (size_t)length * sizeof(double));
+
+  RB_GC_GUARD(arr_val);
+  return self;
+}
+
+static VALUE shared_memory_read(VALUE self, VALUE offset_val, VALUE length_val) {
+  shared_memory* shm = get_shared_memory(self);
+  const int64_t offset = NUM2LL(offset_val);
+  const int64_t length = NUM2LL(length_val);
+
+  shared_memory_check_range(shm, offset, length);
+  size_t shape[1] = { (size_t)length };
+  VALUE arr_val = nary_new(numo_cDFloat, 1, shape);
+  memcpy(na_get_pointer_for_write(arr_val), shm->ptr + offset, (size_t)length * sizeof(double));
+  return arr_val;
+}
+
+static VALUE shared_memory_reduce(VALUE self, VALUE offset_val, VALUE length_val, VALUE count_val) {
+  shared_memory* shm = get_shared_memory(self);
+  const int64_t offset = NUM2LL(offset_val);
+  const int64_t length = NUM2LL(length_val);
+  const int64_t count = NUM2LL(count_val);
+
+  if (count <= 0) {
+    rb_raise(rb_eArgError, "count must be a positive integer.");
+  }
+  shared_memory_check_range(shm, offset, length);
+  if (length > 0 && count > (shm->size - offset) / length) {
+    rb_raise(rb_eIndexError, "The %" PRId64 " blocks of length %" PRId64 " are out of the shared memory.", count, length);
+  }
+  size_t shape[1] = { (size_t)length };
+  VALUE sum_val = nary_new(numo_cDFloat, 1, shape);
+  double* sum_ptr = (double*)na_get_pointer_for_write(sum_val);
+  memcpy(sum_ptr, shm->ptr + offset, (size_t)length * sizeof(double));
+  for (int64_t b = 1; b < count; b++) {
+    blas_daxpy(length, 1.0, shm->ptr + offset + b * length, sum_ptr);
+  }
+  return sum_val;
+}
+
+/* Returns the number of entries of the evaluation cache given as nil or Integer, where 0 means no cache. */
+static int64_t solve_cache_capacity(VALUE cache_val) {
+  if (NIL_P(cache_val)) {
+    return 0;
+  }
+  const int64_t capacity = NUM2LL(cache_val);
+  if (capacity <= 0) {
+    rb_raise(rb_eArgError, "cache must be a positive integer.");
+  }
+  return capacity;
+}
+
+/* Allocates the buffer of the evaluation cache and initializes the cache. Returns the buffer, which is NULL without the cache. */
+static void* solve_cache_init(eval_cache* cache, int64_t n, int64_t capacity) {
+  if (capacity == 0) {
+    memset(cache, 0, sizeof(*cache));
+    return NULL;
+  }
+  void* buf = ruby_xmalloc((size_t)eval_cache_bytes(n, capacity));
+  eval_cache_init(cache, n, capacity, buf);
+  return buf;
+}
+
+/* Evaluation cache wrapped by Numo::Optimize::EvalCache for the solvers written in Ruby. */
+typedef struct {
+  eval_cache cache;
+  void* buf;
+} eval_cache_object;
+
+static void eval_cache_object_free(void* ptr) {
+  eval_cache_object* obj = (eval_cache_object*)ptr;
+  xfree(obj->buf);
+  xfree(obj);
+}
+
+static size_t eval_cache_object_size(const void* ptr) {
+  const eval_cache_object* obj = (const eval_cache_object*)ptr;
+  return sizeof(*obj) + (obj->buf != NULL ? (size_t)eval_cache_bytes(obj->cache.n, obj->cache.capacity) : 0);
+}
+
+static const rb_data_type_t eval_cache_object_type = {
+  "Numo::Optimize::EvalCache",
+  {
+    NULL,
+    eval_cache_object_free,
+    eval_cache_object_size,
+  },
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE eval_cache_object_alloc(VALUE klass) {
+  eval_cache_object* obj = ALLOC(eval_cache_object);
+  memset(obj, 0, sizeof(*obj));
+  return TypedData_Wrap_Struct(klass, &eval_cache_object_type, obj);
+}
+
+static eval_cache_object* get_eval_cache_object(VALUE self) {
+  eval_cache_object* obj = NULL;
+  TypedData_Get_Struct(self, eval_cache_object, &eval_cache_object_type, obj);
+  if (obj->buf == NULL) {
+    rb_raise(rb_eRuntimeError, "EvalCache is not initialized.");
+  }
+  return obj;
+}
+
+static VALUE eval_cache_object_initialize(VALUE self, VALUE n_val, VALUE capacity_val) {
+  eval_cache_object* obj = NULL;
+  const int64_t n = NUM2LL(n_val);
+  const int64_t capacity = NUM2LL(capacity_val);
+
+  TypedData_Get_Struct(self, eval_cache_object, &eval_cache_object_type, obj);
+  if (obj->buf != NULL) {
+    rb_raise(rb_eRuntimeError, "EvalCache is already initialized.");
+  }
+  if (n <= 0) {
+    rb_raise(rb_eArgError, "n must be a positive integer.");
+  }
+  if (capacity <= 0) {
+    rb_raise(rb_eArgError, "capacity must be a positive integer.");
+  }
+  obj->buf = solve_cache_init(&obj->cache, n, capacity);
+  return self;
+}
+
+/* Casts the point to a contiguous Numo::DFloat with the number of elements of the cache. */
+static VALUE eval_cache_object_point(const eval_cache_object* obj, VALUE x_val) {
+  if (CLASS_OF(x_val) != numo_cDFloat) {
+    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  }
+  if (!RTEST(nary_check_contiguous(x_val))) {
+    x_val = nary_dup(x_val);
+  }
+  narray_t* x_nary = NULL;
+  GetNArray(x_val, x_nary);
+  if ((int64_t)NA_SIZE(x_nary) != obj->cache.n) {
+    rb_raise(rb_eArgError, "The size of x must be equal to n of the cache.");
+  }
+  return x_val;
+}
+
+static VALUE eval_cache_object_aref(VALUE self, VALUE x_val) {
+  eval_cache_object* obj = get_eval_cache_object(self);
+  double f = 0.0;
+
+  x_val = eval_cache_object_point(obj, x_val);
+  const bool hit = eval_cache_get(&obj->cache, (const double*)na_get_pointer_for_read(x_val), &f, NULL);
+  RB_GC_GUARD(x_val);
+  return hit ? DBL2NUM(f) : Qnil;
+}
+
+static VALUE eval_cache_object_aset(VALUE self, VALUE x_val, VALUE f_val) {
+  eval_cache_object* obj = get_eval_cache_object(self);
+  const double f = NUM2DBL(f_val);
+
+  x_val = eval_cache_object_point(obj, x_val);
+  eval_cache_put(&obj->cache, (const double*)na_get_pointer_for_read(x_val), &f, NULL);
+  RB_GC_GUARD(x_val);
+  return f_val;
+}
+
+static VALUE eval_cache_object_get_hits(VALUE self) {
+  return LL2NUM(get_eval_cache_object(self)->cache.hits);
+}
+
+static VALUE eval_cache_object_get_bytesize(VALUE self) {
+  const eval_cache_object* obj = get_eval_cache_object(self);
+  return LL2NUM(eval_cache_bytes(obj->cache.n, obj->cache.capacity));
+}
+
+/* Number of the points given at once to batch_f of the native objective by the finite differences. */
+#define FDIFF_CHUNK 16
+
+/**
+ * Gradient of jcb = :forward_diff or :central_diff evaluated with fnc at the perturbed points of fdiff.c.
+ * fnc is called point by point, or once with the matrix of x and the perturbed points as rows if batch is set.
+ * The native objective is called on the threads of the pool, or with batch_f in chunks if it has no fg.
+ */
+typedef struct {
+  int method;
+  int64_t n;
+  bool batch;
+  VALUE self;
+  VALUE fnc;
+  VALUE args;
+  const native_objective* native;
+  /* The bounds of the elements, which are NULL if x is unbounded. */
+  double* lo;
+  double* hi;
+  /* Steps and function values of the perturbed points. */
+  double* h;
+  double* fp;
+  /* The point given to fnc, or the copies of x perturbed by the workers or the chunk given to batch_f. */
+  VALUE pt_val;
+  double* tmp;
+  worker_pool* pool;
+  const double* x;
+  int64_t n_evals;
+} fdiff_engine;
+
+/* Returns FDIFF_FORWARD or FDIFF_CENTRAL for jcb given as :forward_diff or :central_diff, or 0 otherwise. */
+static int fdiff_method(VALUE jcb) {
+  if (!SYMBOL_P(jcb)) {
+    return 0;
+  }
+  const ID name = SYM2ID(jcb);
+  if (name == rb_intern("forward_diff")) {
+    return FDIFF_FORWARD;
+  }
+  if (name == rb_intern("central_diff")) {
+    return FDIFF_CENTRAL;
+  }
+  rb_raise(rb_eArgError, "jcb must be a Method, Proc, true, :forward_diff, or :central_diff.");
+  return 0;
+}
+
+/**
+ * Allocates the buffers of the engine for the method. The pool is created only for fg of the native objective,
+ * with n_threads capped at the number of the perturbed points since each thread evaluates at least one of them.
+ */
+static void fdiff_engine_init(fdiff_engine* eng, int method, VALUE self, VALUE fnc, VALUE x_val, VALUE args,
+                              const native_objective* native, bool batch, int n_threads) {
+  narray_t* x_nary = NULL;
+  GetNArray(x_val, x_nary);
+  const int64_t n = (int64_t)NA_SIZE(x_nary);
+  const int64_t k = fdiff_n_points(method, n);
+  eng->method = method;
+  eng->n = n;
+  eng->batch = batch && native == NULL;
+  eng->self = self;
+  eng->fnc = fnc;
+  eng->args = args;
+  eng->native = native;
+  eng->lo = NULL;
+  eng->hi = NULL;
+  eng->pt_val = Qnil;
+  eng->tmp = NULL;
+  eng->pool = NULL;
+  eng->x = NULL;
+  eng->n_evals = 0;
+  eng->h = ALLOC_N(double, k);
+  eng->fp = ALLOC_N(double, k);
+  if (native == NULL) {
+    /* The point keeps the shape of x, which fnc is given otherwise. */
+    eng->pt_val = nary_dup(x_val);
+  } else if (native->fg != NULL) {
+    if (n_threads > k) n_threads = (int)k;
+    eng->pool = n_threads > 1 ? worker_pool_create(n_threads) : NULL;
+    eng->tmp = ALLOC_N(double, n * (eng->pool != NULL ? worker_pool_size(eng->pool) : 1));
+  } else {
+    eng->tmp = ALLOC_N(double, n * FDIFF_CHUNK);
+  }
+}
+
+/* Copies the bounds of L-BFGS-B so that the perturbed points stay in the box; nbd is in the width of the solver. */
+static void fdiff_engine_bounds(fdiff_engine* eng, const double* l, const double* u, const void* nbd, bool use_int64) {
+  const int64_t n = eng->n;
+  eng->lo = ALLOC_N(double, n);
+  eng->hi = ALLOC_N(double, n);
+  for (int64_t i = 0; i < n; i++) {
+    const int64_t b = use_int64 ? ((const int64_t*)nbd)[i] : ((const F77_int*)nbd)[i];
+    eng->lo[i] = b == 1 || b == 2 ? l[i] : -HUGE_VAL;
+    eng->hi[i] = b == 2 || b == 3 ? u[i] : HUGE_VAL;
+  }
+}
+
+static void fdiff_engine_release(fdiff_engine* eng) {
+  worker_pool_destroy(eng->pool);
+  eng->pool = NULL;
+  xfree(eng->h);
+  xfree(eng->fp);
+  xfree(eng->tmp);
+  xfree(eng->lo);
+  xfree(eng->hi);
+  eng->h = NULL;
+  eng->fp = NULL;
+  eng->tmp = NULL;
+  eng->lo = NULL;
+  eng->hi = NULL;
+}
+
+/* Returns the native memory of the engine in bytes. */
+static size_t fdiff_engine_bytes(const fdiff_engine* eng) {
+  const size_t k = (size_t)fdiff_n_points(eng->method, eng->n);
+  size_t bytes = 2 * k * sizeof(double);
+  if (eng->lo != NULL) bytes += 2 * (size_t)eng->n * sizeof(double);
+  if (eng->native != NULL) {
+    const size_t rows = eng->native->fg == NULL ? FDIFF_CHUNK : (eng->pool != NULL ? (size_t)worker_pool_size(eng->pool) : 1);
+    bytes += rows * (size_t)eng->n * sizeof(double);
+  }
+  return bytes;
+}
+
+static void fdiff_engine_task(void* arg, int64_t task, int worker) {
+  fdiff_engine* eng = (fdiff_engine*)arg;
+  const int64_t n = eng->n;
+  const int64_t j = task % n;
+  double* pt = eng->tmp + worker * n;
+  pt[j] = eng->x[j] + eng->h[task];
+  eng->fp[task] = eng->native->fg(n, pt, NULL, eng->native->data);
+  pt[j] = eng->x[j];
+}
+
+/* Returns the function value of the Ruby objective at the point of pt_val. */
+static double fdiff_engine_call(fdiff_engine* eng) {
+  return NUM2DBL(rb_funcall(eng->self, rb_intern("fnc"), 3, eng->fnc, eng->pt_val, eng->args));
+}
+
+/* Evaluates the function values of the perturbed points in fp. */
+static void fdiff_engine_eval_points(fdiff_engine* eng, int64_t k) {
+  const int64_t n = eng->n;
+  const double* x = eng->x;
+  if (eng->native != NULL && eng->native->fg != NULL) {
+    const int n_workers = eng->pool != NULL ? worker_pool_size(eng->pool) : 1;
+    for (int w = 0; w < n_workers; w++) {
+      memcpy(eng->tmp + w * n, x, n * sizeof(double));
+    }
+    if (eng->pool != NULL) {
+      worker_pool_run(eng->pool, k, fdiff_engine_task, eng);
+    } else {
+      for (int64_t p = 0; p < k; p++) fdiff_engine_task(eng, p, 0);
+    }
+  } else if (eng->native != NULL) {
+    for (int64_t p0 = 0; p0 < k; p0 += FDIFF_CHUNK) {
+      const int64_t c = k - p0 < FDIFF_CHUNK ? k - p0 : FDIFF_CHUNK;
+      for (int64_t i = 0; i < n; i++) {
+        for (int64_t q = 0; q < c; q++) eng->tmp[i * c + q] = x[i];
+      }
+      for (int64_t q = 0; q < c; q++) {
+        eng->tmp[((p0 + q) % n) * c + q] += eng->h[p0 + q];
+      }
+      eng->native->batch_f(n, c, eng->tmp, eng->fp + p0, eng->native->data);
+    }
+  } else {
+    double* pt = (double*)na_get_pointer_for_write(eng->pt_val);
+    memcpy(pt, x, n * sizeof(double));
+    for (int64_t p = 0; p < k; p++) {
+      const int64_t j = p % n;
+      pt[j] = x[j] + eng->h[p];
+      eng->fp[p] = fdiff_engine_call(eng);
+      pt[j] = x[j];
+    }
+  }
+}
+
+/**
+ * Returns the function value at x and stores the gradient in g unless g is NULL.
+ * With batch, fnc is called once with the matrix of x and the perturbed points, and returns their function values.
+ */
+static double fdiff_engine_fg(fdiff_engine* eng, const double* x, double* g) {
+  const int64_t n = eng->n;
+  const int64_t k = g != NULL ? fdiff_n_points(eng->method, n) : 0;
+  double f0 = 0.0;
+  eng->x = x;
+  if (k > 0) {
+    fdiff_steps(eng->method, n, x, eng->lo, eng->hi, eng->h);
+  }
+  if (eng->batch) {
+    size_t shape[2] = { (size_t)(k + 1), (size_t)n };
+    VALUE pts_val = nary_new(numo_cDFloat, 2, shape);
+    double* pts = (double*)na_get_pointer_for_write(pts_val);
+    for (int64_t r = 0; r <= k; r++) {
+      memcpy(pts + r * n, x, n * sizeof(double));
+      if (r > 0) pts[r * n + (r - 1) % n] += eng->h[r - 1];
+    }
+    VALUE f_val = rb_funcall(eng->self, rb_intern("fnc"), 3, eng->fnc, pts_val, eng->args);
+    if (CLASS_OF(f_val) != numo_cDFloat) {
+      f_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, f_val);
+    }
+    if (!RTEST(nary_check_contiguous(f_val))) {
+      f_val = nary_dup(f_val);
+    }
+    narray_t* f_nary = NULL;
+    GetNArray(f_val, f_nary);
+    if ((int64_t)NA_SIZE(f_nary) != k + 1) {
+      rb_raise(rb_eArgError, "The size of fnc must be equal to the number of rows of x.");
+    }
+    const double* f_ptr = (const double*)na_get_pointer_for_read(f_val);
+    f0 = f_ptr[0];
+    memcpy(eng->fp, f_ptr + 1, k * sizeof(double));
+    RB_GC_GUARD(pts_val);
+    RB_GC_GUARD(f_val);
+  } else {
+    if (eng->native == NULL) {
+      memcpy(na_get_pointer_for_write(eng->pt_val), x, n * sizeof(double));
+      f0 = fdiff_engine_call(eng);
+    } else if (eng->native->fg != NULL) {
+      f0 = eng->native->fg(n, x, NULL, eng->native->data);
+    } else {
+      eng->native->batch_f(n, 1, x, &f0, eng->native->data);
+    }
+    if (k > 0) {
+      fdiff_engine_eval_points(eng, k);
+    }
+  }
+  eng->n_evals += 1 + k;
+  if (g != NULL) {
+    fdiff_gradient(eng->method, n, f0, eng->fp, eng->h, g);
+  }
+  return f0;
+}
+
+/* User objective of SCG, of which the evaluations are counted and served from the cache if it is given. */
+typedef struct {
+  VALUE self;
+  VALUE fnc;
+  VALUE jcb;
+  VALUE args;
+  int64_t n;
+  eval_cache* cache;
+  /* n doubles keeping the gradient returned by fnc with jcb = true for the cache when only f is asked. */
+  double* cache_g;
+  int32_t n_fev;
+  int32_t n_jev;
+  /* The finite differences of jcb = :forward_diff or :central_diff, or NULL. */
+  fdiff_engine* fdiff;
+} scg_objective;
+
+/**
+ * Evaluates the function value into f and the gradient into g at x_val, either of which can be NULL if it is not needed.
+ * Both are stored in the cache if fnc returns them together, so that the gradient at the point of the function value,
+ * which SCG needs after a successful step, is not evaluated again.
+ */
+static void scg_eval(scg_objective* obj, VALUE x_val, double* f, double* g) {
+  const double* x_ptr = (const double*)na_get_pointer_for_read(x_val);
+  double* g_ptr = g != NULL ? g : obj->cache_g;
+  VALUE j_val = Qnil;
+  double f_eval = 0.0;
+  bool has_f = f != NULL;
+  bool has_g = g != NULL;
+
+  if (obj->cache != NULL && eval_cache_get(obj->cache, x_ptr, f, g)) {
+    return;
+  }
+
+#if NUMO_OPTIMIZE_PROBE_ENABLED
+  const double t_start = monotonic_seconds();
+#endif
+  if (obj->fdiff != NULL) {
+    const int64_t n_evals = obj->fdiff->n_evals;
+    f_eval = fdiff_engine_fg(obj->fdiff, x_ptr, g);
+    /* The perturbed points are counted as the evaluations of fnc besides that of x below. */
+    obj->n_fev += (int32_t)(obj->fdiff->n_evals - n_evals) - (f != NULL ? 1 : 0);
+    has_f = true;
+  } else if (RB_TYPE_P(obj->jcb, T_TRUE)) {
+    VALUE fg_arr = rb_funcall(obj->self, rb_intern("fnc"), 3, obj->fnc, x_val, obj->args);
+    f_eval = NUM2DBL(rb_ary_entry(fg_arr, 0));
+    j_val = rb_ary_entry(fg_arr, 1);
+    has_f = true;
+  } else {
+    if (f != NULL) {
+      f_eval = NUM2DBL(rb_funcall(obj->self, rb_intern("fnc"), 3, obj->fnc, x_val, obj->args));
+    }
+    if (g != NULL) {
+      j_val = rb_funcall(obj->self, rb_intern("jcb"), 3, obj->jcb, x_val, obj->args);
+    }
+  }
+#if NUMO_OPTIMIZE_PROBE_ENABLED
+  NUMO_OPTIMIZE_PROBE2(fg__eval, obj->n, (int64_t)((monotonic_seconds() - t_start) * 1e9));
+#endif
+  if (f != NULL) {
+    obj->n_fev++;
+    *f = f_eval;
+  }
+  if (g != NULL) {
+    obj->n_jev++;
+  }
+  if (!NIL_P(j_val) && g_ptr != NULL) {
+    j_val = jcb_to_dfloat(j_val, obj->n);
+    memcpy(g_ptr, na_get_pointer_for_read(j_val), obj->n * sizeof(double));
+    has_g = true;
+  }
+  if (obj->cache != NULL) {
+    eval_cache_put(obj->cache, x_ptr, has_f ? &f_eval : NULL, has_g ? g_ptr : NULL);
+  }
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(j_val);
+}
+
+/* Context of scg_fmin shared by the loop and the ensure function, which releases the native buffers if fnc raises. */
+typedef struct {
+  scg_objective obj;
+  fdiff_engine fdiff;
+  int fdiff_method;
+  bool fdiff_batch;
+  eval_cache cache;
+  int64_t cache_capacity;
+  void* cache_buf;
+  /* Buffer of the state of the iteration. */
+  void* scg_buf;
+  VALUE x_val;
+  /* The trial points are given to fnc in this array, and the points at x in x_val itself. */
+  VALUE pt_val;
+  VALUE j_val;
+  double xtol;
+  double ftol;
+  double jtol;
+  int64_t max_iter;
+  double deadline;
+  int64_t max_fev;
+  VALUE callback;
+  int64_t callback_every;
+  double f;
+  int64_t n_iter;
+  VALUE task_val;
+  size_t native_bytes;
+} scg_fmin_ctx;
+
+static VALUE scg_fmin_loop(VALUE data) {
+  scg_fmin_ctx* ctx = (scg_fmin_ctx*)data;
+  scg_objective* obj = &ctx->obj;
+  const int64_t n = obj->n;
+  int64_t n_steps = 0;
+  scg_state scg;
+
+  ctx->cache_buf = solve_cache_init(&ctx->cache, n, ctx->cache_capacity);
+  if (ctx->cache_buf != NULL) {
+    obj->cache = &ctx->cache;
+    obj->cache_g = ALLOC_N(double, n);
+    ctx->native_bytes += (size_t)eval_cache_bytes(n, ctx->cache_capacity) + (size_t)n * sizeof(double);
+  }
+  if (ctx->fdiff_method != 0) {
+    fdiff_engine_init(&ctx->fdiff, ctx->fdiff_method, obj->self, obj->fnc, ctx->x_val, obj->args, NULL, ctx->fdiff_batch, 1);
+    obj->fdiff = &ctx->fdiff;
+    ctx->native_bytes += fdiff_engine_bytes(&ctx->fdiff);
+  }
+  ctx->scg_buf = ALLOC_N(char, scg_bytes(n));
+  ctx->native_bytes += (size_t)scg_bytes(n);
+  ctx->pt_val = nary_dup(ctx->x_val);
+
+  double* x_ptr = (double*)na_get_pointer_for_read_write(ctx->x_val);
+  double* pt_ptr = (double*)na_get_pointer_for_write(ctx->pt_val);
+  scg_init(&scg, n, x_ptr, ctx->scg_buf);
+  scg.max_iter = ctx->max_iter;
+  scg.xtol = ctx->xtol;
+  scg.ftol = ctx->ftol;
+  scg.jtol = ctx->jtol;
+
+  NUMO_OPTIMIZE_PROBE2(solve__start, "scg", n);
+  for (int req = scg_run(&scg); req != SCG_DONE; req = scg_run(&scg)) {
+    if (req == SCG_ITERATE) {
+      /* x is the best point so far since it moves only on the successful steps decreasing the function value. */
+      if (obj->n_fev >= ctx->max_fev) {
+        ctx->task_val = rb_str_new_cstr("STOP: MAX_FEV");
+        break;
+      }
+      if (monotonic_seconds() >= ctx->deadline) {
+        ctx->task_val = rb_str_new_cstr("STOP: TIMEOUT");
+        break;
+      }
+    } else if (req == SCG_NEW_X) {
+      NUMO_OPTIMIZE_PROBE3(new__x, scg.n_iter, NUMO_OPTIMIZE_PROBE_BITS(scg.f), NUMO_OPTIMIZE_PROBE_BITS(sqrt(scg.j_norm)));
+      if (!NIL_P(ctx->callback) && ++n_steps % ctx->callback_every == 0) {
+        double pg_norm = 0.0;
+        for (int64_t i = 0; i < n; i++) {
+          pg_norm = fmax(pg_norm, fabs(scg.j[i]));
+        }
+        if (solve_callback(ctx->callback, ctx->x_val, scg.f, pg_norm, scg.n_iter)) {
+          ctx->task_val = rb_str_new_cstr("STOP: CALLBACK");
+          break;
+        }
+      }
+    } else {
+      /* The gradient by the finite differences costs the calls at the perturbed points, which max_fev caps as well. */
+      int64_t cost = req != SCG_EVAL_G || obj->fdiff != NULL || RB_TYPE_P(obj->jcb, T_TRUE) ? 1 : 0;
+      if (obj->fdiff != NULL && req != SCG_EVAL_F) {
+        cost += fdiff_n_points(ctx->fdiff_method, n);
+      }
+      if (cost > 0 && obj->n_fev > 0 && obj->n_fev + cost > ctx->max_fev) {
+        ctx->task_val = rb_str_new_cstr("STOP: MAX_FEV");
+        break;
+      }
+      VALUE pt_val = ctx->x_val;
+      if (scg.pts != x_ptr) {
+        memcpy(pt_ptr, scg.pts, n * sizeof(double));
+        pt_val = ctx->pt_val;
+      }
+      scg_eval(obj, pt_val, req != SCG_EVAL_G ? &scg.fval : NULL, req != SCG_EVAL_F ? scg.gval : NULL);
+    }
+  }
+  NUMO_OPTIMIZE_PROBE3(solve__done, "scg", scg.n_iter, (int64_t)obj->n_fev);
+
+  size_t shape[1] = { (size_t)n };
+  ctx->j_val = nary_new(numo_cDFloat, 1, shape);
+  memcpy(na_get_pointer_for_write(ctx->j_val), scg.j, n * sizeof(double));
+  ctx->f = scg.f;
+  ctx->n_iter = scg.n_iter;
+  return Qnil;
+}
+
+static VALUE scg_fmin_ensure(VALUE data) {
+  scg_fmin_ctx* ctx = (scg_fmin_ctx*)data;
+  xfree(ctx->scg_buf);
+  xfree(ctx->obj.cache_g);
+  xfree(ctx->cache_buf);
+  ctx->scg_buf = NULL;
+  ctx->obj.cache_g = NULL;
+  ctx->cache_buf = NULL;
+  if (ctx->obj.fdiff != NULL) {
+    fdiff_engine_release(ctx->obj.fdiff);
+  }
+  return Qnil;
+}
+
+static VALUE scg_fmin(VALUE self, VALUE fnc, VALUE x_val, VALUE jcb, VALUE args,
+                      VALUE xtol_val, VALUE ftol_val, VALUE jtol_val, VALUE maxiter, VALUE opts) {
+  scg_fmin_ctx ctx;
+  solve_alloc_mark alloc_mark;
+
+  solve_alloc_mark_start(&alloc_mark);
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.xtol = NUM2DBL(xtol_val);
+  ctx.ftol = NUM2DBL(ftol_val);
+  ctx.jtol = NUM2DBL(jtol_val);
+  ctx.max_iter = NUM2INT(maxiter);
+  ctx.deadline = solve_deadline(NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("timeout"))));
+  ctx.max_fev = solve_max_fev(NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("max_fev"))));
+  ctx.callback = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("callback")));
+  ctx.callback_every = solve_callback_every(NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("every"))));
+  ctx.cache_capacity = solve_cache_capacity(NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("cache"))));
+  ctx.fdiff_method = fdiff_method(jcb);
+  ctx.fdiff_batch = !NIL_P(opts) && RTEST(rb_hash_lookup(opts, ID2SYM(rb_intern("diff_batch"))));
+  ctx.task_val = Qnil;
+  ctx.pt_val = Qnil;
+  ctx.j_val = Qnil;
+
+  if (CLASS_OF(x_val) != numo_cDFloat) {
+    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  }
+  if (!RTEST(nary_check_contiguous(x_val))) {
+    x_val = nary_dup(x_val);
+  }
+  narray_t* x_nary = NULL;
+  GetNArray(x_val, x_nary);
+  ctx.x_val = x_val;
+  ctx.obj.self = self;
+  ctx.obj.fnc = fnc;
+  ctx.obj.jcb = jcb;
+  ctx.obj.args = args;
+  ctx.obj.n = (int64_t)NA_SIZE(x_nary);
+
+  rb_ensure(scg_fmin_loop, (VALUE)&ctx, scg_fmin_ensure, (VALUE)&ctx);
+
+  VALUE ret = rb_hash_new();
+  rb_hash_aset(ret, ID2SYM(rb_intern("task")), ctx.task_val);
+  rb_hash_aset(ret, ID2SYM(rb_intern("x")), ctx.x_val);
+  rb_hash_aset(ret, ID2SYM(rb_intern("fnc")), DBL2NUM(ctx.f));
+  rb_hash_aset(ret, ID2SYM(rb_intern("jcb")), reshape_like(ctx.j_val, ctx.x_val));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), LL2NUM(ctx.n_iter));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), INT2NUM(ctx.obj.n_fev));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_jev")), INT2NUM(ctx.obj.n_jev));
+  rb_hash_aset(ret, ID2SYM(rb_intern("success")), ctx.n_iter < ctx.max_iter && NIL_P(ctx.task_val) ? Qtrue : Qfalse);
+  VALUE stats_val = rb_hash_new();
+  /* The state of the iteration, the cache with its scratch gradient, and the finite differences are the native memory of SCG. */
+  solve_alloc_stats(stats_val, &alloc_mark, ctx.native_bytes);
+  if (ctx.obj.cache != NULL) {
+    rb_hash_aset(stats_val, ID2SYM(rb_intern("cache_hits")), LL2NUM(ctx.cache.hits));
+  }
+  rb_hash_aset(ret, ID2SYM(rb_intern("stats")), stats_val);
+
+  RB_GC_GUARD(fnc);
+  RB_GC_GUARD(jcb);
+  RB_GC_GUARD(args);
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(ctx.callback);
+
+  return ret;
+}
+
+/* Buffers of L-BFGS-B that can be kept between solves of the same size. */
+typedef struct {
+  bool use_int64;
+  int64_t n;
+  int64_t m;
+  double* g;
+  double* wa;
+  void* iwa;
+  void* nbd;
+  double* lu;
+  bool busy;
+} lbfgsb_workspace;
+
+/* Native state of the reverse communication interface of L-BFGS-B. */
+typedef struct {
+  int64_t iprint;
+  char task[60];
+  char csave[60];
+  union {
+    int32_t i32[4];
+    int64_t i64[4];
+  } lsave;
+  union {
+    int32_t i32[44];
+    int64_t i64[44];
+  } isave;
+  double dsave[29];
+} lbfgsb_state;
+
+/* Returns the length of wa for n variables and m corrections. */
+static int64_t lbfgsb_wa_length(int64_t n, int64_t m) {
+  return (2 * m + 5) * n + 12 * m * m + 12 * m;
+}
+
+/* Returns whether the work arrays for n variables and m corrections have to be indexed with 64-bit integers. */
+static bool lbfgsb_needs_int64(int64_t n, int64_t m) {
+#ifdef FORCE_INT64
+  return true;
+#else
+  return lbfgsb_wa_length(n, m) > INT32_MAX;
+#endif
+}
+
+static void lbfgsb_workspace_init(lbfgsb_workspace* ws, int64_t n, int64_t m) {
+  ws->use_int64 = lbfgsb_needs_int64(n, m);
+  ws->n = n;
+  ws->m = m;
+  ws->g = ALLOC_N(double, n);
+  ws->wa = ALLOC_N(double, lbfgsb_wa_length(n, m));
+  if (ws->use_int64) {
+    ws->iwa = ALLOC_N(int64_t, 3 * n);
+  } else {
+    ws->iwa = ALLOC_N(F77_int, 3 * n);
+  }
+  ws->nbd = NULL;
+  ws->lu = NULL;
+  ws->busy = false;
+}
+
+static void lbfgsb_workspace_release(lbfgsb_workspace* ws) {
+  xfree(ws->g);
+  xfree(ws->wa);
+  xfree(ws->iwa);
+  xfree(ws->nbd);
+  xfree(ws->lu);
+  ws->g = NULL;
+  ws->wa = NULL;
+  ws->iwa = NULL;
+  ws->nbd = NULL;
+  ws->lu = NULL;
+}
+
+static size_t lbfgsb_workspace_bytes(const lbfgsb_workspace* ws) {
+  const size_t n = (size_t)ws->n;
+  const size_t int_size = ws->use_int64 ? sizeof(int64_t) : sizeof(F77_int);
+  size_t bytes = (n + (size_t)lbfgsb_wa_length(ws->n, ws->m)) * sizeof(double) + 3 * n * int_size;
+  if (ws->nbd != NULL) bytes += n * int_size;
+  if (ws->lu != NULL) bytes += n * sizeof(double);
+  return bytes;
+}
+
+/**
+ * Returns the upper bound of the native memory in bytes allocated by a solve with n variables and m corrections:
+ * the work arrays, the converted nbd, l and u of an unbounded problem, and the curvature memory if it is returned as the state.
+ */
+static size_t lbfgsb_solve_bytes(int64_t n, int64_t m, bool unbounded, bool return_state) {
+  const size_t int_size = lbfgsb_needs_int64(n, m) ? sizeof(int64_t) : sizeof(F77_int);
+  size_t bytes = (size_t)(n + lbfgsb_wa_length(n, m)) * sizeof(double) + (size_t)(4 * n) * int_size;
+  if (unbounded) bytes += (size_t)n * sizeof(double);
+  if (return_state) bytes += (size_t)(2 * m * n + 2 * m * m) * sizeof(double);
+  return bytes;
+}
+
+/* Returns the nbd buffer of the workspace, which is allocated on the first use and then kept. */
+static void* lbfgsb_workspace_nbd(lbfgsb_workspace* ws) {
+  if (ws->nbd == NULL) {
+    if (ws->use_int64) {
+      ws->nbd = ALLOC_N(int64_t, ws->n);
+    } else {
+      ws->nbd = ALLOC_N(F77_int, ws->n);
+    }
+  }
+  return ws->nbd;
+}
+
+static void lbfgsb_setulb(lbfgsb_workspace* ws, lbfgsb_state* st, double* x, double* l, double* u, void* nbd, double* f,
+                          double* factr, double* pgtol) {
+  if (ws->use_int64) {
+    setulb_i64_(&ws->n, &ws->m, x, l, u, (int64_t*)nbd, f, ws->g, factr, pgtol, ws->wa, (int64_t*)ws->iwa, st->task, &st->iprint,
+                st->csave, st->lsave.i64, st->isave.i64, st->dsave);
+  } else {
+    F77_int n = (F77_int)ws->n;
+    F77_int m = (F77_int)ws->m;
+    F77_int iprint = (F77_int)st->iprint;
+    setulb_(&n, &m, x, l, u, (F77_int*)nbd, f, ws->g, factr, pgtol, ws->wa, (F77_int*)ws->iwa, st->task, &iprint, st->csave,
+            st->lsave.i32, st->isave.i32, st->dsave);
+  }
+}
+
+static void lbfgsb_workspace_free(void* ptr) {
+  lbfgsb_workspace* ws = (lbfgsb_workspace*)ptr;
+  lbfgsb_workspace_release(ws);
+  ruby_xfree(ws);
+}
+
+static size_t lbfgsb_workspace_size(const void* ptr) {
+  const lbfgsb_workspace* ws = (const lbfgsb_workspace*)ptr;
+  return sizeof(*ws) + (ws->g != NULL ? lbfgsb_workspace_bytes(ws) : 0);
+}
+
+static const rb_data_type_t lbfgsb_workspace_type = {
+  "Numo::Optimize::Lbfgsb::Workspace",
+  {
+    NULL,
+    lbfgsb_workspace_free,
+    lbfgsb_workspace_size,
+  },
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static VALUE lbfgsb_workspace_alloc(VALUE klass) {
+  lbfgsb_workspace* ws = ALLOC(lbfgsb_workspace);
+  memset(ws, 0, sizeof(*ws));
+  return TypedData_Wrap_Struct(klass, &lbfgsb_workspace_type, ws);
+}
+
+static lbfgsb_workspace* get_lbfgsb_workspace(VALUE self) {
+  lbfgsb_workspace* ws = NULL;
+  TypedData_Get_Struct(self, lbfgsb_workspace, &lbfgsb_workspace_type, ws);
+  if (ws->g == NULL) {
+    rb_raise(rb_eRuntimeError, "The workspace is not initialized.");
+  }
+  return ws;
+}
+
+static VALUE lbfgsb_workspace_initialize(VALUE self, VALUE n_val, VALUE maxcor) {
+  lbfgsb_workspace* ws = NULL;
+  TypedData_Get_Struct(self, lbfgsb_workspace, &lbfgsb_workspace_type, ws);
+  const int64_t n = NUM2LL(n_val);
+  const int64_t m = NUM2LL(maxcor);
+  if (n <= 0) {
+    rb_raise(rb_eArgError, "n must be a positive integer.");
+  }
+  if (m <= 0) {
+    rb_raise(rb_eArgError, "maxcor must be a positive integer.");
+  }
+  if (ws->busy) {
+    rb_raise(rb_eRuntimeError, "The workspace is being used by another solve.");
+  }
+  lbfgsb_workspace_release(ws);
+  lbfgsb_workspace_init(ws, n, m);
+  return self;
+}
+
+static VALUE lbfgsb_workspace_get_n(VALUE self) {
+  return LL2NUM(get_lbfgsb_workspace(self)->n);
+}
+
+static VALUE lbfgsb_workspace_get_maxcor(VALUE self) {
+  return LL2NUM(get_lbfgsb_workspace(self)->m);
+}
+
+static VALUE lbfgsb_workspace_get_bytesize(VALUE self) {
+  return SIZET2NUM(lbfgsb_workspace_bytes(get_lbfgsb_workspace(self)));
+}
+
+/* Returns the element of isave in the solver width; idx is the 0-based index of isave in setulb. */
+static int64_t lbfgsb_isave_get(const lbfgsb_workspace* ws, const lbfgsb_state* st, int idx) {
+  return ws->use_int64 ? st->isave.i64[idx] : st->isave.i32[idx];
+}
+
+static void lbfgsb_isave_set(const lbfgsb_workspace* ws, lbfgsb_state* st, int idx, int64_t val) {
+  if (ws->use_int64) {
+    st->isave.i64[idx] = val;
+  } else {
+    st->isave.i32[idx] = (int32_t)val;
+  }
+}
+
+static void lbfgsb_lsave_set(const lbfgsb_workspace* ws, lbfgsb_state* st, int idx, int64_t val) {
+  if (ws->use_int64) {
+    st->lsave.i64[idx] = val;
+  } else {
+    st->lsave.i32[idx] = (int32_t)val;
+  }
+}
+
+/* Curvature memory of L-BFGS-B with the correction pairs stored from the oldest one. */
+typedef struct {
+  int64_t n;
+  int64_t col;
+  double theta;
+  double* s;
+  double* y;
+  double* sy;
+  double* ss;
+} lbfgsb_memory;
+
+static void lbfgsb_memory_free(void* ptr) {
+  lbfgsb_memory* mem = (lbfgsb_memory*)ptr;
+  xfree(mem->s);
+  ruby_xfree(mem);
+}
+
+static size_t lbfgsb_memory_size(const void* ptr) {
+  const lbfgsb_memory* mem = (const lbfgsb_memory*)ptr;
+  return sizeof(*mem) + (size_t)(2 * mem->col * mem->n + 2 * mem->col * mem->col) * sizeof(double);
+}
+
+static const rb_data_type_t lbfgsb_memory_type = {
+  "Numo::Optimize::Lbfgsb::State",
+  {
+    NULL,
+    lbfgsb_memory_free,
+    lbfgsb_memory_size,
+  },
+  NULL,
+  NULL,
+  RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static lbfgsb_memory* get_lbfgsb_memory(VALUE self) {
+  lbfgsb_memory* mem = NULL;
+  TypedData_Get_Struct(self, lbfgsb_memory, &lbfgsb_memory_type, mem);
+  return mem;
+}
+
+/* Copies the curvature memory kept in the work arrays after a solve into a new Numo::Optimize::Lbfgsb::State. */
+static VALUE lbfgsb_memory_export(const lbfgsb_workspace* ws, const lbfgsb_state* st) {
+  const int64_t n = ws->n;
+  const int64_t m = ws->m;
+  /* isave[26], isave[27] and dsave[0] hold head, col and theta saved by mainlb. */
+  const int64_t head = lbfgsb_isave_get(ws, st, 26);
+  const int64_t col = lbfgsb_isave_get(ws, st, 27);
+  lbfgsb_memory* mem = ALLOC(lbfgsb_memory);
+  memset(mem, 0, sizeof(*mem));
+  VALUE mem_val = TypedData_Wrap_Struct(rb_cLbfgsbState, &lbfgsb_memory_type, mem);
+  mem->n = n;
+  mem->col = col;
+  mem->theta = st->dsave[0];
+  if (col <= 0) {
+    mem->col = 0;
+    mem->theta = 1.0;
+    return mem_val;
+  }
+
+  /* ws, wy, sy and ss are the first segments of wa; ws and wy are ring buffers starting at head. */
+  const double* ws_ptr = ws->wa;
+  const double* wy_ptr = ws->wa + m * n;
+  const double* sy_ptr = ws->wa + 2 * m * n;
+  const double* ss_ptr = sy_ptr + m * m;
+  mem->s = ALLOC_N(double, 2 * col * n + 2 * col * col);
+  mem->y = mem->s + col * n;
+  mem->sy = mem->y + col * n;
+  mem->ss = mem->sy + col * col;
+  for (int64_t j = 0; j < col; j++) {
+    const int64_t p = (head - 1 + j) % m;
+    memcpy(mem->s + j * n, ws_ptr + p * n, n * sizeof(double));
+    memcpy(mem->y + j * n, wy_ptr + p * n, n * sizeof(double));
+    for (int64_t i = 0; i < col; i++) {
+      mem->sy[j * col + i] = sy_ptr[j * m + i];
+      mem->ss[j * col + i] = ss_ptr[j * m + i];
+    }
+  }
+  return mem_val;
+}
+
+/**
+ * Seeds the work arrays with the curvature memory after setulb returned with task = FG_START.
+ * If the memory has more corrections than the workspace can hold, the newest ones are used.
+ */
+static void lbfgsb_memory_seed(lbfgsb_workspace* ws, lbfgsb_state* st, const lbfgsb_memory* mem) {
+  const int64_t n = ws->n;
+  const int64_t m = ws->m;
+  const int64_t col = mem->col < m ? mem->col : m;
+  const int64_t off = mem->col - col;
+  if (col <= 0) return;
+
+  double* ws_ptr = ws->wa;
+  double* wy_ptr = ws->wa + m * n;
+  double* sy_ptr = ws->wa + 2 * m * n;
+  double* ss_ptr = sy_ptr + m * m;
+  for (int64_t j = 0; j < col; j++) {
+    memcpy(ws_ptr + j * n, mem->s + (off + j) * n, n * sizeof(double));
+    memcpy(wy_ptr + j * n, mem->y + (off + j) * n, n * sizeof(double));
+    for (int64_t i = 0; i < col; i++) {
+      sy_ptr[j * m + i] = mem->sy[(off + j) * mem->col + off + i];
+      ss_ptr[j * m + i] = mem->ss[(off + j) * mem->col + off + i];
+    }
+  }
+  /* See the description of isave and dsave in setulb. */
+  lbfgsb_isave_set(ws, st, 22, 1);
+  lbfgsb_isave_set(ws, st, 26, 1);
+  lbfgsb_isave_set(ws, st, 27, col);
+  lbfgsb_isave_set(ws, st, 28, col);
+  lbfgsb_isave_set(ws, st, 30, col);
+  lbfgsb_lsave_set(ws, st, 3, 1);
+  st->dsave[0] = mem->theta;
+}
+
+static VALUE lbfgsb_memory_get_n(VALUE self) {
+  return LL2NUM(get_lbfgsb_memory(self)->n);
+}
+
+static VALUE lbfgsb_memory_get_size(VALUE self) {
+  return LL2NUM(get_lbfgsb_memory(self)->col);
+}
+
+/* Per-iteration records of L-BFGS-B kept in native arrays that grow by doubling. */
+typedef struct {
+  int64_t size;
+  int64_t capacity;
+  double* f;
+  double* sbgnrm;
+  double* stp;
+  int32_t* n_fev;
+  int32_t* nact;
+  int32_t* nseg;
+  int32_t* nskip;
+} lbfgsb_trace;
+
+static void lbfgsb_trace_reserve(lbfgsb_trace* tr, int64_t capacity) {
+  REALLOC_N(tr->f, double, capacity);
+  REALLOC_N(tr->sbgnrm, double, capacity);
+  REALLOC_N(tr->stp, double, capacity);
+  REALLOC_N(tr->n_fev, int32_t, capacity);
+  REALLOC_N(tr->nact, int32_t, capacity);
+  REALLOC_N(tr->nseg, int32_t, capacity);
+  REALLOC_N(tr->nskip, int32_t, capacity);
+  tr->capacity = capacity;
+}
+
+static void lbfgsb_trace_release(lbfgsb_trace* tr) {
+  xfree(tr->f);
+  xfree(tr->sbgnrm);
+  xfree(tr->stp);
+  xfree(tr->n_fev);
+  xfree(tr->nact);
+  xfree(tr->nseg);
+  xfree(tr->nskip);
+  memset(tr, 0, sizeof(*tr));
+}
+
+/* Returns the column of the trace as a new Numo::DFloat or Numo::Int32. */
+static VALUE lbfgsb_trace_column(VALUE klass, const void* ptr, size_t elem_size, int64_t size) {
+  size_t shape[1] = { (size_t)size };
+  VALUE col_val = nary_new(klass, 1, shape);
+  if (size > 0) {
+    memcpy(na_get_pointer_for_write(col_val), ptr, (size_t)size * elem_size);
+  }
+  return col_val;
+}
+
+#define LBFGSB_LOG_FLUSH_BYTES 8192
+
+/**
+ * Sink of the diagnostics of L-BFGS-B given by the log option.
+ * The text is written to a file opened once for the solve with full buffering, or collected in a string that is
+ * written to the Ruby IO in chunks. In the JSON lines format, each line of the text becomes a message event.
+ */
+typedef struct {
+  solver_log_sink sink;
+  bool json;
+  VALUE io;
+  VALUE io_buf;
+  FILE* fp;
+  char* line;
+  size_t line_len;
+  size_t line_cap;
+  int line_stream;
+} lbfgsb_log;
+
+static void lbfgsb_log_put(lbfgsb_log* log, const char* text, size_t len) {
+  if (log->fp != NULL) {
+    fwrite(text, 1, len, log->fp);
+  } else if (!NIL_P(log->io)) {
+    rb_str_cat(log->io_buf, text, (long)len);
+  }
+}
+
+static void lbfgsb_log_puts(lbfgsb_log* log, const char* text) {
+  lbfgsb_log_put(log, text, strlen(text));
+}
+
+/* Writes the text as a JSON string; the text of the solvers is ASCII, so only the quotes and controls are escaped. */
+static void lbfgsb_log_put_json_string(lbfgsb_log* log, const char* text, size_t len) {
+  char esc[8];
+  size_t begin = 0;
+  lbfgsb_log_puts(log, "\"");
+  for (size_t i = 0; i < len; i++) {
+    const unsigned char c = (unsigned char)text[i];
+    if (c != '"' && c != '\\' && c >= 0x20) continue;
+    lbfgsb_log_put(log, text + begin, i - begin);
+    if (c == '"' || c == '\\') {
+      snprintf(esc, sizeof(esc), "\\%c", c);
+    } else {
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+    }
+    lbfgsb_log_puts(log, esc);
+    begin = i + 1;
+  }
+  lbfgsb_log_put(log, text + begin, len - begin);
+  lbfgsb_log_puts(log, "\"");
+}
+
+static void lbfgsb_log_put_json_line(lbfgsb_log* log, int stream, const char* text, size_t len) {
+  static const char* const stream_names[] = { "console", "iterate", "warning" };
+  size_t n_spaces = 0;
+  while (n_spaces < len && text[n_spaces] == ' ') n_spaces++;
+  if (n_spaces == len) return;
+  lbfgsb_log_puts(log, "{\"event\":\"message\",\"stream\":\"");
+  lbfgsb_log_puts(log, stream_names[stream]);
+  lbfgsb_log_puts(log, "\",\"text\":");
+  lbfgsb_log_put_json_string(log, text + n_spaces, len - n_spaces);
+  lbfgsb_log_puts(log, "}\n");
+}
+
+static void lbfgsb_log_write(void* data, int stream, const char* text, size_t len) {
+  lbfgsb_log* log = (lbfgsb_log*)data;
+  if (log->fp == NULL && NIL_P(log->io)) {
+    return;
+  }
+  if (!log->json) {
+    lbfgsb_log_put(log, text, len);
+    return;
+  }
+  /* The messages are printed in pieces, so they are joined into lines before being written as events. */
+  for (size_t i = 0; i < len; i++) {
+    if (text[i] == '\n') {
+      lbfgsb_log_put_json_line(log, log->line_stream, log->line, log->line_len);
+      log->line_len = 0;
+      continue;
+    }
+    if (log->line_len == 0) {
+      log->line_stream = stream;
+    }
+    if (log->line_len == log->line_cap) {
+      log->line_cap = log->line_cap == 0 ? 128 : 2 * log->line_cap;
+      REALLOC_N(log->line, char, log->line_cap);
+    }
+    log->line[log->line_len++] = text[i];
+  }
+}
+
+/* Writes the structured record of the iteration that has just finished in the JSON lines format. */
+static void lbfgsb_log_put_iteration(lbfgsb_log* log, int64_t n_iter, int64_t n_fev, double f, double sbgnrm, double stp,
+                                     int64_t nact, int64_t nseg, int64_t nskip) {
+  char buf[320];
+  const double vals[3] = { f, sbgnrm, stp };
+  char nums[3][32];
+  for (int i = 0; i < 3; i++) {
+    /* JSON has no representation of inf and nan. */
+    if (isfinite(vals[i])) {
+      snprintf(nums[i], sizeof(nums[i]), "%.17g", vals[i]);
+    } else {
+      strcpy(nums[i], "null");
+    }
+  }
+  const int len = snprintf(buf, sizeof(buf),
+                           "{\"event\":\"iteration\",\"n_iter\":%" PRId64 ",\"n_fev\":%" PRId64 ",\"f\":%s,\"sbgnrm\":%s,\"stp\":%s,"
+                           "\"nact\":%" PRId64 ",\"nseg\":%" PRId64 ",\"nskip\":%" PRId64 "}\n",
+                           n_iter, n_fev, nums[0], nums[1], nums[2], nact, nseg, nskip);
+  lbfgsb_log_put(log, buf, (size_t)len);
+}
+
+/* Passes the collected text to the Ruby IO; the file is left to the buffering of stdio until it is closed. */
+static void lbfgsb_log_flush(lbfgsb_log* log, size_t min_bytes) {
+  if (NIL_P(log->io) || (size_t)RSTRING_LEN(log->io_buf) < min_bytes || RSTRING_LEN(log->io_buf) == 0) {
+    return;
+  }
+  VALUE buf = log->io_buf;
+  log->io_buf = rb_str_buf_new(LBFGSB_LOG_FLUSH_BYTES);
+  rb_io_write(log->io, buf);
+}
+
+/* Sets up the sink for the log option given as nil, false, IO, path, or { to:, format: }. */
+static void lbfgsb_log_open(lbfgsb_log* log, VALUE log_val) {
+  VALUE to_val = log_val;
+  VALUE format_val = Qnil;
+
+  memset(log, 0, sizeof(*log));
+  log->io = Qnil;
+  log->io_buf = Qnil;
+  if (NIL_P(log_val)) {
+    return;
+  }
+  log->sink.write = lbfgsb_log_write;
+  log->sink.data = log;
+  if (RB_TYPE_P(log_val, T_HASH)) {
+    to_val = rb_hash_lookup(log_val, ID2SYM(rb_intern("to")));
+    format_val = rb_hash_lookup(log_val, ID2SYM(rb_intern("format")));
+  }
+  if (!NIL_P(format_val)) {
+    if (format_val == ID2SYM(rb_intern("json"))) {
+      log->json = true;
+    } else if (format_val != ID2SYM(rb_intern("text"))) {
+      rb_raise(rb_eArgError, "format of log must be :text or :json.");
+    }
+  }
+  if (!RTEST(to_val)) {
+    /* The diagnostics are discarded. */
+    return;
+  }
+  if (rb_respond_to(to_val, rb_intern("write"))) {
+    log->io = to_val;
+    log->io_buf = rb_str_buf_new(LBFGSB_LOG_FLUSH_BYTES);
+    return;
+  }
+  VALUE path_val = rb_get_path(to_val);
+  log->fp = fopen(StringValueCStr(path_val), "w");
+  if (log->fp == NULL) {
+    rb_sys_fail(StringValueCStr(path_val));
+  }
+  setvbuf(log->fp, NULL, _IOFBF, 1 << 16);
+}
+
+/* Writes out the rest of the text and closes the file; errors are raised only when raise_error is true. */
+static void lbfgsb_log_close(lbfgsb_log* log, bool raise_error) {
+  if (raise_error && log->json && log->line_len > 0) {
+    lbfgsb_log_put_json_line(log, log->line_stream, log->line, log->line_len);
+    log->line_len = 0;
+  }
+  if (raise_error) {
+    lbfgsb_log_flush(log, 0);
+  }
+  if (log->fp != NULL) {
+    const bool ok = fclose(log->fp) == 0;
+    log->fp = NULL;
+    if (!ok && raise_error) {
+      rb_sys_fail("log");
+    }
+  }
+  xfree(log->line);
+  log->line = NULL;
+  log->line_len = 0;
+  log->line_cap = 0;
+}
+
+/* Arguments and results of a L-BFGS-B solve passed through rb_ensure. */
+typedef struct {
+  VALUE self;
+  VALUE fnc;
+  VALUE x_val;
+  VALUE jcb;
+  VALUE args;
+  VALUE g_val;
+  int64_t max_iter;
+  double factr;
+  double pgtol;
+  double* x_ptr;
+  double* l_ptr;
+  double* u_ptr;
+  void* nbd_ptr;
+  lbfgsb_workspace* ws;
+  bool own_ws;
+  const lbfgsb_memory* warm_start;
+  bool return_state;
+  VALUE state_val;
+  VALUE ckpt_path;
+  VALUE ckpt_tmp_path;
+  int64_t ckpt_every;
+  FILE* resume_fp;
+  VALUE resume_path;
+  lbfgsb_state st;
+  double f;
+  int64_t n_iter;
+  int64_t n_fev;
+  int64_t n_jev;
+  size_t workspace_bytes;
+  size_t peak_native_bytes_estimate;
+  double deadline;
+  int64_t max_fev;
+  /* The best point evaluated so far, which is kept only when timeout or max_fev is given. */
+  double* best_x;
+  double* best_g;
+  double best_f;
+  bool has_best;
+  VALUE callback;
+  int64_t callback_every;
+  bool use_trace;
+  lbfgsb_trace trace;
+  VALUE trace_val;
+  VALUE log_val;
+  lbfgsb_log log;
+  const solver_log_sink* prev_sink;
+  /* Seconds on the monotonic clock spent in the Ruby methods, in the conversion and copy of arrays, and in setulb. */
+  double time_start;
+  double time_callback;
+  double time_copy;
+  double time_solver;
+  VALUE stats_val;
+  /* The native objective called instead of fnc and jcb, or NULL. */
+  const native_objective* native;
+  solve_alloc_mark alloc_mark;
+  size_t native_bytes;
+  /* LNSRCH_MORE_THUENTE, LNSRCH_HAGER_ZHANG, LNSRCH_ARMIJO, LNSRCH_NONMONOTONE, or LNSRCH_SPECULATIVE. */
+  int line_search;
+  /* The candidates of the speculative line search, of which the points and gradients are rows of n elements,
+     and the method evaluating them at once or the threads evaluating them with the native objective. */
+  VALUE batch_fnc;
+  double* spec_x;
+  double* spec_g;
+  double spec_f[LNSRCH_BATCH_SIZE];
+  worker_pool* spec_pool;
+  /* The cache of the evaluations, of which the buffer is NULL unless the cache option is given. */
+  int64_t cache_capacity;
+  eval_cache cache;
+  void* cache_buf;
+  /* The finite differences of jcb = :forward_diff or :central_diff, of which the method is 0 otherwise. */
+  fdiff_engine fdiff;
+  int fdiff_threads;
+} lbfgsb_fmin_ctx;
+
+#define LBFGSB_CHECKPOINT_MAGIC "NMOPTLBB"
+#define LBFGSB_CHECKPOINT_VERSION 1
+#define LBFGSB_CHECKPOINT_BYTE_ORDER 0x01020304
+
+/**
+ * Header of the checkpoint file of L-BFGS-B. The header is followed by task, csave, lsave, isave, dsave,
+ * x, g, wa, and iwa, which are written as they are in memory with the native byte order.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  int64_t n;
+  int64_t m;
+  int64_t int_size;
+  int64_t n_iter;
+  int64_t n_fev;
+  int64_t n_jev;
+  double f;
+} lbfgsb_checkpoint_header;
+
+/* Writes or reads the solver state following the header; returns false if any of the blocks is not transferred. */
+static bool lbfgsb_checkpoint_transfer(lbfgsb_fmin_ctx* ctx, FILE* fp, bool write) {
+  lbfgsb_workspace* ws = ctx->ws;
+  lbfgsb_state* st = &ctx->st;
+  const size_t n = (size_t)ws->n;
+  const size_t int_size = ws->use_int64 ? sizeof(int64_t) : sizeof(int32_t);
+  struct {
+    void* ptr;
+    size_t size;
+  } blocks[] = {
+    { st->task, sizeof(st->task) },
+    { st->csave, sizeof(st->csave) },
+    { &st->lsave, 4 * int_size },
+    { &st->isave, 44 * int_size },
+    { st->dsave, sizeof(st->dsave) },
+    { ctx->x_ptr, n * sizeof(double) },
+    { ws->g, n * sizeof(double) },
+    { ws->wa, (size_t)lbfgsb_wa_length(ws->n, ws->m) * sizeof(double) },
+    { ws->iwa, 3 * n * int_size },
+  };
+  for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+    const size_t ret = write ? fwrite(blocks[i].ptr, 1, blocks[i].size, fp) : fread(blocks[i].ptr, 1, blocks[i].size, fp);
+    if (ret != blocks[i].size) return false;
+  }
+  return true;
+}
+
+/* Writes the checkpoint to the temporary file and then renames it so that the checkpoint file is always complete. */
+static void lbfgsb_checkpoint_write(lbfgsb_fmin_ctx* ctx) {
+  const char* path = StringValueCStr(ctx->ckpt_path);
+  const char* tmp_path = StringValueCStr(ctx->ckpt_tmp_path);
+  lbfgsb_checkpoint_header hdr;
+  FILE* fp = fopen(tmp_path, "wb");
+  if (fp == NULL) {
+    rb_sys_fail(tmp_path);
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, LBFGSB_CHECKPOINT_MAGIC, sizeof(hdr.magic));
+  hdr.version = LBFGSB_CHECKPOINT_VERSION;
+  hdr.byte_order = LBFGSB_CHECKPOINT_BYTE_ORDER;
+  hdr.n = ctx->ws->n;
+  hdr.m = ctx->ws->m;
+  hdr.int_size = ctx->ws->use_int64 ? sizeof(int64_t) : sizeof(int32_t);
+  hdr.n_iter = ctx->n_iter;
+  hdr.n_fev = ctx->n_fev;
+  hdr.n_jev = ctx->n_jev;
+  hdr.f = ctx->f;
+
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 && lbfgsb_checkpoint_transfer(ctx, fp, true);
+  ok = fflush(fp) == 0 && ok;
+#ifdef HAVE_FSYNC
+  ok = fsync(fileno(fp)) == 0 && ok;
+#endif
+  const int err = errno;
+  ok = fclose(fp) == 0 && ok;
+  if (!ok) {
+    remove(tmp_path);
+    errno = err;
+    rb_sys_fail(tmp_path);
+  }
+  if (rename(tmp_path, path) != 0) {
+    rb_sys_fail(path);
+  }
+}
+
+/* Opens the checkpoint file and reads its header; the solver state is read by lbfgsb_checkpoint_transfer. */
+static FILE* lbfgsb_checkpoint_open(VALUE path_val, lbfgsb_checkpoint_header* hdr) {
+  const char* path = StringValueCStr(path_val);
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    rb_sys_fail(path);
+  }
+  const bool ok = fread(hdr, sizeof(*hdr), 1, fp) == 1 &&
+                  memcmp(hdr->magic, LBFGSB_CHECKPOINT_MAGIC, sizeof(hdr->magic)) == 0 &&
+                  hdr->version == LBFGSB_CHECKPOINT_VERSION && hdr->byte_order == LBFGSB_CHECKPOINT_BYTE_ORDER &&
+                  hdr->n > 0 && hdr->m > 0;
+  if (!ok) {
+    fclose(fp);
+    rb_raise(rb_eIOError, "%s is not a checkpoint file of this version of L-BFGS-B.", path);
+  }
+  if (hdr->int_size != (lbfgsb_needs_int64(hdr->n, hdr->m) ? 8 : 4)) {
+    fclose(fp);
+    rb_raise(rb_eIOError, "%s was written with a different integer width of L-BFGS-B.", path);
+  }
+  return fp;
+}
+
+/* Replaces x, f, and g with the best point evaluated so far, e.g. a trial point of the line search may be the last one. */
+static void lbfgsb_fmin_restore_best(lbfgsb_fmin_ctx* ctx) {
+  const int64_t n = ctx->ws->n;
+  if (!ctx->has_best) {
+    return;
+  }
+  memcpy(ctx->x_ptr, ctx->best_x, n * sizeof(double));
+  ctx->f = ctx->best_f;
+  size_t shape[1] = { (size_t)n };
+  ctx->g_val = nary_new(numo_cDFloat, 1, shape);
+  memcpy(na_get_pointer_for_write(ctx->g_val), ctx->best_g, n * sizeof(double));
+}
+
+static void lbfgsb_fmin_speculate_task(void* arg, int64_t task, int worker) {
+  lbfgsb_fmin_ctx* ctx = (lbfgsb_fmin_ctx*)arg;
+  const int64_t n = ctx->ws->n;
+  ctx->spec_f[task] = ctx->native->fg(n, ctx->spec_x + task * n, ctx->spec_g + task * n, ctx->native->data);
+}
+
+/**
+ * Evaluates f and g at the candidate steps of the speculative line search after the return with task = FG_LNSRCH_BATCH,
+ * and writes f and g'd of each candidate to the state read by lnsrlb. The candidates beyond max_fev are dropped,
+ * and false is returned without evaluating anything if not even the first one fits in max_fev.
+ */
+static bool lbfgsb_fmin_speculate(lbfgsb_fmin_ctx* ctx) {
+  lbfgsb_workspace* ws = ctx->ws;
+  lbfgsb_state* st = &ctx->st;
+  const int64_t n = ws->n;
+  /* dsave[16] starts the state of the line search, and isave[12] and isave[13] hold the offsets of d and t in wa. */
+  double* ls = st->dsave + 16;
+  const double* d = ws->wa + lbfgsb_isave_get(ws, st, 12) - 1;
+  const double* t = ws->wa + lbfgsb_isave_get(ws, st, 13) - 1;
+  /* Each candidate costs the evaluations of its gradient by the finite differences, which max_fev caps as well. */
+  const int64_t cost = ctx->fdiff.method != 0 ? 1 + fdiff_n_points(ctx->fdiff.method, n) : 1;
+  int64_t k = 0;
+  while (k < LNSRCH_BATCH_SIZE && ls[LNSRCH_BATCH_STP + k] > 0.0 && ctx->n_fev + (k + 1) * cost <= ctx->max_fev) {
+    for (int64_t i = 0; i < n; i++) {
+      ctx->spec_x[k * n + i] = ls[LNSRCH_BATCH_STP + k] * d[i] + t[i];
+    }
+    k++;
+  }
+  if (k == 0) {
+    return false;
+  }
+  for (int64_t p = k; p < LNSRCH_BATCH_SIZE; p++) {
+    ls[LNSRCH_BATCH_STP + p] = 0.0;
+  }
+
+  double t_start = monotonic_seconds();
+  const int64_t n_evals = ctx->fdiff.n_evals;
+  if (ctx->fdiff.method != 0) {
+    for (int64_t p = 0; p < k; p++) {
+      ctx->spec_f[p] = fdiff_engine_fg(&ctx->fdiff, ctx->spec_x + p * n, ctx->spec_g + p * n);
+    }
+  } else if (ctx->native != NULL) {
+    if (ctx->spec_pool != NULL && k > 1) {
+      worker_pool_run(ctx->spec_pool, k, lbfgsb_fmin_speculate_task, ctx);
+    } else {
+      for (int64_t p = 0; p < k; p++) lbfgsb_fmin_speculate_task(ctx, p, 0);
+    }
+  } else if (!NIL_P(ctx->batch_fnc)) {
+    size_t shape[2] = { (size_t)k, (size_t)n };
+    VALUE pts_val = nary_new(numo_cDFloat, 2, shape);
+    memcpy(na_get_pointer_for_write(pts_val), ctx->spec_x, k * n * sizeof(double));
+    VALUE fg_arr = rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->batch_fnc, pts_val, ctx->args);
+    VALUE f_val = rb_ary_entry(fg_arr, 0);
+    VALUE g_val = jcb_to_dfloat(rb_ary_entry(fg_arr, 1), k * n);
+    if (CLASS_OF(f_val) != numo_cDFloat) {
+      f_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, f_val);
+    }
+    if (!RTEST(nary_check_contiguous(f_val))) {
+      f_val = nary_dup(f_val);
+    }
+    narray_t* f_nary = NULL;
+    GetNArray(f_val, f_nary);
+    if ((int64_t)NA_SIZE(f_nary) != k) {
+      rb_raise(rb_eArgError, "The size of batch_fnc must be equal to the number of rows of x.");
+    }
+    memcpy(ctx->spec_f, na_get_pointer_for_read(f_val), k * sizeof(double));
+    memcpy(ctx->spec_g, na_get_pointer_for_read(g_val), k * n * sizeof(double));
+    RB_GC_GUARD(pts_val);
+    RB_GC_GUARD(f_val);
+    RB_GC_GUARD(g_val);
+  } else {
+    /* Without batch_fnc, the candidates are evaluated one by one at x, which lnsrlb sets again on the next call. */
+    for (int64_t p = 0; p < k; p++) {
+      memcpy(ctx->x_ptr, ctx->spec_x + p * n, n * sizeof(double));
+      VALUE g_val;
+      if (RB_TYPE_P(ctx->jcb, T_TRUE)) {
+        VALUE fg_arr = rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, ctx->x_val, ctx->args);
+        ctx->spec_f[p] = NUM2DBL(rb_ary_entry(fg_arr, 0));
+        g_val = rb_ary_entry(fg_arr, 1);
+      } else {
+        ctx->spec_f[p] = NUM2DBL(rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, ctx->x_val, ctx->args));
+        g_val = rb_funcall(ctx->self, rb_intern("jcb"), 3, ctx->jcb, ctx->x_val, ctx->args);
+      }
+      g_val = jcb_to_dfloat(g_val, n);
+      memcpy(ctx->spec_g + p * n, na_get_pointer_for_read(g_val), n * sizeof(double));
+      RB_GC_GUARD(g_val);
+    }
+  }
+  ctx->n_fev += ctx->fdiff.method != 0 ? ctx->fdiff.n_evals - n_evals : k;
+  ctx->n_jev += k;
+  const double t_end = monotonic_seconds();
+  ctx->time_callback += t_end - t_start;
+  NUMO_OPTIMIZE_PROBE2(fg__eval, n, (int64_t)((t_end - t_start) * 1e9));
+
+  for (int64_t p = 0; p < k; p++) {
+    const double* g = ctx->spec_g + p * n;
+    double gd = 0.0;
+    for (int64_t i = 0; i < n; i++) gd += g[i] * d[i];
+    ls[LNSRCH_BATCH_F + p] = ctx->spec_f[p];
+    ls[LNSRCH_BATCH_GD + p] = gd;
+    if (ctx->best_x != NULL && (!ctx->has_best || ctx->spec_f[p] < ctx->best_f)) {
+      memcpy(ctx->best_x, ctx->spec_x + p * n, n * sizeof(double));
+      memcpy(ctx->best_g, g, n * sizeof(double));
+      ctx->best_f = ctx->spec_f[p];
+      ctx->has_best = true;
+    }
+    if (ctx->cache_buf != NULL) {
+      eval_cache_put(&ctx->cache, ctx->spec_x + p * n, &ctx->spec_f[p], g);
+    }
+  }
+  ctx->time_copy += monotonic_seconds() - t_end;
+  return true;
+}
+
+/* Sets x, f, and g to the candidate accepted by lnsrlb after the return with task = FG_LNSRCH_PICK. */
+static void lbfgsb_fmin_pick(lbfgsb_fmin_ctx* ctx) {
+  const int64_t n = ctx->ws->n;
+  const int64_t p = (int64_t)ctx->st.dsave[16 + LNSRCH_BATCH_PICK];
+  memcpy(ctx->x_ptr, ctx->spec_x + p * n, n * sizeof(double));
+  memcpy(ctx->ws->g, ctx->spec_g + p * n, n * sizeof(double));
+  ctx->f = ctx->spec_f[p];
+  ctx->g_val = Qnil;
+}
+
+static VALUE lbfgsb_fmin_loop(VALUE data) {
+  lbfgsb_fmin_ctx* ctx = (lbfgsb_fmin_ctx*)data;
+  lbfgsb_state* st = &ctx->st;
+  const int64_t n = ctx->ws->n;
+  VALUE fg_arr;
+
+  ctx->g_val = Qnil;
+  lbfgsb_log_open(&ctx->log, ctx->log_val);
+  if (ctx->max_fev < INT64_MAX || ctx->deadline < HUGE_VAL) {
+    ctx->best_x = ALLOC_N(double, n);
+    ctx->best_g = ALLOC_N(double, n);
+    ctx->native_bytes += 2 * (size_t)n * sizeof(double);
+  }
+  ctx->cache_buf = solve_cache_init(&ctx->cache, n, ctx->cache_capacity);
+  if (ctx->cache_buf != NULL) {
+    ctx->native_bytes += (size_t)eval_cache_bytes(n, ctx->cache_capacity);
+  }
+  if (ctx->line_search == LNSRCH_SPECULATIVE) {
+    ctx->spec_x = ALLOC_N(double, LNSRCH_BATCH_SIZE * n);
+    ctx->spec_g = ALLOC_N(double, LNSRCH_BATCH_SIZE * n);
+    ctx->native_bytes += 2 * LNSRCH_BATCH_SIZE * (size_t)n * sizeof(double);
+    if (ctx->native != NULL && ctx->fdiff.method == 0) {
+      /* The candidates are evaluated serially if the threads are not available. */
+      ctx->spec_pool = worker_pool_create(LNSRCH_BATCH_SIZE);
+    }
+  }
+  if (ctx->fdiff.method != 0) {
+    fdiff_engine_init(&ctx->fdiff, ctx->fdiff.method, ctx->self, ctx->fnc, ctx->x_val, ctx->args, ctx->native,
+                      ctx->fdiff.batch, ctx->fdiff_threads);
+    if (ctx->l_ptr != ctx->ws->lu) {
+      fdiff_engine_bounds(&ctx->fdiff, ctx->l_ptr, ctx->u_ptr, ctx->nbd_ptr, ctx->ws->use_int64);
+    }
+    ctx->native_bytes += fdiff_engine_bytes(&ctx->fdiff);
+  }
+  if (ctx->resume_fp != NULL) {
+    /* Continue from the state at the return with task = NEW_X. */
+    const bool ok = lbfgsb_checkpoint_transfer(ctx, ctx->resume_fp, false);
+    fclose(ctx->resume_fp);
+    ctx->resume_fp = NULL;
+    if (!ok) {
+      rb_raise(rb_eIOError, "%s is truncated.", StringValueCStr(ctx->resume_path));
+    }
+  } else {
+    ctx->f = 0.0;
+    memset(ctx->ws->g, 0, n * sizeof(*ctx->ws->g));
+    memset(&st->lsave, 0, sizeof(st->lsave));
+    memset(&st->isave, 0, sizeof(st->isave));
+    memset(st->dsave, 0, sizeof(st->dsave));
+    strcpy(st->task, "START");
+    ctx->n_iter = 0;
+    ctx->n_fev = 0;
+    ctx->n_jev = 0;
+  }
+  if (ctx->use_trace) {
+    /* The remaining iterations are reserved up to 1024 so that a typical solve records without reallocation. */
+    const int64_t n_left = ctx->max_iter - ctx->n_iter;
+    lbfgsb_trace_reserve(&ctx->trace, n_left < 1 ? 1 : (n_left < 1024 ? n_left : 1024));
+  }
+
+  NUMO_OPTIMIZE_PROBE2(solve__start, "lbfgsb", n);
+  while (ctx->n_iter < ctx->max_iter) {
+    double t_start = monotonic_seconds();
+    if (ctx->log.sink.write != NULL) {
+      /* The sink is set only during the call, since another Ruby thread may run a solve on this thread in between. */
+      ctx->prev_sink = solver_log_set_sink(&ctx->log.sink);
+      lbfgsb_setulb(ctx->ws, st, ctx->x_ptr, ctx->l_ptr, ctx->u_ptr, ctx->nbd_ptr, &ctx->f, &ctx->factr, &ctx->pgtol);
+      solver_log_set_sink(ctx->prev_sink);
+      lbfgsb_log_flush(&ctx->log, LBFGSB_LOG_FLUSH_BYTES);
+    } else {
+      lbfgsb_setulb(ctx->ws, st, ctx->x_ptr, ctx->l_ptr, ctx->u_ptr, ctx->nbd_ptr, &ctx->f, &ctx->factr, &ctx->pgtol);
+    }
+    double t_end = monotonic_seconds();
+    ctx->time_solver += t_end - t_start;
+    if (strncmp(st->task, "FG", 2) == 0) {
+      if (strncmp(st->task, "FG_LNSRCH_PICK", 14) == 0) {
+        /* The accepted candidate has been evaluated in the batch, so the objective is not called. */
+        lbfgsb_fmin_pick(ctx);
+        continue;
+      }
+      /* Armijo and the nonmonotone search ask only f at the trial steps, and only g at the accepted step. */
+      const bool need_f = strncmp(st->task, "FG_LNSRCH_G", 11) != 0;
+      const bool need_g = strncmp(st->task, "FG_LNSRCH_F", 11) != 0;
+      /* The gradient by the finite differences costs the calls at the perturbed points, which max_fev caps as well. */
+      const int64_t cost = ctx->fdiff.method != 0 && need_g ? 1 + fdiff_n_points(ctx->fdiff.method, n) : 1;
+      if (ctx->n_fev > 0 && (ctx->n_fev + cost > ctx->max_fev || t_end >= ctx->deadline)) {
+        strcpy(st->task, ctx->n_fev + cost > ctx->max_fev ? "STOP: MAX_FEV" : "STOP: TIMEOUT");
+        lbfgsb_fmin_restore_best(ctx);
+        break;
+      }
+      if (strncmp(st->task, "FG_LNSRCH_BATCH", 15) == 0) {
+        if (!lbfgsb_fmin_speculate(ctx)) {
+          strcpy(st->task, "STOP: MAX_FEV");
+          lbfgsb_fmin_restore_best(ctx);
+          break;
+        }
+        continue;
+      }
+      bool has_f = need_f;
+      bool has_g = need_g;
+      int64_t n_evals = need_f ? 1 : 0;
+      t_start = t_end;
+      if (ctx->cache_buf != NULL &&
+          eval_cache_get(&ctx->cache, ctx->x_ptr, need_f ? &ctx->f : NULL, need_g ? ctx->ws->g : NULL)) {
+        /* The point has been evaluated, e.g. before the restart of the line search, so the objective is not called. */
+        ctx->g_val = Qnil;
+      } else {
+        if (ctx->fdiff.method != 0) {
+          /* The finite differences need f at x, so f is evaluated even if only g is asked. */
+          n_evals = ctx->fdiff.n_evals;
+          ctx->f = fdiff_engine_fg(&ctx->fdiff, ctx->x_ptr, need_g ? ctx->ws->g : NULL);
+          n_evals = ctx->fdiff.n_evals - n_evals;
+          has_f = true;
+        } else if (ctx->native != NULL) {
+          /* The native objective writes the gradient to the work array, so the evaluation creates no Ruby object. */
+          ctx->f = ctx->native->fg(n, ctx->x_ptr, need_g ? ctx->ws->g : NULL, ctx->native->data);
+          /* f is computed with g even if only g is asked, so the call counts as an evaluation. */
+          has_f = true;
+          n_evals = 1;
+        } else if (RB_TYPE_P(ctx->jcb, T_TRUE)) {
+          fg_arr = rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, ctx->x_val, ctx->args);
+          ctx->f = NUM2DBL(rb_ary_entry(fg_arr, 0));
+          ctx->g_val = rb_ary_entry(fg_arr, 1);
+          has_f = true;
+          has_g = true;
+          n_evals = 1;
+        } else {
+          if (need_f) {
+            ctx->f = NUM2DBL(rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, ctx->x_val, ctx->args));
+          }
+          if (need_g) {
+            ctx->g_val = rb_funcall(ctx->self, rb_intern("jcb"), 3, ctx->jcb, ctx->x_val, ctx->args);
+          }
+        }
+        ctx->n_fev += n_evals;
+        ctx->n_jev += has_g ? 1 : 0;
+        t_end = monotonic_seconds();
+        ctx->time_callback += t_end - t_start;
+        NUMO_OPTIMIZE_PROBE2(fg__eval, n, (int64_t)((t_end - t_start) * 1e9));
+        t_start = t_end;
+        if (!has_g) {
+          ctx->g_val = Qnil;
+        } else if (ctx->native == NULL && ctx->fdiff.method == 0) {
+          ctx->g_val = jcb_to_dfloat(ctx->g_val, n);
+          memcpy(ctx->ws->g, na_get_pointer_for_read(ctx->g_val), n * sizeof(*ctx->ws->g));
+        }
+        if (ctx->cache_buf != NULL) {
+          eval_cache_put(&ctx->cache, ctx->x_ptr, has_f ? &ctx->f : NULL, has_g ? ctx->ws->g : NULL);
+        }
+      }
+      /* The best point is kept with its gradient, so the points of only f are skipped. */
+      if (ctx->best_x != NULL && has_g && (!ctx->has_best || ctx->f < ctx->best_f)) {
+        memcpy(ctx->best_x, ctx->x_ptr, n * sizeof(double));
+        memcpy(ctx->best_g, ctx->ws->g, n * sizeof(double));
+        ctx->best_f = ctx->f;
+        ctx->has_best = true;
+      }
+      ctx->time_copy += monotonic_seconds() - t_start;
+      if (strncmp(st->task, "FG_START", 8) == 0) {
+        if (ctx->warm_start != NULL) {
+          lbfgsb_memory_seed(ctx->ws, st, ctx->warm_start);
+        }
+        /* isave[41] holds the line search, which setulb reads after the return with task = FG_START. */
+        lbfgsb_isave_set(ctx->ws, st, 41, ctx->line_search);
+      }
+    } else if (strncmp(st->task, "NEW_X", 5) == 0) {
+      ctx->n_iter++;
+      NUMO_OPTIMIZE_PROBE3(new__x, ctx->n_iter, NUMO_OPTIMIZE_PROBE_BITS(ctx->f), NUMO_OPTIMIZE_PROBE_BITS(st->dsave[12]));
+      if (ctx->use_trace) {
+        /* isave[25], isave[32], and isave[38] hold nskip, nseg, and nact, and dsave[12] and dsave[13] hold sbgnrm and stp. */
+        lbfgsb_trace* tr = &ctx->trace;
+        if (tr->size == tr->capacity) {
+          lbfgsb_trace_reserve(tr, 2 * tr->capacity);
+        }
+        tr->f[tr->size] = ctx->f;
+        tr->sbgnrm[tr->size] = st->dsave[12];
+        tr->stp[tr->size] = st->dsave[13];
+        tr->n_fev[tr->size] = (int32_t)ctx->n_fev;
+        tr->nact[tr->size] = (int32_t)lbfgsb_isave_get(ctx->ws, st, 38);
+        tr->nseg[tr->size] = (int32_t)lbfgsb_isave_get(ctx->ws, st, 32);
+        tr->nskip[tr->size] = (int32_t)lbfgsb_isave_get(ctx->ws, st, 25);
+        tr->size++;
+      }
+      if (ctx->log.json) {
+        lbfgsb_log_put_iteration(&ctx->log, ctx->n_iter, ctx->n_fev, ctx->f, st->dsave[12], st->dsave[13], lbfgsb_isave_get(ctx->ws, st, 38),
+                                 lbfgsb_isave_get(ctx->ws, st, 32), lbfgsb_isave_get(ctx->ws, st, 25));
+      }
+      if (!NIL_P(ctx->ckpt_path) && ctx->n_iter % ctx->ckpt_every == 0) {
+        lbfgsb_checkpoint_write(ctx);
+      }
+      /* dsave[12] holds sbgnrm computed by mainlb for the new x. */
+      if (!NIL_P(ctx->callback) && ctx->n_iter % ctx->callback_every == 0) {
+        t_start = monotonic_seconds();
+        const bool stop = solve_callback(ctx->callback, ctx->x_val, ctx->f, st->dsave[12], ctx->n_iter);
+        ctx->time_callback += monotonic_seconds() - t_start;
+        if (stop) {
+          strcpy(st->task, "STOP: CALLBACK");
+          break;
+        }
+      }
+    } else {
+      break;
+    }
+  }
+  NUMO_OPTIMIZE_PROBE3(solve__done, "lbfgsb", ctx->n_iter, ctx->n_fev);
+
+  if (NIL_P(ctx->g_val) && ctx->n_jev > 0) {
+    /* The gradient is only in the work array with the native objective, after a hit of the cache,
+       or after resuming without an evaluation. */
+    size_t shape[1] = { (size_t)n };
+    ctx->g_val = nary_new(numo_cDFloat, 1, shape);
+    memcpy(na_get_pointer_for_write(ctx->g_val), ctx->ws->g, n * sizeof(*ctx->ws->g));
+  }
+
+  lbfgsb_log_close(&ctx->log, true);
+
+  if (ctx->use_trace) {
+    const lbfgsb_trace* tr = &ctx->trace;
+    ctx->trace_val = rb_hash_new();
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("f")), lbfgsb_trace_column(numo_cDFloat, tr->f, sizeof(double), tr->size));
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("sbgnrm")), lbfgsb_trace_column(numo_cDFloat, tr->sbgnrm, sizeof(double), tr->size));
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("stp")), lbfgsb_trace_column(numo_cDFloat, tr->stp, sizeof(double), tr->size));
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("n_fev")), lbfgsb_trace_column(numo_cInt32, tr->n_fev, sizeof(int32_t), tr->size));
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("nact")), lbfgsb_trace_column(numo_cInt32, tr->nact, sizeof(int32_t), tr->size));
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("nseg")), lbfgsb_trace_column(numo_cInt32, tr->nseg, sizeof(int32_t), tr->size));
+    rb_hash_aset(ctx->trace_val, ID2SYM(rb_intern("nskip")), lbfgsb_trace_column(numo_cInt32, tr->nskip, sizeof(int32_t), tr->size));
+  }
+
+  /* dsave[6], dsave[7], and dsave[8] hold cachyt, sbtime, and lnscht accumulated by mainlb, and isave[21] holds nintol. */
+  ctx->stats_val = rb_hash_new();
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_total")), DBL2NUM(monotonic_seconds() - ctx->time_start));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_callback")), DBL2NUM(ctx->time_callback));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_copy")), DBL2NUM(ctx->time_copy));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_solver")), DBL2NUM(ctx->time_solver));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_cauchy")), DBL2NUM(st->dsave[6]));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_subspace")), DBL2NUM(st->dsave[7]));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("time_line_search")), DBL2NUM(st->dsave[8]));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("nintol")), LL2NUM(lbfgsb_isave_get(ctx->ws, st, 21)));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("nskip")), LL2NUM(lbfgsb_isave_get(ctx->ws, st, 25)));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("nact")), LL2NUM(lbfgsb_isave_get(ctx->ws, st, 38)));
+  rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("nseg")), LL2NUM(lbfgsb_isave_get(ctx->ws, st, 32)));
+  if (ctx->cache_buf != NULL) {
+    rb_hash_aset(ctx->stats_val, ID2SYM(rb_intern("cache_hits")), LL2NUM(ctx->cache.hits));
+  }
+
+  /* The peak is estimated from the buffer sizes: the work arrays are kept to the end, so it is reached at the export. */
+  size_t state_bytes = 0;
+  if (ctx->return_state) {
+    ctx->state_val = lbfgsb_memory_export(ctx->ws, st);
+    state_bytes = lbfgsb_memory_size(get_lbfgsb_memory(ctx->state_val)) - sizeof(lbfgsb_memory);
+  }
+  const size_t trace_bytes = (size_t)ctx->trace.capacity * (3 * sizeof(double) + 4 * sizeof(int32_t));
+  ctx->workspace_bytes = lbfgsb_workspace_bytes(ctx->ws);
+  ctx->peak_native_bytes_estimate = ctx->workspace_bytes + state_bytes + trace_bytes;
+  ctx->native_bytes += state_bytes + trace_bytes;
+  solve_alloc_stats(ctx->stats_val, &ctx->alloc_mark, ctx->native_bytes);
+
+  return Qnil;
+}
+
+static VALUE lbfgsb_fmin_ensure(VALUE data) {
+  lbfgsb_fmin_ctx* ctx = (lbfgsb_fmin_ctx*)data;
+  if (ctx->resume_fp != NULL) {
+    fclose(ctx->resume_fp);
+    ctx->resume_fp = NULL;
+  }
+  ctx->ws->busy = false;
+  if (ctx->own_ws) {
+    lbfgsb_workspace_release(ctx->ws);
+  }
+  xfree(ctx->best_x);
+  xfree(ctx->best_g);
+  xfree(ctx->cache_buf);
+  ctx->cache_buf = NULL;
+  xfree(ctx->spec_x);
+  xfree(ctx->spec_g);
+  worker_pool_destroy(ctx->spec_pool);
+  ctx->spec_pool = NULL;
+  fdiff_engine_release(&ctx->fdiff);
+  lbfgsb_trace_release(&ctx->trace);
+  if (ctx->log.sink.write != NULL) {
+    solver_log_set_sink(ctx->prev_sink);
+  }
+  lbfgsb_log_close(&ctx->log, false);
+  return Qnil;
+}
+
+/* Returns the line search given as nil, Symbol, or String. */
+static int lbfgsb_line_search(VALUE line_search_val) {
+  if (NIL_P(line_search_val)) {
+    return LNSRCH_MORE_THUENTE;
+  }
+  const ID name = rb_to_id(line_search_val);
+  if (name == rb_intern("more_thuente")) {
+    return LNSRCH_MORE_THUENTE;
+  }
+  if (name == rb_intern("hager_zhang")) {
+    return LNSRCH_HAGER_ZHANG;
+  }
+  if (name == rb_intern("armijo")) {
+    return LNSRCH_ARMIJO;
+  }
+  if (name == rb_intern("nonmonotone")) {
+    return LNSRCH_NONMONOTONE;
+  }
+  if (name == rb_intern("speculative")) {
+    return LNSRCH_SPECULATIVE;
+  }
+  rb_raise(rb_eArgError, "line_search must be :more_thuente, :hager_zhang, :armijo, :nonmonotone, or :speculative.");
+  return LNSRCH_MORE_THUENTE;
+}
+
+/* Returns the pointer to contiguous Numo::Int32 or Numo::Int64 nbd in the solver width, converting it if needed. */
+static void* lbfgsb_convert_nbd(lbfgsb_workspace* ws, VALUE nbd_val) {
+  const int64_t n = ws->n;
+  const bool src_int64 = CLASS_OF(nbd_val) == numo_cInt64;
+  const void* src = (const void*)na_get_pointer_for_read(nbd_val);
+  if (src_int64 == ws->use_int64) {
+    /* Read the given array in place as it already has the solver width. */
+    RB_GC_GUARD(nbd_val);
+    return (void*)src;
+  }
+  void* dst = lbfgsb_workspace_nbd(ws);
+  for (int64_t i = 0; i < n; i++) {
+    const int64_t v = src_int64 ? ((const int64_t*)src)[i] : ((const int32_t*)src)[i];
+    if (ws->use_int64) {
+      ((int64_t*)dst)[i] = v;
+    } else {
+      ((F77_int*)dst)[i] = (F77_int)v;
+    }
+  }
+  RB_GC_GUARD(nbd_val);
+  return dst;
+}
+
+/* Checks l, u, and nbd of L-BFGS-B, and replaces them with contiguous arrays of the types read by the solver. */
+static void lbfgsb_prepare_bounds(VALUE* l_val, VALUE* u_val, VALUE* nbd_val, int64_t n) {
+  narray_t* l_nary = NULL;
+  narray_t* u_nary = NULL;
+  narray_t* nbd_nary = NULL;
+
+  GetNArray(*l_val, l_nary);
+  if (NA_NDIM(l_nary) != 1) {
+    rb_raise(rb_eArgError, "l must be a 1-D array.");
+  }
+  if ((int64_t)NA_SIZE(l_nary) != n) {
+    rb_raise(rb_eArgError, "The size of l must be equal to that of x.");
+  }
+  if (CLASS_OF(*l_val) != numo_cDFloat) {
+    *l_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, *l_val);
+  }
+  if (!RTEST(nary_check_contiguous(*l_val))) {
+    *l_val = nary_dup(*l_val);
+  }
+
+  GetNArray(*u_val, u_nary);
+  if (NA_NDIM(u_nary) != 1) {
+    rb_raise(rb_eArgError, "u must be a 1-D array.");
+  }
+  if ((int64_t)NA_SIZE(u_nary) != n) {
+    rb_raise(rb_eArgError, "The size of u must be equal to that of x.");
+  }
+  if (CLASS_OF(*u_val) != numo_cDFloat) {
+    *u_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, *u_val);
+  }
+  if (!RTEST(nary_check_contiguous(*u_val))) {
+    *u_val = nary_dup(*u_val);
+  }
+
+  GetNArray(*nbd_val, nbd_nary);
+  if (NA_NDIM(nbd_nary) != 1) {
+    rb_raise(rb_eArgError, "nbd must be a 1-D array.");
+  }
+  if ((int64_t)NA_SIZE(nbd_nary) != n) {
+    rb_raise(rb_eArgError, "The size of nbd must be equal to that of x.");
+  }
+  if (CLASS_OF(*nbd_val) != numo_cInt32 && CLASS_OF(*nbd_val) != numo_cInt64) {
+    *nbd_val = rb_funcall(numo_cInt32, rb_intern("cast"), 1, *nbd_val);
+  }
+  if (!RTEST(nary_check_contiguous(*nbd_val))) {
+    *nbd_val = nary_dup(*nbd_val);
+  }
+}
+
+static VALUE lbfgsb_fmin(VALUE self, VALUE fnc, VALUE x_val, VALUE jcb, VALUE args, VALUE l_val, VALUE u_val,
+                         VALUE nbd_val, VALUE maxcor, VALUE ftol, VALUE gtol, VALUE maxiter, VALUE disp, VALUE opts) {
+  narray_t* x_nary;
+  int64_t n;
+  lbfgsb_workspace tmp_ws;
+  lbfgsb_fmin_ctx ctx;
+  VALUE ws_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("workspace")));
+  VALUE warm_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("warm_start")));
+  VALUE return_state_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("return_state")));
+  VALUE ckpt_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("checkpoint")));
+  VALUE resume_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("resume_from")));
+  VALUE limit_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("memory_limit")));
+  VALUE timeout_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("timeout")));
+  VALUE max_fev_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("max_fev")));
+  VALUE callback_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("callback")));
+  VALUE every_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("every")));
+  VALUE trace_opt = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("trace")));
+  VALUE log_val = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("log")));
+  lbfgsb_checkpoint_header hdr;
+  VALUE ret;
+
+  ctx.time_start = monotonic_seconds();
+  solve_alloc_mark_start(&ctx.alloc_mark);
+  GetNArray(x_val, x_nary);
+  n = (int64_t)NA_SIZE(x_nary);
+  if (CLASS_OF(x_val) != numo_cDFloat) {
+    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  }
+  if (!RTEST(nary_check_contiguous(x_val))) {
+    x_val = nary_dup(x_val);
+  }
+
+  if (!NIL_P(nbd_val)) {
+    lbfgsb_prepare_bounds(&l_val, &u_val, &nbd_val, n);
+  }
+  ctx.time_copy = monotonic_seconds() - ctx.time_start;
+  ctx.time_callback = 0.0;
+  ctx.time_solver = 0.0;
+  ctx.stats_val = Qnil;
+
+  ctx.self = self;
+  ctx.fnc = fnc;
+  ctx.x_val = x_val;
+  ctx.jcb = jcb;
+  ctx.args = args;
+  ctx.native = get_native_objective(fnc);
+  memset(&ctx.fdiff, 0, sizeof(ctx.fdiff));
+  ctx.fdiff.method = fdiff_method(jcb);
+  ctx.fdiff.batch = !NIL_P(opts) && RTEST(rb_hash_lookup(opts, ID2SYM(rb_intern("diff_batch"))));
+  ctx.fdiff_threads = 1;
+  if (!NIL_P(opts) && !NIL_P(rb_hash_lookup(opts, ID2SYM(rb_intern("threads"))))) {
+    ctx.fdiff_threads = NUM2INT(rb_hash_lookup(opts, ID2SYM(rb_intern("threads"))));
+  }
+  if (ctx.native != NULL && ctx.native->fg == NULL && ctx.fdiff.method == 0) {
+    rb_raise(rb_eArgError, "L-BFGS-B requires fg of the native objective unless jcb is :forward_diff or :central_diff.");
+    return Qnil;
+  }
+  ctx.native_bytes = 0;
+  ctx.cache_capacity = solve_cache_capacity(NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("cache"))));
+  ctx.cache_buf = NULL;
+  ctx.line_search = lbfgsb_line_search(NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("line_search"))));
+  ctx.batch_fnc = NIL_P(opts) ? Qnil : rb_hash_lookup(opts, ID2SYM(rb_intern("batch_fnc")));
+  ctx.spec_x = NULL;
+  ctx.spec_g = NULL;
+  ctx.spec_pool = NULL;
+  ctx.max_iter = NUM2LL(maxiter);
+  ctx.factr = NUM2DBL(ftol);
+  ctx.pgtol = NUM2DBL(gtol);
+  ctx.st.iprint = NIL_P(disp) ? -1 : NUM2LL(disp);
+  ctx.x_ptr = (double*)na_get_pointer_for_read_write(x_val);
+  ctx.warm_start = NULL;
+  ctx.return_state = RTEST(return_state_val);
+  ctx.state_val = Qnil;
+  ctx.deadline = solve_deadline(timeout_val);
+  ctx.max_fev = solve_max_fev(max_fev_val);
+  ctx.best_x = NULL;
+  ctx.best_g = NULL;
+  ctx.best_f = 0.0;
+  ctx.has_best = false;
+  ctx.callback = callback_val;
+  ctx.callback_every = solve_callback_every(every_val);
+  ctx.use_trace = RTEST(trace_opt);
+  memset(&ctx.trace, 0, sizeof(ctx.trace));
+  ctx.trace_val = Qnil;
+  ctx.log_val = log_val;
+  memset(&ctx.log, 0, sizeof(ctx.log));
+  ctx.log.io = Qnil;
+  ctx.log.io_buf = Qnil;
+  ctx.prev_sink = NULL;
+  if (!NIL_P(warm_val)) {
+    ctx.warm_start = get_lbfgsb_memory(warm_val);
+    if (ctx.warm_start->n != n) {
+      rb_raise(rb_eArgError, "The size of x must be equal to n of the warm start state.");
+      return Qnil;
+    }
+  }
+
+  ctx.ckpt_path = Qnil;
+  ctx.ckpt_tmp_path = Qnil;
+  ctx.ckpt_every = 1;
+  if (!NIL_P(ckpt_val)) {
+    Check_Type(ckpt_val, T_HASH);
+    VALUE every_val = rb_hash_lookup(ckpt_val, ID2SYM(rb_intern("every")));
+    ctx.ckpt_path = rb_str_dup(rb_get_path(rb_hash_lookup(ckpt_val, ID2SYM(rb_intern("path")))));
+    ctx.ckpt_tmp_path = rb_str_plus(ctx.ckpt_path, rb_str_new_cstr(".tmp"));
+    ctx.ckpt_every = NIL_P(every_val) ? 1 : NUM2LL(every_val);
+    if (ctx.ckpt_every <= 0) {
+      rb_raise(rb_eArgError, "every of checkpoint must be a positive integer.");
+      return Qnil;
+    }
+  }
+
+  int64_t m = NUM2LL(maxcor);
+  const size_t memory_limit = NIL_P(limit_val) ? SIZE_MAX : NUM2SIZET(limit_val);
+  if (!NIL_P(ws_val)) {
+    ctx.ws = get_lbfgsb_workspace(ws_val);
+    m = ctx.ws->m;
+    if (ctx.ws->n != n) {
+      rb_raise(rb_eArgError, "The size of x must be equal to n of the workspace.");
+      return Qnil;
+    }
+    if (ctx.ws->busy) {
+      rb_raise(rb_eRuntimeError, "The workspace is being used by another solve.");
+      return Qnil;
+    }
+  }
+
+  ctx.resume_fp = NULL;
+  ctx.resume_path = Qnil;
+  if (!NIL_P(resume_val)) {
+    ctx.resume_path = rb_get_path(resume_val);
+    ctx.resume_fp = lbfgsb_checkpoint_open(ctx.resume_path, &hdr);
+    if (hdr.n != n || (!NIL_P(ws_val) && hdr.m != ctx.ws->m)) {
+      fclose(ctx.resume_fp);
+      rb_raise(rb_eArgError, "The checkpoint does not match the size of x or maxcor of the workspace.");
+      return Qnil;
+    }
+    /* A solve resumed from a checkpoint continues with maxcor of the checkpoint. */
+    m = hdr.m;
+    ctx.f = hdr.f;
+    ctx.n_iter = hdr.n_iter;
+    ctx.n_fev = hdr.n_fev;
+    ctx.n_jev = hdr.n_jev;
+  }
+
+  if (!NIL_P(limit_val)) {
+    if (NIL_P(ws_val) && ctx.resume_fp == NULL) {
+      /* Choose the largest number of corrections that is not greater than maxcor and fits in the limit. */
+      while (m > 0 && lbfgsb_solve_bytes(n, m, NIL_P(nbd_val), ctx.return_state) > memory_limit) m--;
+    }
+    if (m <= 0 || lbfgsb_solve_bytes(n, m, NIL_P(nbd_val), ctx.return_state) > memory_limit) {
+      if (ctx.resume_fp != NULL) fclose(ctx.resume_fp);
+      rb_raise(rb_eArgError, "The memory required by L-BFGS-B exceeds memory_limit.");
+      return Qnil;
+    }
+  }
+
+  size_t ws_bytes_before = 0;
+  if (NIL_P(ws_val)) {
+    lbfgsb_workspace_init(&tmp_ws, n, m);
+    ctx.ws = &tmp_ws;
+    ctx.own_ws = true;
+  } else {
+    ctx.own_ws = false;
+    ws_bytes_before = lbfgsb_workspace_bytes(ctx.ws);
+  }
+  ctx.ws->busy = true;
+
+  if (NIL_P(nbd_val)) {
+    /* Unbounded problem: L-BFGS-B does not read l and u when all elements of nbd are zero. */
+    if (ctx.ws->lu == NULL) {
+      ctx.ws->lu = ZALLOC_N(double, n);
+    }
+    ctx.l_ptr = ctx.ws->lu;
+    ctx.u_ptr = ctx.ws->lu;
+    ctx.nbd_ptr = lbfgsb_workspace_nbd(ctx.ws);
+    memset(ctx.nbd_ptr, 0, n * (ctx.ws->use_int64 ? sizeof(int64_t) : sizeof(F77_int)));
+  } else {
+    ctx.l_ptr = (double*)na_get_pointer_for_read(l_val);
+    ctx.u_ptr = (double*)na_get_pointer_for_read(u_val);
+    ctx.nbd_ptr = lbfgsb_convert_nbd(ctx.ws, nbd_val);
+  }
+  /* A given workspace counts only the buffers allocated on its first use by this solve. */
+  ctx.native_bytes += lbfgsb_workspace_bytes(ctx.ws) - ws_bytes_before;
+
+  rb_ensure(lbfgsb_fmin_loop, (VALUE)&ctx, lbfgsb_fmin_ensure, (VALUE)&ctx);
+
+  ret = rb_hash_new();
+  rb_hash_aset(ret, ID2SYM(rb_intern("task")), rb_str_new_cstr(ctx.st.task));
+  rb_hash_aset(ret, ID2SYM(rb_intern("x")), x_val);
+  rb_hash_aset(ret, ID2SYM(rb_intern("fnc")), DBL2NUM(ctx.f));
+  rb_hash_aset(ret, ID2SYM(rb_intern("jcb")), NIL_P(ctx.g_val) ? Qnil : reshape_like(ctx.g_val, x_val));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), LL2NUM(ctx.n_iter));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), LL2NUM(ctx.n_fev));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_jev")), LL2NUM(ctx.n_jev));
+  rb_hash_aset(ret, ID2SYM(rb_intern("success")), strncmp(ctx.st.task, "CONV", 4) == 0 ? Qtrue : Qfalse);
+  rb_hash_aset(ret, ID2SYM(rb_intern("state")), ctx.state_val);
+  rb_hash_aset(ret, ID2SYM(rb_intern("workspace_bytes")), SIZET2NUM(ctx.workspace_bytes));
+  rb_hash_aset(ret, ID2SYM(rb_intern("peak_native_bytes_estimate")), SIZET2NUM(ctx.peak_native_bytes_estimate));
+  if (ctx.use_trace) {
+    rb_hash_aset(ret, ID2SYM(rb_intern("trace")), ctx.trace_val);
+  }
+  rb_hash_aset(ret, ID2SYM(rb_intern("stats")), ctx.stats_val);
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(l_val);
+  RB_GC_GUARD(u_val);
+  RB_GC_GUARD(nbd_val);
+  RB_GC_GUARD(ws_val);
+  RB_GC_GUARD(warm_val);
+  RB_GC_GUARD(ckpt_val);
+  RB_GC_GUARD(resume_val);
+  RB_GC_GUARD(limit_val);
+  RB_GC_GUARD(callback_val);
+  RB_GC_GUARD(log_val);
+
+  return ret;
+}
+
+/* Arguments and results of K L-BFGS-B solves run in lock-step, passed through rb_ensure. */
+typedef struct {
+  VALUE self;
+  VALUE fnc;
+  VALUE x_val;
+  VALUE jcb;
+  VALUE args;
+  int64_t k;
+  int64_t n;
+  int64_t m;
+  int64_t max_iter;
+  double factr;
+  double pgtol;
+  double* x_ptr;
+  double* l_ptr;
+  double* u_ptr;
+  void* nbd_ptr;
+  VALUE nbd_val;
+  lbfgsb_workspace* ws;
+  int64_t n_ws;
+  lbfgsb_state* st;
+  double* f;
+  int64_t* n_iter;
+  int64_t* n_fev;
+  bool* done;
+  int64_t* idx;
+  int64_t n_calls;
+  const native_objective* native;
+  VALUE ret;
+} lbfgsb_batch_ctx;
+
+/* Advances the solve of the problem k until it requests f and g or terminates; returns whether f and g are requested. */
+static bool lbfgsb_batch_advance(lbfgsb_batch_ctx* ctx, int64_t k) {
+  lbfgsb_state* st = &ctx->st[k];
+  while (ctx->n_iter[k] < ctx->max_iter) {
+    lbfgsb_setulb(&ctx->ws[k], st, ctx->x_ptr + k * ctx->n, ctx->l_ptr, ctx->u_ptr, ctx->nbd_ptr, &ctx->f[k], &ctx->factr,
+                  &ctx->pgtol);
+    if (strncmp(st->task, "FG", 2) == 0) {
+      return true;
+    } else if (strncmp(st->task, "NEW_X", 5) == 0) {
+      ctx->n_iter[k]++;
+    } else {
+      break;
+    }
+  }
+  ctx->done[k] = true;
+  return false;
+}
+
+static VALUE lbfgsb_batch_loop(VALUE data) {
+  lbfgsb_batch_ctx* ctx = (lbfgsb_batch_ctx*)data;
+  const int64_t n = ctx->n;
+  VALUE pts_val;
+  VALUE f_val;
+  VALUE g_val;
+  VALUE fg_arr;
+
+  for (int64_t k = 0; k < ctx->k; k++) {
+    lbfgsb_workspace_init(&ctx->ws[k], n, ctx->m);
+    ctx->n_ws++;
+    memset(ctx->ws[k].g, 0, n * sizeof(double));
+    strcpy(ctx->st[k].task, "START");
+  }
+
+  if (NIL_P(ctx->nbd_val)) {
+    ctx->ws[0].lu = ZALLOC_N(double, n);
+    ctx->l_ptr = ctx->ws[0].lu;
+    ctx->u_ptr = ctx->ws[0].lu;
+    ctx->nbd_ptr = lbfgsb_workspace_nbd(&ctx->ws[0]);
+    memset(ctx->nbd_ptr, 0, n * (ctx->ws[0].use_int64 ? sizeof(int64_t) : sizeof(F77_int)));
+  } else {
+    /* All the problems share the bounds, so the nbd converted for the first workspace is used for all. */
+    ctx->nbd_ptr = lbfgsb_convert_nbd(&ctx->ws[0], ctx->nbd_val);
+  }
+
+  for (;;) {
+    int64_t n_eval = 0;
+    for (int64_t k = 0; k < ctx->k; k++) {
+      if (!ctx->done[k] && lbfgsb_batch_advance(ctx, k)) {
+        ctx->idx[n_eval++] = k;
+      }
+    }
+    if (n_eval == 0) break;
+
+    if (ctx->native != NULL) {
+      for (int64_t i = 0; i < n_eval; i++) {
+        const int64_t k = ctx->idx[i];
+        ctx->f[k] = ctx->native->fg(n, ctx->x_ptr + k * n, ctx->ws[k].g, ctx->native->data);
+        ctx->n_fev[k]++;
+      }
+      ctx->n_calls++;
+      /* The native rounds do not call Ruby, so handle Thread#raise and signals here. */
+      rb_thread_check_ints();
+      continue;
+    }
+
+    if (n_eval == ctx->k) {
+      pts_val = ctx->x_val;
+    } else {
+      size_t shape[2] = { (size_t)n_eval, (size_t)n };
+      pts_val = nary_new(numo_cDFloat, 2, shape);
+      double* pts_ptr = (double*)na_get_pointer_for_write(pts_val);
+      for (int64_t i = 0; i < n_eval; i++) {
+        memcpy(pts_ptr + i * n, ctx->x_ptr + ctx->idx[i] * n, n * sizeof(double));
+      }
+    }
+
+    if (RB_TYPE_P(ctx->jcb, T_TRUE)) {
+      fg_arr = rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, pts_val, ctx->args);
+      f_val = rb_ary_entry(fg_arr, 0);
+      g_val = rb_ary_entry(fg_arr, 1);
+    } else {
+      f_val = rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, pts_val, ctx->args);
+      g_val = rb_funcall(ctx->self, rb_intern("jcb"), 3, ctx->jcb, pts_val, ctx->args);
+    }
+    ctx->n_calls++;
+
+    if (CLASS_OF(f_val) != numo_cDFloat) {
+      f_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, f_val);
+    }
+    if (!RTEST(nary_check_contiguous(f_val))) {
+      f_val = nary_dup(f_val);
+    }
+    narray_t* f_nary = NULL;
+    GetNArray(f_val, f_nary);
+    if ((int64_t)NA_SIZE(f_nary) != n_eval) {
+      rb_raise(rb_eArgError, "The size of fnc must be equal to the number of rows of x.");
+    }
+    g_val = jcb_to_dfloat(g_val, n_eval * n);
+
+    const double* f_ptr = (double*)na_get_pointer_for_read(f_val);
+    const double* g_ptr = (double*)na_get_pointer_for_read(g_val);
+    for (int64_t i = 0; i < n_eval; i++) {
+      const int64_t k = ctx->idx[i];
+      ctx->f[k] = f_ptr[i];
+      memcpy(ctx->ws[k].g, g_ptr + i * n, n * sizeof(double));
+      ctx->n_fev[k]++;
+    }
+    RB_GC_GUARD(pts_val);
+    RB_GC_GUARD(f_val);
+    RB_GC_GUARD(g_val);
+  }
+
+  size_t k_shape[1] = { (size_t)ctx->k };
+  size_t kn_shape[2] = { (size_t)ctx->k, (size_t)n };
+  VALUE fnc_val = nary_new(numo_cDFloat, 1, k_shape);
+  VALUE jcb_val = nary_new(numo_cDFloat, 2, kn_shape);
+  VALUE n_iter_val = nary_new(numo_cInt64, 1, k_shape);
+  VALUE n_fev_val = nary_new(numo_cInt64, 1, k_shape);
+  VALUE task_val = rb_ary_new_capa(ctx->k);
+  VALUE success_val = rb_ary_new_capa(ctx->k);
+  double* fnc_ptr = (double*)na_get_pointer_for_write(fnc_val);
+  double* jcb_ptr = (double*)na_get_pointer_for_write(jcb_val);
+  int64_t* n_iter_ptr = (int64_t*)na_get_pointer_for_write(n_iter_val);
+  int64_t* n_fev_ptr = (int64_t*)na_get_pointer_for_write(n_fev_val);
+  for (int64_t k = 0; k < ctx->k; k++) {
+    fnc_ptr[k] = ctx->f[k];
+    memcpy(jcb_ptr + k * n, ctx->ws[k].g, n * sizeof(double));
+    n_iter_ptr[k] = ctx->n_iter[k];
+    n_fev_ptr[k] = ctx->n_fev[k];
+    rb_ary_push(task_val, rb_str_new_cstr(ctx->st[k].task));
+    rb_ary_push(success_val, strncmp(ctx->st[k].task, "CONV", 4) == 0 ? Qtrue : Qfalse);
+  }
+
+  ctx->ret = rb_hash_new();
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("task")), task_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("x")), ctx->x_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("fnc")), fnc_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("jcb")), jcb_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_iter")), n_iter_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_fev")), n_fev_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_jev")), n_fev_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_calls")), LL2NUM(ctx->n_calls));
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("success")), success_val);
+
+  return Qnil;
+}
+
+static VALUE lbfgsb_batch_ensure(VALUE data) {
+  lbfgsb_batch_ctx* ctx = (lbfgsb_batch_ctx*)data;
+  for (int64_t k = 0; k < ctx->n_ws; k++) {
+    lbfgsb_workspace_release(&ctx->ws[k]);
+  }
+  xfree(ctx->ws);
+  xfree(ctx->st);
+  xfree(ctx->f);
+  xfree(ctx->n_iter);
+  xfree(ctx->n_fev);
+  xfree(ctx->done);
+  xfree(ctx->idx);
+  return Qnil;
+}
+
+static VALUE lbfgsb_fmin_batch(VALUE self, VALUE fnc, VALUE x_val, VALUE jcb, VALUE args, VALUE l_val, VALUE u_val,
+                               VALUE nbd_val, VALUE maxcor, VALUE ftol, VALUE gtol, VALUE maxiter) {
+  narray_t* x_nary = NULL;
+  lbfgsb_batch_ctx ctx;
+  VALUE ret;
+
+  if (CLASS_OF(x_val) != numo_cDFloat) {
+    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  }
+  if (!RTEST(nary_check_contiguous(x_val))) {
+    x_val = nary_dup(x_val);
+  }
+  GetNArray(x_val, x_nary);
+  if (NA_NDIM(x_nary) != 2) {
+    rb_raise(rb_eArgError, "x must be a 2-D array.");
+    return Qnil;
+  }
+  const int64_t k = (int64_t)NA_SHAPE(x_nary)[0];
+  const int64_t n = (int64_t)NA_SHAPE(x_nary)[1];
+  if (k <= 0 || n <= 0) {
+    rb_raise(rb_eArgError, "x must not be empty.");
+    return Qnil;
+  }
+  if (!NIL_P(nbd_val)) {
+    lbfgsb_prepare_bounds(&l_val, &u_val, &nbd_val, n);
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.self = self;
+  ctx.fnc = fnc;
+  ctx.x_val = x_val;
+  ctx.jcb = jcb;
+  ctx.args = args;
+  ctx.k = k;
+  ctx.n = n;
+  ctx.m = NUM2LL(maxcor);
+  ctx.max_iter = NUM2LL(maxiter);
+  ctx.factr = NUM2DBL(ftol);
+  ctx.pgtol = NUM2DBL(gtol);
+  if (ctx.m <= 0) {
+    rb_raise(rb_eArgError, "maxcor must be a positive integer.");
+    return Qnil;
+  }
+  ctx.native = get_native_objective(fnc);
+  if (ctx.native != NULL && ctx.native->fg == NULL) {
+    rb_raise(rb_eArgError, "L-BFGS-B requires fg of the native objective.");
+    return Qnil;
+  }
+  ctx.x_ptr = (double*)na_get_pointer_for_read_write(x_val);
+  ctx.nbd_val = nbd_val;
+  if (!NIL_P(nbd_val)) {
+    ctx.l_ptr = (double*)na_get_pointer_for_read(l_val);
+    ctx.u_ptr = (double*)na_get_pointer_for_read(u_val);
+  }
+  ctx.ws = ZALLOC_N(lbfgsb_workspace, k);
+  ctx.st = ZALLOC_N(lbfgsb_state, k);
+  ctx.f = ZALLOC_N(double, k);
+  ctx.n_iter = ZALLOC_N(int64_t, k);
+  ctx.n_fev = ZALLOC_N(int64_t, k);
+  ctx.done = ZALLOC_N(bool, k);
+  ctx.idx = ZALLOC_N(int64_t, k);
+  for (int64_t i = 0; i < k; i++) {
+    ctx.st[i].iprint = -1;
+  }
+
+  rb_ensure(lbfgsb_batch_loop, (VALUE)&ctx, lbfgsb_batch_ensure, (VALUE)&ctx);
+
+  ret = ctx.ret;
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(l_val);
+  RB_GC_GUARD(u_val);
+  RB_GC_GUARD(nbd_val);
+
+  return ret;
+}
+
+/* Arguments and results of the batched Nelder-Mead method passed through rb_ensure. */
+typedef struct {
+  VALUE self;
+  VALUE fnc;
+  VALUE args;
+  VALUE pts_val;
+  const native_objective* native;
+  nm_batch nm;
+  void* buf;
+  double* tmp;
+  int64_t n_calls;
+  VALUE ret;
+} nm_batch_ctx;
+
+static VALUE nm_batch_loop(VALUE data) {
+  nm_batch_ctx* ctx = (nm_batch_ctx*)data;
+  nm_batch* nm = &ctx->nm;
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  VALUE f_val;
+
+  while (nm_batch_run(nm) == NM_BATCH_EVAL) {
+    ctx->n_calls++;
+    if (ctx->native != NULL) {
+      native_objective_eval_batch(ctx->native, n, k, nm->pts, nm->fval, ctx->tmp);
+      rb_thread_check_ints();
+      continue;
+    }
+    /* The points are given to the Ruby function as the rows of a matrix, which is reused over the calls. */
+    double* pts_ptr = (double*)na_get_pointer_for_write(ctx->pts_val);
+    for (int64_t i = 0; i < n; i++) {
+      for (int64_t p = 0; p < k; p++) {
+        pts_ptr[p * n + i] = nm->pts[i * k + p];
+      }
+    }
+    f_val = rb_funcall(ctx->self, rb_intern("fnc"), 3, ctx->fnc, ctx->pts_val, ctx->args);
+    if (CLASS_OF(f_val) != numo_cDFloat) {
+      f_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, f_val);
+    }
+    if (!RTEST(nary_check_contiguous(f_val))) {
+      f_val = nary_dup(f_val);
+    }
+    narray_t* f_nary = NULL;
+    GetNArray(f_val, f_nary);
+    if ((int64_t)NA_SIZE(f_nary) != k) {
+      rb_raise(rb_eArgError, "The size of fnc must be equal to the number of rows of x.");
+    }
+    memcpy(nm->fval, na_get_pointer_for_read(f_val), k * sizeof(double));
+    RB_GC_GUARD(f_val);
+  }
+
+  size_t k_shape[1] = { (size_t)k };
+  size_t kn_shape[2] = { (size_t)k, (size_t)n };
+  VALUE x_val = nary_new(numo_cDFloat, 2, kn_shape);
+  VALUE fnc_val = nary_new(numo_cDFloat, 1, k_shape);
+  VALUE n_iter_val = nary_new(numo_cInt64, 1, k_shape);
+  VALUE n_fev_val = nary_new(numo_cInt64, 1, k_shape);
+  nm_batch_best(nm, (double*)na_get_pointer_for_write(x_val), (double*)na_get_pointer_for_write(fnc_val));
+  memcpy(na_get_pointer_for_write(n_iter_val), nm->n_iter, k * sizeof(int64_t));
+  memcpy(na_get_pointer_for_write(n_fev_val), nm->n_fev, k * sizeof(int64_t));
+
+  ctx->ret = rb_hash_new();
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("x")), x_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("fnc")), fnc_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_iter")), n_iter_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_fev")), n_fev_val);
+  rb_hash_aset(ctx->ret, ID2SYM(rb_intern("n_calls")), LL2NUM(ctx->n_calls));
+
+  return Qnil;
+}
+
+static VALUE nm_batch_ensure(VALUE data) {
+  nm_batch_ctx* ctx = (nm_batch_ctx*)data;
+  xfree(ctx->buf);
+  xfree(ctx->tmp);
+  return Qnil;
+}
+
+static VALUE nelder_mead_fmin_batch(VALUE self, VALUE fnc, VALUE x_val, VALUE args, VALUE maxiter, VALUE xtol, VALUE ftol) {
+  narray_t* x_nary = NULL;
+  nm_batch_ctx ctx;
+
+  if (CLASS_OF(x_val) != numo_cDFloat) {
+    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  }
+  if (!RTEST(nary_check_contiguous(x_val))) {
+    x_val = nary_dup(x_val);
+  }
+  GetNArray(x_val, x_nary);
+  if (NA_NDIM(x_nary) != 2) {
+    rb_raise(rb_eArgError, "x must be a 2-D array.");
+    return Qnil;
+  }
+  const int64_t k = (int64_t)NA_SHAPE(x_nary)[0];
+  const int64_t n = (int64_t)NA_SHAPE(x_nary)[1];
+  if (k <= 0 || n <= 0) {
+    rb_raise(rb_eArgError, "x must not be empty.");
+    return Qnil;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.self = self;
+  ctx.fnc = fnc;
+  ctx.args = args;
+  ctx.native = get_native_objective(fnc);
+  ctx.pts_val = Qnil;
+  if (ctx.native == NULL) {
+    size_t shape[2] = { (size_t)k, (size_t)n };
+    ctx.pts_val = nary_new(numo_cDFloat, 2, shape);
+  }
+  const int64_t max_iter = NIL_P(maxiter) ? 200 * n : NUM2LL(maxiter);
+  const double x_tol = NUM2DBL(xtol);
+  const double f_tol = NUM2DBL(ftol);
+
+  ctx.buf = ALLOC_N(char, nm_batch_bytes(n, k));
+  ctx.tmp = ALLOC_N(double, n);
+  nm_batch_init(&ctx.nm, n, k, ctx.buf);
+  ctx.nm.max_iter = max_iter;
+  ctx.nm.xtol = x_tol;
+  ctx.nm.ftol = f_tol;
+  const double* x_ptr = (double*)na_get_pointer_for_read(x_val);
+  for (int64_t i = 0; i < n; i++) {
+    for (int64_t p = 0; p < k; p++) {
+      ctx.nm.sim[i * k + p] = x_ptr[p * n + i];
+    }
+  }
+
+  rb_ensure(nm_batch_loop, (VALUE)&ctx, nm_batch_ensure, (VALUE)&ctx);
+
+  RB_GC_GUARD(x_val);
+  RB_GC_GUARD(ctx.pts_val);
+
+  return ctx.ret;
+}
+
+/* Solver of a problem given to Numo::Optimize.fmin_many. */
+enum { MANY_LBFGSB, MANY_SCG, MANY_NELDER_MEAD };
+
+/* A problem solved on the worker pool without the GVL; every array is allocated before releasing the GVL. */
+typedef struct {
+  int method;
+  int64_t n;
+  int64_t m;
+  const native_objective* obj;
+  double* x;
+  double* g;
+  const double* l;
+  const double* u;
+  const void* nbd;
+  bool nbd_int64;
+  double factr;
+  double pgtol;
+  double xtol;
+  double ftol;
+  double jtol;
+  int64_t max_iter;
+  double f;
+  int64_t n_iter;
+  int64_t n_fev;
+  int64_t n_jev;
+  char task[60];
+} many_problem;
+
+typedef struct {
+  VALUE problems_val;
+  many_problem* problems;
+  int64_t n_problems;
+  int n_threads;
+  worker_pool* pool;
+  /* Scratch arrays of the workers: dbuf_len doubles and ibuf_len 64-bit integers each. */
+  double* dbuf;
+  int64_t* ibuf;
+  int64_t dbuf_len;
+  int64_t ibuf_len;
+  /* x, g, l, u, and nbd of each problem kept alive until the run ends. */
+  VALUE refs;
+  VALUE ret;
+} many_ctx;
 
-static VALUE scg_fmin(VALUE self, VALUE fnc, VALUE x_val, VALUE jcb, VALUE args,
-                      VALUE xtol_val, VALUE ftol_val, VALUE jtol_val, VALUE maxiter) {
-  F77_int inc = 1;
-  double xtol = NUM2DBL(xtol_val);
-  double ftol = NUM2DBL(ftol_val);
-  double jtol = NUM2DBL(jtol_val);
-  int32_t max_iter = NUM2INT(maxiter);
+/* The pool is kept between the calls and recreated when another number of threads is requested. */
+static worker_pool* many_pool = NULL;
+static bool many_pool_busy = false;
 
-  if (CLASS_OF(x_val) != numo_cDFloat) {
-    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
-  }
-  if (!RTEST(nary_check_contiguous(x_val))) {
-    x_val = nary_dup(x_val);
+/* Returns the numbers of doubles and 64-bit integers of the scratch arrays used to solve the problem. */
+static void many_scratch_length(const many_problem* pr, int64_t* dbuf_len, int64_t* ibuf_len) {
+  const int64_t n = pr->n;
+  switch (pr->method) {
+  case MANY_LBFGSB:
+    *dbuf_len = lbfgsb_wa_length(n, pr->m) + n;
+    *ibuf_len = 4 * n;
+    break;
+  case MANY_SCG:
+    *dbuf_len = (scg_bytes(n) + (int64_t)sizeof(double) - 1) / (int64_t)sizeof(double);
+    *ibuf_len = 0;
+    break;
+  default:
+    *dbuf_len = (nm_batch_bytes(n, 1) + (int64_t)sizeof(double) - 1) / (int64_t)sizeof(double);
+    *ibuf_len = 0;
+    break;
   }
-  narray_t* x_nary = NULL;
-  GetNArray(x_val, x_nary);
-  if (NA_NDIM(x_nary) != 1) {
-    rb_raise(rb_eArgError, "x must be a 1-D array.");
-    return Qnil;
-  }
-  F77_int n = (F77_int)NA_SIZE(x_nary);
-
-  int32_t n_fev = 0;
-  int32_t n_jev = 0;
-  double f_prev = 0.0;
-  double f_curr = 0.0;
-  VALUE j_next_val = Qnil;
-  if (RB_TYPE_P(jcb, T_TRUE)) {
-    VALUE fg_arr = rb_funcall(self, rb_intern("fnc"), 3, fnc, x_val, args);
-    f_prev = NUM2DBL(rb_ary_entry(fg_arr, 0));
-    n_fev = 1;
-    f_curr = f_prev;
-    j_next_val = rb_ary_entry(fg_arr, 1);
-    n_jev = 1;
-  } else {
-    f_prev = NUM2DBL(rb_funcall(self, rb_intern("fnc"), 3, fnc, x_val, args));
-    n_fev = 1;
-    f_curr = f_prev;
-    j_next_val = rb_funcall(self, rb_intern("jcb"), 3, jcb, x_val, args);
-    n_jev = 1;
-  }
-  if (CLASS_OF(j_next_val) != numo_cDFloat) {
-    j_next_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, j_next_val);
-  }
-  if (!RTEST(nary_check_contiguous(j_next_val))) {
-    j_next_val = nary_dup(j_next_val);
-  }
-  double* j_next_ptr = (double*)na_get_pointer_for_read(j_next_val);
-  double j_norm = ddot_(&n, j_next_ptr, &inc, j_next_ptr, &inc);
-  VALUE j_prev_val = nary_dup(j_next_val);
-  double* d_vec = ALLOC_N(double, n);
-  for (F77_int i = 0; i < n; i++) {
-    d_vec[i] = -j_next_ptr[i];
-  }
-
-  bool success = true;
-  int32_t n_successes = 0;
-  int32_t n_iter = 0;
-  double mu = 0.0;
-  double kappa = 0.0;
-  double theta = 0.0;
-  double beta = 1.0;
-  double* j_diff_vec = ALLOC_N(double, n);
-
-  while (n_iter < max_iter) {
-    if (success) {
-      j_next_ptr = (double*)na_get_pointer_for_read(j_next_val);
-      mu = ddot_(&n, d_vec, &inc, j_next_ptr, &inc);
-      if (mu >= 0.0) {
-        for (F77_int i = 0; i < n; i++) {
-          d_vec[i] = -j_next_ptr[i];
-        }
-        mu = ddot_(&n, d_vec, &inc, j_next_ptr, &inc);
-      }
-      kappa = ddot_(&n, d_vec, &inc, d_vec, &inc);
-      if (kappa < 1e-16) {
-        break;
-      }
+}
 
-      double sigma = SIGMA_INIT / sqrt(kappa);
-      VALUE x_plus_val = nary_dup(x_val);
-      double* x_plus_ptr = (double*)na_get_pointer_for_read_write(x_plus_val);
-      daxpy_(&n, &sigma, d_vec, &inc, x_plus_ptr, &inc);
-      VALUE j_plus_val = Qnil;
-      if (RB_TYPE_P(jcb, T_TRUE)) {
-        VALUE fg_arr = rb_funcall(self, rb_intern("fnc"), 3, fnc, x_plus_val, args);
-        j_plus_val = rb_ary_entry(fg_arr, 1);
-        n_jev++;
-      } else {
-        j_plus_val = rb_funcall(self, rb_intern("jcb"), 3, jcb, x_plus_val, args);
-        n_jev++;
-      }
-      if (CLASS_OF(j_plus_val) != numo_cDFloat) {
-        j_plus_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, j_plus_val);
-      }
-      if (!RTEST(nary_check_contiguous(j_plus_val))) {
-        j_plus_val = nary_dup(j_plus_val);
-      }
-      double* j_plus_ptr = (double*)na_get_pointer_for_read(j_plus_val);
-      for (F77_int i = 0; i < n; i++) {
-        j_diff_vec[i] = j_plus_ptr[i] - j_next_ptr[i];
-      }
-      theta = ddot_(&n, d_vec, &inc, j_diff_vec, &inc);
-      theta /= sigma;
-      RB_GC_GUARD(x_plus_val);
-      RB_GC_GUARD(j_plus_val);
-    }
-
-    double delta = theta + beta * kappa;
-    if (delta <= 0.0) {
-      delta = beta * kappa;
-      beta -= theta / kappa;
-    }
-    double alpha = -mu / delta;
-
-    VALUE x_next_val = nary_dup(x_val);
-    double* x_next_ptr = (double*)na_get_pointer_for_read_write(x_next_val);
-    daxpy_(&n, &alpha, d_vec, &inc, x_next_ptr, &inc);
-    double f_next = 0.0;
-    if (RB_TYPE_P(jcb, T_TRUE)) {
-      VALUE fg_arr = rb_funcall(self, rb_intern("fnc"), 3, fnc, x_next_val, args);
-      f_next = NUM2DBL(rb_ary_entry(fg_arr, 0));
-      n_fev++;
+static void many_lbfgsb_solve(many_problem* pr, double* dbuf, int64_t* ibuf, const worker_pool* pool) {
+  const int64_t n = pr->n;
+  lbfgsb_workspace ws;
+  lbfgsb_state st;
+
+  /* The workspace borrows the scratch arrays of the worker, which are large enough for any problem in the run. */
+  ws.use_int64 = lbfgsb_needs_int64(n, pr->m);
+  ws.n = n;
+  ws.m = pr->m;
+  ws.g = pr->g;
+  ws.wa = dbuf;
+  ws.iwa = ibuf;
+  ws.nbd = ibuf + 3 * n;
+  ws.lu = dbuf + lbfgsb_wa_length(n, pr->m);
+  ws.busy = true;
+
+  const double* l = pr->l;
+  const double* u = pr->u;
+  for (int64_t i = 0; i < n; i++) {
+    const int64_t v = pr->nbd == NULL ? 0 : (pr->nbd_int64 ? ((const int64_t*)pr->nbd)[i] : ((const int32_t*)pr->nbd)[i]);
+    if (ws.use_int64) {
+      ((int64_t*)ws.nbd)[i] = v;
     } else {
-      f_next = NUM2DBL(rb_funcall(self, rb_intern("fnc"), 3, fnc, x_next_val, args));
-      n_fev++;
+      ((F77_int*)ws.nbd)[i] = (F77_int)v;
     }
+  }
+  if (pr->nbd == NULL) {
+    memset(ws.lu, 0, n * sizeof(double));
+    l = ws.lu;
+    u = ws.lu;
+  }
+
+  memset(&st, 0, sizeof(st));
+  st.iprint = -1;
+  strcpy(st.task, "START");
+  pr->f = 0.0;
+  memset(pr->g, 0, n * sizeof(double));
 
-    delta = 2 * (f_next - f_prev) / (alpha * mu);
-    if (delta >= 0.0) {
-      success = true;
-      n_successes++;
-      x_val = nary_dup(x_next_val);
-      f_curr = f_next;
+  while (pr->n_iter < pr->max_iter) {
+    if (worker_pool_cancelled(pool)) {
+      strcpy(st.task, "CANCELLED");
+      break;
+    }
+    lbfgsb_setulb(&ws, &st, pr->x, (double*)l, (double*)u, ws.nbd, &pr->f, &pr->factr, &pr->pgtol);
+    if (strncmp(st.task, "FG", 2) == 0) {
+      pr->f = pr->obj->fg(n, pr->x, pr->g, pr->obj->data);
+      pr->n_fev++;
+      pr->n_jev++;
+    } else if (strncmp(st.task, "NEW_X", 5) == 0) {
+      pr->n_iter++;
     } else {
-      success = false;
-      f_curr = f_prev;
+      break;
     }
+  }
+  strcpy(pr->task, st.task);
+}
 
-    RB_GC_GUARD(x_next_val);
-    n_iter++;
+/* Same iteration as scg_fmin, driven with the native objective. */
+static void many_scg_solve(many_problem* pr, double* dbuf, const worker_pool* pool) {
+  const int64_t n = pr->n;
+  const native_objective* obj = pr->obj;
+  scg_state scg;
 
-    if (success) {
-      if (fabs(f_next - f_prev) < ftol) {
-        break;
-      }
-      double err = 0.0;
-      for (F77_int i = 0; i < n; i++) {
-        err = fmax(err, fabs(alpha * d_vec[i]));
-      }
-      if (err < xtol) {
+  scg_init(&scg, n, pr->x, dbuf);
+  scg.max_iter = pr->max_iter;
+  scg.xtol = pr->xtol;
+  scg.ftol = pr->ftol;
+  scg.jtol = pr->jtol;
+  for (int req = scg_run(&scg); req != SCG_DONE; req = scg_run(&scg)) {
+    if (req == SCG_ITERATE) {
+      if (worker_pool_cancelled(pool)) {
+        strcpy(pr->task, "CANCELLED");
         break;
       }
+    } else if (req == SCG_EVAL_FG) {
+      scg.fval = obj->fg(n, scg.pts, scg.gval, obj->data);
+      pr->n_fev++;
+      pr->n_jev++;
+    } else if (req == SCG_EVAL_F) {
+      scg.fval = obj->fg(n, scg.pts, NULL, obj->data);
+      pr->n_fev++;
+    } else if (req == SCG_EVAL_G) {
+      obj->fg(n, scg.pts, scg.gval, obj->data);
+      pr->n_jev++;
+    }
+  }
 
-      f_prev = f_next;
+  pr->f = scg.f;
+  pr->n_iter = scg.n_iter;
+  memcpy(pr->g, scg.j, n * sizeof(double));
+}
 
-      j_prev_val = nary_dup(j_next_val);
-      if (RB_TYPE_P(jcb, T_TRUE)) {
-        VALUE fg_arr = rb_funcall(self, rb_intern("fnc"), 3, fnc, x_val, args);
-        j_next_val = rb_ary_entry(fg_arr, 1);
-        n_jev++;
-      } else {
-        j_next_val = rb_funcall(self, rb_intern("jcb"), 3, jcb, x_val, args);
-        n_jev++;
-      }
-      if (CLASS_OF(j_next_val) != numo_cDFloat) {
-        j_next_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, j_next_val);
-      }
-      if (!RTEST(nary_check_contiguous(j_next_val))) {
-        j_next_val = nary_dup(j_next_val);
-      }
-      j_next_ptr = (double*)na_get_pointer_for_read(j_next_val);
-      j_norm = ddot_(&n, j_next_ptr, &inc, j_next_ptr, &inc);
-      if (j_norm <= jtol) {
-        break;
-      }
-    }
+static void many_nelder_mead_solve(many_problem* pr, double* dbuf, const worker_pool* pool) {
+  const int64_t n = pr->n;
+  const native_objective* obj = pr->obj;
+  nm_batch nm;
 
-    if (delta < 0.25) {
-      beta = fmin(beta * 4, BETA_MAX);
-    } else if (delta > 0.75) {
-      beta = fmax(beta / 4, BETA_MIN);
+  nm_batch_init(&nm, n, 1, dbuf);
+  nm.max_iter = pr->max_iter;
+  nm.xtol = pr->xtol;
+  nm.ftol = pr->ftol;
+  memcpy(nm.sim, pr->x, n * sizeof(double));
+  while (nm_batch_run(&nm) == NM_BATCH_EVAL) {
+    if (worker_pool_cancelled(pool)) {
+      strcpy(pr->task, "CANCELLED");
+      break;
     }
-
-    j_next_ptr = (double*)na_get_pointer_for_read(j_next_val);
-    if (n_successes == n) {
-      for (F77_int i = 0; i < n; i++) {
-        d_vec[i] = -j_next_ptr[i];
-      }
-      beta = 1.0;
-      n_successes = 0;
-    } else if (success) {
-      double* j_prev_ptr = (double*)na_get_pointer_for_read(j_prev_val);
-      for (F77_int i = 0; i < n; i++) {
-        j_diff_vec[i] = j_prev_ptr[i] - j_next_ptr[i];
-      }
-      double gamma = ddot_(&n, j_diff_vec, &inc, j_next_ptr, &inc);
-      gamma /= mu;
-      for (F77_int i = 0; i < n; i++) {
-        d_vec[i] = -j_next_ptr[i] + gamma * d_vec[i];
-      }
+    if (obj->fg != NULL) {
+      nm.fval[0] = obj->fg(n, nm.pts, NULL, obj->data);
+    } else {
+      obj->batch_f(n, 1, nm.pts, nm.fval, obj->data);
     }
   }
+  nm_batch_best(&nm, pr->x, &pr->f);
+  pr->n_iter = nm.n_iter[0];
+  pr->n_fev = nm.n_fev[0];
+}
 
-  xfree(j_diff_vec);
-  xfree(d_vec);
-
-  VALUE ret = rb_hash_new();
-  rb_hash_aset(ret, ID2SYM(rb_intern("task")), Qnil);
-  rb_hash_aset(ret, ID2SYM(rb_intern("x")), x_val);
-  rb_hash_aset(ret, ID2SYM(rb_intern("fnc")), DBL2NUM(f_curr));
-  rb_hash_aset(ret, ID2SYM(rb_intern("jcb")), j_next_val);
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), INT2NUM(n_iter));
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), INT2NUM(n_fev));
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_jev")), INT2NUM(n_jev));
-  rb_hash_aset(ret, ID2SYM(rb_intern("success")), n_iter < max_iter ? Qtrue : Qfalse);
+static void many_run_task(void* arg, int64_t task, int worker) {
+  many_ctx* ctx = (many_ctx*)arg;
+  many_problem* pr = &ctx->problems[task];
+  double* dbuf = ctx->dbuf + worker * ctx->dbuf_len;
+  int64_t* ibuf = ctx->ibuf + worker * ctx->ibuf_len;
 
-  RB_GC_GUARD(x_val);
-  RB_GC_GUARD(j_next_val);
-  RB_GC_GUARD(j_prev_val);
+  switch (pr->method) {
+  case MANY_LBFGSB:
+    many_lbfgsb_solve(pr, dbuf, ibuf, ctx->pool);
+    break;
+  case MANY_SCG:
+    many_scg_solve(pr, dbuf, ctx->pool);
+    break;
+  default:
+    many_nelder_mead_solve(pr, dbuf, ctx->pool);
+    break;
+  }
+}
 
-  return ret;
+static void* many_run_without_gvl(void* data) {
+  many_ctx* ctx = (many_ctx*)data;
+  worker_pool_run(ctx->pool, ctx->n_problems, many_run_task, ctx);
+  return NULL;
 }
 
-static VALUE lbfgsb_fmin(VALUE self, VALUE fnc, VALUE x_val, VALUE jcb, VALUE args, VALUE l_val, VALUE u_val,
-                         VALUE nbd_val, VALUE maxcor, VALUE ftol, VALUE gtol, VALUE maxiter, VALUE disp) {
-  F77_int n_iter;
-  F77_int n_fev;
-  F77_int n_jev;
-#ifdef USE_INT64
-  F77_int max_iter = NUM2LONG(maxiter);
-#else
-  F77_int max_iter = NUM2INT(maxiter);
-#endif
-  narray_t* x_nary;
-  narray_t* l_nary;
-  narray_t* u_nary;
-  narray_t* nbd_nary;
-  F77_int n;
-#ifdef USE_INT64
-  F77_int m = NUM2LONG(maxcor);
-#else
-  F77_int m = NUM2INT(maxcor);
-#endif
-  double* x_ptr;
-  double* l_ptr;
-  double* u_ptr;
-  F77_int* nbd_ptr;
-  double f;
-  double* g;
-  double factr = NUM2DBL(ftol);
-  double pgtol = NUM2DBL(gtol);
-  double* wa;
-  F77_int* iwa;
-  char task[60];
-#ifdef USE_INT64
-  F77_int iprint = NIL_P(disp) ? -1 : NUM2LONG(disp);
-#else
-  F77_int iprint = NIL_P(disp) ? -1 : NUM2INT(disp);
-#endif
-  char csave[60];
-  F77_int lsave[4];
-  F77_int isave[44];
-  double dsave[29];
-  VALUE g_val;
-  VALUE fg_arr;
-  VALUE ret;
+static void many_unblock(void* data) {
+  many_ctx* ctx = (many_ctx*)data;
+  worker_pool_cancel(ctx->pool);
+}
 
-  GetNArray(x_val, x_nary);
-  if (NA_NDIM(x_nary) != 1) {
-    rb_raise(rb_eArgError, "x must be a 1-D array.");
+static VALUE many_ensure(VALUE data) {
+  many_ctx* ctx = (many_ctx*)data;
+  xfree(ctx->problems);
+  xfree(ctx->dbuf);
+  xfree(ctx->ibuf);
+  if (ctx->pool == NULL) {
     return Qnil;
   }
-  n = (F77_int)NA_SIZE(x_nary);
-  if (CLASS_OF(x_val) != numo_cDFloat) {
-    x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  if (ctx->pool == many_pool) {
+    many_pool_busy = false;
+  } else {
+    worker_pool_destroy(ctx->pool);
   }
-  if (!RTEST(nary_check_contiguous(x_val))) {
-    x_val = nary_dup(x_val);
+  return Qnil;
+}
+
+static VALUE many_problem_result(const many_problem* pr, VALUE x_val, VALUE g_val) {
+  VALUE ret = rb_hash_new();
+  if (pr->method == MANY_NELDER_MEAD) {
+    rb_hash_aset(ret, ID2SYM(rb_intern("x")), x_val);
+    rb_hash_aset(ret, ID2SYM(rb_intern("fnc")), DBL2NUM(pr->f));
+    rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), LL2NUM(pr->n_iter));
+    rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), LL2NUM(pr->n_fev));
+    return ret;
+  }
+  bool success = false;
+  if (pr->method == MANY_LBFGSB) {
+    success = strncmp(pr->task, "CONV", 4) == 0;
+  } else {
+    success = pr->n_iter < pr->max_iter && pr->task[0] == '\0';
   }
+  rb_hash_aset(ret, ID2SYM(rb_intern("task")), pr->task[0] == '\0' ? Qnil : rb_str_new_cstr(pr->task));
+  rb_hash_aset(ret, ID2SYM(rb_intern("x")), x_val);
+  rb_hash_aset(ret, ID2SYM(rb_intern("fnc")), DBL2NUM(pr->f));
+  rb_hash_aset(ret, ID2SYM(rb_intern("jcb")), reshape_like(g_val, x_val));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), LL2NUM(pr->n_iter));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), LL2NUM(pr->n_fev));
+  rb_hash_aset(ret, ID2SYM(rb_intern("n_jev")), LL2NUM(pr->n_jev));
+  rb_hash_aset(ret, ID2SYM(rb_intern("success")), success ? Qtrue : Qfalse);
+  return ret;
+}
 
-  GetNArray(l_val, l_nary);
-  if (NA_NDIM(l_nary) != 1) {
-    rb_raise(rb_eArgError, "l must be a 1-D array.");
-    return Qnil;
+/* Reads the problem from the normalized Hash given by Numo::Optimize.minimize_many. */
+static void many_problem_read(many_problem* pr, VALUE prb_val, VALUE refs) {
+  VALUE method_val = rb_hash_aref(prb_val, ID2SYM(rb_intern("method")));
+  VALUE x_val = rb_hash_aref(prb_val, ID2SYM(rb_intern("x")));
+  VALUE l_val = rb_hash_aref(prb_val, ID2SYM(rb_intern("l")));
+  VALUE u_val = rb_hash_aref(prb_val, ID2SYM(rb_intern("u")));
+  VALUE nbd_val = rb_hash_aref(prb_val, ID2SYM(rb_intern("nbd")));
+  narray_t* x_nary = NULL;
+
+  pr->obj = get_native_objective(rb_hash_aref(prb_val, ID2SYM(rb_intern("fnc"))));
+  if (pr->obj == NULL) {
+    rb_raise(rb_eArgError, "fnc of minimize_many must be Numo::Optimize::NativeObjective.");
   }
-  if ((F77_int)NA_SIZE(l_nary) != n) {
-    rb_raise(rb_eArgError, "The size of l must be equal to that of x.");
-    return Qnil;
+  const char* method = StringValueCStr(method_val);
+  if (strcmp(method, "lbfgsb") == 0) {
+    pr->method = MANY_LBFGSB;
+  } else if (strcmp(method, "scg") == 0) {
+    pr->method = MANY_SCG;
+  } else if (strcmp(method, "neldermead") == 0) {
+    pr->method = MANY_NELDER_MEAD;
+  } else {
+    rb_raise(rb_eArgError, "Unknown method: %s", method);
+  }
+  if (pr->method != MANY_NELDER_MEAD && pr->obj->fg == NULL) {
+    rb_raise(rb_eArgError, "The native objective must have fg to compute the gradient.");
   }
-  if (CLASS_OF(l_val) != numo_cDFloat) {
-    l_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, l_val);
+
+  /* x is updated in place, so the given array is always copied. */
+  x_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, x_val);
+  x_val = nary_dup(x_val);
+  GetNArray(x_val, x_nary);
+  pr->n = (int64_t)NA_SIZE(x_nary);
+  if (pr->n <= 0) {
+    rb_raise(rb_eArgError, "x must not be empty.");
   }
-  if (!RTEST(nary_check_contiguous(l_val))) {
-    l_val = nary_dup(l_val);
+  pr->x = (double*)na_get_pointer_for_read_write(x_val);
+  VALUE g_val = rb_funcall(numo_cDFloat, rb_intern("zeros"), 1, LL2NUM(pr->n));
+  pr->g = (double*)na_get_pointer_for_write(g_val);
+
+  pr->l = NULL;
+  pr->u = NULL;
+  pr->nbd = NULL;
+  pr->nbd_int64 = false;
+  if (pr->method == MANY_LBFGSB && !NIL_P(nbd_val)) {
+    lbfgsb_prepare_bounds(&l_val, &u_val, &nbd_val, pr->n);
+    pr->l = (double*)na_get_pointer_for_read(l_val);
+    pr->u = (double*)na_get_pointer_for_read(u_val);
+    pr->nbd = (void*)na_get_pointer_for_read(nbd_val);
+    pr->nbd_int64 = CLASS_OF(nbd_val) == numo_cInt64;
   }
 
-  GetNArray(u_val, u_nary);
-  if (NA_NDIM(u_nary) != 1) {
-    rb_raise(rb_eArgError, "u must be a 1-D array.");
-    return Qnil;
+  pr->m = NUM2LL(rb_hash_aref(prb_val, ID2SYM(rb_intern("maxcor"))));
+  if (pr->method == MANY_LBFGSB && pr->m <= 0) {
+    rb_raise(rb_eArgError, "maxcor must be a positive integer.");
   }
-  if ((F77_int)NA_SIZE(u_nary) != n) {
-    rb_raise(rb_eArgError, "The size of u must be equal to that of x.");
-    return Qnil;
+  pr->factr = NUM2DBL(rb_hash_aref(prb_val, ID2SYM(rb_intern("factr"))));
+  pr->pgtol = NUM2DBL(rb_hash_aref(prb_val, ID2SYM(rb_intern("pgtol"))));
+  pr->xtol = NUM2DBL(rb_hash_aref(prb_val, ID2SYM(rb_intern("xtol"))));
+  pr->ftol = NUM2DBL(rb_hash_aref(prb_val, ID2SYM(rb_intern("ftol"))));
+  pr->jtol = NUM2DBL(rb_hash_aref(prb_val, ID2SYM(rb_intern("jtol"))));
+  pr->max_iter = NUM2LL(rb_hash_aref(prb_val, ID2SYM(rb_intern("maxiter"))));
+  pr->f = 0.0;
+  pr->n_iter = 0;
+  pr->n_fev = 0;
+  pr->n_jev = 0;
+  pr->task[0] = '\0';
+
+  /* Keep the arrays read and written by the workers alive until the run ends. */
+  rb_ary_push(refs, x_val);
+  rb_ary_push(refs, g_val);
+  rb_ary_push(refs, l_val);
+  rb_ary_push(refs, u_val);
+  rb_ary_push(refs, nbd_val);
+}
+
+static VALUE many_loop(VALUE data) {
+  many_ctx* ctx = (many_ctx*)data;
+  const int n_threads = ctx->n_threads;
+
+  for (int64_t i = 0; i < ctx->n_problems; i++) {
+    int64_t dbuf_len = 0;
+    int64_t ibuf_len = 0;
+    many_problem_read(&ctx->problems[i], rb_ary_entry(ctx->problems_val, i), ctx->refs);
+    many_scratch_length(&ctx->problems[i], &dbuf_len, &ibuf_len);
+    ctx->dbuf_len = dbuf_len > ctx->dbuf_len ? dbuf_len : ctx->dbuf_len;
+    ctx->ibuf_len = ibuf_len > ctx->ibuf_len ? ibuf_len : ctx->ibuf_len;
   }
-  if (CLASS_OF(u_val) != numo_cDFloat) {
-    u_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, u_val);
+  ctx->dbuf = ALLOC_N(double, n_threads * ctx->dbuf_len);
+  ctx->ibuf = ALLOC_N(int64_t, n_threads * ctx->ibuf_len + 1);
+
+  /* Reuse the persistent pool unless it is running on another Ruby thread. */
+  if (many_pool_busy) {
+    ctx->pool = worker_pool_create(n_threads);
+  } else {
+    if (many_pool == NULL || worker_pool_size(many_pool) != n_threads) {
+      worker_pool_destroy(many_pool);
+      many_pool = worker_pool_create(n_threads);
+    }
+    ctx->pool = many_pool;
+    many_pool_busy = ctx->pool != NULL;
   }
-  if (!RTEST(nary_check_contiguous(u_val))) {
-    u_val = nary_dup(u_val);
+  if (ctx->pool == NULL) {
+    rb_raise(rb_eNoMemError, "failed to create the worker threads.");
   }
 
-  GetNArray(nbd_val, nbd_nary);
-  if (NA_NDIM(nbd_nary) != 1) {
-    rb_raise(rb_eArgError, "nbd must be a 1-D array.");
-    return Qnil;
+  worker_pool_reset_cancel(ctx->pool);
+  rb_thread_call_without_gvl(many_run_without_gvl, ctx, many_unblock, ctx);
+  /* Raise Interrupt or the other pending exception if the run was cancelled. */
+  rb_thread_check_ints();
+
+  ctx->ret = rb_ary_new_capa(ctx->n_problems);
+  for (int64_t i = 0; i < ctx->n_problems; i++) {
+    VALUE x_val = rb_ary_entry(ctx->refs, 5 * i);
+    VALUE g_val = rb_ary_entry(ctx->refs, 5 * i + 1);
+    rb_ary_push(ctx->ret, many_problem_result(&ctx->problems[i], x_val, g_val));
   }
-  if ((F77_int)NA_SIZE(nbd_nary) != n) {
-    rb_raise(rb_eArgError, "The size of nbd must be equal to that of x.");
+  return Qnil;
+}
+
+static VALUE optimize_fmin_many(VALUE self, VALUE problems, VALUE threads) {
+  many_ctx ctx;
+
+  Check_Type(problems, T_ARRAY);
+  const int64_t n_problems = RARRAY_LEN(problems);
+  int n_threads = NUM2INT(threads);
+  if (n_threads < 1) {
+    rb_raise(rb_eArgError, "threads must be a positive integer.");
     return Qnil;
   }
-#ifdef USE_INT64
-  if (CLASS_OF(nbd_val) != numo_cInt64) {
-    nbd_val = rb_funcall(numo_cInt64, rb_intern("cast"), 1, nbd_val);
+  if (n_problems == 0) {
+    return rb_ary_new();
   }
-#else
-  if (CLASS_OF(nbd_val) != numo_cInt32) {
-    nbd_val = rb_funcall(numo_cInt32, rb_intern("cast"), 1, nbd_val);
+  if (n_threads > n_problems) {
+    n_threads = (int)n_problems;
   }
-#endif
-  if (!RTEST(nary_check_contiguous(nbd_val))) {
-    nbd_val = nary_dup(nbd_val);
-  }
-
-  x_ptr = (double*)na_get_pointer_for_read_write(x_val);
-  l_ptr = (double*)na_get_pointer_for_read(l_val);
-  u_ptr = (double*)na_get_pointer_for_read(u_val);
-  nbd_ptr = (F77_int*)na_get_pointer_for_read(nbd_val);
-  g = ALLOC_N(double, n);
-  wa = ALLOC_N(double, (2 * m + 5) * n + 12 * m * m + 12 * m);
-  iwa = ALLOC_N(F77_int, 3 * n);
-
-  g_val = Qnil;
-  f = 0.0;
-  memset(g, 0, n * sizeof(*g));
-  strcpy(task, "START");
-  n_fev = 0;
-  n_jev = 0;
-
-  for (n_iter = 0; n_iter < max_iter;) {
-    setulb_(&n, &m, x_ptr, l_ptr, u_ptr, nbd_ptr, &f, g, &factr, &pgtol, wa, iwa, task, &iprint, csave, lsave, isave, dsave);
-    if (strncmp(task, "FG", 2) == 0) {
-      if (RB_TYPE_P(jcb, T_TRUE)) {
-        fg_arr = rb_funcall(self, rb_intern("fnc"), 3, fnc, x_val, args);
-        f = NUM2DBL(rb_ary_entry(fg_arr, 0));
-        g_val = rb_ary_entry(fg_arr, 1);
-      } else {
-        f = NUM2DBL(rb_funcall(self, rb_intern("fnc"), 3, fnc, x_val, args));
-        g_val = rb_funcall(self, rb_intern("jcb"), 3, jcb, x_val, args);
-      }
-      n_fev++;
-      n_jev++;
-      if (CLASS_OF(g_val) != numo_cDFloat)
-        g_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, g_val);
-      if (!RTEST(nary_check_contiguous(g_val)))
-        g_val = nary_dup(g_val);
-      memcpy(g, na_get_pointer_for_read(g_val), n * sizeof(*g));
-      RB_GC_GUARD(g_val);
-    } else if (strncmp(task, "NEW_X", 5) == 0) {
-      n_iter++;
-    } else {
-      break;
-    }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.problems_val = problems;
+  ctx.n_problems = n_problems;
+  ctx.n_threads = n_threads;
+  ctx.refs = rb_ary_new_capa(5 * n_problems);
+  ctx.ret = Qnil;
+  ctx.problems = ALLOC_N(many_problem, n_problems);
+
+  rb_ensure(many_loop, (VALUE)&ctx, many_ensure, (VALUE)&ctx);
+
+  RB_GC_GUARD(ctx.refs);
+  RB_GC_GUARD(problems);
+
+  return ctx.ret;
+}
+
+static VALUE lbfgsb_classify_bounds(VALUE self, VALUE bounds_val) {
+  narray_t* bounds_nary = NULL;
+
+  if (CLASS_OF(bounds_val) != numo_cDFloat) {
+    bounds_val = rb_funcall(numo_cDFloat, rb_intern("cast"), 1, bounds_val);
+  }
+  if (!RTEST(nary_check_contiguous(bounds_val))) {
+    bounds_val = nary_dup(bounds_val);
+  }
+  GetNArray(bounds_val, bounds_nary);
+  if (NA_NDIM(bounds_nary) != 2 || NA_SHAPE(bounds_nary)[1] != 2) {
+    rb_raise(rb_eArgError, "bounds must be a 2-D array of shape [n_elements, 2].");
+    return Qnil;
   }
 
-  xfree(g);
-  xfree(wa);
-  xfree(iwa);
+  size_t n = NA_SHAPE(bounds_nary)[0];
+  VALUE l_val = nary_new(numo_cDFloat, 1, &n);
+  VALUE u_val = nary_new(numo_cDFloat, 1, &n);
+  VALUE nbd_val = nary_new(numo_cInt32, 1, &n);
+  const double* bounds_ptr = (double*)na_get_pointer_for_read(bounds_val);
+  double* l_ptr = (double*)na_get_pointer_for_write(l_val);
+  double* u_ptr = (double*)na_get_pointer_for_write(u_val);
+  int32_t* nbd_ptr = (int32_t*)na_get_pointer_for_write(nbd_val);
 
-  ret = rb_hash_new();
-  rb_hash_aset(ret, ID2SYM(rb_intern("task")), rb_str_new_cstr(task));
-  rb_hash_aset(ret, ID2SYM(rb_intern("x")), x_val);
-  rb_hash_aset(ret, ID2SYM(rb_intern("fnc")), DBL2NUM(f));
-  rb_hash_aset(ret, ID2SYM(rb_intern("jcb")), g_val);
-#ifdef USE_INT64
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), LONG2NUM(n_iter));
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), LONG2NUM(n_fev));
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_jev")), LONG2NUM(n_jev));
-#else
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_iter")), INT2NUM(n_iter));
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_fev")), INT2NUM(n_fev));
-  rb_hash_aset(ret, ID2SYM(rb_intern("n_jev")), INT2NUM(n_jev));
-#endif
-  rb_hash_aset(ret, ID2SYM(rb_intern("success")), strncmp(task, "CONV", 4) == 0 ? Qtrue : Qfalse);
+  for (size_t i = 0; i < n; i++) {
+    const double lower = bounds_ptr[2 * i];
+    const double upper = bounds_ptr[2 * i + 1];
+    const bool has_lower = isfinite(lower);
+    const bool has_upper = isfinite(upper);
+    l_ptr[i] = lower;
+    u_ptr[i] = upper;
+    nbd_ptr[i] = has_lower ? (has_upper ? 2 : 1) : (has_upper ? 3 : 0);
+  }
 
-  RB_GC_GUARD(x_val);
-  RB_GC_GUARD(l_val);
-  RB_GC_GUARD(u_val);
-  RB_GC_GUARD(nbd_val);
+  RB_GC_GUARD(bounds_val);
 
-  return ret;
+  return rb_ary_new3(3, l_val, u_val, nbd_val);
 }
 
 RUBY_FUNC_EXPORTED void
@@ -428,36 +3408,308 @@ Init_optimize(void) {
    * Document-module: Numo::Optimize::Scg
    */
   rb_mScg = rb_define_module_under(rb_mOptimize, "Scg");
+  /**
+   * Document-module: Numo::Optimize::NelderMead
+   */
+  rb_mNelderMead = rb_define_module_under(rb_mOptimize, "NelderMead");
+  /**
+   * Document-class: Numo::Optimize::NativeObjective
+   *
+   * NativeObjective wraps objective functions written in C so that the solvers call them without Ruby method calls.
+   * The functions have the following signatures, where x[i * k + p] of batch_f is the i-th element of the p-th point:
+   *
+   *   double fg(int64_t n, const double* x, double* g, void* data);  // returns f, and stores gradient in g unless g is NULL
+   *   void batch_f(int64_t n, int64_t k, const double* x, double* f, void* data);
+   *
+   * @example
+   *   require 'fiddle'
+   *   lib = Fiddle.dlopen('./libmyobjective.so')
+   *   obj = Numo::Optimize::NativeObjective.new(lib['my_fg'], lib['my_batch_f'])
+   *   Numo::Optimize.minimize_batch(fnc: obj, x_init: x, method: 'Nelder-Mead')
+   */
+  rb_cNativeObjective = rb_define_class_under(rb_mOptimize, "NativeObjective", rb_cObject);
+  rb_define_alloc_func(rb_cNativeObjective, native_objective_alloc);
+  /**
+   * Create a new native objective from the addresses of the functions.
+   *
+   * @overload new(fg, batch_f, data = nil)
+   *   @param fg [Integer/Fiddle::Pointer/nil] The address of fg.
+   *   @param batch_f [Integer/Fiddle::Pointer/nil] The address of batch_f.
+   *   @param data [Integer/Fiddle::Pointer/nil] The address given to the functions as data.
+   *   @return [Numo::Optimize::NativeObjective]
+   */
+  rb_define_method(rb_cNativeObjective, "initialize", native_objective_initialize, -1);
+  /**
+   * Return whether fg is given.
+   * @return [Boolean]
+   */
+  rb_define_method(rb_cNativeObjective, "fg?", native_objective_has_fg, 0);
+  /**
+   * Return whether batch_f is given.
+   * @return [Boolean]
+   */
+  rb_define_method(rb_cNativeObjective, "batch_f?", native_objective_has_batch_f, 0);
+#ifdef NUMO_OPTIMIZE_FIXTURES
+  /**
+   * Return the native objective built in the extension for tests and benchmarks.
+   * It is defined only when the extension is built with --enable-fixtures, as rake compile does.
+   *
+   * @!visibility private
+   * @overload fixture(name)
+   *   @param name [Symbol/String] :rosenbrock (the extended Rosenbrock function) or :sphere (the sum of squares).
+   *   @return [Numo::Optimize::NativeObjective]
+   */
+  rb_define_singleton_method(rb_cNativeObjective, "fixture", native_objective_fixture, 1);
+#endif
+  /**
+   * Document-class: Numo::Optimize::SharedMemory
+   *
+   * SharedMemory is an array of doubles in an anonymous shared mapping.
+   * The processes forked after its creation read and write the same memory, which is used by
+   * Numo::Optimize::ForkedObjective to exchange the points and the partial results with the workers.
+   */
+  rb_cSharedMemory = rb_define_class_under(rb_mOptimize, "SharedMemory", rb_cObject);
+  rb_define_alloc_func(rb_cSharedMemory, shared_memory_alloc);
+  /**
+   * Create a new shared memory.
+   *
+   * @overload new(size)
+   *   @param size [Integer] The number of doubles.
+   *   @return [Numo::Optimize::SharedMemory]
+   */
+  rb_define_method(rb_cSharedMemory, "initialize", shared_memory_initialize, 1);
+  /**
+   * Return the number of doubles.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cSharedMemory, "size", shared_memory_get_size, 0);
+  /**
+   * Copy the elements of the array into the shared memory.
+   *
+   * @overload write(offset, array)
+   *   @param offset [Integer] The index of the first double to be written.
+   *   @param array [Numo::DFloat]
+   *   @return [Numo::Optimize::SharedMemory] self
+   */
+  rb_define_method(rb_cSharedMemory, "write", shared_memory_write, 2);
+  /**
+   * Copy the doubles of the shared memory into a new array.
+   *
+   * @overload read(offset, length)
+   *   @param offset [Integer] The index of the first double to be read.
+   *   @param length [Integer] The number of doubles.
+   *   @return [Numo::DFloat] (shape: [length])
+   */
+  rb_define_method(rb_cSharedMemory, "read", shared_memory_read, 2);
+  /**
+   * Sum up the consecutive blocks of the shared memory.
+   *
+   * @overload reduce(offset, length, count)
+   *   @param offset [Integer] The index of the first double of the first block.
+   *   @param length [Integer] The number of doubles of a block.
+   *   @param count [Integer] The number of blocks.
+   *   @return [Numo::DFloat] (shape: [length]) The sum of the blocks.
+   */
+  rb_define_method(rb_cSharedMemory, "reduce", shared_memory_reduce, 3);
+  /**
+   * Document-class: Numo::Optimize::EvalCache
+   *
+   * EvalCache keeps the function values at the least recently used points of n elements,
+   * which are compared bit by bit. It is used by the Nelder-Mead method for the cache keyword argument of
+   * `Numo::Optimize.minimize`, while 'L-BFGS-B' and 'SCG' keep the same cache with the gradients in the solve.
+   *
+   * @example
+   *   cache = Numo::Optimize::EvalCache.new(x.size, 16)
+   *   f = cache[x] || (cache[x] = fnc.call(x))
+   */
+  rb_cEvalCache = rb_define_class_under(rb_mOptimize, "EvalCache", rb_cObject);
+  rb_define_alloc_func(rb_cEvalCache, eval_cache_object_alloc);
+  /**
+   * Create a new cache.
+   *
+   * @overload new(n, capacity)
+   *   @param n [Integer] The number of elements of the points.
+   *   @param capacity [Integer] The number of points kept in the cache.
+   *   @return [Numo::Optimize::EvalCache]
+   */
+  rb_define_method(rb_cEvalCache, "initialize", eval_cache_object_initialize, 2);
+  /**
+   * Return the function value at the point, or nil if it is not cached.
+   *
+   * @overload [](x)
+   *   @param x [Numo::DFloat] (shape: [n])
+   *   @return [Float/Nil]
+   */
+  rb_define_method(rb_cEvalCache, "[]", eval_cache_object_aref, 1);
+  /**
+   * Store the function value at the point, replacing the least recently used point if the cache is full.
+   *
+   * @overload []=(x, f)
+   *   @param x [Numo::DFloat] (shape: [n])
+   *   @param f [Float]
+   *   @return [Float]
+   */
+  rb_define_method(rb_cEvalCache, "[]=", eval_cache_object_aset, 2);
+  /**
+   * Return the number of lookups that have found the point.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cEvalCache, "hits", eval_cache_object_get_hits, 0);
+  /**
+   * Return the size of the native memory of the cache in bytes.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cEvalCache, "bytesize", eval_cache_object_get_bytesize, 0);
 
-#ifdef USE_INT64
-  /* The bit size of fortran integer. */
+#ifdef FORCE_INT64
+  /* The bit size of fortran integer used for problems that fit in 32-bit indexing. */
   rb_define_const(rb_mLbfgsb, "SZ_F77_INTEGER", INT2NUM(64));
 #else
-  /* The bit size of fortran integer. */
+  /* The bit size of fortran integer used for problems that fit in 32-bit indexing. */
   rb_define_const(rb_mLbfgsb, "SZ_F77_INTEGER", INT2NUM(32));
 #endif
+  /**
+   * Document-class: Numo::Optimize::Lbfgsb::Workspace
+   *
+   * Workspace keeps the work arrays of L-BFGS-B between solves.
+   * Giving it to `Numo::Optimize.minimize` with the workspace keyword argument avoids
+   * allocating the work arrays on every call when the same-sized problem is solved repeatedly.
+   * A workspace can not be used by several solves at the same time.
+   *
+   * @example
+   *   workspace = Numo::Optimize::Lbfgsb::Workspace.new(x.size, 10)
+   *   1000.times { Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, workspace: workspace) }
+   */
+  rb_cLbfgsbWorkspace = rb_define_class_under(rb_mLbfgsb, "Workspace", rb_cObject);
+  rb_define_alloc_func(rb_cLbfgsbWorkspace, lbfgsb_workspace_alloc);
+  /**
+   * Create a new workspace.
+   *
+   * @overload new(n, maxcor)
+   *   @param n [Integer] The number of variables.
+   *   @param maxcor [Integer] The maximum number of variable metric corrections.
+   *   @return [Numo::Optimize::Lbfgsb::Workspace]
+   */
+  rb_define_method(rb_cLbfgsbWorkspace, "initialize", lbfgsb_workspace_initialize, 2);
+  /**
+   * Return the number of variables.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cLbfgsbWorkspace, "n", lbfgsb_workspace_get_n, 0);
+  /**
+   * Return the maximum number of variable metric corrections.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cLbfgsbWorkspace, "maxcor", lbfgsb_workspace_get_maxcor, 0);
+  /**
+   * Return the size of the native buffers in bytes.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cLbfgsbWorkspace, "bytesize", lbfgsb_workspace_get_bytesize, 0);
+
+  /**
+   * Document-class: Numo::Optimize::Lbfgsb::State
+   *
+   * State is the curvature memory of L-BFGS-B (the correction pairs ws and wy, the matrices sy and ss, and theta)
+   * at the end of a solve. It is returned as the state of the result of `Numo::Optimize.minimize`,
+   * with return_state: true, and can be given to the next solve of the same-sized problem with the warm_start
+   * keyword argument so that the solve starts with the curvature information instead of the identity matrix.
+   *
+   * @example
+   *   res = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, return_state: true)
+   *   res = Numo::Optimize.minimize(fnc: updated_fnc, x_init: res[:x], jcb: updated_jcb, warm_start: res[:state])
+   */
+  rb_cLbfgsbState = rb_define_class_under(rb_mLbfgsb, "State", rb_cObject);
+  rb_undef_alloc_func(rb_cLbfgsbState);
+  /**
+   * Return the number of variables.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cLbfgsbState, "n", lbfgsb_memory_get_n, 0);
+  /**
+   * Return the number of correction pairs kept in the state.
+   * @return [Integer]
+   */
+  rb_define_method(rb_cLbfgsbState, "size", lbfgsb_memory_get_size, 0);
+
   /* The value of double epsilon used in the native extension. */
   rb_define_const(rb_mLbfgsb, "DBL_EPSILON", DBL2NUM(DBL_EPSILON));
   /**
    * Minimize a function using the L-BFGS-B algorithm.
    * This module function is for internal use. It is recommended to use `Numo::Optimize.minimize`.
    *
-   * @overload fmin(fnc, x, jcb, args, l, u, nbd, maxcor, ftol, gtol, maxiter, disp)
+   * @overload fmin(fnc, x, jcb, args, l, u, nbd, maxcor, ftol, gtol, maxiter, disp, opts)
    *   @param fnc [Method/Proc]
    *   @param x [Numo::DFloat]
    *   @param jcb [Method/Proc/boolean]
    *   @param args [Object]
-   *   @param l [Numo::DFloat]
-   *   @param u [Numo::DFloat]
-   *   @param nbd [Numo::Int32/Numo::Int64]
-   *   @param maxcor [Integer]
+   *   @param l [Numo::DFloat/nil]
+   *   @param u [Numo::DFloat/nil]
+   *   @param nbd [Numo::IntX/nil] If nil is given, x is unbounded and l and u are ignored.
+   *   @param maxcor [Integer] This argument is ignored if a workspace is given.
    *   @param ftol [Float]
    *   @param gtol [Float]
    *   @param maxiter [Integer]
    *   @param disp [Integer/nil]
+   *   @param opts [Hash/nil] Optional settings;
+   *     { workspace:, warm_start:, return_state:, checkpoint: { path:, every: }, resume_from:, memory_limit:, timeout:,
+   *       max_fev:, callback:, every:, trace:, log: }
+   *   @return [Hash{Symbol => Object}]
+   */
+  rb_define_module_function(rb_mLbfgsb, "fmin", lbfgsb_fmin, 13);
+  /**
+   * Classify the bounds of variables into the lower bounds, upper bounds, and bound types used by L-BFGS-B.
+   * This module function is for internal use. It is recommended to use `Numo::Optimize::Bounds`.
+   *
+   * @overload classify_bounds(bounds)
+   *   @param bounds [Numo::DFloat] (shape: [n_elements, 2])
+   *   @return [Array<Numo::DFloat, Numo::DFloat, Numo::Int32>] l, u, and nbd.
+   */
+  rb_define_module_function(rb_mLbfgsb, "classify_bounds", lbfgsb_classify_bounds, 1);
+  /**
+   * Minimize K functions of the same size using the L-BFGS-B algorithm in lock-step.
+   * This module function is for internal use. It is recommended to use `Numo::Optimize.minimize_batch`.
+   *
+   * @overload fmin_batch(fnc, x, jcb, args, l, u, nbd, maxcor, ftol, gtol, maxiter)
+   *   @param fnc [Method/Proc]
+   *   @param x [Numo::DFloat] (shape: [K, n])
+   *   @param jcb [Method/Proc/boolean]
+   *   @param args [Object]
+   *   @param l [Numo::DFloat/nil]
+   *   @param u [Numo::DFloat/nil]
+   *   @param nbd [Numo::IntX/nil] If nil is given, x is unbounded and l and u are ignored.
+   *   @param maxcor [Integer]
+   *   @param ftol [Float]
+   *   @param gtol [Float]
+   *   @param maxiter [Integer]
+   *   @return [Hash{Symbol => Object}]
+   */
+  rb_define_module_function(rb_mLbfgsb, "fmin_batch", lbfgsb_fmin_batch, 11);
+  /**
+   * Minimize K functions of the same size using the Nelder-Mead simplex algorithm in lock-step.
+   * The simplexes are laid out as structure of arrays over the problems.
+   * This module function is for internal use. It is recommended to use `Numo::Optimize.minimize_batch`.
+   *
+   * @overload fmin_batch(fnc, x, args, maxiter, xtol, ftol)
+   *   @param fnc [Method/Proc/Numo::Optimize::NativeObjective]
+   *   @param x [Numo::DFloat] (shape: [K, n])
+   *   @param args [Object]
+   *   @param maxiter [Integer/nil]
+   *   @param xtol [Float]
+   *   @param ftol [Float]
    *   @return [Hash{Symbol => Object}]
    */
-  rb_define_module_function(rb_mLbfgsb, "fmin", lbfgsb_fmin, 12);
+  rb_define_module_function(rb_mNelderMead, "fmin_batch", nelder_mead_fmin_batch, 6);
+  /**
+   * Solve the problems with native objectives on the persistent pool of native threads without the GVL.
+   * This module function is for internal use. It is recommended to use `Numo::Optimize.minimize_many`.
+   *
+   * @overload fmin_many(problems, threads)
+   *   @param problems [Array<Hash>] The problems normalized by `Numo::Optimize.minimize_many`.
+   *   @param threads [Integer] The number of threads.
+   *   @return [Array<Hash>]
+   */
+  rb_define_module_function(rb_mOptimize, "fmin_many", optimize_fmin_many, 2);
   /**
    * Minimize a function using the scaled conjugate gradient algorithm.
    * This module function is for internal use. It is recommended to use `Numo::Optimize.minimize`.
@@ -465,7 +3717,7 @@ Init_optimize(void) {
    * References:
    * - Moller, M F., "A Scaled Conjugate Gradient Algorithm for Fast Supervised Learning," Neural Networks, Vol. 6, pp. 525--533, 1993.
    *
-   * @overload fmin(fnc, x, jcb, args, xtol, ftol, jtol, maxiter)
+   * @overload fmin(fnc, x, jcb, args, xtol, ftol, jtol, maxiter, opts)
    *   @param fnc [Method/Proc]
    *   @param x [Numo::DFloat]
    *   @param jcb [Method/Proc/boolean]
@@ -474,7 +3726,8 @@ Init_optimize(void) {
    *   @param ftol [Float]
    *   @param gtol [Float]
    *   @param maxiter [Integer]
+   *   @param opts [Hash/nil] Optional settings; { timeout:, max_fev:, callback:, every: }
    *   @return [Hash{Symbol => Object}]
    */
-  rb_define_module_function(rb_mScg, "fmin", scg_fmin, 8);
+  rb_define_module_function(rb_mScg, "fmin", scg_fmin, 9);
 }
@@ -1,15 +1,42 @@
 #ifndef NUMO_OPTIMIZE_H
 #define NUMO_OPTIMIZE_H 1
 
+#include <errno.h>
 #include <float.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include <ruby.h>
+#include <ruby/thread.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <numo/narray.h>
 #include <numo/template.h>
 
 #include "src/blas.h"
+#include "src/eval_cache.h"
+#include "src/fdiff.h"
 #include "src/lbfgsb.h"
+#include "src/lbfgsb_i64.h"
+#include "src/lnsrch.h"
+#include "src/log.h"
+#include "src/nm_batch.h"
+#include "src/pool.h"
+#include "src/probes.h"
+#include "src/scg.h"
+
+/**
+ * Signatures of the native objective functions wrapped by Numo::Optimize::NativeObjective.
+ * numo_optimize_fg_t returns the function value at x of n elements and stores the gradient in g unless g is NULL.
+ * numo_optimize_batch_f_t stores the function values at k points in f, where x[i * k + p] is the i-th element of the p-th point.
+ */
+typedef double (*numo_optimize_fg_t)(int64_t n, const double* x, double* g, void* data);
+typedef void (*numo_optimize_batch_f_t)(int64_t n, int64_t k, const double* x, double* f, void* data);
 
 #endif /* NUMO_OPTIMIZE_H */
@@ -7,7 +7,7 @@
 
 void daxpy_(F77_int* n, double* da, double* dx, F77_int* incx, double* dy, F77_int* incy) {
   F77_int i__1;
-  static F77_int i__, m, ix, iy, mp1;
+  F77_int i__, m, ix, iy, mp1;
 
   --dy;
   --dx;
@@ -71,7 +71,7 @@ L40:
 
 void dcopy_(F77_int* n, double* dx, F77_int* incx, double* dy, F77_int* incy) {
   F77_int i__1;
-  static F77_int i__, m, ix, iy, mp1;
+  F77_int i__, m, ix, iy, mp1;
 
   --dy;
   --dx;
@@ -136,8 +136,8 @@ L40:
 double ddot_(F77_int* n, double* dx, F77_int* incx, double* dy, F77_int* incy) {
   F77_int i__1;
   double ret_val;
-  static F77_int i__, m, ix, iy, mp1;
-  static double dtemp;
+  F77_int i__, m, ix, iy, mp1;
+  double dtemp;
 
   --dy;
   --dx;
@@ -201,7 +201,7 @@ L60:
 
 void dscal_(F77_int* n, double* da, double* dx, F77_int* incx) {
   F77_int i__1, i__2;
-  static F77_int i__, m, mp1, nincx;
+  F77_int i__, m, mp1, nincx;
 
   --dx;
 
@@ -0,0 +1,118 @@
+/**
+ * Cache of the evaluations of the objective.
+ *
+ * The solvers request the same point again, e.g. SCG evaluates the gradient at the point whose function value
+ * has just been taken, and L-BFGS-B re-evaluates after a restart of the line search. The cache is small,
+ * so the entries are scanned linearly, and the fingerprint of the point skips the entries that cannot match
+ * without comparing all the elements.
+ */
+#include <string.h>
+
+#include "eval_cache.h"
+
+#define EVAL_CACHE_F 1
+#define EVAL_CACHE_G 2
+
+/* Returns the FNV-1a hash of the bits of the point. */
+static uint64_t eval_cache_key(int64_t n, const double* x) {
+  const unsigned char* p = (const unsigned char*)x;
+  const size_t len = (size_t)n * sizeof(double);
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* Returns the index of the entry of the point, or -1 if the point is not cached. */
+static int64_t eval_cache_find(const eval_cache* cache, const double* x, uint64_t key) {
+  const int64_t n = cache->n;
+  for (int64_t e = 0; e < cache->size; e++) {
+    if (cache->key[e] == key && memcmp(cache->x + e * n, x, (size_t)n * sizeof(double)) == 0) {
+      return e;
+    }
+  }
+  return -1;
+}
+
+/* Returns the number of bytes of the buffer given to eval_cache_init. */
+int64_t eval_cache_bytes(int64_t n, int64_t capacity) {
+  return capacity * ((2 * n + 1) * (int64_t)sizeof(double) + 2 * (int64_t)sizeof(uint64_t) + (int64_t)sizeof(uint8_t));
+}
+
+/* Initializes the empty cache of capacity entries with the buffer of eval_cache_bytes(n, capacity) bytes. */
+void eval_cache_init(eval_cache* cache, int64_t n, int64_t capacity, void* buf) {
+  double* dp = (double*)buf;
+  cache->n = n;
+  cache->capacity = capacity;
+  cache->size = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->clock = 0;
+  cache->x = dp;
+  dp += capacity * n;
+  cache->g = dp;
+  dp += capacity * n;
+  cache->f = dp;
+  dp += capacity;
+  cache->key = (uint64_t*)dp;
+  cache->used = cache->key + capacity;
+  cache->has = (uint8_t*)(cache->used + capacity);
+}
+
+/**
+ * Copies the function value to f and the gradient to g at the point if they are cached, and returns true.
+ * Either f or g can be NULL if it is not needed. Returns false if any of the needed ones is not cached.
+ */
+bool eval_cache_get(eval_cache* cache, const double* x, double* f, double* g) {
+  const int64_t e = eval_cache_find(cache, x, eval_cache_key(cache->n, x));
+  const uint8_t need = (f != NULL ? EVAL_CACHE_F : 0) | (g != NULL ? EVAL_CACHE_G : 0);
+  if (e < 0 || (cache->has[e] & need) != need) {
+    cache->misses++;
+    return false;
+  }
+  cache->used[e] = ++cache->clock;
+  cache->hits++;
+  if (f != NULL) {
+    *f = cache->f[e];
+  }
+  if (g != NULL) {
+    memcpy(g, cache->g + e * cache->n, (size_t)cache->n * sizeof(double));
+  }
+  return true;
+}
+
+/**
+ * Stores the function value f and the gradient g at the point, either of which can be NULL.
+ * They are added to the entry of the point if it is cached, and otherwise the least recently used entry is replaced.
+ */
+void eval_cache_put(eval_cache* cache, const double* x, const double* f, const double* g) {
+  const int64_t n = cache->n;
+  const uint64_t key = eval_cache_key(n, x);
+  int64_t e = eval_cache_find(cache, x, key);
+  if (e < 0) {
+    if (cache->size < cache->capacity) {
+      e = cache->size++;
+    } else {
+      e = 0;
+      for (int64_t i = 1; i < cache->size; i++) {
+        if (cache->used[i] < cache->used[e]) {
+          e = i;
+        }
+      }
+    }
+    memcpy(cache->x + e * n, x, (size_t)n * sizeof(double));
+    cache->key[e] = key;
+    cache->has[e] = 0;
+  }
+  if (f != NULL) {
+    cache->f[e] = *f;
+    cache->has[e] |= EVAL_CACHE_F;
+  }
+  if (g != NULL) {
+    memcpy(cache->g + e * n, g, (size_t)n * sizeof(double));
+    cache->has[e] |= EVAL_CACHE_G;
+  }
+  cache->used[e] = ++cache->clock;
+}
@@ -0,0 +1,35 @@
+#ifndef NUMO_OPTIMIZE_EVAL_CACHE_H_
+#define NUMO_OPTIMIZE_EVAL_CACHE_H_ 1
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Least recently used cache of the function values and gradients at the evaluated points of n elements.
+ * The points are compared bit by bit, so a hit returns exactly what the objective returned at that point.
+ * Arrays are laid out by entry, so the i-th element of the point of the e-th entry is stored at index [e * n + i] of x.
+ */
+typedef struct {
+  int64_t n;
+  int64_t capacity;
+  int64_t size;
+  int64_t hits;
+  int64_t misses;
+  uint64_t clock;
+  /* capacity * n: points and gradients of the entries. */
+  double* x;
+  double* g;
+  /* capacity: function values, fingerprints of the points, last use, and which of f and g are stored. */
+  double* f;
+  uint64_t* key;
+  uint64_t* used;
+  uint8_t* has;
+} eval_cache;
+
+extern int64_t eval_cache_bytes(int64_t n, int64_t capacity);
+extern void eval_cache_init(eval_cache* cache, int64_t n, int64_t capacity, void* buf);
+extern bool eval_cache_get(eval_cache* cache, const double* x, double* f, double* g);
+extern void eval_cache_put(eval_cache* cache, const double* x, const double* f, const double* g);
+
+#endif /* NUMO_OPTIMIZE_EVAL_CACHE_H_ */
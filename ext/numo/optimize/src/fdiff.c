@@ -0,0 +1,73 @@
+/**
+ * Finite differences of the gradient.
+ *
+ * The step of each element is sqrt(DBL_EPSILON) * max(|x_i|, 1) for the forward differences and
+ * cbrt(DBL_EPSILON) * max(|x_i|, 1) for the central ones, which balance the truncation and rounding errors.
+ * A step crossing a bound is reversed, so the objective is never evaluated outside the box: the forward
+ * differences become backward, and the central differences become the one-sided differences of second order
+ * on the two points of the side with room. If neither side has room for the step, it is shrunk to the wider side.
+ */
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+
+#include "fdiff.h"
+
+int64_t fdiff_n_points(int method, int64_t n) {
+  return method == FDIFF_CENTRAL ? 2 * n : n;
+}
+
+/* Returns the exact difference of x + h and x, which is 0 only if h is. */
+static double fdiff_exact(double x, double h) {
+  const double d = (x + h) - x;
+  return d != 0.0 || h == 0.0 ? d : h;
+}
+
+/* Chooses the steps of the perturbed points at x, which are kept within [lo, hi] unless lo and hi are NULL. */
+void fdiff_steps(int method, int64_t n, const double* x, const double* lo, const double* hi, double* h) {
+  const double rel = method == FDIFF_CENTRAL ? cbrt(DBL_EPSILON) : sqrt(DBL_EPSILON);
+  for (int64_t i = 0; i < n; i++) {
+    const double step = rel * fmax(fabs(x[i]), 1.0);
+    const double up = hi != NULL ? hi[i] - x[i] : HUGE_VAL;
+    const double down = lo != NULL ? x[i] - lo[i] : HUGE_VAL;
+    double a;
+    double b;
+    if (method != FDIFF_CENTRAL) {
+      a = step <= up ? step : (step <= down ? -step : (up >= down ? up : -down));
+      h[i] = fdiff_exact(x[i], a);
+      continue;
+    }
+    if (step <= up && step <= down) {
+      a = step;
+      b = -step;
+    } else if (2.0 * step <= up) {
+      a = step;
+      b = 2.0 * step;
+    } else if (2.0 * step <= down) {
+      a = -step;
+      b = -2.0 * step;
+    } else {
+      b = up >= down ? up : -down;
+      a = 0.5 * b;
+    }
+    h[i] = fdiff_exact(x[i], a);
+    h[n + i] = fdiff_exact(x[i], b);
+  }
+}
+
+/**
+ * Computes the gradient from f0 at x and fp at the perturbed points. The central differences take the derivative
+ * of the parabola through the three points, which is (fp[i] - fp[n + i]) / (2 h) for the symmetric steps.
+ * The element of a zero step, i.e. of a variable fixed by its bounds, is 0.
+ */
+void fdiff_gradient(int method, int64_t n, double f0, const double* fp, const double* h, double* g) {
+  for (int64_t i = 0; i < n; i++) {
+    const double a = h[i];
+    if (method != FDIFF_CENTRAL) {
+      g[i] = a != 0.0 ? (fp[i] - f0) / a : 0.0;
+      continue;
+    }
+    const double b = h[n + i];
+    g[i] = a != 0.0 && b != a ? (b * b * (fp[i] - f0) - a * a * (fp[n + i] - f0)) / (a * b * (b - a)) : 0.0;
+  }
+}
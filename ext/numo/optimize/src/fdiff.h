@@ -0,0 +1,18 @@
+#ifndef NUMO_OPTIMIZE_FDIFF_H_
+#define NUMO_OPTIMIZE_FDIFF_H_ 1
+
+#include <stdint.h>
+
+/* Finite differences of the gradient given as jcb = :forward_diff and :central_diff. */
+#define FDIFF_FORWARD 1
+#define FDIFF_CENTRAL 2
+
+/**
+ * The p-th perturbed point is x + h[p] * e_j with j = p % n, so the forward differences perturb each element once
+ * and the central differences twice. The steps are the exact differences of the perturbed and the given elements.
+ */
+extern int64_t fdiff_n_points(int method, int64_t n);
+extern void fdiff_steps(int method, int64_t n, const double* x, const double* lo, const double* hi, double* h);
+extern void fdiff_gradient(int method, int64_t n, double f0, const double* fp, const double* h, double* g);
+
+#endif /* NUMO_OPTIMIZE_FDIFF_H_ */
@@ -0,0 +1,39 @@
+#ifndef NUMO_OPTIMIZE_INT64_H_
+#define NUMO_OPTIMIZE_INT64_H_
+
+/**
+ * The routines are compiled twice: once with 32-bit integers and once with 64-bit integers.
+ * This header gives the 64-bit integer copy its own symbol names so that both can be linked
+ * into the same extension.
+ */
+#define setulb_ setulb_i64_
+#define mainlb_ mainlb_i64_
+#define active_ active_i64_
+#define bmv_ bmv_i64_
+#define cauchy_ cauchy_i64_
+#define cmprlb_ cmprlb_i64_
+#define errclb_ errclb_i64_
+#define formk_ formk_i64_
+#define formt_ formt_i64_
+#define freev_ freev_i64_
+#define hpsolb_ hpsolb_i64_
+#define lnsrlb_ lnsrlb_i64_
+#define matupd_ matupd_i64_
+#define prn1lb_ prn1lb_i64_
+#define prn2lb_ prn2lb_i64_
+#define prn3lb_ prn3lb_i64_
+#define projgr_ projgr_i64_
+#define subsm_ subsm_i64_
+#define dcsrch_ dcsrch_i64_
+#define dcstep_ dcstep_i64_
+#define timer_ timer_i64_
+
+#define daxpy_ daxpy_i64_
+#define dcopy_ dcopy_i64_
+#define ddot_ ddot_i64_
+#define dscal_ dscal_i64_
+
+#define dpofa_ dpofa_i64_
+#define dtrsl_ dtrsl_i64_
+
+#endif /* NUMO_OPTIMIZE_INT64_H_ */
@@ -47,6 +47,9 @@
 #include "linpack.h"
 
 #include "lbfgsb.h"
+#include "lnsrch.h"
+#include "log.h"
+#include "probes.h"
 
 static double c_b9 = 0.;
 static F77_int c__1 = 1;
@@ -130,6 +133,18 @@ static double c_b282 = .1;
  *
  *     task is a working string of characters of length 60 indicating
  *       the current job when entering and quitting this subroutine.
+ *       On exit with 'task' = FG_LNSRCH_F, only f is needed at x, and
+ *       g may be left unchanged; on exit with 'task' = FG_LNSRCH_G,
+ *       only g is needed at x, and f may be left unchanged. A driver
+ *       that computes both on every task beginning with FG stays valid.
+ *       The tasks below are returned only with isave(42) = 4.
+ *       On exit with 'task' = FG_LNSRCH_BATCH, f and g are needed at
+ *       the points t + dsave(16 + s) * d for the candidates s = 1, ..., 4
+ *       with dsave(16 + s) > 0, where d and t are wa(isave(13)) and
+ *       wa(isave(14)) of length n; f and g'd are written to dsave(20 + s)
+ *       and dsave(24 + s), and x holds the first point. On exit with
+ *       'task' = FG_LNSRCH_PICK, x, f, and g are set to the point and
+ *       the values of the candidate dsave(29) + 1.
  *
  *     iprint is an integer variable that must be set by the user.
  *       It controls the frequency and type of output generated:
@@ -158,6 +173,11 @@ static double c_b282 = .1;
  *                                                             available:
  *         isave(22) = the total number of intervals explored in the
  *                         search of Cauchy points;
+ *         If isave(23) is set to 1 by the driver after the return with
+ *             'task' = FG_START, the L-BFGS matrix seeded in ws, wy, sy, ss,
+ *             dsave(1), isave(27) (head), isave(28) (col), isave(29)
+ *             (itail), isave(31) and lsave(4) is used from the first
+ *             iteration (warm start);
  *         isave(26) = the total number of skipped BFGS updates before
  *                         the current iteration;
  *         isave(30) = the number of current iteration;
@@ -179,6 +199,13 @@ static double c_b282 = .1;
  *                           active constraints in the current iteration;
  *         isave(41) = the number of variables entering the set of active
  *                         constraints in the current iteration.
+ *         If isave(42) is set by the driver after the return with
+ *             'task' = FG_START, it selects the line search: 0 (the
+ *             default) for More-Thuente of dcsrch, 1 for Hager-Zhang,
+ *             2 for Armijo backtracking, and 3 for the nonmonotone
+ *             search of Zhang-Hager, and 4 for More-Thuente starting
+ *             with a batch of the candidate steps; see lnsrch.c. Armijo
+ *             and the nonmonotone search ask only f at the trial steps.
  *
  *     dsave is a double precision working array of dimension 29.
  *       On exit with 'task' = NEW_X, the following information is
@@ -236,7 +263,7 @@ void setulb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
              double* wa, F77_int* iwa, char* task, F77_int* iprint, char* csave, F77_int* lsave, F77_int* isave, double* dsave) {
   F77_int i__1;
 
-  static F77_int ld, lr, lt, lz, lwa, lwn, lss, lxp, lws, lwt, lsy, lwy, lsnd;
+  F77_int ld, lr, lt, lz, lwa, lwn, lss, lxp, lws, lwt, lsy, lwy, lsnd;
 
   /* jlm-jn */
   --iwa;
@@ -471,44 +498,45 @@ void mainlb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
   F77_int ws_dim1, ws_offset, wy_dim1, wy_offset, sy_dim1, sy_offset, ss_dim1, ss_offset, wt_dim1, wt_offset, wn_dim1, wn_offset,
     snd_dim1, snd_offset, i__1;
   double d__1, d__2;
-  FILE* itfptr;
-  static F77_int i__, k;
-  static double gd, dr, rr, dtd;
-  static F77_int col;
-  static double tol;
-  static F77_int wrk;
-  static double stp, cpu1, cpu2;
-  static F77_int head;
-  static double fold;
-  static F77_int nact;
-  static double ddum;
-  static F77_int info, nseg;
-  static double time;
-  static F77_int nfgv, ifun, iter;
-  static char word[4];
-  static double time1, time2;
-  static F77_int iback;
-  static double gdold;
-  static F77_int nfree;
-  static F77_int boxed;
-  static F77_int itail;
-  static double theta;
-  static double dnorm;
-  static F77_int nskip, iword;
-  static double xstep, stpmx;
-  static F77_int ileave;
-  static double cachyt;
-  static F77_int itfile;
-  static double epsmch;
-  static F77_int updatd;
-  static double sbtime;
-  static F77_int prjctd;
-  static F77_int iupdat;
-  static double sbgnrm;
-  static F77_int cnstnd;
-  static F77_int nenter;
-  static double lnscht;
-  static F77_int nintol;
+  F77_int i__, k = 0;
+  double gd, dr, rr, dtd;
+  F77_int col;
+  double tol;
+  F77_int wrk;
+  double stp, cpu1, cpu2;
+  F77_int head;
+  double fold;
+  F77_int nact;
+  double ddum;
+  F77_int info, nseg;
+  double time;
+  F77_int nfgv, ifun, iter;
+  char word[4];
+  double time1, time2;
+  F77_int iback;
+  double gdold;
+  F77_int nfree;
+  F77_int boxed;
+  F77_int itail;
+  double theta;
+  double dnorm;
+  F77_int nskip, iword;
+  double xstep = 0., stpmx;
+  F77_int ileave;
+  double cachyt;
+  F77_int itfile;
+  double epsmch;
+  F77_int updatd;
+  double sbtime;
+  F77_int prjctd;
+  F77_int iupdat;
+  double sbgnrm;
+  F77_int cnstnd;
+  F77_int nenter;
+  double lnscht;
+  F77_int nintol;
+  F77_int warm, icol;
+  F77_int lsmeth;
 
   --indx2;
   --iwhere;
@@ -560,6 +588,8 @@ void mainlb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
     theta = 1.;
     iupdat = 0;
     updatd = FALSE_;
+    warm = FALSE_;
+    lsmeth = LNSRCH_MORE_THUENTE;
     iback = 0;
     itail = 0;
     iword = 0;
@@ -597,11 +627,11 @@ void mainlb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
     /* Check the input arguments for errors. */
     errclb_(n, m, factr, &l[1], &u[1], &nbd[1], task, &info, &k);
     if (strncmp(task, "ERROR", 5) == 0) {
-      prn3lb_(n, &x[1], f, task, iprint, &info, &itfile, &iter, &nfgv, &nintol, &nskip, &nact, &sbgnrm, &c_b9, &nseg, word,
+      prn3lb_(n, &x[1], f, task, iprint, &info, &iter, &nfgv, &nintol, &nskip, &nact, &sbgnrm, &c_b9, &nseg, word,
               &iback, &stp, &xstep, &k, &cachyt, &sbtime, &lnscht);
       return;
     }
-    prn1lb_(n, m, &l[1], &u[1], &x[1], iprint, &itfile, &epsmch);
+    prn1lb_(n, m, &l[1], &u[1], &x[1], iprint, &epsmch);
     /* Initialize iwhere & project x onto the feasible set. */
     active_(n, &l[1], &u[1], &nbd[1], &x[1], &iwhere[1], iprint, &prjctd, &cnstnd, &boxed);
     /* The end of the initialization. */
@@ -612,6 +642,7 @@ void mainlb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
     boxed = lsave[3];
     updatd = lsave[4];
     nintol = isave[1];
+    warm = isave[2];
     itfile = isave[3];
     iback = isave[4];
     nskip = isave[5];
@@ -629,6 +660,7 @@ void mainlb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
     nact = isave[18];
     ileave = isave[19];
     nenter = isave[20];
+    lsmeth = isave[21];
     theta = dsave[1];
     fold = dsave[2];
     tol = dsave[3];
@@ -645,6 +677,18 @@ void mainlb_(F77_int* n, F77_int* m, double* x, double* l, double* u, F77_int* n
     stp = dsave[14];
     gdold = dsave[15];
     dtd = dsave[16];
+    /* word and xstep are only printed; derive them from the saved variables */
+    /* as prn2lb and lnsrlb do, so that no state is kept across the calls. */
+    if (iword == 0) {
+      strcpy(word, "con");
+    } else if (iword == 1) {
+      strcpy(word, "bnd");
+    } else if (iword == 5) {
+      strcpy(word, "TNT");
+    } else {
+      strcpy(word, "---");
+    }
+    xstep = stp * dnorm;
     /* After returning from the driver go to the point where execution */
     /* is to resume. */
     if (strncmp(task, "FG_LN", 5) == 0) {
@@ -675,10 +719,8 @@ L111:
   /* Compute the infinity norm of the (-) projected gradient. */
   projgr_(n, &l[1], &u[1], &nbd[1], &x[1], &g[1], &sbgnrm);
   if (*iprint >= 1) {
-    fprintf(stdout, "\nAt iterate%5" PRIdF77INT "    f= %12.5E    |proj g|= %12.5E\n", iter, *f, sbgnrm);
-    itfptr = fopen("iterate.dat", "a");
-    fprintf(itfptr, " %4" PRIdF77INT " %4" PRIdF77INT "     -     -   -     -     -        -    %10.3E %10.3E\n", iter, nfgv, sbgnrm, *f);
-    fclose(itfptr);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\nAt iterate%5" PRIdF77INT "    f= %12.5E    |proj g|= %12.5E\n", iter, *f, sbgnrm);
+    solver_log_printf(SOLVER_LOG_ITERATE, " %4" PRIdF77INT " %4" PRIdF77INT "     -     -   -     -     -        -    %10.3E %10.3E\n", iter, nfgv, sbgnrm, *f);
   }
   if (sbgnrm <= *pgtol) {
     /* terminate the algorithm. */
@@ -689,11 +731,26 @@ L111:
 L222:
   if (*iprint >= 99) {
     i__1 = iter + 1;
-    fprintf(stdout, "\n\nITERATION %5" PRIdF77INT "\n", i__1);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n\nITERATION %5" PRIdF77INT "\n", i__1);
   }
   iword = -1;
 
-  if (!cnstnd && col > 0) {
+  if (warm) {
+    /* The driver seeded ws, wy, sy, ss, theta, col and head for a warm start; */
+    /* form T from the seeded SY and SS before computing the GCP. */
+    formt_(m, &wt[wt_offset], &sy[sy_offset], &ss[ss_offset], &col, &theta, &info);
+    if (info != 0) {
+      /* the seeded matrices are not usable; start with an empty memory. */
+      info = 0;
+      col = 0;
+      head = 1;
+      theta = 1.;
+      iupdat = 0;
+      updatd = FALSE_;
+      warm = FALSE_;
+    }
+  }
+  if (!cnstnd && col > 0 && !warm) {
     /* skip the search for GCP. */
     dcopy_(n, &x[1], &c__1, &z__[1], &c__1);
     wrk = updatd;
@@ -710,10 +767,11 @@ L222:
   if (info != 0) {
     /* singular triangular system detected; refresh the lbfgs memory. */
     if (*iprint >= 1) {
-      fprintf(stdout, "\n");
-      fprintf(stdout, " Singular triangular system detected;\n");
-      fprintf(stdout, "   refresh the lbfgs memory and restart the iteration.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Singular triangular system detected;\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "   refresh the lbfgs memory and restart the iteration.\n");
     }
+    NUMO_OPTIMIZE_PROBE2(memory__refresh, (int64_t)iter, (int64_t)1);
     info = 0;
     col = 0;
     head = 1;
@@ -731,6 +789,18 @@ L222:
   /* find the index set of free and active variables at the GCP. */
   freev_(n, &nfree, &index[1], &nenter, &ileave, &indx2[1], &iwhere[1], &wrk, &updatd, &cnstnd, iprint, &iter);
   nact = *n - nfree;
+  if (warm) {
+    /* Build wn1 for the seeded corrections one column at a time, */
+    /* as formk does after each update of the L-BFGS matrix. */
+    i__1 = col;
+    for (icol = 1; icol <= i__1; ++icol) {
+      formk_(n, &nfree, &index[1], &nenter, &ileave, &indx2[1], &icol, &updatd, &wn[wn_offset], &snd[snd_offset], m,
+             &ws[ws_offset], &wy[wy_offset], &sy[sy_offset], &theta, &icol, &head, &info);
+    }
+    info = 0;
+    warm = FALSE_;
+    wrk = TRUE_;
+  }
 L333:
   /* If there are no free variables or B=theta*I, then */
   /*                                    skip the subspace minimization. */
@@ -754,10 +824,11 @@ L333:
     /* nonpositive definiteness in Cholesky factorization; */
     /* refresh the lbfgs memory and restart the iteration. */
     if (*iprint >= 1) {
-      fprintf(stdout, "\n");
-      fprintf(stdout, " Nonpositive definiteness in Cholesky factorization in formk;\n");
-      fprintf(stdout, "   refresh the lbfgs memory and restart the iteration.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Nonpositive definiteness in Cholesky factorization in formk;\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "   refresh the lbfgs memory and restart the iteration.\n");
     }
+    NUMO_OPTIMIZE_PROBE2(memory__refresh, (int64_t)iter, (int64_t)2);
     info = 0;
     col = 0;
     head = 1;
@@ -783,10 +854,11 @@ L444:
     /* singular triangular system detected; */
     /* refresh the lbfgs memory and restart the iteration. */
     if (*iprint >= 1) {
-      fprintf(stdout, "\n");
-      fprintf(stdout, " Singular triangular system detected;\n");
-      fprintf(stdout, "   refresh the lbfgs memory and restart the iteration.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Singular triangular system detected;\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "   refresh the lbfgs memory and restart the iteration.\n");
     }
+    NUMO_OPTIMIZE_PROBE2(memory__refresh, (int64_t)iter, (int64_t)3);
     info = 0;
     col = 0;
     head = 1;
@@ -811,7 +883,7 @@ L555:
   timer_(&cpu1);
 L666:
   lnsrlb_(n, &l[1], &u[1], &nbd[1], &x[1], f, &fold, &gd, &gdold, &g[1], &d__[1], &r__[1], &t[1], &z__[1], &stp, &dnorm, &dtd,
-          &xstep, &stpmx, &iter, &ifun, &iback, &nfgv, &info, task, &boxed, &cnstnd, csave, &isave[22], &dsave[17]);
+          &xstep, &stpmx, &iter, &ifun, &iback, &nfgv, &info, task, &boxed, &cnstnd, &lsmeth, csave, &isave[22], &dsave[17]);
   if (info != 0 || iback >= 20) {
     /* restore the previous iterate. */
     dcopy_(n, &t[1], &c__1, &x[1], &c__1);
@@ -832,13 +904,15 @@ L666:
     } else {
       /* refresh the lbfgs memory and restart the iteration. */
       if (*iprint >= 1) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Bad direction in the line search;\n");
-        fprintf(stdout, "   refresh the lbfgs memory and restart the iteration.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Bad direction in the line search;\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "   refresh the lbfgs memory and restart the iteration.\n");
       }
       if (info == 0) {
         --nfgv;
       }
+      NUMO_OPTIMIZE_PROBE2(memory__refresh, (int64_t)iter, (int64_t)4);
+      NUMO_OPTIMIZE_PROBE1(lnsrch__restart, (int64_t)iter);
       info = 0;
       col = 0;
       head = 1;
@@ -861,7 +935,7 @@ L666:
     /* Compute the infinity norm of the projected (-)gradient. */
     projgr_(n, &l[1], &u[1], &nbd[1], &x[1], &g[1], &sbgnrm);
     /* Print iteration information. */
-    prn2lb_(n, &x[1], f, &g[1], iprint, &itfile, &iter, &nfgv, &nact, &sbgnrm, &nseg, word, &iword, &iback, &stp, &xstep);
+    prn2lb_(n, &x[1], f, &g[1], iprint, &iter, &nfgv, &nact, &sbgnrm, &nseg, word, &iword, &iback, &stp, &xstep);
     goto L1000;
   }
 L777:
@@ -875,7 +949,8 @@ L777:
   d__2 = fabs(*f);
   d__1 = d__1 >= d__2 ? d__1 : d__2;
   ddum = d__1 >= 1. ? d__1 : 1.;
-  if (fold - *f <= tol * ddum) {
+  /* The nonmonotone search may accept an increase of f, which is not a convergence. */
+  if (fold - *f <= tol * ddum && (lsmeth != LNSRCH_NONMONOTONE || *f <= fold)) {
     /* terminate the algorithm. */
     strcpy(task, "CONVERGENCE: REL_REDUCTION_OF_F_<=_FACTR*EPSMCH");
     if (iback >= 10) {
@@ -903,7 +978,7 @@ L777:
     ++nskip;
     updatd = FALSE_;
     if (*iprint >= 1) {
-      fprintf(stdout, "  ys=%10.3E  -gs=%10.3E BFGS update SKIPPED\n", dr, ddum);
+      solver_log_printf(SOLVER_LOG_CONSOLE, "  ys=%10.3E  -gs=%10.3E BFGS update SKIPPED\n", dr, ddum);
     }
     goto L888;
   }
@@ -924,10 +999,11 @@ L777:
     /* nonpositive definiteness in Cholesky factorization; */
     /* refresh the lbfgs memory and restart the iteration. */
     if (*iprint >= 1) {
-      fprintf(stdout, "\n");
-      fprintf(stdout, " Nonpositive definiteness in Cholesky factorization in formt;\n");
-      fprintf(stdout, "   refresh the lbfgs memory and restart the iteration.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Nonpositive definiteness in Cholesky factorization in formt;\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "   refresh the lbfgs memory and restart the iteration.\n");
     }
+    NUMO_OPTIMIZE_PROBE2(memory__refresh, (int64_t)iter, (int64_t)5);
     info = 0;
     col = 0;
     head = 1;
@@ -945,7 +1021,7 @@ L888:
 L999:
   timer_(&time2);
   time = time2 - time1;
-  prn3lb_(n, &x[1], f, task, iprint, &info, &itfile, &iter, &nfgv, &nintol, &nskip, &nact, &sbgnrm, &time, &nseg, word, &iback,
+  prn3lb_(n, &x[1], f, task, iprint, &info, &iter, &nfgv, &nintol, &nskip, &nact, &sbgnrm, &time, &nseg, word, &iback,
           &stp, &xstep, &k, &cachyt, &sbtime, &lnscht);
 L1000:
   /* Save local variables. */
@@ -954,6 +1030,7 @@ L1000:
   lsave[3] = boxed;
   lsave[4] = updatd;
   isave[1] = nintol;
+  isave[2] = warm;
   isave[3] = itfile;
   isave[4] = iback;
   isave[5] = nskip;
@@ -971,6 +1048,7 @@ L1000:
   isave[18] = nact;
   isave[19] = ileave;
   isave[20] = nenter;
+  isave[21] = lsmeth;
   dsave[1] = theta;
   dsave[2] = fold;
   dsave[3] = tol;
@@ -1014,7 +1092,7 @@ L1000:
 void active_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, F77_int* iwhere, F77_int* iprint, F77_int* prjctd, F77_int* cnstnd,
              F77_int* boxed) {
   F77_int i__1;
-  static F77_int i__, nbdd;
+  F77_int i__, nbdd;
   --iwhere;
   --x;
   --nbd;
@@ -1067,15 +1145,15 @@ void active_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, F77_int*
   }
   if (*iprint >= 0) {
     if (*prjctd) {
-      fprintf(stdout, " The initial X is infeasible.  Restart with its projection.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " The initial X is infeasible.  Restart with its projection.\n");
     }
     if (!(*cnstnd)) {
-      fprintf(stdout, " This problem is unconstrained.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " This problem is unconstrained.\n");
     }
   }
   if (*iprint > 0) {
-    fprintf(stdout, "\n");
-    fprintf(stdout, "At X0 %9" PRIdF77INT " variables are exactly at the bounds\n", nbdd);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "At X0 %9" PRIdF77INT " variables are exactly at the bounds\n", nbdd);
   }
 }
 
@@ -1134,8 +1212,8 @@ void active_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, F77_int*
  */
 void bmv_(F77_int* m, double* sy, double* wt, F77_int* col, double* v, double* p, F77_int* info) {
   F77_int sy_dim1, sy_offset, wt_dim1, wt_offset, i__1, i__2;
-  static F77_int i__, k, i2;
-  static double sum;
+  F77_int i__, k, i2;
+  double sum;
 
   wt_dim1 = *m;
   wt_offset = 1 + wt_dim1;
@@ -1376,24 +1454,24 @@ void cauchy_(F77_int* n, double* x, double* l, double* u, F77_int* nbd, double*
              double* epsmch) {
   F77_int wy_dim1, wy_offset, ws_dim1, ws_offset, sy_dim1, sy_offset, wt_dim1, wt_offset, i__1, i__2;
   double d__1;
-  static F77_int i__, j;
-  static double f1, f2, dt, tj, tl, tu, tj0;
-  static F77_int ibp;
-  static double dtm;
-  static double wmc, wmp, wmw;
-  static F77_int col2;
-  static double dibp;
-  static F77_int iter;
-  static double zibp, tsum, dibp2;
-  static F77_int bnded;
-  static double neggi;
-  static F77_int nfree;
-  static double bkmin;
-  static F77_int nleft;
-  static double f2_org__;
-  static F77_int nbreak, ibkmin;
-  static F77_int pointr;
-  static F77_int xlower, xupper;
+  F77_int i__, j;
+  double f1, f2, dt, tj, tl = 0., tu = 0., tj0;
+  F77_int ibp;
+  double dtm;
+  double wmc, wmp, wmw;
+  F77_int col2;
+  double dibp;
+  F77_int iter;
+  double zibp, tsum, dibp2;
+  F77_int bnded;
+  double neggi;
+  F77_int nfree;
+  double bkmin;
+  F77_int nleft;
+  double f2_org__;
+  F77_int nbreak, ibkmin;
+  F77_int pointr;
+  F77_int xlower, xupper;
 
   --xcp;
   --d__;
@@ -1427,7 +1505,7 @@ void cauchy_(F77_int* n, double* x, double* l, double* u, F77_int* nbd, double*
   /*   the derivative f1 and the vector p = W'd (for theta = 1). */
   if (*sbgnrm <= 0.) {
     if (*iprint >= 0) {
-      fprintf(stdout, " Subgnorm = 0.  GCP = X.\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Subgnorm = 0.  GCP = X.\n");
     }
     dcopy_(n, &x[1], &c__1, &xcp[1], &c__1);
     return;
@@ -1440,7 +1518,7 @@ void cauchy_(F77_int* n, double* x, double* l, double* u, F77_int* nbd, double*
   col2 = *col << 1;
   f1 = 0.;
   if (*iprint >= 99) {
-    fprintf(stdout, "\n---------------- CAUCHY entered-------------------\n\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n---------------- CAUCHY entered-------------------\n\n");
   }
   /* We set p to zero and build it up as we determine d. */
   i__1 = col2;
@@ -1535,17 +1613,17 @@ void cauchy_(F77_int* n, double* x, double* l, double* u, F77_int* nbd, double*
   if (nbreak == 0 && nfree == *n + 1) {
     /* is a zero vector, return with the initial xcp as GCP. */
     if (*iprint > 100) {
-      fprintf(stdout, "Cauchy X =  \n");
-      fprintf(stdout, "    ");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "Cauchy X =  \n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "    ");
       i__1 = *n;
       for (i__ = 1; i__ <= i__1; ++i__) {
-        fprintf(stdout, " %11.4E", xcp[i__]);
+        solver_log_printf(SOLVER_LOG_CONSOLE, " %11.4E", xcp[i__]);
         if (i__ % 6 == 0) {
-          fprintf(stdout, "\n");
-          fprintf(stdout, "    ");
+          solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+          solver_log_printf(SOLVER_LOG_CONSOLE, "    ");
         }
       }
-      fprintf(stdout, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
     }
     return;
   }
@@ -1568,7 +1646,7 @@ void cauchy_(F77_int* n, double* x, double* l, double* u, F77_int* nbd, double*
   tsum = 0.;
   *nseg = 1;
   if (*iprint >= 99) {
-    fprintf(stdout, " There are %3" PRIdF77INT "  breakpoints \n", nbreak);
+    solver_log_printf(SOLVER_LOG_CONSOLE, " There are %3" PRIdF77INT "  breakpoints \n", nbreak);
   }
   /* If there are no breakpoints, locate the GCP and return. */
   if (nbreak == 0) {
@@ -1606,10 +1684,10 @@ L777:
   }
   dt = tj - tj0;
   if (dt != 0. && *iprint >= 100) {
-    fprintf(stdout, "\n");
-    fprintf(stdout, "Piece    %3" PRIdF77INT " --f1, f2 at start point  %11.4E %11.4E\n", *nseg, f1, f2);
-    fprintf(stdout, "Distance to the next break point =  %11.4E\n", dt);
-    fprintf(stdout, "Distance to the stationary point =  %11.4E\n", dtm);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Piece    %3" PRIdF77INT " --f1, f2 at start point  %11.4E %11.4E\n", *nseg, f1, f2);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Distance to the next break point =  %11.4E\n", dt);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Distance to the stationary point =  %11.4E\n", dtm);
   }
   /* If a minimizer is within this interval, locate the GCP and return. */
   if (dtm < dt) {
@@ -1632,7 +1710,7 @@ L777:
     iwhere[ibp] = 1;
   }
   if (*iprint >= 100) {
-    fprintf(stdout, " Variable   %" PRIdF77INT "  is fixed.\n", ibp);
+    solver_log_printf(SOLVER_LOG_CONSOLE, " Variable   %" PRIdF77INT "  is fixed.\n", ibp);
   }
   if (nleft == 0 && nbreak == *n) {
     /* all n variables are fixed, */
@@ -1692,10 +1770,10 @@ L777:
   /* ------------------- the end of the loop ------------------------------- */
 L888:
   if (*iprint >= 99) {
-    fprintf(stdout, "\n");
-    fprintf(stdout, " GCP found in this segment\n");
-    fprintf(stdout, "Piece    %3" PRIdF77INT " --f1, f2 at start point  %11.4E %11.4E\n", *nseg, f1, f2);
-    fprintf(stdout, "Distance to the stationary point =  %11.4E\n", dtm);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, " GCP found in this segment\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Piece    %3" PRIdF77INT " --f1, f2 at start point  %11.4E %11.4E\n", *nseg, f1, f2);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Distance to the stationary point =  %11.4E\n", dtm);
   }
   if (dtm <= 0.) {
     dtm = 0.;
@@ -1711,20 +1789,20 @@ L999:
     daxpy_(&col2, &dtm, &p[1], &c__1, &c__[1], &c__1);
   }
   if (*iprint > 100) {
-    fprintf(stdout, "Cauchy X =  \n");
-    fprintf(stdout, "    ");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Cauchy X =  \n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "    ");
     i__1 = *n;
     for (i__ = 1; i__ <= i__1; ++i__) {
-      fprintf(stdout, " %11.4E", xcp[i__]);
+      solver_log_printf(SOLVER_LOG_CONSOLE, " %11.4E", xcp[i__]);
       if (i__ % 6 == 0) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, "    ");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "    ");
       }
     }
-    fprintf(stdout, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
   }
   if (*iprint >= 99) {
-    fprintf(stdout, "\n---------------- exit CAUCHY----------------------\n\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n---------------- exit CAUCHY----------------------\n\n");
   }
 }
 
@@ -1750,9 +1828,9 @@ L999:
 void cmprlb_(F77_int* n, F77_int* m, double* x, double* g, double* ws, double* wy, double* sy, double* wt, double* z__, double* r__,
              double* wa, F77_int* index, double* theta, F77_int* col, F77_int* head, F77_int* nfree, F77_int* cnstnd, F77_int* info) {
   F77_int ws_dim1, ws_offset, wy_dim1, wy_offset, sy_dim1, sy_offset, wt_dim1, wt_offset, i__1, i__2;
-  static F77_int i__, j, k;
-  static double a1, a2;
-  static F77_int pointr;
+  F77_int i__, j, k;
+  double a1, a2;
+  F77_int pointr;
 
   --index;
   --r__;
@@ -1820,7 +1898,7 @@ void cmprlb_(F77_int* n, F77_int* m, double* x, double* g, double* ws, double* w
  */
 void errclb_(F77_int* n, F77_int* m, double* factr, double* l, double* u, F77_int* nbd, char* task, F77_int* info, F77_int* k) {
   F77_int i__1;
-  static F77_int i__;
+  F77_int i__;
   --nbd;
   --u;
   --l;
@@ -1977,10 +2055,10 @@ void errclb_(F77_int* n, F77_int* m, double* factr, double* l, double* u, F77_in
 void formk_(F77_int* n, F77_int* nsub, F77_int* ind, F77_int* nenter, F77_int* ileave, F77_int* indx2, F77_int* iupdat, F77_int* updatd, double* wn,
             double* wn1, F77_int* m, double* ws, double* wy, double* sy, double* theta, F77_int* col, F77_int* head, F77_int* info) {
   F77_int wn_dim1, wn_offset, wn1_dim1, wn1_offset, ws_dim1, ws_offset, wy_dim1, wy_offset, sy_dim1, sy_offset, i__1, i__2, i__3;
-  static F77_int i__, k, k1, m2, is, js, iy, jy, is1, js1, col2, dend, pend;
-  static F77_int upcl;
-  static double temp1, temp2, temp3, temp4;
-  static F77_int ipntr, jpntr, dbegin, pbegin;
+  F77_int i__, k, k1, m2, is, js, iy, jy, is1, js1, col2, dend, pend;
+  F77_int upcl;
+  double temp1, temp2, temp3, temp4;
+  F77_int ipntr, jpntr, dbegin, pbegin;
 
   --indx2;
   --ind;
@@ -2217,8 +2295,8 @@ void formk_(F77_int* n, F77_int* nsub, F77_int* ind, F77_int* nenter, F77_int* i
  */
 void formt_(F77_int* m, double* wt, double* sy, double* ss, F77_int* col, double* theta, F77_int* info) {
   F77_int wt_dim1, wt_offset, sy_dim1, sy_offset, ss_dim1, ss_offset, i__1, i__2, i__3;
-  static F77_int i__, j, k, k1;
-  static double ddum;
+  F77_int i__, j, k, k1;
+  double ddum;
 
   ss_dim1 = *m;
   ss_offset = 1 + ss_dim1;
@@ -2293,7 +2371,7 @@ void formt_(F77_int* m, double* wt, double* sy, double* ss, F77_int* col, double
 void freev_(F77_int* n, F77_int* nfree, F77_int* index, F77_int* nenter, F77_int* ileave, F77_int* indx2, F77_int* iwhere, F77_int* wrk, F77_int* updatd,
             F77_int* cnstnd, F77_int* iprint, F77_int* iter) {
   F77_int i__1;
-  static F77_int i__, k, iact;
+  F77_int i__, k, iact;
 
   --iwhere;
   --indx2;
@@ -2312,7 +2390,7 @@ void freev_(F77_int* n, F77_int* nfree, F77_int* index, F77_int* nenter, F77_int
         --(*ileave);
         indx2[*ileave] = k;
         if (*iprint >= 100) {
-          fprintf(stdout, " Variable %2" PRIdF77INT " leaves the set of free variables\n", k);
+          solver_log_printf(SOLVER_LOG_CONSOLE, " Variable %2" PRIdF77INT " leaves the set of free variables\n", k);
         }
       }
     }
@@ -2323,13 +2401,13 @@ void freev_(F77_int* n, F77_int* nfree, F77_int* index, F77_int* nenter, F77_int
         ++(*nenter);
         indx2[*nenter] = k;
         if (*iprint >= 100) {
-          fprintf(stdout, " Variable %2" PRIdF77INT " enters the set of free variables\n", k);
+          solver_log_printf(SOLVER_LOG_CONSOLE, " Variable %2" PRIdF77INT " enters the set of free variables\n", k);
         }
       }
     }
     if (*iprint >= 99) {
       i__1 = *n + 1 - *ileave;
-      fprintf(stdout, " %2" PRIdF77INT " variables leave; %2" PRIdF77INT " variables enter\n", i__1, *nenter);
+      solver_log_printf(SOLVER_LOG_CONSOLE, " %2" PRIdF77INT " variables leave; %2" PRIdF77INT " variables enter\n", i__1, *nenter);
     }
   }
   *wrk = *ileave < *n + 1 || *nenter > 0 || *updatd;
@@ -2348,7 +2426,7 @@ void freev_(F77_int* n, F77_int* nfree, F77_int* index, F77_int* nenter, F77_int
   }
   if (*iprint >= 99) {
     i__1 = *iter + 1;
-    fprintf(stdout, " %2" PRIdF77INT " variables are free at GCP %3" PRIdF77INT "\n", *nfree, i__1);
+    solver_log_printf(SOLVER_LOG_CONSOLE, " %2" PRIdF77INT " variables are free at GCP %3" PRIdF77INT "\n", *nfree, i__1);
   }
 }
 
@@ -2393,9 +2471,9 @@ void freev_(F77_int* n, F77_int* nfree, F77_int* index, F77_int* nenter, F77_int
  */
 void hpsolb_(F77_int* n, double* t, F77_int* iorder, F77_int* iheap) {
   F77_int i__1;
-  static F77_int i__, j, k;
-  static double out, ddum;
-  static F77_int indxin, indxou;
+  F77_int i__, j, k;
+  double out, ddum;
+  F77_int indxin, indxou;
 
   --iorder;
   --t;
@@ -2460,6 +2538,16 @@ void hpsolb_(F77_int* n, double* t, F77_int* iorder, F77_int* iheap) {
  *       to perform the line search.  Subroutine dscrch is safeguarded so
  *       that all trial points lie within the feasible region.
  *
+ *     If lsmeth is not LNSRCH_MORE_THUENTE, the search of lnsrch.c is
+ *       performed instead with its state in dsave of dcsrch, and the
+ *       trial steps are also kept within the feasible region.
+ *
+ *     If lsmeth is LNSRCH_SPECULATIVE, the first trial of dcsrch is
+ *       replaced by the batch of the candidate steps of
+ *       lnsrch_batch_start. The first one satisfying the strong Wolfe
+ *       conditions is accepted, and dcsrch continues from the first
+ *       candidate if there is none.
+ *
  *     Subprograms called:
  *
  *       Minpack2 Library ... dcsrch.
@@ -2478,11 +2566,12 @@ void hpsolb_(F77_int* n, double* t, F77_int* iorder, F77_int* iheap) {
 void lnsrlb_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, double* f, double* fold, double* gd, double* gdold, double* g,
              double* d__, double* r__, double* t, double* z__, double* stp, double* dnorm, double* dtd, double* xstep,
              double* stpmx, F77_int* iter, F77_int* ifun, F77_int* iback, F77_int* nfgv, F77_int* info, char* task, F77_int* boxed, F77_int* cnstnd,
-             char* csave, F77_int* isave, double* dsave) {
+             F77_int* lsmeth, char* csave, F77_int* isave, double* dsave) {
   F77_int i__1;
   double d__1;
-  static F77_int i__;
-  static double a1, a2;
+  F77_int i__;
+  double a1, a2;
+  int req;
 
   --z__;
   --t;
@@ -2543,21 +2632,35 @@ void lnsrlb_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, double*
   *iback = 0;
   strcpy(csave, "START");
 L556:
+  if (*lsmeth != LNSRCH_MORE_THUENTE && *lsmeth != LNSRCH_SPECULATIVE) {
+    goto L557;
+  }
+  if (strncmp(task, "FG_LNSRCH_", 10) == 0) {
+    goto L558;
+  }
   *gd = ddot_(n, &g[1], &c__1, &d__[1], &c__1);
   if (*ifun == 0) {
     *gdold = *gd;
     if (*gd >= 0.) {
       /* the directional derivative >=0. */
       /* Line search is impossible. */
-      fprintf(stdout, "  ascent direction in projection gd =  %.8E\n", *gd);
+      solver_log_printf(SOLVER_LOG_WARNING, "  ascent direction in projection gd =  %.8E\n", *gd);
       *info = -4;
       return;
     }
+    if (*lsmeth == LNSRCH_SPECULATIVE && *stp > 0.) {
+      /* The first trial is the batch of the candidate steps, of which x holds the first one. */
+      *nfgv += lnsrch_batch_start(*stp, *stpmx, &dsave[1]) - 1;
+      strcpy(csave, "BATCH");
+    }
+  }
+  if (strncmp(csave, "BATCH", 5) != 0) {
+    dcsrch_(f, gd, stp, &c_b280, &c_b281, &c_b282, &c_b9, stpmx, csave, &isave[1], &dsave[1]);
   }
-  dcsrch_(f, gd, stp, &c_b280, &c_b281, &c_b282, &c_b9, stpmx, csave, &isave[1], &dsave[1]);
+L559:
   *xstep = *stp * *dnorm;
   if (strncmp(csave, "CONV", 4) != 0 && strncmp(csave, "WARN", 4) != 0) {
-    strcpy(task, "FG_LNSRCH");
+    strcpy(task, strncmp(csave, "BATCH", 5) == 0 ? "FG_LNSRCH_BATCH" : "FG_LNSRCH");
     ++(*ifun);
     ++(*nfgv);
     *iback = *ifun - 1;
@@ -2572,6 +2675,76 @@ L556:
   } else {
     strcpy(task, "NEW_X");
   }
+  return;
+L558:
+  if (strncmp(task, "FG_LNSRCH_PICK", 14) == 0) {
+    /* The driver has set x, f, and g of the accepted candidate. */
+    *gd = ddot_(n, &g[1], &c__1, &d__[1], &c__1);
+    strcpy(task, "NEW_X");
+    return;
+  }
+  /* phi and phi' of the candidates have been written in the state by the driver. */
+  i__1 = lnsrch_batch_pick(*fold, *gdold, c_b280, c_b281, &dsave[1]);
+  if (i__1 >= 0) {
+    *stp = dsave[LNSRCH_BATCH_STP + 1 + i__1];
+  } else {
+    /* dcsrch continues from the first candidate, which replaces its first trial. */
+    a1 = dsave[LNSRCH_BATCH_F + 1];
+    a2 = dsave[LNSRCH_BATCH_GD + 1];
+    *stp = dsave[LNSRCH_BATCH_STP + 1];
+    strcpy(csave, "START");
+    dcsrch_(fold, gdold, stp, &c_b280, &c_b281, &c_b282, &c_b9, stpmx, csave, &isave[1], &dsave[1]);
+    dcsrch_(&a1, &a2, stp, &c_b280, &c_b281, &c_b282, &c_b9, stpmx, csave, &isave[1], &dsave[1]);
+    if (strncmp(csave, "CONV", 4) != 0 && strncmp(csave, "WARN", 4) != 0) {
+      goto L559;
+    }
+    i__1 = 0;
+  }
+  /* The state of dcsrch is not needed after it has converged, so the index is kept in its place. */
+  dsave[LNSRCH_BATCH_PICK + 1] = (double)i__1;
+  *xstep = *stp * *dnorm;
+  strcpy(task, "FG_LNSRCH_PICK");
+  return;
+L557:
+  /* g is the gradient at x unless only f has been evaluated. */
+  if (strncmp(task, "FG_LNSRCH_F", 11) != 0) {
+    *gd = ddot_(n, &g[1], &c__1, &d__[1], &c__1);
+  }
+  if (*ifun == 0) {
+    *gdold = *gd;
+    if (*gd >= 0.) {
+      solver_log_printf(SOLVER_LOG_WARNING, "  ascent direction in projection gd =  %.8E\n", *gd);
+      *info = -4;
+      return;
+    }
+    req = lnsrch_start((int)*lsmeth, *f, *gd, stp, *stpmx, *iter == 0, &dsave[1]);
+  } else {
+    req = lnsrch_next((int)*lsmeth, *f, *gd, stp, *stpmx, &dsave[1]);
+  }
+  *xstep = *stp * *dnorm;
+  if (req == LNSRCH_EVAL_G) {
+    /* The accepted step is at x, where only g is evaluated. */
+    strcpy(task, "FG_LNSRCH_G");
+    ++(*nfgv);
+  } else if (req == LNSRCH_EVAL_F || req == LNSRCH_EVAL_FG) {
+    strcpy(task, req == LNSRCH_EVAL_F ? "FG_LNSRCH_F" : "FG_LNSRCH");
+    ++(*ifun);
+    ++(*nfgv);
+    *iback = *ifun - 1;
+    if (*stp == 1.) {
+      dcopy_(n, &z__[1], &c__1, &x[1], &c__1);
+    } else {
+      i__1 = *n;
+      for (i__ = 1; i__ <= i__1; ++i__) {
+        x[i__] = *stp * d__[i__] + t[i__];
+      }
+    }
+  } else if (req == LNSRCH_CONV) {
+    strcpy(task, "NEW_X");
+  } else {
+    /* The step is too small; the previous iterate is restored by mainlb. */
+    *info = -9;
+  }
 }
 
 /**
@@ -2596,8 +2769,8 @@ L556:
 void matupd_(F77_int* n, F77_int* m, double* ws, double* wy, double* sy, double* ss, double* d__, double* r__, F77_int* itail,
              F77_int* iupdat, F77_int* col, F77_int* head, double* theta, double* rr, double* dr, double* stp, double* dtd) {
   F77_int ws_dim1, ws_offset, wy_dim1, wy_offset, sy_dim1, sy_offset, ss_dim1, ss_offset, i__1, i__2;
-  static F77_int j;
-  static F77_int pointr;
+  F77_int j;
+  F77_int pointr;
 
   --r__;
   --d__;
@@ -2673,79 +2846,76 @@ void matupd_(F77_int* n, F77_int* m, double* ws, double* wy, double* sy, double*
  *                        Ciyou Zhu
  *     in collaboration with R.H. Byrd, P. Lu-Chen and J. Nocedal.
  */
-void prn1lb_(F77_int* n, F77_int* m, double* l, double* u, double* x, F77_int* iprint, F77_int* itfile, double* epsmch) {
+void prn1lb_(F77_int* n, F77_int* m, double* l, double* u, double* x, F77_int* iprint, double* epsmch) {
   F77_int i__1;
-  FILE* itfptr;
-  static F77_int i__;
+  F77_int i__;
 
   --x;
   --u;
   --l;
 
   if (*iprint >= 0) {
-    fprintf(stdout, "RUNNING THE L-BFGS-B CODE\n\n");
-    fprintf(stdout, "           * * *\n\n");
-    fprintf(stdout, "Machine precision = %.3E\n", *epsmch);
-    fprintf(stdout, " N = %3" PRIdF77INT "    M = %2" PRIdF77INT "\n", *n, *m);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "RUNNING THE L-BFGS-B CODE\n\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "           * * *\n\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Machine precision = %.3E\n", *epsmch);
+    solver_log_printf(SOLVER_LOG_CONSOLE, " N = %3" PRIdF77INT "    M = %2" PRIdF77INT "\n", *n, *m);
     if (*iprint >= 1) {
-      itfptr = fopen("iterate.dat", "w");
-      fprintf(itfptr, "RUNNING THE L-BFGS-B CODE\n");
-      fprintf(itfptr, "\n");
-      fprintf(itfptr, "it    = iteration number\n");
-      fprintf(itfptr, "nf    = number of function evaluations\n");
-      fprintf(itfptr, "nseg  = number of segments explored during the Cauchy search\n");
-      fprintf(itfptr, "nact  = number of active bounds at the generalized Cauchy point\n");
-      fprintf(itfptr, "sub   = manner in which the subspace minimization terminated:\n");
-      fprintf(itfptr, "        con = converged, bnd = a bound was reached\n");
-      fprintf(itfptr, "itls  = number of iterations performed in the line search\n");
-      fprintf(itfptr, "stepl = step length used\n");
-      fprintf(itfptr, "tstep = norm of the displacement (total step)\n");
-      fprintf(itfptr, "projg = norm of the projected gradient\n");
-      fprintf(itfptr, "f     = function value\n");
-      fprintf(itfptr, "\n");
-      fprintf(itfptr, "           * * *\n\n");
-      fprintf(itfptr, "Machine precision = %.3E\n", *epsmch);
-      fprintf(itfptr, " N = %3" PRIdF77INT "    M = %2" PRIdF77INT "\n", *n, *m);
-      fprintf(itfptr, "\n");
-      fprintf(itfptr, "   it   nf  nseg  nact  sub  itls  stepl    tstep     projg        f\n");
-      fclose(itfptr);
+      solver_log_printf(SOLVER_LOG_ITERATE, "RUNNING THE L-BFGS-B CODE\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "it    = iteration number\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "nf    = number of function evaluations\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "nseg  = number of segments explored during the Cauchy search\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "nact  = number of active bounds at the generalized Cauchy point\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "sub   = manner in which the subspace minimization terminated:\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "        con = converged, bnd = a bound was reached\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "itls  = number of iterations performed in the line search\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "stepl = step length used\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "tstep = norm of the displacement (total step)\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "projg = norm of the projected gradient\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "f     = function value\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "           * * *\n\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "Machine precision = %.3E\n", *epsmch);
+      solver_log_printf(SOLVER_LOG_ITERATE, " N = %3" PRIdF77INT "    M = %2" PRIdF77INT "\n", *n, *m);
+      solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "   it   nf  nseg  nact  sub  itls  stepl    tstep     projg        f\n");
 
       if (*iprint > 100) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " L = ");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " L = ");
         i__1 = *n;
         for (i__ = 1; i__ <= i__1; ++i__) {
-          fprintf(stdout, " %11.4E", l[i__]);
+          solver_log_printf(SOLVER_LOG_CONSOLE, " %11.4E", l[i__]);
           if (i__ % 6 == 0) {
-            fprintf(stdout, "\n");
-            fprintf(stdout, "     ");
+            solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+            solver_log_printf(SOLVER_LOG_CONSOLE, "     ");
           }
         }
-        fprintf(stdout, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
 
-        fprintf(stdout, "\n");
-        fprintf(stdout, " X0 =");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " X0 =");
         i__1 = *n;
         for (i__ = 1; i__ <= i__1; ++i__) {
-          fprintf(stdout, " %11.4E", x[i__]);
+          solver_log_printf(SOLVER_LOG_CONSOLE, " %11.4E", x[i__]);
           if (i__ % 6 == 0) {
-            fprintf(stdout, "\n");
-            fprintf(stdout, "     ");
+            solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+            solver_log_printf(SOLVER_LOG_CONSOLE, "     ");
           }
         }
-        fprintf(stdout, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
 
-        fprintf(stdout, "\n");
-        fprintf(stdout, " U = ");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " U = ");
         i__1 = *n;
         for (i__ = 1; i__ <= i__1; ++i__) {
-          fprintf(stdout, " %11.4E", u[i__]);
+          solver_log_printf(SOLVER_LOG_CONSOLE, " %11.4E", u[i__]);
           if (i__ % 6 == 0) {
-            fprintf(stdout, "\n");
-            fprintf(stdout, "     ");
+            solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+            solver_log_printf(SOLVER_LOG_CONSOLE, "     ");
           }
         }
-        fprintf(stdout, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
       }
     }
   }
@@ -2766,11 +2936,10 @@ void prn1lb_(F77_int* n, F77_int* m, double* l, double* u, double* x, F77_int* i
  *                        Ciyou Zhu
  *     in collaboration with R.H. Byrd, P. Lu-Chen and J. Nocedal.
  */
-void prn2lb_(F77_int* n, double* x, double* f, double* g, F77_int* iprint, F77_int* itfile, F77_int* iter, F77_int* nfgv, F77_int* nact,
+void prn2lb_(F77_int* n, double* x, double* f, double* g, F77_int* iprint, F77_int* iter, F77_int* nfgv, F77_int* nact,
              double* sbgnrm, F77_int* nseg, char* word, F77_int* iword, F77_int* iback, double* stp, double* xstep) {
   F77_int i__1;
-  static F77_int i__, imod;
-  FILE* itfptr;
+  F77_int i__, imod;
   --g;
   --x;
 
@@ -2788,34 +2957,32 @@ void prn2lb_(F77_int* n, double* x, double* f, double* g, F77_int* iprint, F77_i
     strcpy(word, "---");
   }
   if (*iprint >= 99) {
-    fprintf(stdout, "LINE SEARCH %" PRIdF77INT " times; norm of step = %E\n", *iback, *xstep);
-    fprintf(stdout, "\nAt iterate%5" PRIdF77INT "    f= %12.5E    |proj g|= %12.5E\n", *iter, *f, *sbgnrm);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "LINE SEARCH %" PRIdF77INT " times; norm of step = %E\n", *iback, *xstep);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\nAt iterate%5" PRIdF77INT "    f= %12.5E    |proj g|= %12.5E\n", *iter, *f, *sbgnrm);
 
     if (*iprint > 100) {
-      fprintf(stdout, "X =");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "X =");
       i__1 = *n;
       for (i__ = 1; i__ <= i__1; ++i__) {
-        fprintf(stdout, "%11.4E ", x[i__]);
+        solver_log_printf(SOLVER_LOG_CONSOLE, "%11.4E ", x[i__]);
       }
-      fprintf(stdout, "\n");
-      fprintf(stdout, "G =");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "G =");
       i__1 = *n;
       for (i__ = 1; i__ <= i__1; ++i__) {
-        fprintf(stdout, "%11.4E ", g[i__]);
+        solver_log_printf(SOLVER_LOG_CONSOLE, "%11.4E ", g[i__]);
       }
-      fprintf(stdout, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
     }
   } else if (*iprint > 0) {
     imod = *iter % *iprint;
     if (imod == 0) {
-      fprintf(stdout, "\nAt iterate%5" PRIdF77INT "    f= %12.5E    |proj g|= %12.5E\n", *iter, *f, *sbgnrm);
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\nAt iterate%5" PRIdF77INT "    f= %12.5E    |proj g|= %12.5E\n", *iter, *f, *sbgnrm);
     }
   }
   if (*iprint >= 1) {
-    itfptr = fopen("iterate.dat", "a");
-    fprintf(itfptr, " %4" PRIdF77INT " %4" PRIdF77INT " %5" PRIdF77INT " %5" PRIdF77INT "  %3s %4" PRIdF77INT "  %7.1E  %7.1E %10.3E %10.3E\n",
-            *iter, *nfgv, *nseg, *nact, word, *iback, *stp, *xstep, *sbgnrm, *f);
-    fclose(itfptr);
+    solver_log_printf(SOLVER_LOG_ITERATE, " %4" PRIdF77INT " %4" PRIdF77INT " %5" PRIdF77INT " %5" PRIdF77INT "  %3s %4" PRIdF77INT "  %7.1E  %7.1E %10.3E %10.3E\n",
+                      *iter, *nfgv, *nseg, *nact, word, *iback, *stp, *xstep, *sbgnrm, *f);
   }
 }
 
@@ -2835,12 +3002,11 @@ void prn2lb_(F77_int* n, double* x, double* f, double* g, F77_int* iprint, F77_i
  *                        Ciyou Zhu
  *     in collaboration with R.H. Byrd, P. Lu-Chen and J. Nocedal.
  */
-void prn3lb_(F77_int* n, double* x, double* f, char* task, F77_int* iprint, F77_int* info, F77_int* itfile, F77_int* iter, F77_int* nfgv,
+void prn3lb_(F77_int* n, double* x, double* f, char* task, F77_int* iprint, F77_int* info, F77_int* iter, F77_int* nfgv,
              F77_int* nintol, F77_int* nskip, F77_int* nact, double* sbgnrm, double* time, F77_int* nseg, char* word, F77_int* iback,
              double* stp, double* xstep, F77_int* k, double* cachyt, double* sbtime, double* lnscht) {
   F77_int i__1;
-  FILE* itfptr;
-  static F77_int i__;
+  F77_int i__;
 
   --x;
 
@@ -2848,147 +3014,145 @@ void prn3lb_(F77_int* n, double* x, double* f, char* task, F77_int* iprint, F77_
     goto L999;
   }
   if (*iprint >= 0) {
-    fprintf(stdout, "\n");
-    fprintf(stdout, "           * * *\n");
-    fprintf(stdout, "\n");
-    fprintf(stdout, "Tit   = total number of iterations\n");
-    fprintf(stdout, "Tnf   = total number of function evaluations\n");
-    fprintf(stdout, "Tnint = total number of segments explored during Cauchy searches\n");
-    fprintf(stdout, "Skip  = number of BFGS updates skipped\n");
-    fprintf(stdout, "Nact  = number of active bounds at final generalized Cauchy point\n");
-    fprintf(stdout, "Projg = norm of the final projected gradient\n");
-    fprintf(stdout, "F     = final function value\n");
-    fprintf(stdout, "\n");
-    fprintf(stdout, "           * * *\n");
-    fprintf(stdout, "\n");
-    fprintf(stdout, "   N    Tit     Tnf  Tnint  Skip  Nact     Projg        F\n");
-    fprintf(stdout, "%5" PRIdF77INT " %6" PRIdF77INT " %6" PRIdF77INT " %6" PRIdF77INT " %5" PRIdF77INT " %5" PRIdF77INT "  %10.3E  %10.3E\n",
-            *n, *iter, *nfgv, *nintol, *nskip, *nact, *sbgnrm, *f);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "           * * *\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Tit   = total number of iterations\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Tnf   = total number of function evaluations\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Tnint = total number of segments explored during Cauchy searches\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Skip  = number of BFGS updates skipped\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Nact  = number of active bounds at final generalized Cauchy point\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "Projg = norm of the final projected gradient\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "F     = final function value\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "           * * *\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "   N    Tit     Tnf  Tnint  Skip  Nact     Projg        F\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "%5" PRIdF77INT " %6" PRIdF77INT " %6" PRIdF77INT " %6" PRIdF77INT " %5" PRIdF77INT " %5" PRIdF77INT "  %10.3E  %10.3E\n",
+                      *n, *iter, *nfgv, *nintol, *nskip, *nact, *sbgnrm, *f);
     if (*iprint >= 100) {
-      fprintf(stdout, "\n");
-      fprintf(stdout, " X =");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " X =");
       i__1 = *n;
       for (i__ = 1; i__ <= i__1; ++i__) {
-        fprintf(stdout, " %11.4E", x[i__]);
+        solver_log_printf(SOLVER_LOG_CONSOLE, " %11.4E", x[i__]);
         if (i__ % 6 == 0) {
-          fprintf(stdout, "\n");
-          fprintf(stdout, "    ");
+          solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+          solver_log_printf(SOLVER_LOG_CONSOLE, "    ");
         }
       }
-      fprintf(stdout, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
     }
     if (*iprint >= 1) {
-      fprintf(stdout, "  F =  %3.8E\n", *f);
+      solver_log_printf(SOLVER_LOG_CONSOLE, "  F =  %3.8E\n", *f);
     }
   }
 L999:
   if (*iprint >= 0) {
-    fprintf(stdout, "\n");
-    fprintf(stdout, "%s\n", task);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "%s\n", task);
     if (*info != 0) {
       if (*info == -1) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Matrix in 1st Cholesky factorization in formk is not Pos. Def.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Matrix in 1st Cholesky factorization in formk is not Pos. Def.\n");
       }
       if (*info == -2) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Matrix in 2st Cholesky factorization in formk is not Pos. Def.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Matrix in 2st Cholesky factorization in formk is not Pos. Def.\n");
       }
       if (*info == -3) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Matrix in the Cholesky factorization in formt is not Pos. Def.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Matrix in the Cholesky factorization in formt is not Pos. Def.\n");
       }
       if (*info == -4) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Derivative >= 0, backtracking line search impossible.\n");
-        fprintf(stdout, "   Previous x, f and g restored.\n");
-        fprintf(stdout, " Possible causes: 1 error in function or gradient evaluation;\n");
-        fprintf(stdout, "                  2 rounding errors dominate computation.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Derivative >= 0, backtracking line search impossible.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "   Previous x, f and g restored.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Possible causes: 1 error in function or gradient evaluation;\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "                  2 rounding errors dominate computation.\n");
       }
       if (*info == -5) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Warning:  more than 10 function and gradient\n");
-        fprintf(stdout, "   evaluations in the last line search.  Termination\n");
-        fprintf(stdout, "   may possibly be caused by a bad search direction.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Warning:  more than 10 function and gradient\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "   evaluations in the last line search.  Termination\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "   may possibly be caused by a bad search direction.\n");
       }
       if (*info == -6) {
-        fprintf(stdout, "  Input nbd(%2" PRIdF77INT ") is invalid.\n", *k);
+        solver_log_printf(SOLVER_LOG_CONSOLE, "  Input nbd(%2" PRIdF77INT ") is invalid.\n", *k);
       }
       if (*info == -7) {
-        fprintf(stdout, "  l(%2" PRIdF77INT ") > u(%2" PRIdF77INT ").  No feasible solution.\n", *k, *k);
+        solver_log_printf(SOLVER_LOG_CONSOLE, "  l(%2" PRIdF77INT ") > u(%2" PRIdF77INT ").  No feasible solution.\n", *k, *k);
       }
       if (*info == -8) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " The triangular system is singular.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " The triangular system is singular.\n");
       }
       if (*info == -9) {
-        fprintf(stdout, "\n");
-        fprintf(stdout, " Line search cannot locate an adequate point after 20 function\n");
-        fprintf(stdout, "  and gradient evaluations.  Previous x, f and g restored.\n");
-        fprintf(stdout, " Possible causes: 1 error in function or gradient evaluation;\n");
-        fprintf(stdout, "                  2 rounding error dominate computation.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Line search cannot locate an adequate point after 20 function\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "  and gradient evaluations.  Previous x, f and g restored.\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, " Possible causes: 1 error in function or gradient evaluation;\n");
+        solver_log_printf(SOLVER_LOG_CONSOLE, "                  2 rounding error dominate computation.\n");
       }
     }
     if (*iprint >= 1) {
-      fprintf(stdout, "\n");
-      fprintf(stdout, " Cauchy                time %1.3E seconds.\n", *cachyt);
-      fprintf(stdout, " Subspace minimization time %1.3E seconds.\n", *sbtime);
-      fprintf(stdout, " Line search           time %1.3E seconds.\n", *lnscht);
+      solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Cauchy                time %1.3E seconds.\n", *cachyt);
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Subspace minimization time %1.3E seconds.\n", *sbtime);
+      solver_log_printf(SOLVER_LOG_CONSOLE, " Line search           time %1.3E seconds.\n", *lnscht);
     }
-    fprintf(stdout, "\n");
-    fprintf(stdout, " Total User time %1.3E seconds.\n", *time);
-    fprintf(stdout, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, " Total User time %1.3E seconds.\n", *time);
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n");
 
     if (*iprint >= 1) {
-      itfptr = fopen("iterate.dat", "a");
       if (*info == -4 || *info == -9) {
-        fprintf(itfptr, " %4" PRIdF77INT " %4" PRIdF77INT " %5" PRIdF77INT " %5" PRIdF77INT "  %3s %4" PRIdF77INT "  %7.1E  %7.1E      -          -\n",
-                *iter, *nfgv, *nseg, *nact, word, *iback, *stp, *xstep);
+        solver_log_printf(SOLVER_LOG_ITERATE, " %4" PRIdF77INT " %4" PRIdF77INT " %5" PRIdF77INT " %5" PRIdF77INT "  %3s %4" PRIdF77INT "  %7.1E  %7.1E      -          -\n",
+                          *iter, *nfgv, *nseg, *nact, word, *iback, *stp, *xstep);
       }
-      fprintf(itfptr, "\n");
-      fprintf(itfptr, "%s\n", task);
+      solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, "%s\n", task);
       if (*info != 0) {
         if (*info == -1) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " Matrix in 1st Cholesky factorization in formk is not Pos. Def.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Matrix in 1st Cholesky factorization in formk is not Pos. Def.\n");
         }
         if (*info == -2) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " Matrix in 2st Cholesky factorization in formk is not Pos. Def.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Matrix in 2st Cholesky factorization in formk is not Pos. Def.\n");
         }
         if (*info == -3) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " Matrix in the Cholesky factorization in formt is not Pos. Def.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Matrix in the Cholesky factorization in formt is not Pos. Def.\n");
         }
         if (*info == -4) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " Derivative >= 0, backtracking line search impossible.\n");
-          fprintf(itfptr, "   Previous x, f and g restored.\n");
-          fprintf(itfptr, " Possible causes: 1 error in function or gradient evaluation;\n");
-          fprintf(itfptr, "                  2 rounding errors dominate computation.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Derivative >= 0, backtracking line search impossible.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "   Previous x, f and g restored.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Possible causes: 1 error in function or gradient evaluation;\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "                  2 rounding errors dominate computation.\n");
         }
         if (*info == -5) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " Warning:  more than 10 function and gradient\n");
-          fprintf(itfptr, "   evaluations in the last line search.  Termination\n");
-          fprintf(itfptr, "   may possibly be caused by a bad search direction.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Warning:  more than 10 function and gradient\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "   evaluations in the last line search.  Termination\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "   may possibly be caused by a bad search direction.\n");
         }
         if (*info == -8) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " The triangular system is singular.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " The triangular system is singular.\n");
         }
         if (*info == -9) {
-          fprintf(itfptr, "\n");
-          fprintf(itfptr, " Line search cannot locate an adequate point after 20 function\n");
-          fprintf(itfptr, "  and gradient evaluations.  Previous x, f and g restored.\n");
-          fprintf(itfptr, " Possible causes: 1 error in function or gradient evaluation;\n");
-          fprintf(itfptr, "                  2 rounding error dominate computation.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Line search cannot locate an adequate point after 20 function\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "  and gradient evaluations.  Previous x, f and g restored.\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, " Possible causes: 1 error in function or gradient evaluation;\n");
+          solver_log_printf(SOLVER_LOG_ITERATE, "                  2 rounding error dominate computation.\n");
         }
       }
-      fprintf(itfptr, "\n");
-      fprintf(itfptr, " Total User time %1.3E seconds.\n", *time);
-      fprintf(itfptr, "\n");
-      fclose(itfptr);
+      solver_log_printf(SOLVER_LOG_ITERATE, "\n");
+      solver_log_printf(SOLVER_LOG_ITERATE, " Total User time %1.3E seconds.\n", *time);
+      solver_log_printf(SOLVER_LOG_ITERATE, "\n");
     }
   }
 }
@@ -3011,8 +3175,8 @@ L999:
 void projgr_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, double* g, double* sbgnrm) {
   F77_int i__1;
   double d__1, d__2;
-  static F77_int i__;
-  static double gi;
+  F77_int i__;
+  double gi;
 
   --g;
   --x;
@@ -3219,13 +3383,13 @@ void subsm_(F77_int* n, F77_int* m, F77_int* nsub, F77_int* ind, double* l, doub
             double* wn, F77_int* iprint, F77_int* info) {
   F77_int ws_dim1, ws_offset, wy_dim1, wy_offset, wn_dim1, wn_offset, i__1, i__2;
   double d__1, d__2;
-  static F77_int i__, j, k, m2;
-  static double dk;
-  static F77_int js, jy;
-  static double xk;
-  static F77_int ibd, col2;
-  static double dd_p__, temp1, temp2, alpha;
-  static F77_int pointr;
+  F77_int i__, j, k, m2;
+  double dk;
+  F77_int js, jy;
+  double xk;
+  F77_int ibd, col2;
+  double dd_p__, temp1, temp2, alpha;
+  F77_int pointr;
 
   --gg;
   --xx;
@@ -3251,7 +3415,7 @@ void subsm_(F77_int* n, F77_int* m, F77_int* nsub, F77_int* ind, double* l, doub
     return;
   }
   if (*iprint >= 99) {
-    fprintf(stdout, "\n----------------SUBSM entered-----------------\n\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n----------------SUBSM entered-----------------\n\n");
   }
   /* Compute wv = W'Zd. */
   pointr = *head;
@@ -3356,8 +3520,8 @@ void subsm_(F77_int* n, F77_int* m, F77_int* nsub, F77_int* ind, double* l, doub
   }
   if (dd_p__ > 0.) {
     dcopy_(n, &xp[1], &c__1, &x[1], &c__1);
-    fprintf(stderr, "  Positive dir derivative in projection\n");
-    fprintf(stderr, "  Using the backtracking step\n");
+    solver_log_printf(SOLVER_LOG_WARNING, "  Positive dir derivative in projection\n");
+    solver_log_printf(SOLVER_LOG_WARNING, "  Using the backtracking step\n");
   } else {
     goto L911;
   }
@@ -3412,7 +3576,7 @@ void subsm_(F77_int* n, F77_int* m, F77_int* nsub, F77_int* ind, double* l, doub
   /* ccccc */
 L911:
   if (*iprint >= 99) {
-    fprintf(stdout, "\n----------------exit SUBSM --------------------\n\n");
+    solver_log_printf(SOLVER_LOG_CONSOLE, "\n----------------exit SUBSM --------------------\n\n");
   }
 }
 
@@ -3550,10 +3714,10 @@ void dcsrch_(double* f, double* g, double* stp, double* ftol, double* gtol, doub
              char* task, F77_int* isave, double* dsave) {
 
   double d__1;
-  static double fm, gm, fx, fy, gx, gy, fxm, fym, gxm, gym, stx, sty;
-  static F77_int stage;
-  static double finit, ginit, width, ftest, gtest, stmin, stmax, width1;
-  static F77_int brackt;
+  double fm, gm, fx, fy, gx, gy, fxm, fym, gxm, gym, stx, sty;
+  F77_int stage;
+  double finit, ginit, width, ftest, gtest, stmin, stmax, width1;
+  F77_int brackt;
 
   --dsave;
   --isave;
@@ -3825,7 +3989,7 @@ L1000:
 void dcstep_(double* stx, double* fx, double* dx, double* sty, double* fy, double* dy, double* stp, double* fp, double* dp,
              F77_int* brackt, double* stpmin, double* stpmax) {
   double d__1, d__2, d__3;
-  static double p, q, r__, s, sgnd, stpc, stpf, stpq, gamma, theta;
+  double p, q, r__, s, sgnd, stpc, stpf, stpq, gamma, theta;
 
   sgnd = *dp * (*dx / fabs(*dx));
   /* First case: A higher function value. The minimum is bracketed. */
@@ -3990,6 +4154,17 @@ void dcstep_(double* stx, double* fx, double* dx, double* sty, double* fy, doubl
   *stp = stpf;
 }
 
+/* Returns the seconds of the monotonic clock; clock() measured the CPU time of the whole process, which is meaningless with threads. */
 void timer_(double* ttime) {
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  *ttime = (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#elif defined(TIME_UTC)
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  *ttime = (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#else
   *ttime = (double)clock() / CLOCKS_PER_SEC;
+#endif
 }
@@ -52,17 +52,17 @@ extern void hpsolb_(F77_int* n, double* t, F77_int* iorder, F77_int* iheap);
 extern void lnsrlb_(F77_int* n, double* l, double* u, F77_int* nbd, double* x, double* f, double* fold, double* gd, double* gdold,
                     double* g, double* d__, double* r__, double* t, double* z__, double* stp, double* dnorm, double* dtd,
                     double* xstep, double* stpmx, F77_int* iter, F77_int* ifun, F77_int* iback, F77_int* nfgv, F77_int* info, char* task,
-                    F77_int* boxed, F77_int* cnstnd, char* csave, F77_int* isave, double* dsave);
+                    F77_int* boxed, F77_int* cnstnd, F77_int* lsmeth, char* csave, F77_int* isave, double* dsave);
 
 extern void matupd_(F77_int* n, F77_int* m, double* ws, double* wy, double* sy, double* ss, double* d__, double* r__, F77_int* itail,
                     F77_int* iupdat, F77_int* col, F77_int* head, double* theta, double* rr, double* dr, double* stp, double* dtd);
 
-extern void prn1lb_(F77_int* n, F77_int* m, double* l, double* u, double* x, F77_int* iprint, F77_int* itfile, double* epsmch);
+extern void prn1lb_(F77_int* n, F77_int* m, double* l, double* u, double* x, F77_int* iprint, double* epsmch);
 
-extern void prn2lb_(F77_int* n, double* x, double* f, double* g, F77_int* iprint, F77_int* itfile, F77_int* iter, F77_int* nfgv, F77_int* nact,
+extern void prn2lb_(F77_int* n, double* x, double* f, double* g, F77_int* iprint, F77_int* iter, F77_int* nfgv, F77_int* nact,
                     double* sbgnrm, F77_int* nseg, char* word, F77_int* iword, F77_int* iback, double* stp, double* xstep);
 
-extern void prn3lb_(F77_int* n, double* x, double* f, char* task, F77_int* iprint, F77_int* info, F77_int* itfile, F77_int* iter, F77_int* nfgv,
+extern void prn3lb_(F77_int* n, double* x, double* f, char* task, F77_int* iprint, F77_int* info, F77_int* iter, F77_int* nfgv,
                     F77_int* nintol, F77_int* nskip, F77_int* nact, double* sbgnrm, double* time, F77_int* nseg, char* word, F77_int* iback,
                     double* stp, double* xstep, F77_int* k, double* cachyt, double* sbtime, double* lnscht);
 
@@ -0,0 +1,7 @@
+/**
+ * The 64-bit integer version of lbfgsb.c.
+ */
+#define USE_INT64 1
+#include "int64.h"
+
+#include "lbfgsb.c"
@@ -0,0 +1,14 @@
+#ifndef NUMO_OPTIMIZE_LBFGSB_I64_H_
+#define NUMO_OPTIMIZE_LBFGSB_I64_H_
+
+#include <stdint.h>
+
+/* The routines of the 64-bit integer version used from the extension. */
+extern void setulb_i64_(int64_t* n, int64_t* m, double* x, double* l, double* u, int64_t* nbd, double* f, double* g, double* factr,
+                        double* pgtol, double* wa, int64_t* iwa, char* task, int64_t* iprint, char* csave, int64_t* lsave, int64_t* isave,
+                        double* dsave);
+
+extern void daxpy_i64_(int64_t* n, double* da, double* dx, int64_t* incx, double* dy, int64_t* incy);
+extern double ddot_i64_(int64_t* n, double* dx, int64_t* incx, double* dy, int64_t* incy);
+
+#endif /* NUMO_OPTIMIZE_LBFGSB_I64_H_ */
@@ -45,9 +45,9 @@ static F77_int c__1 = 1;
  */
 void dpofa_(double* a, F77_int* lda, F77_int* n, F77_int* info) {
   F77_int a_dim1, a_offset, i__1, i__2, i__3;
-  static F77_int j, k;
-  static double s, t;
-  static F77_int jm1;
+  F77_int j, k;
+  double s, t;
+  F77_int jm1;
 
   a_dim1 = *lda;
   a_offset = 1 + a_dim1;
@@ -133,8 +133,8 @@ L40:
  */
 void dtrsl_(double* t, F77_int* ldt, F77_int* n, double* b, F77_int* job, F77_int* info) {
   F77_int t_dim1, t_offset, i__1, i__2;
-  static F77_int j, jj, case__;
-  static double temp;
+  F77_int j, jj, case__;
+  double temp;
 
   /* check for zero diagonal elements. */
   t_dim1 = *ldt;
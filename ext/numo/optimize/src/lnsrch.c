@@ -0,0 +1,232 @@
+/**
+ * Line searches of L-BFGS-B other than the More-Thuente search of dcsrch.
+ *
+ * The searches work on phi(stp) = f(x + stp * d) through reverse communication like dcsrch:
+ * lnsrch_start and lnsrch_next return the values needed at the new stp, and the caller evaluates them
+ * and calls lnsrch_next with phi(stp) and phi'(stp). phi'(stp) is given only after LNSRCH_EVAL_FG and LNSRCH_EVAL_G.
+ *
+ * - Hager-Zhang: the approximate Wolfe conditions with the secant and bisection steps of
+ *   Hager, W. W. and Zhang, H., "A new conjugate gradient method with guaranteed descent and an efficient line search,"
+ *   SIAM Journal on Optimization, Vol. 16, pp. 170--192, 2005.
+ *   Every trial needs f and g, and the double secant step is replaced by a bisection when the interval shrinks slowly.
+ * - Armijo: backtracking with the safeguarded quadratic interpolation, where the trials need only f,
+ *   and g is evaluated once at the accepted step.
+ * - Nonmonotone: the Armijo backtracking against the weighted average of the function values of
+ *   Zhang, H. and Hager, W. W., "A nonmonotone line search technique and its application to unconstrained optimization,"
+ *   SIAM Journal on Optimization, Vol. 14, pp. 1043--1056, 2004.
+ * - Speculative: the first trial of More-Thuente is replaced by a batch of the candidate steps evaluated at once,
+ *   of which the first one satisfying the strong Wolfe conditions is accepted, and dcsrch continues otherwise.
+ *   lnsrch_batch_start and lnsrch_batch_pick only choose the steps; the batch is kept by lnsrlb.
+ */
+#include <math.h>
+
+#include "lnsrch.h"
+
+/* Sufficient decrease of Armijo and of the nonmonotone search. */
+#define LNSRCH_C1 1e-4
+/* Weight of the past function values of the nonmonotone search. */
+#define LNSRCH_ETA 0.85
+/* Parameters of Hager-Zhang. */
+#define LNSRCH_HZ_DELTA 0.1
+#define LNSRCH_HZ_SIGMA 0.9
+#define LNSRCH_HZ_EPSILON 1e-6
+#define LNSRCH_HZ_GAMMA 0.66
+#define LNSRCH_HZ_RHO 5.0
+/* Smallest step tried before the search gives up. */
+#define LNSRCH_STPMIN 1e-20
+
+/* Indices of the state. C and Q are kept across the searches by the nonmonotone search. */
+enum {
+  LS_STAGE,
+  LS_F0,
+  LS_GD0,
+  LS_A,
+  LS_FA,
+  LS_DA,
+  LS_B,
+  LS_FB,
+  LS_DB,
+  LS_WIDTH,
+  LS_FREF,
+  LS_C,
+  LS_Q
+};
+
+enum {
+  LS_STAGE_TRIAL = 1,
+  LS_STAGE_GRAD,
+  LS_STAGE_EXPAND,
+  LS_STAGE_BRACKET
+};
+
+/**
+ * Starts the search along the descent direction with phi(0) = f0, phi'(0) = gd0 < 0, and the initial step stp.
+ * reset starts the average of the nonmonotone search from f0, which is done at the first iteration.
+ */
+int lnsrch_start(int method, double f0, double gd0, double* stp, double stpmax, bool reset, double* dsave) {
+  dsave[LS_F0] = f0;
+  dsave[LS_GD0] = gd0;
+  if (*stp > stpmax) {
+    *stp = stpmax;
+  }
+  if (*stp < LNSRCH_STPMIN) {
+    return LNSRCH_FAIL;
+  }
+  if (method == LNSRCH_HAGER_ZHANG) {
+    dsave[LS_STAGE] = LS_STAGE_EXPAND;
+    dsave[LS_A] = 0.0;
+    dsave[LS_FA] = f0;
+    dsave[LS_DA] = gd0;
+    dsave[LS_WIDTH] = HUGE_VAL;
+    return LNSRCH_EVAL_FG;
+  }
+  if (method == LNSRCH_NONMONOTONE) {
+    if (reset || !(dsave[LS_Q] >= 1.0)) {
+      dsave[LS_C] = f0;
+      dsave[LS_Q] = 1.0;
+    }
+    dsave[LS_FREF] = dsave[LS_C];
+  } else {
+    dsave[LS_FREF] = f0;
+  }
+  dsave[LS_STAGE] = LS_STAGE_TRIAL;
+  return LNSRCH_EVAL_F;
+}
+
+/* Armijo and nonmonotone searches. */
+static int lnsrch_backtrack(int method, double f, double* stp, double* dsave) {
+  const double f0 = dsave[LS_F0];
+  const double gd0 = dsave[LS_GD0];
+
+  if (dsave[LS_STAGE] == LS_STAGE_GRAD) {
+    if (method == LNSRCH_NONMONOTONE) {
+      const double q = LNSRCH_ETA * dsave[LS_Q] + 1.0;
+      dsave[LS_C] = (LNSRCH_ETA * dsave[LS_Q] * dsave[LS_C] + f) / q;
+      dsave[LS_Q] = q;
+    }
+    return LNSRCH_CONV;
+  }
+  if (isfinite(f) && f <= dsave[LS_FREF] + LNSRCH_C1 * *stp * gd0) {
+    dsave[LS_STAGE] = LS_STAGE_GRAD;
+    return LNSRCH_EVAL_G;
+  }
+  /* The minimizer of the quadratic through phi(0), phi'(0), and phi(stp), kept in [0.1 stp, 0.5 stp]. */
+  double next = 0.1 * *stp;
+  if (isfinite(f)) {
+    const double curv = f - f0 - gd0 * *stp;
+    if (curv > 0.0) {
+      next = -gd0 * *stp * *stp / (2.0 * curv);
+    }
+    next = fmin(fmax(next, 0.1 * *stp), 0.5 * *stp);
+  }
+  *stp = next;
+  return *stp < LNSRCH_STPMIN ? LNSRCH_FAIL : LNSRCH_EVAL_F;
+}
+
+/* Hager-Zhang search. */
+static int lnsrch_hager_zhang(double f, double gd, double* stp, double stpmax, double* dsave) {
+  const double f0 = dsave[LS_F0];
+  const double gd0 = dsave[LS_GD0];
+  const double fmax_eps = f0 + LNSRCH_HZ_EPSILON * fabs(f0);
+  const double c = *stp;
+
+  if (isfinite(f) && isfinite(gd)) {
+    const bool wolfe = f - f0 <= LNSRCH_HZ_DELTA * c * gd0 && gd >= LNSRCH_HZ_SIGMA * gd0;
+    const bool approx_wolfe = (2.0 * LNSRCH_HZ_DELTA - 1.0) * gd0 >= gd && gd >= LNSRCH_HZ_SIGMA * gd0 && f <= fmax_eps;
+    if (wolfe || approx_wolfe) {
+      return LNSRCH_CONV;
+    }
+  }
+
+  if (dsave[LS_STAGE] == LS_STAGE_EXPAND) {
+    if (isfinite(f) && isfinite(gd) && gd < 0.0 && f <= fmax_eps) {
+      /* Still descending, so the step is expanded, or taken if it is at the bound of the feasible region. */
+      dsave[LS_A] = c;
+      dsave[LS_FA] = f;
+      dsave[LS_DA] = gd;
+      if (c >= stpmax) {
+        return LNSRCH_CONV;
+      }
+      *stp = fmin(LNSRCH_HZ_RHO * c, stpmax);
+      return LNSRCH_EVAL_FG;
+    }
+    dsave[LS_B] = c;
+    dsave[LS_FB] = f;
+    dsave[LS_DB] = gd;
+    dsave[LS_STAGE] = LS_STAGE_BRACKET;
+  } else if (isfinite(f) && isfinite(gd) && gd < 0.0 && f <= fmax_eps) {
+    dsave[LS_A] = c;
+    dsave[LS_FA] = f;
+    dsave[LS_DA] = gd;
+  } else {
+    dsave[LS_B] = c;
+    dsave[LS_FB] = f;
+    dsave[LS_DB] = gd;
+  }
+
+  /* The secant step of the derivatives at the ends, or the bisection if it is outside or the interval shrinks slowly. */
+  const double a = dsave[LS_A];
+  const double b = dsave[LS_B];
+  const double da = dsave[LS_DA];
+  const double db = dsave[LS_DB];
+  const double width = b - a;
+  double next = 0.5 * (a + b);
+  if (isfinite(db) && db > da && width <= LNSRCH_HZ_GAMMA * dsave[LS_WIDTH]) {
+    const double secant = (a * db - b * da) / (db - da);
+    if (secant > a && secant < b) {
+      next = secant;
+    }
+  }
+  dsave[LS_WIDTH] = width;
+  if (!(width > 1e-12 * b) || next < LNSRCH_STPMIN) {
+    return LNSRCH_FAIL;
+  }
+  *stp = next;
+  return LNSRCH_EVAL_FG;
+}
+
+/* Continues the search with phi(stp) = f and phi'(stp) = gd, where gd is ignored after LNSRCH_EVAL_F. */
+int lnsrch_next(int method, double f, double gd, double* stp, double stpmax, double* dsave) {
+  if (method == LNSRCH_HAGER_ZHANG) {
+    return lnsrch_hager_zhang(f, gd, stp, stpmax, dsave);
+  }
+  return lnsrch_backtrack(method, f, stp, dsave);
+}
+
+/**
+ * Stores the candidate steps of the speculative search for the initial step stp, which are clipped to stpmax.
+ * A candidate equal to an earlier one is replaced by 0, which the caller skips. Returns the number of the candidates.
+ */
+int lnsrch_batch_start(double stp, double stpmax, double* dsave) {
+  static const double scale[LNSRCH_BATCH_SIZE] = { 1.0, 0.5, 0.25, 2.0 };
+  int count = 0;
+  for (int s = 0; s < LNSRCH_BATCH_SIZE; s++) {
+    const double cand = fmin(scale[s] * stp, stpmax);
+    bool dup = false;
+    for (int r = 0; r < s; r++) {
+      dup = dup || dsave[LNSRCH_BATCH_STP + r] == cand;
+    }
+    dsave[LNSRCH_BATCH_STP + s] = dup ? 0.0 : cand;
+    dsave[LNSRCH_BATCH_F + s] = 0.0;
+    dsave[LNSRCH_BATCH_GD + s] = 0.0;
+    count += dup ? 0 : 1;
+  }
+  dsave[LNSRCH_BATCH_PICK] = -1.0;
+  return count;
+}
+
+/**
+ * Returns the first candidate satisfying the strong Wolfe conditions with phi(0) = f0 and phi'(0) = gd0,
+ * or -1 if there is none, with phi and phi' of the candidates written in the state by the caller.
+ */
+int lnsrch_batch_pick(double f0, double gd0, double ftol, double gtol, const double* dsave) {
+  for (int s = 0; s < LNSRCH_BATCH_SIZE; s++) {
+    const double stp = dsave[LNSRCH_BATCH_STP + s];
+    const double f = dsave[LNSRCH_BATCH_F + s];
+    const double gd = dsave[LNSRCH_BATCH_GD + s];
+    if (stp > 0.0 && f <= f0 + ftol * stp * gd0 && fabs(gd) <= gtol * -gd0) {
+      return s;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,36 @@
+#ifndef NUMO_OPTIMIZE_LNSRCH_H_
+#define NUMO_OPTIMIZE_LNSRCH_H_ 1
+
+#include <stdbool.h>
+
+/* Line searches of L-BFGS-B selected by isave(42) of setulb; More-Thuente is dcsrch itself. */
+#define LNSRCH_MORE_THUENTE 0
+#define LNSRCH_HAGER_ZHANG 1
+#define LNSRCH_ARMIJO 2
+#define LNSRCH_NONMONOTONE 3
+#define LNSRCH_SPECULATIVE 4
+
+/* Return values of lnsrch_start and lnsrch_next. */
+#define LNSRCH_CONV 0
+#define LNSRCH_EVAL_FG 1
+#define LNSRCH_EVAL_F 2
+#define LNSRCH_EVAL_G 3
+#define LNSRCH_FAIL (-1)
+
+/* Number of doubles of the state, which takes the place of dsave of dcsrch. */
+#define LNSRCH_DSAVE_SIZE 13
+
+/* Number of the candidate steps of the speculative search, which are stp times 1, 0.5, 0.25, and 2. */
+#define LNSRCH_BATCH_SIZE 4
+/* Offsets in the state of the candidate steps, of phi and phi' at them written by the caller, and of the accepted one. */
+#define LNSRCH_BATCH_STP 0
+#define LNSRCH_BATCH_F 4
+#define LNSRCH_BATCH_GD 8
+#define LNSRCH_BATCH_PICK 12
+
+extern int lnsrch_start(int method, double f0, double gd0, double* stp, double stpmax, bool reset, double* dsave);
+extern int lnsrch_next(int method, double f, double gd, double* stp, double stpmax, double* dsave);
+extern int lnsrch_batch_start(double stp, double stpmax, double* dsave);
+extern int lnsrch_batch_pick(double f0, double gd0, double ftol, double gtol, const double* dsave);
+
+#endif /* NUMO_OPTIMIZE_LNSRCH_H_ */
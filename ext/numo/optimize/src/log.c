@@ -0,0 +1,55 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define SOLVER_LOG_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define SOLVER_LOG_THREAD_LOCAL __declspec(thread)
+#else
+#define SOLVER_LOG_THREAD_LOCAL __thread
+#endif
+
+static SOLVER_LOG_THREAD_LOCAL const solver_log_sink* solver_log_current = NULL;
+
+/* Sets the sink of the calling thread and returns the previous one. NULL restores the default destinations. */
+const solver_log_sink* solver_log_set_sink(const solver_log_sink* sink) {
+  const solver_log_sink* prev = solver_log_current;
+  solver_log_current = sink;
+  return prev;
+}
+
+/* Formats the message and passes it to the sink of the calling thread. */
+void solver_log_printf(int stream, const char* format, ...) {
+  const solver_log_sink* sink = solver_log_current;
+  va_list args;
+
+  if (sink == NULL) {
+    if (stream == SOLVER_LOG_ITERATE) return;
+    va_start(args, format);
+    vfprintf(stream == SOLVER_LOG_WARNING ? stderr : stdout, format, args);
+    va_end(args);
+    return;
+  }
+
+  char buf[256];
+  va_start(args, format);
+  const int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return;
+  if ((size_t)len < sizeof(buf)) {
+    sink->write(sink->data, stream, buf, (size_t)len);
+    return;
+  }
+
+  /* Longer messages are formatted on the heap. */
+  char* text = (char*)malloc((size_t)len + 1);
+  if (text == NULL) return;
+  va_start(args, format);
+  vsnprintf(text, (size_t)len + 1, format, args);
+  va_end(args);
+  sink->write(sink->data, stream, text, (size_t)len);
+  free(text);
+}
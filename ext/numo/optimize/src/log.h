@@ -0,0 +1,34 @@
+#ifndef NUMO_OPTIMIZE_LOG_H_
+#define NUMO_OPTIMIZE_LOG_H_ 1
+
+#include <stddef.h>
+
+/* Streams of the diagnostics written by the solvers. */
+#define SOLVER_LOG_CONSOLE 0 /* messages to the console, controlled by iprint */
+#define SOLVER_LOG_ITERATE 1 /* rows of the iteration table formerly written to iterate.dat */
+#define SOLVER_LOG_WARNING 2 /* messages written regardless of iprint */
+
+/* Function receiving the formatted text of a stream; the text is not null-terminated. */
+typedef void (*solver_log_fn)(void* data, int stream, const char* text, size_t len);
+
+/**
+ * Destination of the diagnostics of the solvers.
+ * The sink is set per thread, so the solves running on different threads write to their own sinks.
+ * Without a sink, the console messages go to stdout, the warnings go to stderr, and the iteration table is discarded.
+ */
+typedef struct {
+  solver_log_fn write;
+  void* data;
+} solver_log_sink;
+
+extern const solver_log_sink* solver_log_set_sink(const solver_log_sink* sink);
+/* The format is checked against the arguments by the compilers supporting the attribute. */
+#if defined(__GNUC__) || defined(__clang__)
+#define SOLVER_LOG_PRINTF_FORMAT __attribute__((format(printf, 2, 3)))
+#else
+#define SOLVER_LOG_PRINTF_FORMAT
+#endif
+
+extern void solver_log_printf(int stream, const char* format, ...) SOLVER_LOG_PRINTF_FORMAT;
+
+#endif /* NUMO_OPTIMIZE_LOG_H_ */
@@ -0,0 +1,354 @@
+/**
+ * Nelder-Mead simplex method for many small problems in lock-step.
+ *
+ * The method is the same as Numo::Optimize::NelderMead, including the adaptive parameters:
+ * - Gao, F. and Han, L., "Implementing the Nelder-Mead simplex algorithm with adaptive parameters,"
+ *   Computational Optimization and Applications, Vol. 51, pp. 259--277, 2012.
+ *
+ * The problems are laid out as structure of arrays so that each step of the method is a loop over
+ * the problems with unit stride. Problems that have converged are masked instead of branching,
+ * and the driver evaluates the objective for all the problems at once through reverse communication.
+ */
+#include <math.h>
+#include <string.h>
+
+#include "nm_batch.h"
+
+#define NM_ZERO_TAU 0.00025
+#define NM_NONZERO_TAU 0.05
+
+enum {
+  NM_STAGE_VERTEX,
+  NM_STAGE_ITERATE,
+  NM_STAGE_REFLECT,
+  NM_STAGE_TRIAL,
+  NM_STAGE_SHRINK
+};
+
+enum {
+  NM_STEP_EXPAND,
+  NM_STEP_REFLECT,
+  NM_STEP_OUTSIDE,
+  NM_STEP_INSIDE
+};
+
+/* Returns the number of bytes of the buffer given to nm_batch_init. */
+int64_t nm_batch_bytes(int64_t n, int64_t k) {
+  const int64_t n_doubles = (n + 1) * n * k + (n + 1) * k + 4 * n * k + 2 * k;
+  const int64_t n_flags = 3 * k;
+  return n_doubles * (int64_t)sizeof(double) + 2 * k * (int64_t)sizeof(int64_t) + k * (int64_t)sizeof(int) +
+         n_flags * (int64_t)sizeof(bool);
+}
+
+/**
+ * Initializes the state with the buffer of nm_batch_bytes(n, k) bytes.
+ * The initial points are to be set in the first vertex of sim before the first call of nm_batch_run.
+ */
+void nm_batch_init(nm_batch* nm, int64_t n, int64_t k, void* buf) {
+  double* dp = (double*)buf;
+  nm->n = n;
+  nm->k = k;
+  nm->max_iter = 200 * n;
+  nm->xtol = 1e-6;
+  nm->ftol = 1e-6;
+  nm->alpha = 1.0;
+  nm->beta = n > 1 ? 1.0 + 2.0 / n : 2.0;
+  nm->gamma = n > 1 ? 0.75 - 1.0 / (2.0 * n) : 0.5;
+  nm->delta = n > 1 ? 1.0 - 1.0 / n : 0.5;
+  nm->sim = dp;
+  dp += (n + 1) * n * k;
+  nm->fsim = dp;
+  dp += (n + 1) * k;
+  nm->xbar = dp;
+  dp += n * k;
+  nm->xr = dp;
+  dp += n * k;
+  nm->xt = dp;
+  dp += n * k;
+  nm->pts = dp;
+  dp += n * k;
+  nm->fval = dp;
+  dp += k;
+  nm->fr = dp;
+  dp += k;
+  nm->n_iter = (int64_t*)dp;
+  nm->n_fev = nm->n_iter + k;
+  nm->step = (int*)(nm->n_fev + k);
+  nm->active = (bool*)(nm->step + k);
+  nm->mask = nm->active + k;
+  nm->shrink = nm->mask + k;
+  memset(nm->n_iter, 0, 2 * k * sizeof(int64_t));
+  for (int64_t p = 0; p < k; p++) {
+    nm->active[p] = true;
+  }
+  nm->stage = NM_STAGE_VERTEX;
+  nm->vertex = -1;
+}
+
+/* Copies src to pts for the problems of the mask and the best vertex for the others, which keeps all the points finite. */
+static void nm_batch_set_points(nm_batch* nm, const double* src) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t i = 0; i < n; i++) {
+    const double* s = src + i * k;
+    const double* b = nm->sim + i * k;
+    double* d = nm->pts + i * k;
+    for (int64_t p = 0; p < k; p++) {
+      d[p] = nm->mask[p] ? s[p] : b[p];
+    }
+  }
+}
+
+static bool nm_batch_any(const bool* flags, int64_t k) {
+  for (int64_t p = 0; p < k; p++) {
+    if (flags[p]) return true;
+  }
+  return false;
+}
+
+/* Sorts the vertices of each running problem by the function values with the insertion sort, which is stable. */
+static void nm_batch_sort(nm_batch* nm) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t p = 0; p < k; p++) {
+    if (!nm->active[p]) continue;
+    for (int64_t v = 1; v <= n; v++) {
+      for (int64_t w = v; w > 0 && nm->fsim[w * k + p] < nm->fsim[(w - 1) * k + p]; w--) {
+        double tmp = nm->fsim[w * k + p];
+        nm->fsim[w * k + p] = nm->fsim[(w - 1) * k + p];
+        nm->fsim[(w - 1) * k + p] = tmp;
+        for (int64_t i = 0; i < n; i++) {
+          double* a = nm->sim + (w * n + i) * k + p;
+          double* b = nm->sim + ((w - 1) * n + i) * k + p;
+          tmp = *a;
+          *a = *b;
+          *b = tmp;
+        }
+      }
+    }
+  }
+}
+
+/* Deactivates the problems that have converged or reached the maximum number of iterations; returns whether any is running. */
+static bool nm_batch_check(nm_batch* nm) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  bool running = false;
+  for (int64_t p = 0; p < k; p++) {
+    if (!nm->active[p]) continue;
+    if (nm->n_iter[p] >= nm->max_iter) {
+      nm->active[p] = false;
+      continue;
+    }
+    double xdiff = 0.0;
+    double fdiff = 0.0;
+    for (int64_t v = 1; v <= n; v++) {
+      for (int64_t i = 0; i < n; i++) {
+        const double d = fabs(nm->sim[(v * n + i) * k + p] - nm->sim[i * k + p]);
+        if (d > xdiff) xdiff = d;
+      }
+      const double d = fabs(nm->fsim[p] - nm->fsim[v * k + p]);
+      if (d > fdiff) fdiff = d;
+    }
+    nm->active[p] = !(xdiff <= nm->xtol && fdiff <= nm->ftol);
+    running = running || nm->active[p];
+  }
+  return running;
+}
+
+/* Computes the centroid of the vertices except the worst one and the reflection point. */
+static void nm_batch_reflect(nm_batch* nm) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t i = 0; i < n; i++) {
+    double* xbar = nm->xbar + i * k;
+    double* xr = nm->xr + i * k;
+    const double* worst = nm->sim + (n * n + i) * k;
+    memcpy(xbar, nm->sim + i * k, k * sizeof(double));
+    for (int64_t v = 1; v < n; v++) {
+      const double* s = nm->sim + (v * n + i) * k;
+      for (int64_t p = 0; p < k; p++) {
+        xbar[p] += s[p];
+      }
+    }
+    for (int64_t p = 0; p < k; p++) {
+      xbar[p] /= n;
+      xr[p] = xbar[p] + nm->alpha * (xbar[p] - worst[p]);
+    }
+  }
+}
+
+/* Chooses the next step from the value at the reflection point and computes the trial point. */
+static void nm_batch_trial(nm_batch* nm) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t p = 0; p < k; p++) {
+    const double fr = nm->fr[p];
+    int step = NM_STEP_INSIDE;
+    if (fr < nm->fsim[p]) {
+      step = NM_STEP_EXPAND;
+    } else if (fr < nm->fsim[(n - 1) * k + p]) {
+      step = NM_STEP_REFLECT;
+    } else if (fr < nm->fsim[n * k + p]) {
+      step = NM_STEP_OUTSIDE;
+    }
+    nm->step[p] = step;
+    nm->mask[p] = nm->active[p] && step != NM_STEP_REFLECT;
+  }
+  for (int64_t i = 0; i < n; i++) {
+    const double* xbar = nm->xbar + i * k;
+    const double* xr = nm->xr + i * k;
+    double* xt = nm->xt + i * k;
+    for (int64_t p = 0; p < k; p++) {
+      const double coef = nm->step[p] == NM_STEP_EXPAND ? nm->beta : (nm->step[p] == NM_STEP_INSIDE ? -nm->gamma : nm->gamma);
+      xt[p] = xbar[p] + coef * (xr[p] - xbar[p]);
+    }
+  }
+}
+
+/* Replaces the worst vertex with the accepted point, and marks the problems whose simplex is to be shrunk. */
+static void nm_batch_accept(nm_batch* nm) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t p = 0; p < k; p++) {
+    const double fr = nm->fr[p];
+    const double ft = nm->fval[p];
+    const int step = nm->step[p];
+    const double* src = NULL;
+    double f = 0.0;
+    nm->shrink[p] = false;
+    if (!nm->active[p]) continue;
+    if (step == NM_STEP_EXPAND) {
+      src = ft < fr ? nm->xt : nm->xr;
+      f = ft < fr ? ft : fr;
+    } else if (step == NM_STEP_REFLECT) {
+      src = nm->xr;
+      f = fr;
+    } else if (step == NM_STEP_OUTSIDE ? ft <= fr : ft < nm->fsim[n * k + p]) {
+      src = nm->xt;
+      f = ft;
+    } else {
+      nm->shrink[p] = true;
+      continue;
+    }
+    for (int64_t i = 0; i < n; i++) {
+      nm->sim[(n * n + i) * k + p] = src[i * k + p];
+    }
+    nm->fsim[n * k + p] = f;
+  }
+}
+
+/* Moves the v-th vertex of the shrinking simplexes towards the best vertex and sets it to the points to be evaluated. */
+static void nm_batch_shrink(nm_batch* nm, int64_t v) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t i = 0; i < n; i++) {
+    const double* best = nm->sim + i * k;
+    double* s = nm->sim + (v * n + i) * k;
+    for (int64_t p = 0; p < k; p++) {
+      const double moved = best[p] + nm->delta * (s[p] - best[p]);
+      s[p] = nm->shrink[p] ? moved : s[p];
+    }
+  }
+  memcpy(nm->mask, nm->shrink, k * sizeof(bool));
+  nm_batch_set_points(nm, nm->sim + v * n * k);
+}
+
+static void nm_batch_count(nm_batch* nm) {
+  for (int64_t p = 0; p < nm->k; p++) {
+    nm->n_fev[p] += nm->mask[p];
+  }
+}
+
+/**
+ * Runs the method until the objective has to be evaluated or all the problems have finished.
+ * When NM_BATCH_EVAL is returned, the driver sets the values at pts to fval and calls this function again.
+ * Only the values of the problems with mask are used.
+ */
+int nm_batch_run(nm_batch* nm) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+
+  switch (nm->stage) {
+  case NM_STAGE_VERTEX:
+    if (nm->vertex >= 0) {
+      memcpy(nm->fsim + nm->vertex * k, nm->fval, k * sizeof(double));
+    } else {
+      /* Build the initial simplexes from the initial points in the first vertex. */
+      for (int64_t v = 1; v <= n; v++) {
+        memcpy(nm->sim + v * n * k, nm->sim, n * k * sizeof(double));
+        double* s = nm->sim + (v * n + v - 1) * k;
+        for (int64_t p = 0; p < k; p++) {
+          s[p] = s[p] == 0.0 ? NM_ZERO_TAU : (1.0 + NM_NONZERO_TAU) * s[p];
+        }
+      }
+      for (int64_t p = 0; p < k; p++) {
+        nm->mask[p] = true;
+      }
+    }
+    if (++nm->vertex <= n) {
+      memcpy(nm->pts, nm->sim + nm->vertex * n * k, n * k * sizeof(double));
+      nm_batch_count(nm);
+      return NM_BATCH_EVAL;
+    }
+    nm->stage = NM_STAGE_ITERATE;
+    break;
+  case NM_STAGE_REFLECT:
+    memcpy(nm->fr, nm->fval, k * sizeof(double));
+    nm_batch_trial(nm);
+    if (nm_batch_any(nm->mask, k)) {
+      nm->stage = NM_STAGE_TRIAL;
+      nm_batch_set_points(nm, nm->xt);
+      nm_batch_count(nm);
+      return NM_BATCH_EVAL;
+    }
+    /* fall through */
+  case NM_STAGE_TRIAL:
+    nm_batch_accept(nm);
+    nm->vertex = 0;
+    nm->stage = NM_STAGE_SHRINK;
+    /* fall through */
+  case NM_STAGE_SHRINK:
+    if (nm->vertex > 0) {
+      for (int64_t p = 0; p < k; p++) {
+        nm->fsim[nm->vertex * k + p] = nm->shrink[p] ? nm->fval[p] : nm->fsim[nm->vertex * k + p];
+      }
+    }
+    if (nm_batch_any(nm->shrink, k) && ++nm->vertex <= n) {
+      nm_batch_shrink(nm, nm->vertex);
+      nm_batch_count(nm);
+      return NM_BATCH_EVAL;
+    }
+    nm_batch_sort(nm);
+    for (int64_t p = 0; p < k; p++) {
+      nm->n_iter[p] += nm->active[p];
+    }
+    nm->stage = NM_STAGE_ITERATE;
+    break;
+  default:
+    break;
+  }
+
+  /* NM_STAGE_ITERATE */
+  if (!nm_batch_check(nm)) {
+    return NM_BATCH_DONE;
+  }
+  nm_batch_reflect(nm);
+  memcpy(nm->mask, nm->active, k * sizeof(bool));
+  nm_batch_set_points(nm, nm->xr);
+  nm_batch_count(nm);
+  nm->stage = NM_STAGE_REFLECT;
+  return NM_BATCH_EVAL;
+}
+
+/* Copies the best vertex and its function value of each problem; x is laid out as [p * n + i]. */
+void nm_batch_best(const nm_batch* nm, double* x, double* f) {
+  const int64_t n = nm->n;
+  const int64_t k = nm->k;
+  for (int64_t p = 0; p < k; p++) {
+    for (int64_t i = 0; i < n; i++) {
+      x[p * n + i] = nm->sim[i * k + p];
+    }
+    f[p] = nm->fsim[p];
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef NUMO_OPTIMIZE_NM_BATCH_H_
+#define NUMO_OPTIMIZE_NM_BATCH_H_ 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Return values of nm_batch_run. */
+#define NM_BATCH_EVAL 1
+#define NM_BATCH_DONE 0
+
+/**
+ * State of the Nelder-Mead simplex method running k problems of n variables in lock-step.
+ * Arrays are laid out as structure of arrays, so the value of the p-th problem is stored at
+ * index [(v * n + i) * k + p] of sim for the i-th element of the v-th vertex, and the loops over
+ * the problems are innermost.
+ */
+typedef struct {
+  int64_t n;
+  int64_t k;
+  int64_t max_iter;
+  double xtol;
+  double ftol;
+  double alpha;
+  double beta;
+  double gamma;
+  double delta;
+  /* (n + 1) * n * k: vertices of the simplexes; the initial points are given in the first vertex. */
+  double* sim;
+  /* (n + 1) * k: function values at the vertices. */
+  double* fsim;
+  /* n * k: centroid, reflection point and trial point. */
+  double* xbar;
+  double* xr;
+  double* xt;
+  /* n * k: points to be evaluated by the driver when nm_batch_run returns NM_BATCH_EVAL. */
+  double* pts;
+  /* k: function values at pts set by the driver. */
+  double* fval;
+  double* fr;
+  /* k: whether the problem is still running, and whether the value at pts is used. */
+  bool* active;
+  bool* mask;
+  bool* shrink;
+  int* step;
+  int64_t* n_iter;
+  int64_t* n_fev;
+  int stage;
+  int64_t vertex;
+} nm_batch;
+
+extern int64_t nm_batch_bytes(int64_t n, int64_t k);
+extern void nm_batch_init(nm_batch* nm, int64_t n, int64_t k, void* buf);
+extern int nm_batch_run(nm_batch* nm);
+extern void nm_batch_best(const nm_batch* nm, double* x, double* f);
+
+#endif /* NUMO_OPTIMIZE_NM_BATCH_H_ */
@@ -0,0 +1,238 @@
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "pool.h"
+
+#ifdef HAVE_PTHREAD_H
+
+/* Range [head, tail) of the task indices owned by a worker. */
+typedef struct {
+  pthread_mutex_t lock;
+  int64_t head;
+  int64_t tail;
+} worker_deque;
+
+typedef struct {
+  worker_pool* pool;
+  int index;
+} worker_arg;
+
+struct worker_pool {
+  int n_threads;
+  pthread_t* threads;
+  worker_arg* args;
+  worker_deque* deques;
+  pthread_mutex_t run_lock;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  uint64_t generation;
+  int n_running;
+  bool shutdown;
+  int cancelled;
+  worker_pool_fn fn;
+  void* fn_arg;
+};
+
+/* Takes the next task of the worker, or steals the latter half of the tasks of another worker. */
+static bool worker_pool_take(worker_pool* pool, int w, int64_t* task) {
+  worker_deque* own = &pool->deques[w];
+
+  pthread_mutex_lock(&own->lock);
+  if (own->head < own->tail) {
+    *task = own->head++;
+    pthread_mutex_unlock(&own->lock);
+    return true;
+  }
+  pthread_mutex_unlock(&own->lock);
+
+  for (int i = 1; i < pool->n_threads; i++) {
+    worker_deque* victim = &pool->deques[(w + i) % pool->n_threads];
+    pthread_mutex_lock(&victim->lock);
+    const int64_t n_left = victim->tail - victim->head;
+    if (n_left > 0) {
+      const int64_t n_stolen = (n_left + 1) / 2;
+      const int64_t begin = victim->tail - n_stolen;
+      victim->tail = begin;
+      pthread_mutex_unlock(&victim->lock);
+      pthread_mutex_lock(&own->lock);
+      own->head = begin + 1;
+      own->tail = begin + n_stolen;
+      pthread_mutex_unlock(&own->lock);
+      *task = begin;
+      return true;
+    }
+    pthread_mutex_unlock(&victim->lock);
+  }
+  return false;
+}
+
+static void worker_pool_work(worker_pool* pool, int w) {
+  int64_t task;
+  while (!worker_pool_cancelled(pool) && worker_pool_take(pool, w, &task)) {
+    pool->fn(pool->fn_arg, task, w);
+  }
+}
+
+static void* worker_pool_main(void* data) {
+  worker_arg* arg = (worker_arg*)data;
+  worker_pool* pool = arg->pool;
+  uint64_t seen = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->shutdown && pool->generation == seen) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->shutdown) break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+    worker_pool_work(pool, arg->index);
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->n_running == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/* Creates the pool of n_threads threads. Returns NULL if the memory or the threads cannot be allocated. */
+worker_pool* worker_pool_create(int n_threads) {
+  if (n_threads < 1) n_threads = 1;
+  worker_pool* pool = (worker_pool*)calloc(1, sizeof(worker_pool));
+  if (pool == NULL) return NULL;
+  pool->n_threads = n_threads;
+  pool->threads = (pthread_t*)calloc(n_threads, sizeof(pthread_t));
+  pool->args = (worker_arg*)calloc(n_threads, sizeof(worker_arg));
+  pool->deques = (worker_deque*)calloc(n_threads, sizeof(worker_deque));
+  if (pool->threads == NULL || pool->args == NULL || pool->deques == NULL) {
+    free(pool->threads);
+    free(pool->args);
+    free(pool->deques);
+    free(pool);
+    return NULL;
+  }
+  for (int w = 0; w < n_threads; w++) {
+    pthread_mutex_init(&pool->deques[w].lock, NULL);
+    pool->args[w].pool = pool;
+    pool->args[w].index = w;
+  }
+  pthread_mutex_init(&pool->run_lock, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (int w = 1; w < n_threads; w++) {
+    if (pthread_create(&pool->threads[w], NULL, worker_pool_main, &pool->args[w]) != 0) {
+      pool->n_threads = w;
+      worker_pool_destroy(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void worker_pool_destroy(worker_pool* pool) {
+  if (pool == NULL) return;
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for (int w = 1; w < pool->n_threads; w++) {
+    pthread_join(pool->threads[w], NULL);
+  }
+  for (int w = 0; w < pool->n_threads; w++) {
+    pthread_mutex_destroy(&pool->deques[w].lock);
+  }
+  pthread_mutex_destroy(&pool->run_lock);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  free(pool->threads);
+  free(pool->args);
+  free(pool->deques);
+  free(pool);
+}
+
+/* Runs fn for the tasks 0, ..., n_tasks - 1 on the pool and waits for all of them. Concurrent runs are serialized. */
+void worker_pool_run(worker_pool* pool, int64_t n_tasks, worker_pool_fn fn, void* arg) {
+  const int n_threads = pool->n_threads;
+
+  pthread_mutex_lock(&pool->run_lock);
+  for (int w = 0; w < n_threads; w++) {
+    pthread_mutex_lock(&pool->deques[w].lock);
+    pool->deques[w].head = n_tasks * w / n_threads;
+    pool->deques[w].tail = n_tasks * (w + 1) / n_threads;
+    pthread_mutex_unlock(&pool->deques[w].lock);
+  }
+  pool->fn = fn;
+  pool->fn_arg = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->n_running = n_threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  worker_pool_work(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->n_running > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  pthread_mutex_unlock(&pool->run_lock);
+}
+
+#else /* HAVE_PTHREAD_H */
+
+/* Without pthread, the tasks run one after another on the calling thread. */
+struct worker_pool {
+  int n_threads;
+  int cancelled;
+};
+
+worker_pool* worker_pool_create(int n_threads) {
+  (void)n_threads;
+  worker_pool* pool = (worker_pool*)calloc(1, sizeof(worker_pool));
+  if (pool == NULL) return NULL;
+  pool->n_threads = 1;
+  return pool;
+}
+
+void worker_pool_destroy(worker_pool* pool) {
+  free(pool);
+}
+
+void worker_pool_run(worker_pool* pool, int64_t n_tasks, worker_pool_fn fn, void* arg) {
+  for (int64_t task = 0; task < n_tasks && !worker_pool_cancelled(pool); task++) {
+    fn(arg, task, 0);
+  }
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+int worker_pool_size(const worker_pool* pool) {
+  return pool->n_threads;
+}
+
+/* Makes the workers stop taking new tasks. It can be called from any thread, e.g. the unblocking function of Ruby. */
+void worker_pool_cancel(worker_pool* pool) {
+  __atomic_store_n(&pool->cancelled, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Clears the cancel before a run. The caller does it before it releases the GVL, since the unblocking function
+ * can fire before worker_pool_run starts, and the cancel it sets must not be lost.
+ */
+void worker_pool_reset_cancel(worker_pool* pool) {
+  __atomic_store_n(&pool->cancelled, 0, __ATOMIC_RELEASE);
+}
+
+bool worker_pool_cancelled(const worker_pool* pool) {
+  return __atomic_load_n(&pool->cancelled, __ATOMIC_ACQUIRE) != 0;
+}
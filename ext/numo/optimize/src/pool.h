@@ -0,0 +1,27 @@
+#ifndef NUMO_OPTIMIZE_POOL_H_
+#define NUMO_OPTIMIZE_POOL_H_ 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Function running the task-th task on the worker-th thread of the pool. */
+typedef void (*worker_pool_fn)(void* arg, int64_t task, int worker);
+
+/**
+ * Persistent pool of native threads running independent tasks with work stealing.
+ * The tasks are split evenly over the workers at the start of a run, and a worker that has
+ * run out of its own tasks steals the latter half of the remaining tasks of another worker.
+ * The thread calling worker_pool_run works as the worker 0, so the pool of n threads
+ * keeps n - 1 threads waiting between the runs.
+ */
+typedef struct worker_pool worker_pool;
+
+extern worker_pool* worker_pool_create(int n_threads);
+extern void worker_pool_destroy(worker_pool* pool);
+extern int worker_pool_size(const worker_pool* pool);
+extern void worker_pool_run(worker_pool* pool, int64_t n_tasks, worker_pool_fn fn, void* arg);
+extern void worker_pool_cancel(worker_pool* pool);
+extern void worker_pool_reset_cancel(worker_pool* pool);
+extern bool worker_pool_cancelled(const worker_pool* pool);
+
+#endif /* NUMO_OPTIMIZE_POOL_H_ */
@@ -0,0 +1,48 @@
+#ifndef NUMO_OPTIMIZE_PROBES_H_
+#define NUMO_OPTIMIZE_PROBES_H_ 1
+
+/**
+ * Static tracepoints (USDT) of the solvers for perf, bpftrace, and SystemTap.
+ * They are compiled in only when the extension is built with `--enable-sdt`, and expand to nothing otherwise.
+ * The probes of the provider numo_optimize are:
+ *
+ *   solve__start(const char* method, int64_t n)
+ *   solve__done(const char* method, int64_t n_iter, int64_t n_fev)
+ *   fg__eval(int64_t n, int64_t duration_ns)
+ *   new__x(int64_t n_iter, uint64_t f_bits, uint64_t pg_norm_bits)
+ *   lnsrch__restart(int64_t iter)
+ *   memory__refresh(int64_t iter, int64_t site)
+ *
+ * The floating-point values are passed as the bits of double, since the tracers read the arguments from the integer
+ * registers. pg_norm of new__x is the infinity norm of the projected gradient for L-BFGS-B and the 2-norm of
+ * the gradient for SCG. fg__eval is fired by L-BFGS-B and SCG for the evaluations not served from the cache, and
+ * lnsrch__restart and memory__refresh are fired by L-BFGS-B. The site of memory__refresh is 1 for the Cauchy point,
+ * 2 for formk, 3 for the subspace minimization, 4 for the line search, and 5 for formt. The arguments are not
+ * evaluated when the probes are compiled out, and NUMO_OPTIMIZE_PROBE_ENABLED is 0 then, so that the callers can
+ * skip the work done only for the probes, such as reading the clock.
+ */
+#ifdef NUMO_OPTIMIZE_SDT
+#include <stdint.h>
+#include <string.h>
+#include <sys/sdt.h>
+
+static inline uint64_t numo_optimize_probe_bits(double val) {
+  uint64_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  return bits;
+}
+
+#define NUMO_OPTIMIZE_PROBE1(name, a1) DTRACE_PROBE1(numo_optimize, name, a1)
+#define NUMO_OPTIMIZE_PROBE2(name, a1, a2) DTRACE_PROBE2(numo_optimize, name, a1, a2)
+#define NUMO_OPTIMIZE_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(numo_optimize, name, a1, a2, a3)
+#define NUMO_OPTIMIZE_PROBE_BITS(val) numo_optimize_probe_bits(val)
+#define NUMO_OPTIMIZE_PROBE_ENABLED 1
+#else
+#define NUMO_OPTIMIZE_PROBE1(name, a1) ((void)0)
+#define NUMO_OPTIMIZE_PROBE2(name, a1, a2) ((void)0)
+#define NUMO_OPTIMIZE_PROBE3(name, a1, a2, a3) ((void)0)
+#define NUMO_OPTIMIZE_PROBE_BITS(val) 0
+#define NUMO_OPTIMIZE_PROBE_ENABLED 0
+#endif
+
+#endif /* NUMO_OPTIMIZE_PROBES_H_ */
@@ -0,0 +1,235 @@
+/**
+ * Scaled conjugate gradient method through reverse communication.
+ *
+ * The method is the same as Numo::Optimize::Scg:
+ * - Moller, M F., "A Scaled Conjugate Gradient Algorithm for Fast Supervised Learning," Neural Networks, Vol. 6, pp. 525--533, 1993.
+ *
+ * scg_run advances the iteration until it needs the objective, and returns which of f and g the driver
+ * is to evaluate at pts. The driver also gets the control at the start of each iteration and after each
+ * successful step, where it checks its own limits and calls back to the user.
+ */
+#include <math.h>
+#include <string.h>
+
+#include "blas.h"
+#include "lbfgsb_i64.h"
+#include "scg.h"
+
+#define SIGMA_INIT 1e-4
+#define BETA_MIN 1e-15
+#define BETA_MAX 1e+15
+
+enum {
+  SCG_STAGE_START,
+  SCG_STAGE_INIT,
+  SCG_STAGE_TOP,
+  SCG_STAGE_STEP,
+  SCG_STAGE_CURVATURE,
+  SCG_STAGE_TRIAL,
+  SCG_STAGE_ACCEPT,
+  SCG_STAGE_GRADIENT,
+  SCG_STAGE_NEW_X,
+  SCG_STAGE_UPDATE,
+  SCG_STAGE_DONE
+};
+
+static double scg_ddot(int64_t n, double* x, double* y) {
+  if (n > INT32_MAX) {
+    int64_t inc = 1;
+    return ddot_i64_(&n, x, &inc, y, &inc);
+  }
+  F77_int n32 = (F77_int)n;
+  F77_int inc = 1;
+  return ddot_(&n32, x, &inc, y, &inc);
+}
+
+static void scg_daxpy(int64_t n, double a, double* x, double* y) {
+  if (n > INT32_MAX) {
+    int64_t inc = 1;
+    daxpy_i64_(&n, &a, x, &inc, y, &inc);
+    return;
+  }
+  F77_int n32 = (F77_int)n;
+  F77_int inc = 1;
+  daxpy_(&n32, &a, x, &inc, y, &inc);
+}
+
+/* Returns the number of bytes of the buffer given to scg_init. */
+int64_t scg_bytes(int64_t n) {
+  return 6 * n * (int64_t)sizeof(double);
+}
+
+/**
+ * Initializes the state for the point x of n elements with the buffer of scg_bytes(n) bytes.
+ * The tolerances and the maximum number of iterations are to be set before the first call of scg_run.
+ */
+void scg_init(scg_state* scg, int64_t n, double* x, void* buf) {
+  double* dp = (double*)buf;
+  memset(scg, 0, sizeof(*scg));
+  scg->n = n;
+  scg->max_iter = 100 * n;
+  scg->xtol = 1e-6;
+  scg->ftol = 1e-8;
+  scg->jtol = 1e-7;
+  scg->x = x;
+  scg->j = dp;
+  scg->j_prev = dp + n;
+  scg->d_vec = dp + 2 * n;
+  scg->j_diff = dp + 3 * n;
+  scg->x_trial = dp + 4 * n;
+  scg->j_plus = dp + 5 * n;
+  scg->stage = SCG_STAGE_START;
+}
+
+/* Returns the request to the driver: SCG_EVAL_FG, SCG_EVAL_F, SCG_EVAL_G, SCG_ITERATE, SCG_NEW_X, or SCG_DONE. */
+int scg_run(scg_state* scg) {
+  const int64_t n = scg->n;
+  for (;;) {
+    switch (scg->stage) {
+    case SCG_STAGE_START:
+      scg->pts = scg->x;
+      scg->gval = scg->j;
+      scg->stage = SCG_STAGE_INIT;
+      return SCG_EVAL_FG;
+    case SCG_STAGE_INIT:
+      scg->f = scg->fval;
+      scg->f_prev = scg->fval;
+      scg->j_norm = scg_ddot(n, scg->j, scg->j);
+      for (int64_t i = 0; i < n; i++) {
+        scg->d_vec[i] = -scg->j[i];
+      }
+      scg->success = true;
+      scg->n_successes = 0;
+      scg->beta = 1.0;
+      scg->stage = SCG_STAGE_TOP;
+      break;
+    case SCG_STAGE_TOP:
+      if (scg->n_iter >= scg->max_iter) {
+        scg->stage = SCG_STAGE_DONE;
+        break;
+      }
+      scg->stage = SCG_STAGE_STEP;
+      return SCG_ITERATE;
+    case SCG_STAGE_STEP:
+      if (!scg->success) {
+        scg->stage = SCG_STAGE_TRIAL;
+        break;
+      }
+      scg->mu = scg_ddot(n, scg->d_vec, scg->j);
+      if (scg->mu >= 0.0) {
+        for (int64_t i = 0; i < n; i++) {
+          scg->d_vec[i] = -scg->j[i];
+        }
+        scg->mu = scg_ddot(n, scg->d_vec, scg->j);
+      }
+      scg->kappa = scg_ddot(n, scg->d_vec, scg->d_vec);
+      if (scg->kappa < 1e-16) {
+        scg->stage = SCG_STAGE_DONE;
+        break;
+      }
+      /* The curvature along d is estimated from the gradient at a small step. */
+      scg->sigma = SIGMA_INIT / sqrt(scg->kappa);
+      memcpy(scg->x_trial, scg->x, n * sizeof(double));
+      scg_daxpy(n, scg->sigma, scg->d_vec, scg->x_trial);
+      scg->pts = scg->x_trial;
+      scg->gval = scg->j_plus;
+      scg->stage = SCG_STAGE_CURVATURE;
+      return SCG_EVAL_G;
+    case SCG_STAGE_CURVATURE:
+      for (int64_t i = 0; i < n; i++) {
+        scg->j_diff[i] = scg->j_plus[i] - scg->j[i];
+      }
+      scg->theta = scg_ddot(n, scg->d_vec, scg->j_diff);
+      scg->theta /= scg->sigma;
+      scg->stage = SCG_STAGE_TRIAL;
+      break;
+    case SCG_STAGE_TRIAL:
+      scg->delta = scg->theta + scg->beta * scg->kappa;
+      if (scg->delta <= 0.0) {
+        scg->delta = scg->beta * scg->kappa;
+        scg->beta -= scg->theta / scg->kappa;
+      }
+      scg->alpha = -scg->mu / scg->delta;
+      memcpy(scg->x_trial, scg->x, n * sizeof(double));
+      scg_daxpy(n, scg->alpha, scg->d_vec, scg->x_trial);
+      scg->pts = scg->x_trial;
+      scg->gval = NULL;
+      scg->stage = SCG_STAGE_ACCEPT;
+      return SCG_EVAL_F;
+    case SCG_STAGE_ACCEPT: {
+      const double f_next = scg->fval;
+      scg->delta = 2 * (f_next - scg->f_prev) / (scg->alpha * scg->mu);
+      scg->success = scg->delta >= 0.0;
+      if (scg->success) {
+        scg->n_successes++;
+        memcpy(scg->x, scg->x_trial, n * sizeof(double));
+        scg->f = f_next;
+      } else {
+        scg->f = scg->f_prev;
+      }
+      scg->n_iter++;
+      if (!scg->success) {
+        scg->stage = SCG_STAGE_UPDATE;
+        break;
+      }
+      if (fabs(f_next - scg->f_prev) < scg->ftol) {
+        scg->stage = SCG_STAGE_DONE;
+        break;
+      }
+      double err = 0.0;
+      for (int64_t i = 0; i < n; i++) {
+        err = fmax(err, fabs(scg->alpha * scg->d_vec[i]));
+      }
+      if (err < scg->xtol) {
+        scg->stage = SCG_STAGE_DONE;
+        break;
+      }
+      scg->f_prev = f_next;
+      memcpy(scg->j_prev, scg->j, n * sizeof(double));
+      scg->pts = scg->x;
+      scg->gval = scg->j;
+      scg->stage = SCG_STAGE_GRADIENT;
+      return SCG_EVAL_G;
+    }
+    case SCG_STAGE_GRADIENT:
+      scg->j_norm = scg_ddot(n, scg->j, scg->j);
+      scg->stage = SCG_STAGE_NEW_X;
+      return SCG_NEW_X;
+    case SCG_STAGE_NEW_X:
+      if (scg->j_norm <= scg->jtol) {
+        scg->stage = SCG_STAGE_DONE;
+        break;
+      }
+      scg->stage = SCG_STAGE_UPDATE;
+      break;
+    case SCG_STAGE_UPDATE:
+      if (scg->delta < 0.25) {
+        scg->beta = fmin(scg->beta * 4, BETA_MAX);
+      } else if (scg->delta > 0.75) {
+        scg->beta = fmax(scg->beta / 4, BETA_MIN);
+      }
+      if (scg->n_successes == n) {
+        for (int64_t i = 0; i < n; i++) {
+          scg->d_vec[i] = -scg->j[i];
+        }
+        scg->beta = 1.0;
+        scg->n_successes = 0;
+      } else if (scg->success) {
+        for (int64_t i = 0; i < n; i++) {
+          scg->j_diff[i] = scg->j_prev[i] - scg->j[i];
+        }
+        double gamma = scg_ddot(n, scg->j_diff, scg->j);
+        gamma /= scg->mu;
+        for (int64_t i = 0; i < n; i++) {
+          scg->d_vec[i] = -scg->j[i] + gamma * scg->d_vec[i];
+        }
+      }
+      scg->stage = SCG_STAGE_TOP;
+      break;
+    default:
+      scg->pts = NULL;
+      scg->gval = NULL;
+      return SCG_DONE;
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef NUMO_OPTIMIZE_SCG_H_
+#define NUMO_OPTIMIZE_SCG_H_ 1
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Return values of scg_run. */
+#define SCG_DONE 0
+#define SCG_EVAL_FG 1 /* f and g at pts are to be set in fval and gval */
+#define SCG_EVAL_F 2  /* f at pts is to be set in fval */
+#define SCG_EVAL_G 3  /* g at pts is to be set in gval */
+#define SCG_ITERATE 4 /* an iteration starts, where the driver can stop the solve */
+#define SCG_NEW_X 5   /* x has moved and j is the gradient at x */
+
+/**
+ * State of the scaled conjugate gradient method running a problem of n variables.
+ * The driver evaluates the objective through reverse communication, so the same iteration serves
+ * the Ruby objectives of Numo::Optimize::Scg.fmin and the native objectives solved without the GVL.
+ */
+typedef struct {
+  int64_t n;
+  int64_t max_iter;
+  double xtol;
+  double ftol;
+  double jtol;
+  /* n: the point given to scg_init, which is updated in place on the successful steps. */
+  double* x;
+  /* n: gradient at x, and the previous one. */
+  double* j;
+  double* j_prev;
+  /* n: search direction, difference of the gradients, trial point, and gradient at the point of the curvature estimate. */
+  double* d_vec;
+  double* j_diff;
+  double* x_trial;
+  double* j_plus;
+  /* Point to be evaluated by the driver, and the array where the gradient at it is to be written. */
+  double* pts;
+  double* gval;
+  double fval;
+  /* Function value at x. */
+  double f;
+  double f_prev;
+  double j_norm;
+  double mu;
+  double kappa;
+  double theta;
+  double beta;
+  double sigma;
+  double alpha;
+  double delta;
+  bool success;
+  int64_t n_successes;
+  int64_t n_iter;
+  int stage;
+} scg_state;
+
+extern int64_t scg_bytes(int64_t n);
+extern void scg_init(scg_state* scg, int64_t n, double* x, void* buf);
+extern int scg_run(scg_state* scg);
+
+#endif /* NUMO_OPTIMIZE_SCG_H_ */
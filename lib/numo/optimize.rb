@@ -1,5 +1,6 @@
 # frozen_string_literal: true
 
+require 'etc'
 require 'numo/narray/alt'
 
 require_relative 'optimize/version'
@@ -7,9 +8,11 @@ require_relative 'optimize/version'
 # directory from Ruby scripts, so use require to load them.
 require 'numo/optimize/optimize'
 
+require_relative 'optimize/bounds'
 require_relative 'optimize/lbfgsb'
 require_relative 'optimize/scg'
 require_relative 'optimize/nelder_mead'
+require_relative 'optimize/forked_objective'
 
 # Ruby/Numo (NUmerical MOdules)
 module Numo
@@ -19,14 +22,22 @@ module Numo
 
     # Minimize the given function.
     #
-    # @param fnc [Method/Proc] Method for calculating the function to be minimized.
-    # @param x_init [Numo::DFloat] (shape: [n_elements]) Initial point.
-    # @param jcb [Method/Proc/Boolean] Method for calculating the gradient vector.
+    # @param fnc [Method/Proc/Numo::Optimize::NativeObjective] Method for calculating the function to be minimized.
+    #   With 'L-BFGS-B', NativeObjective having fg is called without going through Ruby, and jcb is ignored.
+    # @param x_init [Numo::DFloat] (shape: [n_elements] or any other shape) Initial point.
+    #   A multi-dimensional array is given to 'fnc' and 'jcb' as it is, and the results have the same shape.
+    # @param jcb [Method/Proc/Boolean/Symbol] Method for calculating the gradient vector.
     #   If true is given, fnc is assumed to return the function value and gardient vector as [f, g] array.
+    #   If :forward_diff or :central_diff is given, the gradient is computed natively by the finite differences of fnc
+    #   with the steps sqrt(DBL_EPSILON) * max(|x_i|, 1) or cbrt(DBL_EPSILON) * max(|x_i|, 1), which costs n or 2n
+    #   evaluations of fnc besides that at x, all counted in n_fev. With 'L-BFGS-B', the differences become one-sided
+    #   at the bounds so that fnc is not evaluated outside the box, and NativeObjective having only batch_f is accepted.
+    #   This argument is used 'L-BFGS-B' and 'SCG' methods.
     # @param method [String] Type of algorithm. 'L-BFGS-B', 'SCG', or 'Nelder-Mead' is available.
     # @param args [Object] Arguments pass to the 'fnc' and 'jcb'.
-    # @param bounds [Numo::DFloat/Nil] (shape: [n_elements, 2])
+    # @param bounds [Numo::DFloat/Numo::Optimize::Bounds/Nil] (shape: [x_init.size, 2])
     #   \[lower, upper\] bounds for each element x. If nil is given, x is unbounded.
+    #   Giving a prebuilt Bounds object skips the classification of the bounds when solving repeatedly with the same box.
     #   This argument is only used 'L-BFGS-B' method.
     # @param factr [Float] The iteration will be stop when
     #
@@ -46,53 +57,240 @@ module Numo
     # @param jtol [Float] Tolerance for termination by the norm of the gradient vector. This argument is only used 'SCG' method.
     # @param maxiter [Integer] The maximum number of iterations.
     # @param verbose [Integer/Nil] If negative value or nil is given, no display output is generated. This argument is only used 'L-BFGS-B' method.
+    # @param workspace [Numo::Optimize::Lbfgsb::Workspace/Nil] Work arrays kept between solves of the same size.
+    #   If it is given, maxcor is taken from the workspace. This argument is only used 'L-BFGS-B' method.
+    # @param warm_start [Numo::Optimize::Lbfgsb::State/Nil] The state of a previous solve of the same-sized problem.
+    #   If it is given, the solve starts with its curvature memory. This argument is only used 'L-BFGS-B' method.
+    # @param return_state [Boolean] Whether to copy the curvature memory at the end of the solve into the state of the result,
+    #   which is given to warm_start of the next solve. This argument is only used 'L-BFGS-B' method.
+    # @param checkpoint [Hash/Nil] Settings for writing the solver state to a file; { path:, every: }.
+    #   The state is written atomically to the path every given number of iterations (default 1).
+    #   This argument is only used 'L-BFGS-B' method.
+    # @param resume_from [String/Nil] Path of the checkpoint file to continue the solve from.
+    #   The same fnc, jcb, args, and bounds as the interrupted solve should be given. This argument is only used 'L-BFGS-B' method.
+    # @param memory_limit [Integer/Nil] Upper limit of the native memory in bytes used by the solve.
+    #   The largest number of corrections not greater than maxcor that fits in the limit is used,
+    #   and ArgumentError is raised before allocating if nothing fits. This argument is only used 'L-BFGS-B' method.
+    # @param timeout [Float/Nil] Seconds on the monotonic clock after which the solve stops.
+    #   The best point evaluated so far is returned with the task 'STOP: TIMEOUT'.
+    # @param max_fev [Integer/Nil] Number of calls of the objective function after which the solve stops.
+    #   The best point evaluated so far is returned with the task 'STOP: MAX_FEV'.
+    #   'L-BFGS-B' and 'SCG' never exceed the limit after the first evaluation, and stop before an evaluation whose
+    #   calls, including those of the finite differences of jcb, would exceed it. 'Nelder-Mead' checks it at every iteration.
+    # @param callback [Method/Proc/Nil] Method called with (x, f, pg_norm, n_iter) after each iteration;
+    #   on each new iterate of 'L-BFGS-B', each successful step of 'SCG', and each iteration of 'Nelder-Mead'.
+    #   x is the array updated in place by the solver, so it should be copied if it is kept.
+    #   pg_norm is the infinity norm of the projected gradient, and nil for 'Nelder-Mead'.
+    #   If the callback returns :stop, the solve stops at the current point with the task 'STOP: CALLBACK'.
+    # @param every [Integer] Number of iterations between the calls of the callback.
+    # @param trace [Boolean] Whether to record the convergence trace of each iteration in native arrays.
+    #   This argument is only used 'L-BFGS-B' method.
+    # @param log [IO/String/Hash/Boolean/Nil] Destination of the diagnostics of the solver; an object responding to write,
+    #   a path of the file opened once for the solve, false to discard them, or { to:, format: } where format is
+    #   :text (default) or :json. The JSON lines format writes the messages as { event: 'message', stream:, text: }
+    #   and the iterations as { event: 'iteration', n_iter:, n_fev:, f:, sbgnrm:, stp:, nact:, nseg:, nskip: }.
+    #   The amount of the messages is given by verbose, and the iteration table formerly written to iterate.dat
+    #   is included with verbose >= 1. If nil is given, the messages are printed to the standard output without the table.
+    #   This argument is only used 'L-BFGS-B' method.
+    # @param cache [Integer/Nil] Number of the evaluated points whose function values and gradients are kept,
+    #   so that fnc and jcb are not called again at the same point. The points are compared bit by bit, and
+    #   the least recently used one is replaced when the cache is full. n_fev and n_jev count only the calls
+    #   that are not served by the cache, and the number of the hits is given as cache_hits of stats.
+    # @param line_search [Symbol/Nil] Line search of 'L-BFGS-B'; :more_thuente (default), :hager_zhang with the approximate
+    #   Wolfe conditions, :armijo backtracking, or :nonmonotone backtracking of Zhang and Hager.
+    #   :armijo and :nonmonotone call only fnc at the trial steps and jcb once at the accepted step, which saves
+    #   the gradients when jcb is given separately or fnc is NativeObjective. :speculative evaluates the steps
+    #   1, 0.5, 0.25, and 2 times the initial step at once on the first trial of each search, accepts the first one
+    #   satisfying the strong Wolfe conditions, and continues with More-Thuente otherwise, which trades redundant
+    #   evaluations for fewer round trips. The candidates are evaluated by batch_fnc, on native threads if fnc is
+    #   NativeObjective, or one by one otherwise. This argument is only used 'L-BFGS-B' method.
+    # @param batch_fnc [Method/Proc/Nil] Method evaluating the candidates of line_search: :speculative at once.
+    #   It is given a matrix of shape [k, x_init.size] (k <= 4) and args, and returns the function values and
+    #   gradient vectors as [f, g] array of shapes [k] and [k, x_init.size]. This argument is only used 'L-BFGS-B'.
+    # @param diff_batch [Boolean] Whether to call fnc once per gradient of jcb: :forward_diff or :central_diff
+    #   with the matrix of shape [1 + n_points, x_init.size] whose first row is x and the others are the perturbed points.
+    #   fnc returns the function values of the rows, and is given the matrix of one row where only f is needed.
+    #   This argument is used 'L-BFGS-B' and 'SCG' methods, and ignored when fnc is NativeObjective.
+    # @param threads [Integer/Nil] Number of native threads evaluating NativeObjective at the perturbed points of
+    #   jcb: :forward_diff or :central_diff. It is capped at the number of the perturbed points, and the threads
+    #   are created for each solve. If nil is given, the points are evaluated on the calling thread.
+    #   This argument is only used 'L-BFGS-B' method.
     # @return [Hash] Optimization results; { x:, n_fev:, n_jev:, n_iter:, fnc:, jcb:, task:, success: }
     #   - x [Numo::DFloat] Updated vector by optimization.
     #   - n_fev [Interger] Number of calls of the objective function.
-    #   - n_jev [Integer] Number of calls of the jacobian.
+    #   - n_jev [Integer] Number of calls of the jacobian, or of the evaluations of the gradient by fnc with jcb = true.
     #   - n_iter [Integer] Number of iterations.
     #   - fnc [Float] Value of the objective function.
     #   - jcb [Numo::Narray] Values of the jacobian
-    #   - task [String] Description of the cause of the termination.
+    #   - task [String] Description of the cause of the termination
+    #     ('Nelder-Mead' gives it only when stopped by timeout, max_fev, or callback).
     #   - success [Boolean] Whether or not the optimization exited successfully.
+    #   - state [Numo::Optimize::Lbfgsb::State/Nil] Curvature memory to warm-start the next solve
+    #     (only 'L-BFGS-B' method, and nil unless return_state: true is given).
+    #   - workspace_bytes [Integer] Size of the work arrays in bytes (only 'L-BFGS-B' method).
+    #   - peak_native_bytes_estimate [Integer] Peak size in bytes of the native memory of the solve (only 'L-BFGS-B' method).
+    #     It is estimated from the sizes of the work arrays, the state, and the trace instead of measured,
+    #     and does not include the buffers of the line search, the cache, and the finite differences.
+    #   - trace [Hash] Columns of the values at each iteration; { f:, sbgnrm:, stp:, n_fev:, nact:, nseg:, nskip: }
+    #     (only 'L-BFGS-B' method with trace: true). f, sbgnrm (infinity norm of the projected gradient), and stp
+    #     (step length) are Numo::DFloat, and n_fev (cumulative evaluations), nact (active bounds at the Cauchy point),
+    #     nseg (segments explored by the Cauchy search), and nskip (cumulative skipped BFGS updates) are Numo::Int32.
+    #   - stats [Hash] Allocations of the solve; { allocations:, gc_runs:, native_bytes: }. allocations is the number of
+    #     Ruby objects allocated during the solve, gc_runs the number of GC runs during the solve, and native_bytes
+    #     the size in bytes of the native memory allocated by the solve outside Ruby objects (0 for 'Nelder-Mead').
+    #     'L-BFGS-B' also gives where the solve spent its time in seconds on the monotonic clock, and the internal
+    #     counters of the solver; { time_total:, time_callback:, time_copy:, time_solver:, time_cauchy:, time_subspace:,
+    #     time_line_search:, nintol:, nskip:, nact:, nseg: }. time_callback is spent in fnc, jcb, and callback, time_copy
+    #     in the conversion and copy of the arrays, and time_solver in the native solver, which includes time_cauchy and
+    #     time_subspace. time_line_search spans the line searches including their evaluations of fnc and jcb.
+    #     nintol is the total number of segments explored by the Cauchy searches.
     def minimize(fnc:, x_init:, jcb:, method: 'L-BFGS-B', args: nil, bounds: nil, factr: 1e7, pgtol: 1e-5,
-                 maxcor: 10, xtol: 1e-6, ftol: 1e-8, jtol: 1e-7, maxiter: 15_000, verbose: nil)
+                 maxcor: 10, xtol: 1e-6, ftol: 1e-8, jtol: 1e-7, maxiter: 15_000, verbose: nil, workspace: nil,
+                 warm_start: nil, return_state: false, checkpoint: nil, resume_from: nil, memory_limit: nil,
+                 timeout: nil, max_fev: nil, callback: nil, every: 1, trace: false, log: nil, cache: nil,
+                 line_search: nil, batch_fnc: nil, diff_batch: false, threads: nil)
       case method.downcase.delete('-')
       when 'lbfgsb'
-        n_elements = x_init.size
-        l = Numo::DFloat.zeros(n_elements)
-        u = Numo::DFloat.zeros(n_elements)
-        nbd = if Numo::Optimize::Lbfgsb::SZ_F77_INTEGER == 64
-                Numo::Int64.zeros(n_elements)
-              else
-                Numo::Int32.zeros(n_elements)
-              end
-
+        l = u = nbd = nil
         unless bounds.nil?
-          n_elements.times do |n|
-            lower = bounds[n, 0]
-            upper = bounds[n, 1]
-            l[n] = lower
-            u[n] = upper
-            if lower.finite? && !upper.finite?
-              nbd[n] = 1
-            elsif lower.finite? && upper.finite?
-              nbd[n] = 2
-            elsif !lower.finite? && upper.finite?
-              nbd[n] = 3
-            end
-          end
+          bounds = Numo::Optimize::Bounds.new(bounds) unless bounds.is_a?(Numo::Optimize::Bounds)
+          l = bounds.lower
+          u = bounds.upper
+          nbd = bounds.nbd
         end
 
+        opts = { workspace:, warm_start:, return_state:, checkpoint:, resume_from:, memory_limit:, timeout:,
+                 max_fev:, callback:, every:, trace:, log:, cache:, line_search:, batch_fnc:, diff_batch:,
+                 threads: }
         Numo::Optimize::Lbfgsb.fmin(fnc, x_init.dup, jcb, args, l, u, nbd, maxcor,
-                                    factr, pgtol, maxiter, verbose)
+                                    factr, pgtol, maxiter, verbose, opts)
       when 'neldermead'
-        Numo::Optimize::NelderMead.fmin(fnc, x_init.dup, args, maxiter, xtol, ftol)
+        Numo::Optimize::NelderMead.fmin(fnc, x_init.dup, args, maxiter, xtol, ftol,
+                                        timeout:, max_fev:, callback:, every:, cache:)
       when 'scg'
-        Numo::Optimize::Scg.fmin(fnc, x_init.dup, jcb, args, xtol, ftol, jtol, maxiter)
+        Numo::Optimize::Scg.fmin(fnc, x_init.dup, jcb, args, xtol, ftol, jtol, maxiter,
+                                 { timeout:, max_fev:, callback:, every:, cache:, diff_batch: })
       else
         raise ArgumentError, "Unknown method: #{method}"
       end
     end
+
+    # Minimize K functions of the same size at once.
+    # The K solves run in lock-step, and the objective function is called once per round
+    # with the matrix whose rows are the points of the solves that need evaluation.
+    #
+    # @example
+    #   fnc = proc { |x, t| ((x - t)**2).sum(axis: 1) }
+    #   jcb = proc { |x, t| 2 * (x - t) }
+    #   res = Numo::Optimize.minimize_batch(fnc: fnc, x_init: Numo::DFloat.zeros(100, 3), jcb: jcb, args: target)
+    #
+    # @param fnc [Method/Proc/Numo::Optimize::NativeObjective] Method for calculating the functions to be minimized.
+    #   It is given a matrix of shape [k, n_elements] (k <= K) and returns the k function values.
+    #   With 'Nelder-Mead', k is always K; the values for the solves that have already converged are ignored.
+    #   If NativeObjective is given, the functions written in C are called without going through Ruby.
+    # @param x_init [Numo::DFloat] (shape: [K, n_elements]) Initial points.
+    # @param jcb [Method/Proc/Boolean/Nil] Method for calculating the gradient vectors as a matrix of shape [k, n_elements].
+    #   If true is given, fnc is assumed to return the function values and gardient vectors as [f, g] array.
+    #   It is not used by 'Nelder-Mead', and ignored when fnc is NativeObjective.
+    #   'L-BFGS-B' needs it unless fnc is NativeObjective.
+    # @param method [String] Type of algorithm. 'L-BFGS-B' or 'Nelder-Mead' is available.
+    # @param args [Object] Arguments pass to the 'fnc' and 'jcb'.
+    # @param bounds [Numo::DFloat/Numo::Optimize::Bounds/Nil] (shape: [n_elements, 2])
+    #   \[lower, upper\] bounds shared by all the solves. If nil is given, x is unbounded.
+    #   'Nelder-Mead' does not support the bounds.
+    # @param factr [Float] The iteration of each solve will be stop when
+    #
+    #   (f^k - f^\{k+1\})/max{|f^k|,|f^\{k+1\}|,1} <= factr * Lbfgsb::DBL_EPSILON
+    #
+    # @param pgtol [Float] The iteration of each solve will be stop when
+    #
+    #   max{|pg_i| i = 1, ..., n} <= pgtol
+    #
+    #   where pg_i is the ith component of the projected gradient.
+    # @param maxcor [Integer] The maximum number of variable metric corrections used to define the limited memory matrix.
+    # @param xtol [Float] Tolerance for termination for the updated vectors of 'Nelder-Mead'.
+    # @param ftol [Float] Tolerance for termination for the updated function values of 'Nelder-Mead'.
+    # @param maxiter [Integer/Nil] Maximum number of iterations of each solve.
+    #   If nil is given, 15,000 is used for 'L-BFGS-B' and 200 * n_elements for 'Nelder-Mead'.
+    # @return [Hash] Optimization results; { x:, n_fev:, n_jev:, n_iter:, n_calls:, fnc:, jcb:, task:, success: }
+    #   'Nelder-Mead' returns only x, n_fev, n_iter, n_calls, and fnc.
+    #   - x [Numo::DFloat] (shape: [K, n_elements]) Updated points by optimization.
+    #   - n_fev [Numo::Int64] (shape: [K]) Number of evaluations of each objective function.
+    #   - n_jev [Numo::Int64] (shape: [K]) Number of evaluations of each jacobian.
+    #   - n_iter [Numo::Int64] (shape: [K]) Number of iterations of each solve.
+    #   - n_calls [Integer] Number of calls of the 'fnc'.
+    #   - fnc [Numo::DFloat] (shape: [K]) Values of the objective functions.
+    #   - jcb [Numo::DFloat] (shape: [K, n_elements]) Values of the jacobians.
+    #   - task [Array<String>] Description of the cause of the termination of each solve.
+    #   - success [Array<Boolean>] Whether or not each solve exited successfully.
+    def minimize_batch(fnc:, x_init:, jcb: nil, method: 'L-BFGS-B', args: nil, bounds: nil, factr: 1e7, pgtol: 1e-5,
+                       maxcor: 10, xtol: 1e-6, ftol: 1e-6, maxiter: nil)
+      case method.downcase.delete('-')
+      when 'neldermead'
+        raise ArgumentError, "bounds are not supported by 'Nelder-Mead' of minimize_batch" unless bounds.nil?
+
+        return Numo::Optimize::NelderMead.fmin_batch(fnc, x_init.dup, args, maxiter, xtol, ftol)
+      when 'lbfgsb'
+        unless jcb || fnc.is_a?(Numo::Optimize::NativeObjective)
+          raise ArgumentError, "jcb must be given for 'L-BFGS-B' of minimize_batch unless fnc is NativeObjective"
+        end
+
+        maxiter ||= 15_000
+      else
+        raise ArgumentError, "Unknown method: #{method}"
+      end
+
+      l = u = nbd = nil
+      unless bounds.nil?
+        bounds = Numo::Optimize::Bounds.new(bounds) unless bounds.is_a?(Numo::Optimize::Bounds)
+        l = bounds.lower
+        u = bounds.upper
+        nbd = bounds.nbd
+      end
+
+      Numo::Optimize::Lbfgsb.fmin_batch(fnc, x_init.dup, jcb, args, l, u, nbd, maxcor, factr, pgtol, maxiter)
+    end
+
+    # Minimize many independent problems with native objectives in parallel.
+    # The solves are spread over a persistent pool of native threads with work stealing and run without the GVL,
+    # so the objective functions must be thread-safe.
+    #
+    # @example
+    #   # rosen_fg is double rosen_fg(int64_t n, const double* x, double* g, void* data) in a shared library.
+    #   lib = Fiddle.dlopen('./librosen.so')
+    #   rosen = Numo::Optimize::NativeObjective.new(lib['rosen_fg'], nil)
+    #   problems = Array.new(1000) { { fnc: rosen, x_init: Numo::DFloat.new(4).rand } }
+    #   results = Numo::Optimize.minimize_many(problems, threads: 8)
+    #
+    # @param problems [Array<Hash>] Problems given as the keyword arguments of `Numo::Optimize.minimize`.
+    #   fnc must be Numo::Optimize::NativeObjective, and the keys available are
+    #   fnc, x_init, method, bounds, factr, pgtol, maxcor, xtol, ftol, jtol, and maxiter.
+    #   'L-BFGS-B' and 'SCG' need the native objective to have fg.
+    # @param threads [Integer/Nil] Number of threads. If nil is given, the number of processors is used.
+    # @return [Array<Hash>] Optimization results of the problems in the given order, with the same keys as `Numo::Optimize.minimize`.
+    #   If the run is interrupted, the workers stop taking new problems and the interrupt is raised without the results.
+    def minimize_many(problems, threads: nil)
+      specs = problems.map { |problem| many_spec(**problem) }
+      Numo::Optimize.fmin_many(specs, threads || Etc.nprocessors)
+    end
+
+    # @!visibility private
+    def many_spec(fnc:, x_init:, method: 'L-BFGS-B', bounds: nil, factr: 1e7, pgtol: 1e-5, maxcor: 10, xtol: 1e-6,
+                  ftol: 1e-8, jtol: 1e-7, maxiter: 15_000)
+      name = method.downcase.delete('-')
+      raise ArgumentError, "Unknown method: #{method}" unless %w[lbfgsb scg neldermead].include?(name)
+
+      l = u = nbd = nil
+      unless bounds.nil?
+        bounds = Numo::Optimize::Bounds.new(bounds) unless bounds.is_a?(Numo::Optimize::Bounds)
+        l = bounds.lower
+        u = bounds.upper
+        nbd = bounds.nbd
+      end
+
+      { method: name, fnc:, x: x_init, l:, u:, nbd:, factr:, pgtol:, maxcor:, xtol:, ftol:, jtol:, maxiter: }
+    end
+
+    private_class_method :many_spec
   end
 end
@@ -0,0 +1,40 @@
+# frozen_string_literal: true
+
+module Numo
+  module Optimize
+    # Bounds holds the box constraints on variables in the form used by the L-BFGS-B method.
+    # Creating it once and passing it to `Numo::Optimize.minimize` skips the classification of the bounds
+    # on repeated solves with the same box.
+    #
+    # @example
+    #   bounds = Numo::Optimize::Bounds.new(Numo::DFloat[[0, 1], [-Float::INFINITY, 2]])
+    #   result = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, bounds: bounds)
+    class Bounds
+      # Return the lower bounds of variables.
+      # @return [Numo::DFloat] (shape: [n_elements])
+      attr_reader :lower
+
+      # Return the upper bounds of variables.
+      # @return [Numo::DFloat] (shape: [n_elements])
+      attr_reader :upper
+
+      # Return the types of bounds: 0 for unbounded, 1 for only lower, 2 for both, and 3 for only upper.
+      # @return [Numo::Int32] (shape: [n_elements])
+      attr_reader :nbd
+
+      # Create a new bounds object.
+      #
+      # @param bounds [Numo::DFloat] (shape: [n_elements, 2])
+      #   \[lower, upper\] bounds for each element x. Infinite or NaN values mean that the element is not bounded on that side.
+      def initialize(bounds)
+        @lower, @upper, @nbd = Numo::Optimize::Lbfgsb.classify_bounds(bounds)
+      end
+
+      # Return the number of variables.
+      # @return [Integer]
+      def size
+        @nbd.size
+      end
+    end
+  end
+end
@@ -0,0 +1,161 @@
+# frozen_string_literal: true
+
+require 'socket'
+
+module Numo
+  module Optimize
+    # ForkedObjective evaluates an objective function that is a sum over data by forking local worker processes.
+    # Each worker owns a shard of the data and computes the partial function value and gradient in its own process.
+    # The point is passed to the workers and the partial results are returned through a shared memory segment,
+    # the sum is taken in native code, and a UNIX socket pair per worker only carries the one-line commands.
+    # The object is given to `Numo::Optimize.minimize` as fnc with `jcb: true`.
+    #
+    # @example
+    #   # The block is called once in each worker after forking.
+    #   # It loads the shard and returns the method to compute the partial [f, g] at w.
+    #   fg = Numo::Optimize::ForkedObjective.new(n_features, workers: 8) do |worker, n_workers|
+    #     x_shard, y_shard = load_shard(worker, n_workers)
+    #     proc do |w|
+    #       r = x_shard.dot(w) - y_shard
+    #       [0.5 * r.dot(r), x_shard.transpose.dot(r)]
+    #     end
+    #   end
+    #   begin
+    #     res = Numo::Optimize.minimize(fnc: fg, jcb: true, x_init: Numo::DFloat.zeros(n_features))
+    #   ensure
+    #     fg.close
+    #   end
+    class ForkedObjective
+      # Return the number of elements of the point.
+      # @return [Integer]
+      attr_reader :size
+
+      # Return the number of the worker processes.
+      # @return [Integer]
+      attr_reader :workers
+
+      # Fork the worker processes.
+      #
+      # @param size [Integer] The number of elements of the point.
+      # @param workers [Integer] The number of the worker processes.
+      # @yieldparam worker [Integer] The index of the worker.
+      # @yieldparam n_workers [Integer] The number of the worker processes.
+      # @yieldreturn [Method/Proc] The method for calculating the partial function value and gradient as [f, g] array.
+      def initialize(size, workers: Etc.nprocessors, &block)
+        raise ArgumentError, 'block is required' if block.nil?
+        raise ArgumentError, 'workers must be a positive integer' unless workers.is_a?(Integer) && workers.positive?
+
+        @size = size
+        @workers = workers
+        # The point at [0, size) and the partial [f, g] of each worker after it.
+        @shm = Numo::Optimize::SharedMemory.new(size + (workers * (size + 1)))
+        @sockets = []
+        @pids = []
+        begin
+          workers.times { |worker| spawn_worker(worker, &block) }
+        rescue StandardError
+          # Stop the workers forked before the failure, so that they are not left running.
+          close
+          raise
+        end
+      end
+
+      # Calculate the function value and gradient at x on the workers.
+      #
+      # @param x [Numo::DFloat] (shape: [size])
+      # @return [Array] [f, g]
+      def call(x)
+        raise IOError, 'ForkedObjective is closed' if closed?
+
+        @shm.write(0, x)
+        @sockets.each_with_index do |sock, worker|
+          sock.write("e\n")
+        rescue SystemCallError
+          raise IOError, "worker #{worker} exited"
+        end
+        errors = @sockets.each_with_index.filter_map do |sock, worker|
+          line = begin
+            sock.gets
+          rescue SystemCallError
+            nil
+          end
+          raise IOError, "worker #{worker} exited" if line.nil?
+
+          "worker #{worker}: #{line[1..].chomp}" unless line.start_with?('d')
+        end
+        raise errors.join(', ') unless errors.empty?
+
+        fg = @shm.reduce(@size, @size + 1, @workers)
+        [fg[0], fg[1..].reshape(*x.shape)]
+      end
+
+      # Stop the worker processes.
+      # @return [nil]
+      def close
+        return if closed?
+
+        @sockets.each do |sock|
+          sock.write("q\n")
+        rescue SystemCallError, IOError
+          nil
+        end
+        @sockets.each(&:close)
+        @pids.each { |pid| Process.wait(pid) }
+        @sockets = nil
+        nil
+      end
+
+      # Return whether the worker processes have been stopped.
+      # @return [Boolean]
+      def closed?
+        @sockets.nil?
+      end
+
+      private
+
+      def spawn_worker(worker, &block)
+        parent_sock, child_sock = UNIXSocket.pair
+        begin
+          pid = Process.fork do
+            parent_sock.close
+            @sockets.each(&:close)
+            worker_loop(child_sock, worker, &block)
+          end
+        rescue StandardError
+          parent_sock.close
+          raise
+        ensure
+          child_sock.close
+        end
+        @sockets << parent_sock
+        @pids << pid
+      end
+
+      def worker_loop(sock, worker, &block)
+        status = 0
+        begin
+          fg = block.call(worker, @workers)
+          offset = @size + (worker * (@size + 1))
+          while sock.gets == "e\n"
+            begin
+              f, g = fg.call(@shm.read(0, @size))
+              # A gradient of the wrong size would overwrite the results of the next worker.
+              raise ArgumentError, "gradient must have #{@size} elements, but has #{g.size}" unless g.size == @size
+
+              @shm.write(offset, Numo::DFloat[f])
+              @shm.write(offset + 1, g)
+              sock.write("d\n")
+            rescue StandardError => e
+              sock.write("x#{e.class}: #{e.message.tr("\n", ' ')}\n")
+            end
+          end
+        rescue StandardError
+          status = 1
+        ensure
+          # Skip the at_exit handlers inherited from the parent process.
+          exit!(status)
+        end
+      end
+    end
+  end
+end
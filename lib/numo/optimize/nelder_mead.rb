@@ -21,9 +21,32 @@ module Numo
       # @param maxiter [Integer]
       # @param xtol [Float]
       # @param ftol [Float]
-      def fmin(f, x, args, maxiter = nil, xtol = 1e-6, ftol = 1e-6) # rubocop:disable Metrics/AbcSize, Metrics/CyclomaticComplexity, Metrics/MethodLength, Metrics/PerceivedComplexity
+      # @param timeout [Float/Nil] Seconds on the monotonic clock after which the solve stops.
+      # @param max_fev [Integer/Nil] Number of evaluations after which the solve stops.
+      # @param callback [Method/Proc/Nil] Method called with (x, f, nil, n_iter) after each iteration.
+      # @param every [Integer] Number of iterations between the calls of the callback.
+      # @param cache [Integer/Nil] Number of the evaluated points whose function values are kept in Numo::Optimize::EvalCache.
+      def fmin(f, x, args, maxiter = nil, xtol = 1e-6, ftol = 1e-6, timeout: nil, max_fev: nil, callback: nil, every: 1, cache: nil) # rubocop:disable Metrics/AbcSize, Metrics/CyclomaticComplexity, Metrics/MethodLength, Metrics/PerceivedComplexity
+        allocated = GC.stat(:total_allocated_objects)
+        gc_count = GC.count
+        shape = x.shape
+        x = x.flatten
         n = x.size
         maxiter ||= 200 * n
+        deadline = timeout.nil? ? nil : Process.clock_gettime(Process::CLOCK_MONOTONIC) + timeout
+        raise ArgumentError, 'every must be a positive integer' unless every.is_a?(Integer) && every.positive?
+
+        cache = Numo::Optimize::EvalCache.new(n, cache) unless cache.nil?
+        n_fev = 0
+        evaluate = lambda do |pt|
+          val = cache&.[](pt)
+          return val unless val.nil?
+
+          n_fev += 1
+          val = fnc(f, unflatten(pt, shape), args)
+          cache[pt] = val unless cache.nil?
+          val
+        end
 
         alpha = 1.0
         beta = n > 1 ? 1 + 2.fdiv(n) : 2.0
@@ -40,26 +63,30 @@ module Numo
 
         fsim = Numo::DFloat.zeros(n + 1)
 
-        (n + 1).times { |k| fsim[k] = fnc(f, sim[k, true], args) }
-        n_fev = n + 1
+        (n + 1).times { |k| fsim[k] = evaluate.call(sim[k, true]) }
 
         res = {}
 
         n_iter = 0
         while n_iter < maxiter
+          task = stop_task(n_fev, max_fev, deadline)
+          unless task.nil?
+            # The simplex is sorted at the end of each iteration, but not before the first one.
+            best = fsim.min_index
+            res = { x: unflatten(sim[best, true], shape), fnc: fsim[best], n_iter: n_iter, n_fev: n_fev, task: task }
+            break
+          end
           break if ((sim[1..-1,
                          true] - sim[0, true]).abs.flatten.max <= xtol) && ((fsim[0] - fsim[1..]).abs.max <= ftol)
 
           xbar = sim[0...-1, true].sum(axis: 0) / n
           xr = xbar + (alpha * (xbar - sim[-1, true]))
-          fr = fnc(f, xr, args)
-          n_fev += 1
+          fr = evaluate.call(xr)
 
           shrink = true
           if fr < fsim[0]
             xe = xbar + (beta * (xr - xbar))
-            fe = fnc(f, xe, args)
-            n_fev += 1
+            fe = evaluate.call(xe)
             shrink = false
             if fe < fr
               sim[-1, true] = xe
@@ -74,8 +101,7 @@ module Numo
             fsim[-1] = fr
           elsif fr < fsim[-1]
             xoc = xbar + (gamma * (xr - xbar))
-            foc = fnc(f, xoc, args)
-            n_fev += 1
+            foc = evaluate.call(xoc)
             if foc <= fr
               shrink = false
               sim[-1, true] = xoc
@@ -83,8 +109,7 @@ module Numo
             end
           else
             xic = xbar - (gamma * (xr - xbar))
-            fic = fnc(f, xic, args)
-            n_fev += 1
+            fic = evaluate.call(xic)
             if fic < fsim[-1]
               shrink = false
               sim[-1, true] = xic
@@ -95,8 +120,7 @@ module Numo
           if shrink
             (1..n).to_a.each do |j|
               sim[j, true] = sim[0, true] + (delta * (sim[j, true] - sim[0, true]))
-              fsim[j] = fnc(f, sim[j, true], args)
-              n_fev += 1
+              fsim[j] = evaluate.call(sim[j, true])
             end
           end
 
@@ -104,17 +128,40 @@ module Numo
           sim = sim[ind, true].dup
           fsim = fsim[ind].dup
 
-          res[:x] = sim[0, true]
+          res[:x] = unflatten(sim[0, true], shape)
           res[:fnc] = fsim[0]
           res[:n_iter] = n_iter
           res[:n_fev] = n_fev
 
           n_iter += 1
+
+          next if callback.nil? || (n_iter % every).nonzero?
+          next unless callback.call(res[:x], res[:fnc], nil, n_iter) == :stop
+
+          res[:task] = 'STOP: CALLBACK'
+          break
         end
 
+        res[:stats] = { allocations: GC.stat(:total_allocated_objects) - allocated, gc_runs: GC.count - gc_count,
+                        native_bytes: cache.nil? ? 0 : cache.bytesize }
+        res[:stats][:cache_hits] = cache.hits unless cache.nil?
         res
       end
 
+      # @!visibility private
+      def stop_task(n_fev, max_fev, deadline)
+        if !max_fev.nil? && n_fev >= max_fev
+          'STOP: MAX_FEV'
+        elsif !deadline.nil? && Process.clock_gettime(Process::CLOCK_MONOTONIC) >= deadline
+          'STOP: TIMEOUT'
+        end
+      end
+
+      # @!visibility private
+      def unflatten(x, shape)
+        shape.size == 1 ? x : x.reshape(*shape)
+      end
+
       # @!visibility private
       def fnc(fnc, x, args)
         if args.is_a?(Hash)
@@ -1,6 +1,10 @@
 # frozen_string_literal: true
 
 require 'test_helper'
+require 'json'
+require 'stringio'
+require 'timeout'
+require 'tmpdir'
 
 module Numo
   class TestOptimize < Minitest::Test # rubocop:disable Metrics/ClassLength
@@ -171,6 +175,692 @@ module Numo
       assert_equal(n, result[:jcb].size)
     end
 
+    def test_bounds
+      inf = Float::INFINITY
+      bounds = Numo::Optimize::Bounds.new(Numo::DFloat[[-inf, inf], [0, inf], [0, 1], [-inf, 1]])
+
+      assert_equal(4, bounds.size)
+      assert_equal(Numo::Int32[0, 1, 2, 3], bounds.nbd)
+      assert_equal(Numo::DFloat[-inf, 0, 0, -inf], bounds.lower)
+      assert_equal(Numo::DFloat[inf, inf, 1, 1], bounds.upper)
+
+      fnc = proc { |x| ((x - 2)**2).sum }
+      jcb = proc { |x| 2 * (x - 2) }
+      results = Array.new(2) do
+        Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(4), jcb: jcb, bounds: bounds)
+      end
+
+      assert_in_delta(0.0, (results[0][:x] - Numo::DFloat[2, 2, 1, 1]).abs.max, 1e-6)
+      assert_equal(results[0][:x], results[1][:x])
+    end
+
+    def test_lbfgsb_fmin_nbd_types
+      n = 10
+      x = Numo::DFloat.zeros(n) + 3
+      l = Numo::DFloat.zeros(n) - 1
+      u = Numo::DFloat.zeros(n) + 2
+      fnc = proc { |x| ((x - 1)**2).sum }
+      jcb = proc { |x| 2 * (x - 1) }
+      res_i32 = Numo::Optimize::Lbfgsb.fmin(fnc, x.dup, jcb, nil, l, u, Numo::Int32.zeros(n) + 2,
+                                            5, 1e7, 1e-5, 100, nil, nil)
+      res_i64 = Numo::Optimize::Lbfgsb.fmin(fnc, x.dup, jcb, nil, l, u, Numo::Int64.zeros(n) + 2,
+                                            5, 1e7, 1e-5, 100, nil, nil)
+
+      assert(res_i32[:success])
+      assert_equal(res_i32[:n_iter], res_i64[:n_iter])
+      assert_in_delta(0.0, (res_i32[:x] - res_i64[:x]).abs.max, 1e-12)
+    end
+
+    def test_lbfgsb_workspace
+      n = 8
+      workspace = Numo::Optimize::Lbfgsb::Workspace.new(n, 5)
+
+      assert_equal(n, workspace.n)
+      assert_equal(5, workspace.maxcor)
+      assert_operator(workspace.bytesize, :>, 0)
+
+      fnc = proc { |x| ((x - 1)**2).sum + (x**4).sum }
+      jcb = proc { |x| (2 * (x - 1)) + (4 * (x**3)) }
+      x = Numo::DFloat.new(n).seq
+      expected = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, maxcor: 5)
+      results = Array.new(3) { Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, workspace: workspace) }
+
+      results.each do |res|
+        assert_equal(expected[:x], res[:x])
+        assert_equal(expected[:n_iter], res[:n_iter])
+      end
+      assert_raises(ArgumentError) do
+        Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(n + 1), jcb: jcb, workspace: workspace)
+      end
+    end
+
+    def test_minimize_lbfgsb_warm_start
+      n = 20
+      scale = Numo::DFloat.new(n).seq(1, 10)
+      target = Numo::DFloat.new(n).seq
+      fnc = proc { |x, t| (scale * ((x - t)**2)).sum }
+      jcb = proc { |x, t| 2 * scale * (x - t) }
+      first = Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(n), jcb: jcb, args: target,
+                                      return_state: true)
+      state = first[:state]
+
+      assert_kind_of(Numo::Optimize::Lbfgsb::State, state)
+      assert_equal(n, state.n)
+      assert_operator(state.size, :>, 0)
+      assert_operator(state.size, :<=, 10)
+
+      new_target = target + 0.1
+      warm = Numo::Optimize.minimize(fnc: fnc, x_init: first[:x], jcb: jcb, args: new_target, warm_start: state)
+
+      assert(warm[:success])
+      assert_in_delta(0.0, (warm[:x] - new_target).abs.max, 1e-4)
+      assert_nil(warm[:state])
+      # The curvature memory of the first solve replaces the identity matrix, so the warm solve takes fewer steps.
+      cold = Numo::Optimize.minimize(fnc: fnc, x_init: first[:x], jcb: jcb, args: new_target)
+
+      assert(cold[:success])
+      assert_operator(warm[:n_iter], :<, cold[:n_iter])
+      assert_operator(warm[:n_fev], :<, cold[:n_fev])
+      small = Numo::Optimize.minimize(fnc: fnc, x_init: first[:x], jcb: jcb, args: new_target,
+                                      maxcor: 3, warm_start: state)
+
+      assert_in_delta(0.0, (small[:x] - new_target).abs.max, 1e-4)
+      assert_raises(ArgumentError) do
+        Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(n + 1), jcb: jcb, args: target, warm_start: state)
+      end
+    end
+
+    def test_minimize_lbfgsb_checkpoint
+      n = 30
+      fnc = proc { |x| (4.0 * (((x[1..] - (x[0...-1]**2))**2).sum + (0.25 * ((x[0] - 1)**2)))) }
+      jcb = proc do |x|
+        t = x[1..] - (x[0...-1]**2)
+        g = Numo::DFloat.zeros(n)
+        g[0...-1] = -16.0 * x[0...-1] * t
+        g[1..] += 8.0 * t
+        g[0] += 2.0 * (x[0] - 1)
+        g
+      end
+      x = Numo::DFloat.zeros(n) + 3
+      expected = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb)
+
+      Dir.mktmpdir do |dir|
+        path = File.join(dir, 'lbfgsb.ckpt')
+        stopped = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, maxiter: 9,
+                                          checkpoint: { path: path, every: 4 })
+
+        assert_equal(9, stopped[:n_iter])
+        assert_equal([path], Dir.glob(File.join(dir, '*')))
+
+        resumed = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, resume_from: path)
+
+        assert_equal(expected[:x], resumed[:x])
+        assert_equal(expected[:n_iter], resumed[:n_iter])
+        assert_equal(expected[:n_fev], resumed[:n_fev])
+        assert_equal(expected[:task], resumed[:task])
+
+        broken = File.join(dir, 'broken.ckpt')
+        File.binwrite(broken, 'broken')
+
+        assert_raises(IOError) { Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, resume_from: broken) }
+      end
+    end
+
+    def test_minimize_lbfgsb_memory_limit
+      n = 500
+      fnc = proc { |x| ((x - 1)**2).sum + (x**4).sum }
+      jcb = proc { |x| (2 * (x - 1)) + (4 * (x**3)) }
+      x = Numo::DFloat.zeros(n)
+      full = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb)
+
+      assert_operator(full[:workspace_bytes], :>, 0)
+      assert_operator(full[:peak_native_bytes_estimate], :>=, full[:workspace_bytes])
+
+      limit = full[:workspace_bytes] - 1
+      limited = Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, memory_limit: limit)
+
+      assert(limited[:success])
+      assert_operator(limited[:workspace_bytes], :<, full[:workspace_bytes])
+      assert_operator(limited[:peak_native_bytes_estimate], :<=, limit)
+      assert_raises(ArgumentError) { Numo::Optimize.minimize(fnc: fnc, x_init: x, jcb: jcb, memory_limit: 1024) }
+    end
+
+    def test_minimize_lbfgsb_trace
+      fnc = proc { |x| ((x - 2)**2).sum + (x**4).sum }
+      jcb = proc { |x| (2 * (x - 2)) + (4 * (x**3)) }
+      bounds = Numo::DFloat[[-1, 0.5], [-1, 1], [-1, 2], [-1, 3]]
+      res = Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(4), jcb: jcb, bounds: bounds, trace: true)
+      trace = res[:trace]
+
+      assert(res[:success])
+      %i[f sbgnrm stp].each { |key| assert_kind_of(Numo::DFloat, trace[key]) }
+      %i[n_fev nact nseg nskip].each { |key| assert_kind_of(Numo::Int32, trace[key]) }
+      trace.each_value { |col| assert_equal(res[:n_iter], col.size) }
+      assert_in_delta(res[:fnc], trace[:f][-1], 1e-15)
+      assert_operator(trace[:f].diff.max, :<=, 0)
+      assert_operator(trace[:n_fev].diff.min, :>, 0)
+      assert_operator(trace[:n_fev][-1], :<=, res[:n_fev])
+      assert_operator(trace[:nact].max, :>=, 1)
+      assert_operator(trace[:stp].min, :>, 0)
+      assert_nil(Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(4), jcb: jcb)[:trace])
+    end
+
+    def test_minimize_lbfgsb_stats
+      fnc = proc do |x|
+        sleep(0.001)
+        ((x - 2)**2).sum + (x**4).sum
+      end
+      jcb = proc { |x| (2 * (x - 2)) + (4 * (x**3)) }
+      bounds = Numo::DFloat[[-1, 0.5], [-1, 1], [-1, 2], [-1, 3]]
+      res = Numo::Optimize.minimize(fnc: fnc, x_init: Numo::DFloat.zeros(4), jcb: jcb, bounds: bounds)
+      stats = res[:stats]
+
+      %i[time_total time_callback time_copy time_solver time_cauchy time_subspace time_line_search].each do |key|
+        assert_operator(stats[key], :>=, 0)
+      end
+      assert_operator(stats[:time_callback], :>=, 0.001 * res[:n_fev])
+      assert_operator(stats[:time_total], :>=, stats[:time_callback] + stats[:time_copy] + stats[:time_solver])
+      assert_operator(stats[:time_solver], :>=, stats[:time_cauchy] + stats[:time_subspace])
+      assert_operator(stats[:nintol], :>=, res[:n_iter])
+      %i[nskip nact nseg].each { |key| assert_kind_of(Integer, stats[key]) }
+    end
+
+    def test_minimize_stats_allocations
+      fnc = proc { |x| ((x - 2)**2).sum }
+      jcb = proc { |x| 2 * (x - 2) }
+      %w[L-BFGS-B SCG Nelder-Mead].each do |method|
+        stats = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: Numo::DFloat.zeros(4), method: method)[:stats]
+
+        assert_operator(stats[:allocations], :>, 0)
+        assert_operator(stats[:gc_runs], :>=, 0)
+        assert_operator(stats[:native_bytes], :>=, 0)
+      end
+      assert_steady_state_allocation_free(method: 'L-BFGS-B')
+      assert_steady_state_allocation_free(method: 'L-BFGS-B', bounds: Numo::DFloat[[-2, 2]] * Numo::DFloat.ones(20, 1))
+    end
+
+    def test_minimize_lbfgsb_line_search
+      n_fnc = n_jcb = 0
+      fnc = proc do |x|
+        n_fnc += 1
+        ((x - 2)**2).sum + (x**4).sum
+      end
+      jcb = proc do |x|
+        n_jcb += 1
+        (2 * (x - 2)) + (4 * (x**3))
+      end
+      bounds = Numo::DFloat[[-1, 0.5], [-1, 1], [-1, 2], [-1, 3]]
+      expected = Numo::DFloat[0.5, 0.8351, 0.8351, 0.8351]
+      %i[more_thuente hager_zhang armijo nonmonotone].each do |line_search|
+        [nil, bounds].each do |bnds|
+          n_fnc = n_jcb = 0
+          res = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: Numo::DFloat.zeros(4), bounds: bnds,
+                                        line_search: line_search)
+
+          assert_operator((res[:x] - (bnds.nil? ? Numo::DFloat.ones(4) * 0.8351 : expected)).abs.max, :<, 1e-3)
+          assert_equal(n_fnc, res[:n_fev])
+          assert_equal(n_jcb, res[:n_jev])
+          if %i[armijo nonmonotone].include?(line_search)
+            assert_operator(res[:n_jev], :<=, res[:n_fev])
+          else
+            assert_equal(res[:n_fev], res[:n_jev])
+          end
+        end
+      end
+      # The objective of jcb: true returns f with every g, so each call counts as an evaluation of f.
+      n_calls = 0
+      fg = proc do |x|
+        n_calls += 1
+        [fnc.call(x), jcb.call(x)]
+      end
+      %i[armijo nonmonotone].each do |line_search|
+        n_calls = 0
+        res = Numo::Optimize.minimize(fnc: fg, jcb: true, x_init: Numo::DFloat.zeros(4), line_search: line_search)
+        assert_equal(n_calls, res[:n_fev])
+        assert_equal(n_calls, res[:n_jev])
+      end
+      assert_raises(ArgumentError) do
+        Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: Numo::DFloat.zeros(4), line_search: :wolfe)
+      end
+    end
+
+    def test_minimize_lbfgsb_speculative_line_search
+      n_calls = n_rows = n_batches = 0
+      fnc = proc do |x|
+        n_calls += 1
+        [((x - 2)**2).sum + (x**4).sum, (2 * (x - 2)) + (4 * (x**3))]
+      end
+      batch_fnc = proc do |xs|
+        n_batches += 1
+        n_rows += xs.shape[0]
+        [((xs - 2)**2).sum(axis: 1) + (xs**4).sum(axis: 1), (2 * (xs - 2)) + (4 * (xs**3))]
+      end
+      bounds = Numo::DFloat[[-1, 0.5], [-1, 1], [-1, 2], [-1, 3]]
+      expected = Numo::DFloat[0.5, 0.8351, 0.8351, 0.8351]
+      [nil, bounds].each do |bnds|
+        n_calls = n_rows = n_batches = 0
+        res = Numo::Optimize.minimize(fnc: fnc, jcb: true, x_init: Numo::DFloat.zeros(4), bounds: bnds,
+                                      line_search: :speculative, batch_fnc: batch_fnc)
+
+        assert_operator((res[:x] - (bnds.nil? ? Numo::DFloat.ones(4) * 0.8351 : expected)).abs.max, :<, 1e-3)
+        assert_operator(n_batches, :>, 0)
+        assert_equal(n_calls + n_rows, res[:n_fev])
+        speculative_trips = n_calls + n_batches
+
+        serial = Numo::Optimize.minimize(fnc: fnc, jcb: true, x_init: Numo::DFloat.zeros(4), bounds: bnds,
+                                         line_search: :speculative)
+        assert_operator((res[:x] - serial[:x]).abs.max, :<, 1e-6)
+
+        # An accepted candidate saves the trials of More-Thuente, so an iteration takes fewer round trips.
+        n_calls = 0
+        more_thuente = Numo::Optimize.minimize(fnc: fnc, jcb: true, x_init: Numo::DFloat.zeros(4), bounds: bnds)
+        assert_operator(speculative_trips.fdiv(res[:n_iter]), :<, n_calls.fdiv(more_thuente[:n_iter]))
+      end
+
+      # Each candidate costs n + 1 evaluations with the forward differences, so only those fitting in max_fev run.
+      f = proc { |x| ((x - 2)**2).sum + (x**4).sum }
+      res = Numo::Optimize.minimize(fnc: f, jcb: :forward_diff, x_init: Numo::DFloat.zeros(4),
+                                    line_search: :speculative, max_fev: 12)
+
+      assert_equal('STOP: MAX_FEV', res[:task])
+      assert_operator(res[:n_fev], :<=, 12)
+
+      native = Numo::Optimize::NativeObjective.fixture(:rosenbrock)
+      res = Numo::Optimize.minimize(fnc: native, jcb: nil, x_init: Numo::DFloat.zeros(10), line_search: :speculative)
+      assert(res[:success])
+      assert_operator((res[:x] - 1).abs.max, :<, 1e-3)
+    end
+
+    def test_minimize_finite_differences
+      n_calls = 0
+      outside = false
+      bounds = Numo::DFloat[[-1, 0.5], [-1, 1], [-1, 2], [-1, 3]]
+      fnc = proc do |x|
+        n_calls += 1
+        outside ||= (x - bounds[true, 0]).lt(0).any? || (x - bounds[true, 1]).gt(0).any?
+        ((x - 2)**2).sum + (x**4).sum
+      end
+      expected = Numo::DFloat[0.5, 0.8351, 0.8351, 0.8351]
+      %i[forward_diff central_diff].each do |jcb|
+        [nil, bounds].each do |bnds|
+          n_calls = 0
+          outside = false
+          res = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: Numo::DFloat[0.5, 0, 0, 0], bounds: bnds)
+
+          assert_operator((res[:x] - (bnds.nil? ? Numo::DFloat.ones(4) * 0.8351 : expected)).abs.max, :<, 1e-3)
+          assert_operator((res[:jcb] - ((2 * (res[:x] - 2)) + (4 * (res[:x]**3))))[1..].abs.max, :<, 1e-3)
+          assert_equal(n_calls, res[:n_fev])
+          refute(outside) unless bnds.nil?
+        end
+
+        n_calls = 0
+        batch_fnc = proc do |xs|
+          n_calls += 1
+          ((xs - 2)**2).sum(axis: 1) + (xs**4).sum(axis: 1)
+        end
+        res = Numo::Optimize.minimize(fnc: batch_fnc, jcb: jcb, x_init: Numo::DFloat.zeros(4), diff_batch: true)
+        assert_operator((res[:x] - 0.8351).abs.max, :<, 1e-3)
+        assert_operator(n_calls, :<, res[:n_fev])
+
+        res = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: Numo::DFloat.zeros(4), method: 'SCG')
+        assert_operator((res[:x] - 0.8351).abs.max, :<, 1e-3)
+      end
+
+      native = Numo::Optimize::NativeObjective.fixture(:rosenbrock)
+      res = Numo::Optimize.minimize(fnc: native, jcb: :central_diff, x_init: Numo::DFloat.zeros(10), threads: 2)
+      assert_operator((res[:x] - 1).abs.max, :<, 1e-2)
+
+      # The threads are capped at the two perturbed points of the forward differences in two dimensions.
+      capped = Numo::Optimize.minimize(fnc: native, jcb: :forward_diff, x_init: Numo::DFloat.zeros(2), threads: 64)
+      two = Numo::Optimize.minimize(fnc: native, jcb: :forward_diff, x_init: Numo::DFloat.zeros(2), threads: 2)
+
+      assert_equal(two[:x].to_a, capped[:x].to_a)
+      assert_equal(two[:stats][:native_bytes], capped[:stats][:native_bytes])
+      assert_raises(ArgumentError) do
+        Numo::Optimize.minimize(fnc: fnc, jcb: :backward_diff, x_init: Numo::DFloat.zeros(4))
+      end
+    end
+
+    def test_minimize_cache
+      n_calls = 0
+      fnc = proc do |x|
+        n_calls += 1
+        [((x - 2)**2).sum + (x**4).sum, (2 * (x - 2)) + (4 * (x**3))]
+      end
+      x_init = Numo::DFloat[0.5, -1, 1.5, 3]
+      %w[L-BFGS-B SCG Nelder-Mead].each do |method|
+        f = method == 'Nelder-Mead' ? proc { |x| fnc.call(x)[0] } : fnc
+        n_calls = 0
+        plain = Numo::Optimize.minimize(fnc: f, jcb: true, x_init: x_init, method: method)
+        n_plain = n_calls
+        n_calls = 0
+        cached = Numo::Optimize.minimize(fnc: f, jcb: true, x_init: x_init, method: method, cache: 8)
+
+        assert_equal(plain[:x].to_a, cached[:x].to_a)
+        assert_equal(plain[:fnc], cached[:fnc])
+        assert_equal(n_plain - cached[:stats][:cache_hits], n_calls)
+        assert_nil(plain[:stats][:cache_hits])
+      end
+      # SCG takes the gradient at the point of each successful step, which the cache has from the function value.
+      assert_operator(Numo::Optimize.minimize(fnc: fnc, jcb: true, x_init: x_init, method: 'SCG',
+                                              cache: 1)[:stats][:cache_hits], :>, 0)
+      assert_raises(ArgumentError) { Numo::Optimize.minimize(fnc: fnc, jcb: true, x_init: x_init, cache: 0) }
+
+      cache = Numo::Optimize::EvalCache.new(2, 2)
+      cache[Numo::DFloat[1, 2]] = 1.0
+      cache[Numo::DFloat[3, 4]] = 2.0
+
+      assert_in_delta(1.0, cache[Numo::DFloat[1, 2]])
+      cache[Numo::DFloat[0, 6]] = 3.0
+
+      assert_nil(cache[Numo::DFloat[3, 4]])
+      assert_in_delta(1.0, cache[Numo::DFloat[[1, 0], [2, 0]][true, 0]])
+      assert_nil(cache[Numo::DFloat[-0.0, 6]])
+      assert_equal(2, cache.hits)
+    end
+
+    def test_minimize_lbfgsb_log
+      fnc = proc { |x| ((x - 2)**2).sum + (x**4).sum }
+      jcb = proc { |x| (2 * (x - 2)) + (4 * (x**3)) }
+      bounds = Numo::DFloat[[-1, 0.5], [-1, 1], [-1, 2], [-1, 3]]
+      x_init = Numo::DFloat.zeros(4)
+
+      Dir.mktmpdir do |dir|
+        io = StringIO.new
+        res = Dir.chdir(dir) do
+          Numo::Optimize.minimize(fnc: fnc, x_init: x_init, jcb: jcb, bounds: bounds, verbose: 1, log: io)
+        end
+
+        assert(res[:success])
+        assert_includes(io.string, 'RUNNING THE L-BFGS-B CODE')
+        assert_includes(io.string, 'At iterate')
+        assert_includes(io.string, '   it   nf  nseg  nact  sub  itls  stepl    tstep     projg        f')
+        refute_path_exists(File.join(dir, 'iterate.dat'))
+
+        path = File.join(dir, 'solve.log')
+        Numo::Optimize.minimize(fnc: fnc, x_init: x_init, jcb: jcb, bounds: bounds, verbose: 1, log: path)
+
+        assert_equal(io.string.lines.grep(/At iterate/), File.read(path).lines.grep(/At iterate/))
+      end
+
+      io = StringIO.new
+      res = Numo::Optimize.minimize(fnc: fnc, x_init: x_init, jcb: jcb, bounds: bounds, verbose: 0,
+                                    log: { to: io, format: :json })
+      events = io.string.lines.map { |line| JSON.parse(line) }
+      iterations = events.select { |event| event['event'] == 'iteration' }
+
+      assert_equal((1..res[:n_iter]).to_a, iterations.map { |event| event['n_iter'] })
+      assert_in_delta(res[:fnc], iterations.last['f'], 1e-15)
+      assert(events.any? { |event| event['stream'] == 'console' && event['text'].start_with?('RUNNING') })
+
+      res = Numo::Optimize.minimize(fnc: fnc, x_init: x_init, jcb: jcb, bounds: bounds, verbose: 1, log: false)
+
+      assert(res[:success])
+      assert_raises(ArgumentError) do
+        Numo::Optimize.minimize(fnc: fnc, x_init: x_init, jcb: jcb, log: { to: StringIO.new, format: :xml })
+      end
+    end
+
+    def test_minimize_timeout_and_max_fev
+      evals = []
+      fnc = proc do |x|
+        f = (100 * ((x[1] - (x[0]**2))**2)) + ((1 - x[0])**2)
+        evals << [f, x.dup]
+        f
+      end
+      jcb = proc { |x| Numo::DFloat[(-400 * x[0] * (x[1] - (x[0]**2))) - (2 * (1 - x[0])), 200 * (x[1] - (x[0]**2))] }
+      x_init = Numo::DFloat[-1.2, 1.0]
+
+      %w[L-BFGS-B SCG].each do |method|
+        evals.clear
+        res = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: x_init, method: method, max_fev: 7)
+        best_f, best_x = evals.min_by(&:first)
+
+        assert_equal('STOP: MAX_FEV', res[:task])
+        refute(res[:success])
+        assert_equal(7, res[:n_fev])
+        assert_equal(7, evals.size)
+        assert_in_delta(best_f, res[:fnc], 1e-15)
+        assert_in_delta(0.0, (best_x - res[:x]).abs.max, 1e-15)
+      end
+      # A gradient by the forward differences costs 1 + n calls, so the solves stop before one would exceed max_fev.
+      %w[L-BFGS-B SCG].each do |method|
+        evals.clear
+        res = Numo::Optimize.minimize(fnc: fnc, jcb: :forward_diff, x_init: x_init, method: method, max_fev: 8)
+
+        assert_equal('STOP: MAX_FEV', res[:task])
+        assert_operator(res[:n_fev], :<=, 8)
+        assert_equal(res[:n_fev], evals.size)
+      end
+      res = Numo::Optimize.minimize(fnc: fnc, jcb: nil, x_init: x_init, method: 'Nelder-Mead', max_fev: 10)
+
+      assert_equal('STOP: MAX_FEV', res[:task])
+      assert_operator(res[:n_fev], :>=, 10)
+
+      slow_fnc = proc do |x|
+        sleep(0.01)
+        fnc.call(x)
+      end
+      %w[L-BFGS-B SCG Nelder-Mead].each do |method|
+        res = Numo::Optimize.minimize(fnc: slow_fnc, jcb: jcb, x_init: x_init, method: method, timeout: 0.05)
+
+        assert_equal('STOP: TIMEOUT', res[:task])
+        assert_operator(res[:n_fev], :<, 20)
+      end
+
+      rosen = Numo::Optimize::NativeObjective.fixture(:rosenbrock)
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      assert_raises(Timeout::Error) do
+        Timeout.timeout(0.1) do
+          Numo::Optimize.minimize_batch(fnc: rosen, x_init: Numo::DFloat.ones(1000, 10) * 2, method: 'Nelder-Mead',
+                                        xtol: -1, ftol: -1, maxiter: 10**9)
+        end
+      end
+      assert_operator(Process.clock_gettime(Process::CLOCK_MONOTONIC) - started, :<, 1)
+    end
+
+    def test_minimize_callback
+      fnc = proc { |x| (100 * ((x[1] - (x[0]**2))**2)) + ((1 - x[0])**2) }
+      jcb = proc { |x| Numo::DFloat[(-400 * x[0] * (x[1] - (x[0]**2))) - (2 * (1 - x[0])), 200 * (x[1] - (x[0]**2))] }
+      x_init = Numo::DFloat[-1.2, 1.0]
+
+      full = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: x_init)
+      calls = []
+      callback = proc do |_x, _f, _pg_norm, n_iter|
+        calls << n_iter
+        nil
+      end
+      res = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: x_init, callback: callback)
+
+      assert_equal(full[:n_iter], res[:n_iter])
+      assert_equal((1..full[:n_iter]).to_a, calls)
+
+      %w[L-BFGS-B SCG Nelder-Mead].each do |method|
+        calls = []
+        res = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: x_init, method: method, every: 2,
+                                      callback: proc { |x, f, pg_norm, n_iter|
+                                        calls << [x, f, pg_norm, n_iter]
+                                        calls.size == 3 ? :stop : nil
+                                      })
+        x, f, pg_norm, n_iter = calls.last
+
+        assert_equal('STOP: CALLBACK', res[:task])
+        refute(res[:success])
+        assert_equal(3, calls.size)
+        assert_in_delta(res[:fnc], f, 1e-15)
+        assert_in_delta(0.0, (res[:x] - x).abs.max, 1e-15)
+        if method == 'Nelder-Mead'
+          assert_nil(pg_norm)
+        else
+          assert_same(res[:x], x)
+          assert_in_delta(res[:jcb].abs.max, pg_norm, 1e-12)
+        end
+        assert_equal(6, n_iter) unless method == 'SCG'
+      end
+
+      assert_raises(ArgumentError) do
+        Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: x_init, callback: callback, every: 0)
+      end
+    end
+
+    def test_minimize_batch
+      n_starts = 8
+      n = 3
+      fnc = proc { |x| ((((x**2) - 1)**2) + (0.1 * x)).sum(axis: -1) }
+      jcb = proc { |x| (4 * x * ((x**2) - 1)) + 0.1 }
+      x_init = (Numo::DFloat.new(n_starts, n).seq - 10) / 5
+      n_rows = []
+      batch_fnc = proc do |x|
+        n_rows << x.shape[0]
+        fnc.call(x)
+      end
+      res = Numo::Optimize.minimize_batch(fnc: batch_fnc, x_init: x_init, jcb: jcb)
+
+      assert_equal([n_starts, n], res[:x].shape)
+      assert_equal([n_starts, n], res[:jcb].shape)
+      assert_equal([n_starts], res[:fnc].shape)
+      assert_equal(n_rows.size, res[:n_calls])
+      assert_equal(res[:n_fev].max, res[:n_calls])
+      assert_equal(n_starts, n_rows.first)
+      assert_equal(n_rows, n_rows.sort.reverse)
+      single_fnc = proc { |x| fnc.call(x.expand_dims(0))[0] }
+      n_starts.times do |i|
+        single = Numo::Optimize.minimize(fnc: single_fnc, x_init: x_init[i, true], jcb: jcb)
+
+        assert(res[:success][i])
+        assert_equal(single[:n_iter], res[:n_iter][i])
+        assert_in_delta(0.0, (single[:x] - res[:x][i, true]).abs.max, 1e-8)
+      end
+      assert_raises(ArgumentError) { Numo::Optimize.minimize_batch(fnc: fnc, x_init: x_init, jcb: jcb, method: 'SCG') }
+      error = assert_raises(ArgumentError) { Numo::Optimize.minimize_batch(fnc: fnc, x_init: x_init) }
+
+      assert_match(/jcb must be given/, error.message)
+    end
+
+    def test_minimize_batch_nelder_mead
+      x_init = Numo::DFloat[[-1.2, 1.0], [0.5, -0.5], [2.0, 2.0], [0.0, 0.0]]
+      fnc = proc { |x| ((100 * ((x[true, 1] - (x[true, 0]**2))**2)) + ((1 - x[true, 0])**2)) }
+      res = Numo::Optimize.minimize_batch(fnc: fnc, x_init: x_init, method: 'Nelder-Mead')
+
+      assert_equal([4, 2], res[:x].shape)
+      assert_operator(res[:n_calls], :>=, res[:n_fev].max)
+      single_fnc = proc { |x| fnc.call(x.expand_dims(0))[0] }
+      4.times do |i|
+        single = Numo::Optimize.minimize(method: 'Nelder-Mead', fnc: single_fnc, jcb: nil, x_init: x_init[i, true])
+
+        assert_equal(single[:n_iter], res[:n_iter][i])
+        assert_equal(single[:n_fev], res[:n_fev][i])
+        assert_in_delta(0.0, (single[:x] - res[:x][i, true]).abs.max, 1e-12)
+      end
+
+      error = assert_raises(ArgumentError) do
+        Numo::Optimize.minimize_batch(fnc: fnc, x_init: x_init, method: 'Nelder-Mead',
+                                      bounds: Numo::DFloat[[-2, 2], [-2, 2]])
+      end
+
+      assert_match(/bounds are not supported/, error.message)
+
+      native = Numo::Optimize::NativeObjective.fixture(:rosenbrock)
+      res_native = Numo::Optimize.minimize_batch(fnc: native, x_init: x_init, method: 'Nelder-Mead')
+
+      assert_in_delta(0.0, (res_native[:x] - res[:x]).abs.max, 1e-12)
+      assert_equal(res[:n_fev], res_native[:n_fev])
+    end
+
+    def test_minimize_many
+      rosen = Numo::Optimize::NativeObjective.fixture(:rosenbrock)
+      fnc = proc { |x| (100 * ((x[1] - (x[0]**2))**2)) + ((1 - x[0])**2) }
+      jcb = proc do |x|
+        a = x[1] - (x[0]**2)
+        Numo::DFloat[(-400 * x[0] * a) - (2 * (1 - x[0])), 200 * a]
+      end
+      x_inits = Array.new(12) { |i| Numo::DFloat[-1.2, 1.0] * (1 + (0.1 * i)) }
+      methods = %w[L-BFGS-B SCG Nelder-Mead]
+      problems = x_inits.each_with_index.map { |x, i| { fnc: rosen, x_init: x, method: methods[i % 3] } }
+      problems << { fnc: rosen, x_init: Numo::DFloat[3, 3], bounds: Numo::DFloat[[-2, 0.5], [-2, 2]] }
+      results = Numo::Optimize.minimize_many(problems, threads: 3)
+
+      assert_equal(problems.size, results.size)
+      problems.each_with_index do |problem, i|
+        single = Numo::Optimize.minimize(fnc: fnc, jcb: jcb, x_init: problem[:x_init],
+                                         method: problem[:method] || 'L-BFGS-B', bounds: problem[:bounds])
+
+        assert_equal(single.keys - %i[state workspace_bytes peak_native_bytes_estimate], results[i].keys)
+        assert_equal(single[:n_iter], results[i][:n_iter])
+        assert_equal(single[:n_fev], results[i][:n_fev])
+        assert_in_delta(single[:fnc], results[i][:fnc], 1e-12)
+        assert_in_delta(0.0, (single[:x] - results[i][:x]).abs.max, 1e-12)
+      end
+      assert_equal(Numo::DFloat[-1.2, 1.0], x_inits[0])
+      assert_raises(ArgumentError) { Numo::Optimize.minimize_many([{ fnc: fnc, x_init: x_inits[0] }]) }
+    end
+
+    def test_forked_objective
+      skip 'fork is not available' unless Process.respond_to?(:fork)
+
+      x = Numo::NMath.sin(Numo::DFloat.new(90, 3).seq)
+      y = x.dot(Numo::DFloat[1, -2, 3]) + 0.5
+      fg_shard = lambda do |rows|
+        a = x[rows, true]
+        b = y[rows]
+        proc do |w|
+          r = a.dot(w) - b
+          [0.5 * r.dot(r), a.transpose.dot(r)]
+        end
+      end
+      fg = Numo::Optimize::ForkedObjective.new(3, workers: 3) do |worker, n_workers|
+        fg_shard.call((worker...90).step(n_workers).to_a)
+      end
+      begin
+        f, g = fg.call(Numo::DFloat[0.1, 0.2, 0.3])
+        f_all, g_all = fg_shard.call(true).call(Numo::DFloat[0.1, 0.2, 0.3])
+
+        assert_in_delta(f_all, f, 1e-8)
+        assert_in_delta(0.0, (g_all - g).abs.max, 1e-8)
+
+        res = Numo::Optimize.minimize(fnc: fg, jcb: true, x_init: Numo::DFloat.zeros(3))
+        single = Numo::Optimize.minimize(fnc: fg_shard.call(true), jcb: true, x_init: Numo::DFloat.zeros(3))
+
+        assert(res[:success])
+        assert_in_delta(0.0, (single[:x] - res[:x]).abs.max, 1e-6)
+      ensure
+        fg.close
+      end
+
+      assert_predicate(fg, :closed?)
+      assert_raises(IOError) { fg.call(Numo::DFloat.zeros(3)) }
+
+      fg = Numo::Optimize::ForkedObjective.new(3, workers: 2) do |worker, _n_workers|
+        proc { |w| [w.sum, worker.zero? ? w : w[0...2]] }
+      end
+      begin
+        error = assert_raises(RuntimeError) { fg.call(Numo::DFloat[1, 2, 3]) }
+        assert_match(/worker 1: ArgumentError: gradient must have 3 elements, but has 2/, error.message)
+      ensure
+        fg.close
+      end
+    end
+
+    def test_minimize_multi_dimensional_x
+      target = Numo::DFloat[[1, 2, 3], [4, 5, 6]]
+      x = Numo::DFloat.zeros(2, 3)
+      shapes = []
+      fnc = proc do |x|
+        shapes << x.shape
+        ((x - target)**2).sum
+      end
+      jcb = proc { |x| 2 * (x - target) }
+      %w[L-BFGS-B SCG Nelder-Mead].each do |method|
+        shapes.clear
+        result = Numo::Optimize.minimize(method: method, fnc: fnc, x_init: x, jcb: jcb, maxiter: 2000)
+
+        assert_equal([2, 3], result[:x].shape)
+        assert_equal([2, 3], result[:jcb].shape) unless method == 'Nelder-Mead'
+        assert_equal([[2, 3]], shapes.uniq)
+        assert_operator((result[:x] - target).abs.max, :<, 1e-3)
+      end
+    end
+
     def test_minimize_scg
       x = Numo::DFloat.zeros(2)
       args = [2, 3, 7, 8, 9, 10]
@@ -217,6 +907,34 @@ module Numo
       assert_equal(18, result[:n_jev])
     end
 
+    def test_minimize_scg_releases_buffers_on_exception
+      skip 'the resident memory is read from /proc' unless File.exist?('/proc/self/statm')
+
+      # Each solve holds about 20 n doubles of native buffers, which would pile up if they leaked at the exception.
+      n = 200_000
+      x_init = Numo::DFloat.zeros(n)
+      solve = lambda do
+        n_calls = 0
+        failing = proc do |x|
+          n_calls += 1
+          raise ArgumentError, 'failed' if n_calls > 5
+
+          ((x - 1)**2).sum
+        end
+        assert_raises(ArgumentError) do
+          Numo::Optimize.minimize(method: 'SCG', fnc: failing, x_init: x_init, jcb: :central_diff, cache: 4)
+        end
+      end
+      rss = -> { File.read('/proc/self/statm').split[1].to_i * Etc.sysconf(Etc::SC_PAGESIZE) }
+      solve.call
+      GC.start
+      before = rss.call
+      20.times { solve.call }
+      GC.start
+
+      assert_operator(rss.call - before, :<, 5 * 20 * n * 8)
+    end
+
     def test_minimize_nelder_mead
       x = Numo::DFloat.zeros(2)
       args = [2, 3, 7, 8, 9, 10]
@@ -233,5 +951,19 @@ module Numo
       assert_equal(78, result[:n_iter])
       assert_equal(154, result[:n_fev])
     end
+
+    private
+
+    # Assert that the iterations of the steady state allocate no Ruby object, by comparing the allocations of
+    # a short and a long solve of the native objective; the setup and the result are the same for both.
+    def assert_steady_state_allocation_free(**kwargs)
+      rosen = Numo::Optimize::NativeObjective.fixture(:rosenbrock)
+      short, long = [5, 25].map do |maxiter|
+        Numo::Optimize.minimize(fnc: rosen, jcb: true, x_init: Numo::DFloat.zeros(20), maxiter: maxiter, **kwargs)
+      end
+
+      assert_operator(long[:n_iter], :>, short[:n_iter])
+      assert_equal(short[:stats][:allocations], long[:stats][:allocations])
+    end
   end
 end